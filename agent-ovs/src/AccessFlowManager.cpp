@@ -39,10 +39,22 @@ using boost::copy_range;
 using boost::optional;
 
 static const char* ID_NAMESPACES[] =
-    {"secGroup", "secGroupSet"};
+    {"secGroup", "secGroupSet", "secGroupConjunction", "secGroupBit"};
 
-static const char* ID_NMSPC_SECGROUP     = ID_NAMESPACES[0];
-static const char* ID_NMSPC_SECGROUP_SET = ID_NAMESPACES[1];
+static const char* ID_NMSPC_SECGROUP      = ID_NAMESPACES[0];
+static const char* ID_NMSPC_SECGROUP_SET  = ID_NAMESPACES[1];
+static const char* ID_NMSPC_SECGROUP_CONJ = ID_NAMESPACES[2];
+static const char* ID_NMSPC_SECGROUP_BIT  = ID_NAMESPACES[3];
+
+/* With security group bits, bit n - 1 of registers 8 to 15 is set for
+   the packets of endpoints in the group with ID n */
+static const uint32_t SECGRP_BIT_REG = 8;
+static const uint32_t SECGRP_BIT_REGS = 8;
+
+/* Task queue lanes, so that endpoints are rendered ahead of a backlog
+   of security group changes */
+static const string ENDPOINT_LANE("endpoint");
+static const string POLICY_LANE("policy");
 
 AccessFlowManager::AccessFlowManager(Agent& agent_,
                                      SwitchManager& switchManager_,
@@ -50,9 +62,13 @@ AccessFlowManager::AccessFlowManager(Agent& agent_,
                                      CtZoneManager& ctZoneManager_)
     : agent(agent_), switchManager(switchManager_), idGen(idGen_),
       ctZoneManager(ctZoneManager_), taskQueue(agent.getAgentIOService()),
-      conntrackEnabled(false), stopping(false) {
+      conntrackEnabled(false), classifierConjEnabled(false),
+      secGrpBitsEnabled(false), workerThreads(1), stopping(false) {
     // set up flow tables
     switchManager.setMaxFlowTables(NUM_FLOW_TABLES);
+
+    taskQueue.addLane(ENDPOINT_LANE, 4);
+    taskQueue.addLane(POLICY_LANE, 2);
 }
 
 static string getSecGrpSetId(const uri_set_t& secGrps) {
@@ -70,16 +86,36 @@ void AccessFlowManager::enableConnTrack() {
     conntrackEnabled = true;
 }
 
+void AccessFlowManager::enableClassifierConjunctions() {
+    classifierConjEnabled = true;
+}
+
+void AccessFlowManager::enableSecGroupBits() {
+    secGrpBitsEnabled = true;
+}
+
+void AccessFlowManager::setWorkerThreads(size_t numThreads) {
+    workerThreads = numThreads;
+}
+
 void AccessFlowManager::start() {
     switchManager.getPortMapper().registerPortStatusListener(this);
     agent.getEndpointManager().registerListener(this);
     agent.getPolicyManager().registerListener(this);
 
     for (size_t i = 0; i < sizeof(ID_NAMESPACES)/sizeof(char*); i++) {
-        idGen.initNamespace(ID_NAMESPACES[i]);
+        if (ID_NAMESPACES[i] == ID_NMSPC_SECGROUP_BIT)
+            idGen.initNamespace(ID_NAMESPACES[i], 1, SECGRP_BIT_REGS * 32);
+        else
+            idGen.initNamespace(ID_NAMESPACES[i]);
     }
 
     createStaticFlows();
+
+    // The handlers only share state through the managers and the ID
+    // generator, which are safe to use from several threads
+    if (workerThreads > 1)
+        taskQueue.startWorkers(workerThreads);
 }
 
 void AccessFlowManager::stop() {
@@ -87,21 +123,31 @@ void AccessFlowManager::stop() {
     switchManager.getPortMapper().unregisterPortStatusListener(this);
     agent.getEndpointManager().unregisterListener(this);
     agent.getPolicyManager().unregisterListener(this);
+    taskQueue.stopWorkers();
 }
 
 void AccessFlowManager::endpointUpdated(const string& uuid) {
     if (stopping) return;
     taskQueue.dispatch(uuid,
                        std::bind(&AccessFlowManager::handleEndpointUpdate,
-                                 this, uuid));
+                                 this, uuid),
+                       ENDPOINT_LANE);
 }
 
 void AccessFlowManager::secGroupSetUpdated(const uri_set_t& secGrps) {
     if (stopping) return;
+    if (secGrpBitsEnabled) {
+        // The rules are written for each group rather than each set,
+        // and a group's flows depend only on whether it is in use
+        for (const URI& secGrp : secGrps)
+            secGroupUpdated(secGrp);
+        return;
+    }
     const string id = getSecGrpSetId(secGrps);
     taskQueue.dispatch("set:" + id,
                        std::bind(&AccessFlowManager::handleSecGrpSetUpdate,
-                                 this, secGrps, id));
+                                 this, secGrps, id),
+                       POLICY_LANE);
 }
 
 void AccessFlowManager::configUpdated(const opflex::modb::URI& configURI) {
@@ -113,7 +159,8 @@ void AccessFlowManager::secGroupUpdated(const opflex::modb::URI& uri) {
     if (stopping) return;
     taskQueue.dispatch("secgrp:" + uri.toString(),
                        std::bind(&AccessFlowManager::handleSecGrpUpdate,
-                                   this, uri));
+                                   this, uri),
+                       POLICY_LANE);
 }
 
 void AccessFlowManager::portStatusUpdate(const string& portName,
@@ -150,6 +197,19 @@ static void flowBypassDhcpRequest(FlowEntryList& el, bool v4, uint32_t inport,
     fb.build(el);
 }
 
+/* Load the security group set ID of an endpoint, or the bits of its
+   security groups */
+static void loadSecGrps(ActionBuilder& ab, uint32_t secGrpSetId,
+                        const uint32_t* secGrpBits) {
+    if (secGrpSetId)
+        ab.reg(MFF_REG0, secGrpSetId);
+    for (uint32_t i = 0; i < SECGRP_BIT_REGS; ++i) {
+        if (secGrpBits[i])
+            ab.reg(static_cast<mf_field_id>(MFF_REG0 + SECGRP_BIT_REG + i),
+                   secGrpBits[i]);
+    }
+}
+
 void AccessFlowManager::createStaticFlows() {
     LOG(DEBUG) << "Writing static flows";
     switchManager.writeFlow("static", OUT_TABLE_ID,
@@ -184,8 +244,26 @@ void AccessFlowManager::handleEndpointUpdate(const string& uuid) {
         uplinkPort = switchManager.getPortMapper().FindPort(uplinkIface.get());
     }
 
-    uint32_t secGrpSetId = idGen.getId(ID_NMSPC_SECGROUP_SET,
-                                       getSecGrpSetId(ep->getSecurityGroups()));
+    // With security group bits, endpoints with no security group still
+    // use the empty set, whose flows allow everything
+    const uri_set_t& secGrps = ep->getSecurityGroups();
+    uint32_t secGrpSetId = 0;
+    uint32_t secGrpBits[SECGRP_BIT_REGS] = {};
+    if (secGrpBitsEnabled && !secGrps.empty()) {
+        for (const URI& secGrp : secGrps) {
+            uint32_t bitId = idGen.getId(ID_NMSPC_SECGROUP_BIT,
+                                         secGrp.toString());
+            if (bitId == static_cast<uint32_t>(-1)) {
+                LOG(ERROR) << "Could not allocate a register bit for "
+                           << "security group " << secGrp;
+                continue;
+            }
+            secGrpBits[(bitId - 1) / 32] |= 1u << ((bitId - 1) % 32);
+        }
+    } else {
+        secGrpSetId = idGen.getId(ID_NMSPC_SECGROUP_SET,
+                                  getSecGrpSetId(secGrps));
+    }
     uint16_t zoneId = -1;
     if (conntrackEnabled) {
         zoneId = ctZoneManager.getId(uuid);
@@ -207,8 +285,8 @@ void AccessFlowManager::handleEndpointUpdate(const string& uuid) {
                 in.action()
                     .reg(MFF_REG6, zoneId);
 
+            loadSecGrps(in.action(), secGrpSetId, secGrpBits);
             in.action()
-                .reg(MFF_REG0, secGrpSetId)
                 .reg(MFF_REG7, uplinkPort)
                 .go(SEC_GROUP_OUT_TABLE_ID);
             in.build(el);
@@ -233,9 +311,9 @@ void AccessFlowManager::handleEndpointUpdate(const string& uuid) {
                 out.action()
                     .reg(MFF_REG6, zoneId);
 
-            out.priority(100).inPort(uplinkPort)
-                .action()
-                .reg(MFF_REG0, secGrpSetId)
+            out.priority(100).inPort(uplinkPort);
+            loadSecGrps(out.action(), secGrpSetId, secGrpBits);
+            out.action()
                 .reg(MFF_REG7, accessPort);
             if (ep->getAccessIfaceVlan()) {
                 out.action()
@@ -259,14 +337,47 @@ void AccessFlowManager::handlePortStatusUpdate(const string& portName,
 }
 
 void AccessFlowManager::handleSecGrpUpdate(const opflex::modb::URI& uri) {
+    if (secGrpBitsEnabled) {
+        handleSecGrpRulesUpdate(uri);
+        return;
+    }
     unordered_set<uri_set_t> secGrpSets;
     agent.getEndpointManager().getSecGrpSetsForSecGrp(uri, secGrpSets);
     for (const uri_set_t& secGrpSet : secGrpSets)
         secGroupSetUpdated(secGrpSet);
 }
 
-void AccessFlowManager::handleSecGrpSetUpdate(const uri_set_t& secGrps,
-                                              const string& secGrpsIdStr) {
+/* Conjunction IDs are allocated for each rule's classifier in each
+   direction of each security group in a set, or of each security
+   group when the set is empty with security group bits */
+static flowutils::conj_id_alloc_t
+getConjIdAlloc(IdGenerator& idGen, const string& secGrpsIdStr,
+               const URI& secGrp, const URI& ruleURI, bool in) {
+    string key = secGrpsIdStr + " " + secGrp.toString() + " " +
+        ruleURI.toString() + (in ? " in" : " out");
+    return [&idGen, key]() {
+        return idGen.getId(ID_NMSPC_SECGROUP_CONJ, key);
+    };
+}
+
+static void logClassifierFlows(const string& secGrpsIdStr,
+                               const URI& secGrp, const URI& ruleURI,
+                               bool in, flowutils::ClassEncoding enc,
+                               size_t flows) {
+    LOG(DEBUG) << "Classifier " << ruleURI << (in ? " in" : " out")
+               << " for security group " << secGrp
+               << (secGrpsIdStr.empty() ? "" : " in set \"")
+               << secGrpsIdStr
+               << (secGrpsIdStr.empty() ? "" : "\"") << ": "
+               << flows << " flows"
+               << (enc == flowutils::CE_CONJUNCTION ? " (conjunction)" : "");
+}
+
+void AccessFlowManager::addSecGrpRules(const URI& secGrp,
+                                       const string& secGrpsIdStr,
+                                       uint32_t secGrpSetId,
+                                       FlowEntryList& secGrpIn,
+                                       FlowEntryList& secGrpOut) {
     using modelgbp::gbpe::L24Classifier;
     using modelgbp::gbp::DirectionEnumT;
     using modelgbp::gbp::ConnTrackEnumT;
@@ -275,45 +386,37 @@ void AccessFlowManager::handleSecGrpSetUpdate(const uri_set_t& secGrps,
     using flowutils::CA_REFLEX_FWD;
     using flowutils::CA_ALLOW;
 
-    LOG(DEBUG) << "Updating security group set \"" << secGrpsIdStr << "\"";
-
-    if (agent.getEndpointManager().secGrpSetEmpty(secGrps)) {
-        switchManager.clearFlows(secGrpsIdStr, SEC_GROUP_IN_TABLE_ID);
-        switchManager.clearFlows(secGrpsIdStr, SEC_GROUP_OUT_TABLE_ID);
-        return;
-    }
-
-    uint32_t secGrpSetId = idGen.getId(ID_NMSPC_SECGROUP_SET, secGrpsIdStr);
-
-    FlowEntryList secGrpIn;
-    FlowEntryList secGrpOut;
-
-    for (const opflex::modb::URI& secGrp : secGrps) {
-        PolicyManager::rule_list_t rules;
-        agent.getPolicyManager().getSecGroupRules(secGrp, rules);
-
-        for (shared_ptr<PolicyRule>& pc : rules) {
-            uint8_t dir = pc->getDirection();
-            const shared_ptr<L24Classifier>& cls = pc->getL24Classifier();
-            const URI& ruleURI = cls.get()->getURI();
-            uint64_t secGrpCookie =
-                idGen.getId("l24classifierRule", ruleURI.toString());
-            boost::optional<const network::subnets_t&> remoteSubs;
-            if (!pc->getRemoteSubnets().empty())
-                remoteSubs = pc->getRemoteSubnets();
-
-            flowutils::ClassAction act = flowutils::CA_DENY;
-            if (pc->getAllow()) {
-                if (cls->getConnectionTracking(ConnTrackEnumT::CONST_NORMAL) ==
-                    ConnTrackEnumT::CONST_REFLEXIVE) {
-                    act = CA_REFLEX_FWD;
-                } else {
-                    act = CA_ALLOW;
-                }
+    PolicyManager::rule_list_t rules;
+    agent.getPolicyManager().getSecGroupRules(secGrp, rules);
+
+    for (shared_ptr<PolicyRule>& pc : rules) {
+        uint8_t dir = pc->getDirection();
+        const shared_ptr<L24Classifier>& cls = pc->getL24Classifier();
+        const URI& ruleURI = cls.get()->getURI();
+        uint64_t secGrpCookie =
+            idGen.getId("l24classifierRule", ruleURI.toString());
+        boost::optional<const network::subnets_t&> remoteSubs;
+        if (!pc->getRemoteSubnets().empty())
+            remoteSubs = pc->getRemoteSubnets();
+
+        flowutils::ClassAction act = flowutils::CA_DENY;
+        if (pc->getAllow()) {
+            if (cls->getConnectionTracking(ConnTrackEnumT::CONST_NORMAL) ==
+                ConnTrackEnumT::CONST_REFLEXIVE) {
+                act = CA_REFLEX_FWD;
+            } else {
+                act = CA_ALLOW;
             }
+        }
 
-            if (dir == DirectionEnumT::CONST_BIDIRECTIONAL ||
-                dir == DirectionEnumT::CONST_IN) {
+        if (dir == DirectionEnumT::CONST_BIDIRECTIONAL ||
+            dir == DirectionEnumT::CONST_IN) {
+            flowutils::conj_id_alloc_t conjIdAlloc;
+            if (classifierConjEnabled)
+                conjIdAlloc = getConjIdAlloc(idGen, secGrpsIdStr,
+                                             secGrp, ruleURI, true);
+            size_t numFlows = secGrpIn.size();
+            flowutils::ClassEncoding enc =
                 flowutils::add_classifier_entries(*cls, act,
                                                   remoteSubs,
                                                   boost::none,
@@ -322,31 +425,40 @@ void AccessFlowManager::handleSecGrpSetUpdate(const uri_set_t& secGrps,
                                                   OFPUTIL_FF_SEND_FLOW_REM,
                                                   secGrpCookie,
                                                   secGrpSetId, 0,
+                                                  conjIdAlloc,
                                                   secGrpIn);
-                if (act == CA_REFLEX_FWD) {
-                    // add reverse entries for reflexive classifier
-                    flowutils::add_classifier_entries(*cls, CA_REFLEX_REV,
-                                                      boost::none,
-                                                      remoteSubs,
-                                                      GROUP_MAP_TABLE_ID,
-                                                      pc->getPriority(),
-                                                      OFPUTIL_FF_SEND_FLOW_REM,
-                                                      0,
-                                                      secGrpSetId, 0,
-                                                      secGrpOut);
-                    flowutils::add_classifier_entries(*cls, CA_REFLEX_REV_ALLOW,
-                                                      boost::none,
-                                                      remoteSubs,
-                                                      OUT_TABLE_ID,
-                                                      pc->getPriority(),
-                                                      OFPUTIL_FF_SEND_FLOW_REM,
-                                                      secGrpCookie,
-                                                      secGrpSetId, 0,
-                                                      secGrpOut);
-                }
+            logClassifierFlows(secGrpsIdStr, secGrp, ruleURI, true, enc,
+                               secGrpIn.size() - numFlows);
+            if (act == CA_REFLEX_FWD) {
+                // add reverse entries for reflexive classifier
+                flowutils::add_classifier_entries(*cls, CA_REFLEX_REV,
+                                                  boost::none,
+                                                  remoteSubs,
+                                                  GROUP_MAP_TABLE_ID,
+                                                  pc->getPriority(),
+                                                  OFPUTIL_FF_SEND_FLOW_REM,
+                                                  0,
+                                                  secGrpSetId, 0,
+                                                  secGrpOut);
+                flowutils::add_classifier_entries(*cls, CA_REFLEX_REV_ALLOW,
+                                                  boost::none,
+                                                  remoteSubs,
+                                                  OUT_TABLE_ID,
+                                                  pc->getPriority(),
+                                                  OFPUTIL_FF_SEND_FLOW_REM,
+                                                  secGrpCookie,
+                                                  secGrpSetId, 0,
+                                                  secGrpOut);
             }
-            if (dir == DirectionEnumT::CONST_BIDIRECTIONAL ||
-                dir == DirectionEnumT::CONST_OUT) {
+        }
+        if (dir == DirectionEnumT::CONST_BIDIRECTIONAL ||
+            dir == DirectionEnumT::CONST_OUT) {
+            flowutils::conj_id_alloc_t conjIdAlloc;
+            if (classifierConjEnabled)
+                conjIdAlloc = getConjIdAlloc(idGen, secGrpsIdStr,
+                                             secGrp, ruleURI, false);
+            size_t numFlows = secGrpOut.size();
+            flowutils::ClassEncoding enc =
                 flowutils::add_classifier_entries(*cls, act,
                                                   boost::none,
                                                   remoteSubs,
@@ -355,36 +467,108 @@ void AccessFlowManager::handleSecGrpSetUpdate(const uri_set_t& secGrps,
                                                   OFPUTIL_FF_SEND_FLOW_REM,
                                                   secGrpCookie,
                                                   secGrpSetId, 0,
+                                                  conjIdAlloc,
                                                   secGrpOut);
-                if (act == CA_REFLEX_FWD) {
-                    // add reverse entries for reflexive classifier
-                    flowutils::add_classifier_entries(*cls, CA_REFLEX_REV,
-                                                      remoteSubs,
-                                                      boost::none,
-                                                      GROUP_MAP_TABLE_ID,
-                                                      pc->getPriority(),
-                                                      OFPUTIL_FF_SEND_FLOW_REM,
-                                                      0,
-                                                      secGrpSetId, 0,
-                                                      secGrpIn);
-                    flowutils::add_classifier_entries(*cls, CA_REFLEX_REV_ALLOW,
-                                                      remoteSubs,
-                                                      boost::none,
-                                                      OUT_TABLE_ID,
-                                                      pc->getPriority(),
-                                                      OFPUTIL_FF_SEND_FLOW_REM,
-                                                      secGrpCookie,
-                                                      secGrpSetId, 0,
-                                                      secGrpIn);
-                }
+            logClassifierFlows(secGrpsIdStr, secGrp, ruleURI, false, enc,
+                               secGrpOut.size() - numFlows);
+            if (act == CA_REFLEX_FWD) {
+                // add reverse entries for reflexive classifier
+                flowutils::add_classifier_entries(*cls, CA_REFLEX_REV,
+                                                  remoteSubs,
+                                                  boost::none,
+                                                  GROUP_MAP_TABLE_ID,
+                                                  pc->getPriority(),
+                                                  OFPUTIL_FF_SEND_FLOW_REM,
+                                                  0,
+                                                  secGrpSetId, 0,
+                                                  secGrpIn);
+                flowutils::add_classifier_entries(*cls, CA_REFLEX_REV_ALLOW,
+                                                  remoteSubs,
+                                                  boost::none,
+                                                  OUT_TABLE_ID,
+                                                  pc->getPriority(),
+                                                  OFPUTIL_FF_SEND_FLOW_REM,
+                                                  secGrpCookie,
+                                                  secGrpSetId, 0,
+                                                  secGrpIn);
             }
         }
     }
+}
+
+void AccessFlowManager::handleSecGrpSetUpdate(const uri_set_t& secGrps,
+                                              const string& secGrpsIdStr) {
+    LOG(DEBUG) << "Updating security group set \"" << secGrpsIdStr << "\"";
+
+    if (agent.getEndpointManager().secGrpSetEmpty(secGrps)) {
+        switchManager.clearFlows(secGrpsIdStr, SEC_GROUP_IN_TABLE_ID);
+        switchManager.clearFlows(secGrpsIdStr, SEC_GROUP_OUT_TABLE_ID);
+        return;
+    }
+
+    uint32_t secGrpSetId = idGen.getId(ID_NMSPC_SECGROUP_SET, secGrpsIdStr);
+
+    FlowEntryList secGrpIn;
+    FlowEntryList secGrpOut;
+
+    for (const opflex::modb::URI& secGrp : secGrps)
+        addSecGrpRules(secGrp, secGrpsIdStr, secGrpSetId,
+                       secGrpIn, secGrpOut);
+
+    if (classifierConjEnabled) {
+        // Rules of the set at the same priority can share clauses
+        flowutils::merge_conjunction_entries(secGrpIn);
+        flowutils::merge_conjunction_entries(secGrpOut);
+    }
 
     switchManager.writeFlow(secGrpsIdStr, SEC_GROUP_IN_TABLE_ID, secGrpIn);
     switchManager.writeFlow(secGrpsIdStr, SEC_GROUP_OUT_TABLE_ID, secGrpOut);
 }
 
+/* Restrict the flows of a security group to packets of endpoints with
+   the group's bit set */
+static void matchSecGrpBit(FlowEntryList& el, uint32_t bit) {
+    uint32_t mask = 1u << (bit % 32);
+    for (const FlowEntryPtr& fe : el)
+        match_set_reg_masked(&fe->entry->match,
+                             SECGRP_BIT_REG + bit / 32, mask, mask);
+}
+
+void AccessFlowManager::handleSecGrpRulesUpdate(const URI& secGrp) {
+    const string objId = "secgrp:" + secGrp.toString();
+    LOG(DEBUG) << "Updating security group " << secGrp;
+
+    unordered_set<uri_set_t> secGrpSets;
+    agent.getEndpointManager().getSecGrpSetsForSecGrp(secGrp, secGrpSets);
+    uint32_t bitId = static_cast<uint32_t>(-1);
+    if (!secGrpSets.empty()) {
+        bitId = idGen.getId(ID_NMSPC_SECGROUP_BIT, secGrp.toString());
+        if (bitId == static_cast<uint32_t>(-1))
+            LOG(ERROR) << "Could not allocate a register bit for security "
+                       << "group " << secGrp
+                       << "; its endpoints will match no rules";
+    }
+    if (bitId == static_cast<uint32_t>(-1)) {
+        switchManager.clearFlows(objId, SEC_GROUP_IN_TABLE_ID);
+        switchManager.clearFlows(objId, SEC_GROUP_OUT_TABLE_ID);
+        return;
+    }
+
+    FlowEntryList secGrpIn;
+    FlowEntryList secGrpOut;
+    addSecGrpRules(secGrp, "", 0, secGrpIn, secGrpOut);
+    matchSecGrpBit(secGrpIn, bitId - 1);
+    matchSecGrpBit(secGrpOut, bitId - 1);
+
+    if (classifierConjEnabled) {
+        flowutils::merge_conjunction_entries(secGrpIn);
+        flowutils::merge_conjunction_entries(secGrpOut);
+    }
+
+    switchManager.writeFlow(objId, SEC_GROUP_IN_TABLE_ID, secGrpIn);
+    switchManager.writeFlow(objId, SEC_GROUP_OUT_TABLE_ID, secGrpOut);
+}
+
 static bool secGrpSetIdGarbageCb(EndpointManager& endpointManager,
                                  const string&, const string& str) {
     uri_set_t secGrps;
@@ -402,6 +586,27 @@ static bool secGrpSetIdGarbageCb(EndpointManager& endpointManager,
     return !endpointManager.secGrpSetEmpty(secGrps);
 }
 
+static bool secGrpBitGarbageCb(EndpointManager& endpointManager,
+                               const string&, const string& str) {
+    unordered_set<uri_set_t> secGrpSets;
+    endpointManager.getSecGrpSetsForSecGrp(URI(str), secGrpSets);
+    return !secGrpSets.empty();
+}
+
+static bool secGrpConjIdGarbageCb(EndpointManager& endpointManager,
+                                  const string& nmspc, const string& str) {
+    size_t setEnd = str.find(' ');
+    if (setEnd == 0) {
+        // allocated for the rules of a single group with security
+        // group bits
+        size_t grpEnd = str.find(' ', 1);
+        return secGrpBitGarbageCb(endpointManager, nmspc,
+                                  str.substr(1, grpEnd - 1));
+    }
+    return secGrpSetIdGarbageCb(endpointManager, nmspc,
+                                str.substr(0, setEnd));
+}
+
 void AccessFlowManager::cleanup() {
     using std::placeholders::_1;
     using std::placeholders::_2;
@@ -415,6 +620,16 @@ void AccessFlowManager::cleanup() {
         std::bind(secGrpSetIdGarbageCb,
                   std::ref(agent.getEndpointManager()), _1, _2);
     idGen.collectGarbage(ID_NMSPC_SECGROUP_SET, gcb2);
+
+    IdGenerator::garbage_cb_t gcb3 =
+        std::bind(secGrpConjIdGarbageCb,
+                  std::ref(agent.getEndpointManager()), _1, _2);
+    idGen.collectGarbage(ID_NMSPC_SECGROUP_CONJ, gcb3);
+
+    IdGenerator::garbage_cb_t gcb4 =
+        std::bind(secGrpBitGarbageCb,
+                  std::ref(agent.getEndpointManager()), _1, _2);
+    idGen.collectGarbage(ID_NMSPC_SECGROUP_BIT, gcb4);
 }
 
 } // namespace ovsagent
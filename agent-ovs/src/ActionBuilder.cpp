@@ -7,10 +7,12 @@
  */
 
 #include <algorithm>
+#include <cstring>
 #include <boost/assert.hpp>
 
 #include "ActionBuilder.h"
 #include "FlowBuilder.h"
+#include "FlowEntryArena.h"
 #include "ovs-shim.h"
 #include "ovs-ofputil.h"
 
@@ -22,9 +24,17 @@ using boost::asio::ip::address_v6;
 
 namespace ovsagent {
 
-ActionBuilder::ActionBuilder(FlowBuilder& fb_)
+/* Size of the buffer allocated from an arena for actions, which most
+   flows fit in */
+static const size_t ARENA_ACTIONS_SIZE = 128;
+
+ActionBuilder::ActionBuilder(FlowBuilder& fb_, FlowEntryArena* arena)
     : buf(new ofpbuf), flowHasVlan(false), fb(fb_) {
-    ofpbuf_init(buf, 64);
+    if (arena)
+        ofpbuf_use_stub(buf, arena->allocate(ARENA_ACTIONS_SIZE),
+                        ARENA_ACTIONS_SIZE);
+    else
+        ofpbuf_init(buf, 64);
 }
 
 ActionBuilder::ActionBuilder()
@@ -48,6 +58,20 @@ void ActionBuilder::build(ofputil_flow_stats *dstEntry) {
     dstEntry->ofpacts = getActionsFromBuffer(buf, dstEntry->ofpacts_len);
 }
 
+void ActionBuilder::build(ofputil_flow_stats *dstEntry,
+                          FlowEntryArena& arena) {
+    // Actions still in the stub from the arena are used as they are,
+    // and those that outgrew it are copied back into the arena
+    size_t len = buf->size;
+    void* ofpacts = buf->data;
+    if (buf->source != OFPBUF_STUB && len > 0)
+        ofpacts = memcpy(arena.allocate(len), buf->data, len);
+    dstEntry->ofpacts = (ofpact*)ofpacts;
+    dstEntry->ofpacts_len = len;
+    ofpbuf_uninit(buf);
+    ofpbuf_init(buf, 0);
+}
+
 void ActionBuilder::build(ofputil_flow_mod *dstMod) {
     dstMod->ofpacts = getActionsFromBuffer(buf, dstMod->ofpacts_len);
 }
@@ -247,6 +271,12 @@ ActionBuilder& ActionBuilder::multipath(enum nx_hash_fields fields,
     return *this;
 }
 
+ActionBuilder& ActionBuilder::conjunction(uint32_t id, uint8_t clause,
+                                          uint8_t nClauses) {
+    act_conjunction(buf, id, clause, nClauses);
+    return *this;
+}
+
 } // namespace ovsagent
 
 
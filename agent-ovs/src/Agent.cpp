@@ -41,9 +41,12 @@ using std::make_pair;
 using opflex::modb::ModelMetadata;
 using opflex::modb::Mutator;
 using opflex::ofcore::OFFramework;
+using opflex::ofcore::OFConstants;
 using boost::property_tree::ptree;
 using boost::optional;
 using boost::asio::io_service;
+using boost::asio::deadline_timer;
+using boost::posix_time::seconds;
 
 Agent::Agent(OFFramework& framework_)
     : framework(framework_), policyManager(framework),
@@ -73,6 +76,14 @@ void Agent::setProperties(const boost::property_tree::ptree& properties) {
     static const std::string OPFLEX_SSL_CA_STORE("opflex.ssl.ca-store");
     static const std::string OPFLEX_SSL_CERT_PATH("opflex.ssl.client-cert.path");
     static const std::string OPFLEX_SSL_CERT_PASS("opflex.ssl.client-cert.password");
+    static const std::string OPFLEX_ROLE_ROUTING("opflex.role-routing");
+    static const std::string OPFLEX_WQ_HIGH_MSGS("opflex.write-queue.high-messages");
+    static const std::string OPFLEX_WQ_LOW_MSGS("opflex.write-queue.low-messages");
+    static const std::string OPFLEX_WQ_HIGH_BYTES("opflex.write-queue.high-bytes");
+    static const std::string OPFLEX_WQ_LOW_BYTES("opflex.write-queue.low-bytes");
+    static const std::string OPFLEX_COMPRESSION_MODE("opflex.compression.mode");
+    static const std::string OPFLEX_COMPRESSION_LEVEL("opflex.compression.level");
+    static const std::string STATS_INTERVAL("statistics.report-interval");
     static const std::string HOSTNAME("hostname");
     static const std::string PORT("port");
     static const std::string OPFLEX_INSPECTOR("opflex.inspector.enabled");
@@ -172,6 +183,35 @@ void Agent::setProperties(const boost::property_tree::ptree& properties) {
     if (confsslClientCertPass)
         sslClientCertPass = confsslClientCertPass;
 
+    boost::optional<std::string> confRoleRouting =
+        properties.get_optional<std::string>(OPFLEX_ROLE_ROUTING);
+    if (confRoleRouting)
+        roleRouting = confRoleRouting;
+
+    boost::optional<size_t> confWqHighMsgs =
+        properties.get_optional<size_t>(OPFLEX_WQ_HIGH_MSGS);
+    boost::optional<size_t> confWqLowMsgs =
+        properties.get_optional<size_t>(OPFLEX_WQ_LOW_MSGS);
+    boost::optional<size_t> confWqHighBytes =
+        properties.get_optional<size_t>(OPFLEX_WQ_HIGH_BYTES);
+    boost::optional<size_t> confWqLowBytes =
+        properties.get_optional<size_t>(OPFLEX_WQ_LOW_BYTES);
+    if (confWqHighMsgs) wqHighMessages = confWqHighMsgs;
+    if (confWqLowMsgs) wqLowMessages = confWqLowMsgs;
+    if (confWqHighBytes) wqHighBytes = confWqHighBytes;
+    if (confWqLowBytes) wqLowBytes = confWqLowBytes;
+
+    boost::optional<std::string> confCompressionMode =
+        properties.get_optional<std::string>(OPFLEX_COMPRESSION_MODE);
+    boost::optional<int> confCompressionLevel =
+        properties.get_optional<int>(OPFLEX_COMPRESSION_LEVEL);
+    if (confCompressionMode) compressionMode = confCompressionMode;
+    if (confCompressionLevel) compressionLevel = confCompressionLevel;
+
+    boost::optional<long> confStatsInterval =
+        properties.get_optional<long>(STATS_INTERVAL);
+    if (confStatsInterval) statsInterval = confStatsInterval;
+
     typedef Renderer* (*rend_create)(Agent&);
     typedef std::unordered_map<std::string, rend_create> rend_map_t;
     static rend_map_t rend_map =
@@ -256,6 +296,49 @@ void Agent::applyProperties() {
             framework.enableSSL(sslCaStore.get(), verifyPeers);
         }
     }
+
+    if (roleRouting) {
+        if (roleRouting.get() == "primary") {
+            framework.setRoleRoutingMode(OFConstants::ROUTE_PRIMARY);
+        } else if (roleRouting.get() == "all") {
+            framework.setRoleRoutingMode(OFConstants::ROUTE_ALL);
+        } else {
+            LOG(ERROR) << "Invalid role routing mode: " << roleRouting.get();
+        }
+    }
+
+    if (wqHighMessages || wqLowMessages || wqHighBytes || wqLowBytes) {
+        size_t highMsgs = OFConstants::DEFAULT_WQ_HIGH_MESSAGES;
+        size_t lowMsgs = OFConstants::DEFAULT_WQ_LOW_MESSAGES;
+        size_t highBytes = OFConstants::DEFAULT_WQ_HIGH_BYTES;
+        size_t lowBytes = OFConstants::DEFAULT_WQ_LOW_BYTES;
+        if (wqHighMessages) {
+            highMsgs = wqHighMessages.get();
+            lowMsgs = highMsgs/2;
+        }
+        if (wqHighBytes) {
+            highBytes = wqHighBytes.get();
+            lowBytes = highBytes/2;
+        }
+        if (wqLowMessages) lowMsgs = wqLowMessages.get();
+        if (wqLowBytes) lowBytes = wqLowBytes.get();
+        framework.setWriteQueueLimits(highMsgs, lowMsgs,
+                                      highBytes, lowBytes);
+    }
+
+    if (compressionMode) {
+        if (compressionMode.get() == "deflate") {
+            int level = compressionLevel ? compressionLevel.get() : -1;
+            if (level < -1 || level > 9) {
+                LOG(ERROR) << "Invalid compression level: " << level;
+            } else {
+                framework.enableCompression(level);
+            }
+        } else if (compressionMode.get() != "disabled") {
+            LOG(ERROR) << "Invalid compression mode: "
+                       << compressionMode.get();
+        }
+    }
 }
 
 void Agent::start() {
@@ -292,6 +375,14 @@ void Agent::start() {
     io_work.reset(new io_service::work(agent_io));
     io_service_thread.reset(new thread([this]() { agent_io.run(); }));
 
+    if (statsInterval && statsInterval.get() > 0) {
+        statsTimer.reset(new deadline_timer(agent_io));
+        statsTimer->expires_from_now(seconds(statsInterval.get()));
+        statsTimer->async_wait([this](const boost::system::error_code& ec) {
+                onStatsTimer(ec);
+            });
+    }
+
     for (const std::string& path : endpointSourcePaths) {
         {
             EndpointSource* source =
@@ -342,6 +433,10 @@ void Agent::stop() {
             }
         });
 
+    if (statsTimer) {
+        statsTimer->cancel();
+    }
+
     for (auto& r : renderers) {
         r.second->stop();
     }
@@ -377,4 +472,38 @@ void Agent::stop() {
     LOG(INFO) << "Agent stopped";
 }
 
+void Agent::reportStats() {
+    static const std::vector<std::pair<OFConstants::OpflexRole,
+                                       const char*>> ROLES = {
+        {OFConstants::POLICY_REPOSITORY, "policy-repository"},
+        {OFConstants::ENDPOINT_REGISTRY, "endpoint-registry"},
+        {OFConstants::OBSERVER, "observer"},
+    };
+    for (auto& role : ROLES) {
+        size_t messages, bytes;
+        bool blocked;
+        framework.getWriteQueueStats(role.first, messages, bytes, blocked);
+        LOG(INFO) << "Opflex write queue for " << role.second
+                  << ": messages=" << messages
+                  << " bytes=" << bytes
+                  << " blocked=" << (blocked ? "true" : "false");
+    }
+    for (auto& r : renderers) {
+        r.second->reportStats();
+    }
+}
+
+void Agent::onStatsTimer(const boost::system::error_code& ec) {
+    if (ec) return;
+
+    reportStats();
+
+    if (started) {
+        statsTimer->expires_from_now(seconds(statsInterval.get()));
+        statsTimer->async_wait([this](const boost::system::error_code& ec) {
+                onStatsTimer(ec);
+            });
+    }
+}
+
 } /* namespace ovsagent */
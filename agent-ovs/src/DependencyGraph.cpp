@@ -0,0 +1,59 @@
+/*
+ * Implementation of DependencyGraph class
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include "DependencyGraph.h"
+
+namespace ovsagent {
+
+using std::string;
+using std::unordered_set;
+
+void DependencyGraph::setInputs(const string& object, input_map_t& inputs) {
+    input_map_t& last = objects[object];
+    for (const input_map_t::value_type& kv : last) {
+        if (inputs.find(kv.first) != inputs.end()) continue;
+        auto it = dependents.find(kv.first);
+        if (it == dependents.end()) continue;
+        it->second.erase(object);
+        if (it->second.empty())
+            dependents.erase(it);
+    }
+    for (const input_map_t::value_type& kv : inputs)
+        dependents[kv.first].insert(object);
+    last.swap(inputs);
+    inputs.clear();
+}
+
+void DependencyGraph::removeObject(const string& object) {
+    input_map_t none;
+    setInputs(object, none);
+    objects.erase(object);
+}
+
+bool DependencyGraph::hasObject(const string& object) const {
+    return objects.find(object) != objects.end();
+}
+
+size_t DependencyGraph::getChanged(const string& input, const string& value,
+                                   /* out */ unordered_set<string>& changed)
+    const {
+    size_t unchanged = 0;
+    auto it = dependents.find(input);
+    if (it == dependents.end()) return 0;
+    for (const string& object : it->second) {
+        const string& read = objects.at(object).at(input);
+        if (read == value)
+            unchanged += 1;
+        else
+            changed.insert(object);
+    }
+    return unchanged;
+}
+
+} /* namespace ovsagent */
@@ -7,6 +7,7 @@
  */
 
 #include "FlowBuilder.h"
+#include "FlowEntryArena.h"
 #include "Network.h"
 #include "eth.h"
 
@@ -15,8 +16,12 @@
 
 namespace ovsagent {
 
-FlowBuilder::FlowBuilder() : entry_(new FlowEntry()), ethType_(0) {
-
+FlowBuilder::FlowBuilder()
+    : arena_(FlowEntryArena::current()), ethType_(0) {
+    if (arena_)
+        entry_ = arena_->newEntry();
+    else
+        entry_.reset(new FlowEntry());
 }
 
 FlowBuilder::~FlowBuilder() {
@@ -25,13 +30,16 @@ FlowBuilder::~FlowBuilder() {
 
 ActionBuilder& FlowBuilder::action() {
     if (!action_)
-        action_.reset(new ActionBuilder(*this));
+        action_.reset(new ActionBuilder(*this, arena_));
     return *action_;
 }
 
 FlowEntryPtr FlowBuilder::build() {
-    if (action_)
+    if (action_ && arena_)
+        action_->build(entry_->entry, *arena_);
+    else if (action_)
         action_->build(entry_->entry);
+    entry_->clearEncoding();
     return entry_;
 }
 
@@ -268,4 +276,9 @@ FlowBuilder& FlowBuilder::ctLabel(ovs_u128 ctLabel, ovs_u128 mask) {
     return *this;
 }
 
+FlowBuilder& FlowBuilder::conjId(uint32_t conjId) {
+    match_set_conj_id(match(), conjId);
+    return *this;
+}
+
 } // namespace ovsagent
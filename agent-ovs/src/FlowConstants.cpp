@@ -25,6 +25,7 @@ const uint64_t VIRTUAL_IP_V6   = DEF_COOKIE(7);
 const uint64_t ICMP_ERROR_V4   = DEF_COOKIE(8);
 const uint64_t ICMP_ERROR_V6   = DEF_COOKIE(9);
 #undef DEF_COOKIE
+const uint64_t OBJECT_MASK     = ovs_htonll(0x7fffffff00000000ull);
 
 } // namespace cookie
 
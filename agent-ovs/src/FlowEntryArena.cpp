@@ -0,0 +1,171 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Implementation for FlowEntryArena class.
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include "FlowEntryArena.h"
+#include "ovs-ofputil.h"
+#include "ovs-shim.h"
+
+#include <vector>
+#include <new>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+
+namespace ovsagent {
+
+const size_t FlowEntryArena::DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+static const size_t ALIGN = alignof(std::max_align_t);
+
+static thread_local FlowEntryArena* currentArena = NULL;
+
+class FlowEntryArena::Chunks : private boost::noncopyable {
+public:
+    Chunks(size_t chunkSize_)
+        : chunkSize(chunkSize_), chunk(NULL), used(chunkSize_) {}
+
+    ~Chunks() {
+        for (char* c : chunks)
+            free(c);
+    }
+
+    void* allocate(size_t size) {
+        size = (size + ALIGN - 1) & ~(ALIGN - 1);
+        // Large allocations get a chunk of their own, leaving the
+        // current chunk to the small ones
+        if (size > chunkSize / 4)
+            return newChunk(size);
+        if (used + size > chunkSize) {
+            chunk = newChunk(chunkSize);
+            used = 0;
+        }
+        void* p = chunk + used;
+        used += size;
+        return p;
+    }
+
+    size_t size() const { return chunks.size(); }
+
+private:
+    size_t chunkSize;
+    std::vector<char*> chunks;
+    char* chunk;
+    size_t used;
+
+    char* newChunk(size_t size) {
+        char* c = (char*)malloc(size);
+        if (c == NULL)
+            throw std::bad_alloc();
+        chunks.push_back(c);
+        return c;
+    }
+};
+
+/*
+ * Allocates the shared pointer control blocks of the entries, each
+ * of which holds a reference to the chunks until the entry is gone.
+ * Memory is never freed on its own.
+ */
+template <typename T>
+class FlowEntryArena::Allocator {
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef Allocator<U> other;
+    };
+
+    explicit Allocator(const std::shared_ptr<Chunks>& chunks_)
+        : chunks(chunks_) {}
+
+    template <typename U>
+    Allocator(const Allocator<U>& other) : chunks(other.chunks) {}
+
+    T* allocate(size_t n) {
+        return (T*)chunks->allocate(n * sizeof(T));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const Allocator<U>& other) const {
+        return chunks == other.chunks;
+    }
+
+    template <typename U>
+    bool operator!=(const Allocator<U>& other) const {
+        return chunks != other.chunks;
+    }
+
+private:
+    template <typename U> friend class Allocator;
+    std::shared_ptr<Chunks> chunks;
+};
+
+FlowEntryArena::FlowEntryArena(size_t chunkSize)
+    : chunks(new Chunks(chunkSize)) {}
+
+FlowEntryArena::~FlowEntryArena() {}
+
+FlowEntryPtr FlowEntryArena::newEntry() {
+    ofputil_flow_stats* stats =
+        (ofputil_flow_stats*)chunks->allocate(sizeof(ofputil_flow_stats));
+    memset(stats, 0, sizeof(ofputil_flow_stats));
+    return std::allocate_shared<FlowEntry>(Allocator<FlowEntry>(chunks),
+                                           stats);
+}
+
+void* FlowEntryArena::allocate(size_t size) {
+    return chunks->allocate(size);
+}
+
+size_t FlowEntryArena::getChunkCount() const {
+    return chunks->size();
+}
+
+FlowEntryArena* FlowEntryArena::current() {
+    return currentArena;
+}
+
+FlowEntryPtr FlowEntryArena::promote(const FlowEntryPtr& fe,
+                                     uint64_t objCookie) {
+    // The entry may be shared with other objects, so the object
+    // cookie is only ever set on a copy
+    bool stamp = objCookie != 0 &&
+        (ovs_ntohll(fe->entry->cookie) >> 32) == 0;
+    if (!stamp && !fe->isArenaEntry())
+        return fe;
+
+    FlowEntryPtr copy(new FlowEntry());
+    ofputil_flow_stats* entry = copy->entry;
+    *entry = *fe->entry;
+    entry->ofpacts = NULL;
+    if (entry->ofpacts_len > 0) {
+        void* ofpacts = malloc(entry->ofpacts_len);
+        memcpy(ofpacts, fe->entry->ofpacts, entry->ofpacts_len);
+        entry->ofpacts = (ofpact*)ofpacts;
+    }
+    if (stamp)
+        entry->cookie |= objCookie;
+    return copy;
+}
+
+FlowEntryArena::Scope::Scope(FlowEntryArena& arena)
+    : previous(currentArena) {
+    currentArena = &arena;
+}
+
+FlowEntryArena::Scope::~Scope() {
+    currentArena = previous;
+}
+
+} // namespace ovsagent
@@ -8,8 +8,12 @@
 
 #include "logging.h"
 #include "FlowExecutor.h"
+#include "FlowConstants.h"
 
 #include <mutex>
+#include <future>
+#include <cstring>
+#include <cerrno>
 
 #include "ovs-shim.h"
 #include "ovs-ofputil.h"
@@ -24,7 +28,32 @@ typedef std::unique_lock<std::mutex> mutex_guard;
 
 namespace ovsagent {
 
-FlowExecutor::FlowExecutor() : swConn(NULL) {
+const size_t FlowExecutor::CTRL_INDEX;
+
+/* Bundles are always atomic, and ordered so that flows can refer to
+   groups added earlier in the same bundle */
+static const uint16_t BUNDLE_FLAGS = OFPBF_ATOMIC | OFPBF_ORDERED;
+
+/* Errors that indicate that the switch does not implement bundles,
+   or cannot include some kind of message in one */
+static bool IsBundleUnsupported(int err) {
+    switch (err) {
+    case OFPERR_OFPBRC_BAD_TYPE:
+    case OFPERR_OFPBRC_BAD_EXPERIMENTER:
+    case OFPERR_OFPBRC_BAD_EXP_TYPE:
+    case OFPERR_OFPBFC_MSG_UNSUP:
+    case OFPERR_OFPBFC_BAD_FLAGS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+FlowExecutor::FlowExecutor()
+    : swConn(NULL), maxInFlight(0), inFlight(0),
+      bundlesEnabled(false), bundleMinMsgs(0),
+      bundleSupport(BUNDLES_UNKNOWN), nextBundleId(1),
+      encodingCache(false) {
 }
 
 FlowExecutor::~FlowExecutor() {
@@ -65,30 +94,229 @@ FlowExecutor::ExecuteNoBlock(const GroupEdit& ge) {
     return ExecuteIntNoBlock<GroupEdit>(ge);
 }
 
+bool
+FlowExecutor::ExecuteAsync(const FlowEdit& fe, const CompletionCb& cb) {
+    return ExecuteIntAsync<FlowEdit>(fe, cb);
+}
+
+bool
+FlowExecutor::ExecuteAsync(const GroupEdit& ge, const CompletionCb& cb) {
+    return ExecuteIntAsync<GroupEdit>(ge, cb);
+}
+
+bool
+FlowExecutor::ExecuteAll(const GroupEdit& ge,
+                         const std::vector<FlowEdit>& fes) {
+    bool bundle;
+    {
+        mutex_guard lock(reqMtx);
+        bundle = bundlesEnabled && bundleSupport != BUNDLES_UNSUPPORTED;
+    }
+    if (bundle) {
+        int status = ExecuteBundle(ge, fes);
+        mutex_guard lock(reqMtx);
+        if (status == 0) {
+            bundleSupport = BUNDLES_SUPPORTED;
+            return true;
+        }
+        if (!IsBundleUnsupported(status))
+            return false;
+        LOG(WARNING) << "[" << swConn->getSwitchName() << "] "
+                     << "Switch does not support bundles ("
+                     << ofperr_to_string((ofperr)status)
+                     << "), sending edits without a bundle";
+        bundleSupport = BUNDLES_UNSUPPORTED;
+    }
+
+    bool success = Execute(ge);
+    for (const FlowEdit& fe : fes) {
+        if (!Execute(fe))
+            success = false;
+    }
+    return success;
+}
+
+int
+FlowExecutor::ExecuteBundle(const GroupEdit& ge,
+                            const std::vector<FlowEdit>& fes) {
+    size_t numMsgs = ge.edits.size();
+    for (const FlowEdit& fe : fes)
+        numMsgs += fe.edits.size();
+    if (numMsgs == 0)
+        return 0;
+
+    std::promise<int> done;
+    std::future<int> status = done.get_future();
+    CompletionCb cb = [&done](int s, const std::vector<int>&) {
+        done.set_value(s);
+    };
+    ModSender sendMods =
+        [this, &ge, &fes](uint32_t barrXid,
+                          const boost::optional<uint32_t>& bundleId) {
+        int error = DoExecuteNoBlock<GroupEdit>(ge, barrXid, bundleId, 0);
+        size_t offset = ge.edits.size();
+        for (const FlowEdit& fe : fes) {
+            if (error) break;
+            error = DoExecuteNoBlock<FlowEdit>(fe, barrXid, bundleId, offset);
+            offset += fe.edits.size();
+        }
+        return error;
+    };
+    if (!SendRequest(numMsgs, true, cb, sendMods))
+        return EIO;
+    return status.get();
+}
+
+void FlowExecutor::EnableBundles(bool enabled, size_t minMsgs) {
+    mutex_guard lock(reqMtx);
+    bundlesEnabled = enabled;
+    bundleMinMsgs = minMsgs;
+}
+
+void FlowExecutor::EnableEncodingCache(bool enabled) {
+    encodingCache = enabled;
+}
+
+void FlowExecutor::SetMaxInFlight(size_t max) {
+    mutex_guard lock(reqMtx);
+    maxInFlight = max;
+    reqCondVar.notify_all();
+}
+
+size_t FlowExecutor::GetInFlight() {
+    mutex_guard lock(reqMtx);
+    return inFlight;
+}
+
+void FlowExecutor::WaitForInFlight(size_t numMsgs) {
+    mutex_guard lock(reqMtx);
+    while (maxInFlight > 0 && inFlight > 0 &&
+           inFlight + numMsgs > maxInFlight) {
+        reqCondVar.wait(lock);
+    }
+}
+
 template<typename T>
 bool
 FlowExecutor::ExecuteInt(const T& fe) {
+    std::promise<int> done;
+    std::future<int> status = done.get_future();
+    bool sent =
+        ExecuteIntAsync<T>(fe, [&done](int s, const std::vector<int>&) {
+                done.set_value(s);
+            });
+    return sent && status.get() == 0;
+}
+
+template<typename T>
+bool
+FlowExecutor::ExecuteIntAsync(const T& fe, const CompletionCb& cb) {
     if (fe.edits.empty()) {
+        cb(0, std::vector<int>());
         return true;
     }
+    size_t numMsgs = fe.edits.size();
+    bool bundle;
+    {
+        mutex_guard lock(reqMtx);
+        bundle = bundlesEnabled && bundleSupport == BUNDLES_SUPPORTED &&
+            bundleMinMsgs > 0 && numMsgs >= bundleMinMsgs;
+    }
+    return SendRequest(numMsgs, bundle, cb,
+                       [this, &fe](uint32_t barrXid,
+                                   const boost::optional<uint32_t>& bundleId) {
+                           return DoExecuteNoBlock<T>(fe, barrXid, bundleId);
+                       });
+}
+
+bool
+FlowExecutor::SendRequest(size_t numMsgs, bool bundle, const CompletionCb& cb,
+                          const ModSender& sendMods) {
     /* create the barrier request first to setup request-map */
     ofpbuf *barrReq = ofputil_encode_barrier_request(
         (ofp_version)swConn->GetProtocolVersion());
     ovs_be32 barrXid = ((ofp_header *)barrReq->data)->xid;
+    boost::optional<uint32_t> bundleId;
 
     {
         mutex_guard lock(reqMtx);
-        requests[barrXid];
+        while (maxInFlight > 0 && inFlight > 0 &&
+               inFlight + numMsgs > maxInFlight) {
+            reqCondVar.wait(lock);
+        }
+        RequestState& req = requests[barrXid];
+        req.numMsgs = numMsgs;
+        req.cb = cb;
+        inFlight += numMsgs;
+        if (bundle)
+            bundleId = nextBundleId++;
     }
 
-    int error = DoExecuteNoBlock<T>(fe, barrXid);
+    int error = 0;
+    if (bundleId)
+        error = SendBundleCtrl(OFPBCT_OPEN_REQUEST, bundleId.get(), barrXid);
+    if (error == 0)
+        error = sendMods(barrXid, bundleId);
+    if (error == 0 && bundleId)
+        error = SendBundleCtrl(OFPBCT_COMMIT_REQUEST, bundleId.get(), barrXid);
     if (error == 0) {
-        error = WaitOnBarrier(barrReq);
+        LOG(DEBUG) << "[" << swConn->getSwitchName() << "] "
+                   << "Sending barrier request xid=" << barrXid;
+        error = swConn->SendMessage(barrReq);
+        if (error) {
+            LOG(ERROR) << "[" << swConn->getSwitchName() << "] "
+                       << "Error sending barrier request: "
+                       << ovs_strerror(error);
+        }
     } else {
+        ofpbuf_delete(barrReq);
+    }
+
+    if (error) {
         mutex_guard lock(reqMtx);
-        requests.erase(barrXid);
+        RequestMap::iterator itr = requests.find(barrXid);
+        if (itr == requests.end()) {
+            // The connection was reset meanwhile, and the callback
+            // has already been told
+            return true;
+        }
+        RequestState state;
+        RemoveRequest(itr, state);
+        ReleaseInFlight(state.numMsgs);
+        return false;
     }
-    return error == 0;
+    return true;
+}
+
+int
+FlowExecutor::SendBundleCtrl(uint16_t type, uint32_t bundleId,
+                             uint32_t barrXid) {
+    ofputil_bundle_ctrl_msg bc;
+    memset(&bc, 0, sizeof(bc));
+    bc.bundle_id = bundleId;
+    bc.type = type;
+    bc.flags = BUNDLE_FLAGS;
+    ofpbuf *msg = ofputil_encode_bundle_ctrl_request(
+        (ofp_version)swConn->GetProtocolVersion(), &bc);
+    ovs_be32 xid = ((ofp_header *)msg->data)->xid;
+    {
+        mutex_guard lock(reqMtx);
+        RequestMap::iterator itr = requests.find(barrXid);
+        if (itr != requests.end()) {
+            itr->second.reqXids[xid] = CTRL_INDEX;
+            reqBarriers[xid] = barrXid;
+        }
+    }
+    LOG(DEBUG) << "[" << swConn->getSwitchName() << "] "
+               << "Sending bundle control request xid=" << ntohl(xid)
+               << ", type=" << type << ", bundle=" << bundleId;
+    int error = swConn->SendMessage(msg);
+    if (error) {
+        LOG(ERROR) << "[" << swConn->getSwitchName() << "] "
+                   << "Error sending bundle control message: "
+                   << ovs_strerror(error);
+    }
+    return error;
 }
 
 template<typename T>
@@ -124,17 +352,19 @@ FlowExecutor::EncodeMod<FlowEdit::Entry>(const FlowEdit::Entry& edit,
     flowMod.priority = flow.priority;
     if (mod != FlowEdit::ADD) {
         flowMod.cookie = flow.cookie;
-        flowMod.cookie_mask = ~((uint64_t)0);
+        flowMod.cookie_mask = mod == FlowEdit::DEL_COOKIE
+            ? flow::cookie::OBJECT_MASK : ~((uint64_t)0);
     }
     flowMod.new_cookie = mod == FlowEdit::MOD ? OVS_BE64_MAX :
             (mod == FlowEdit::ADD ? flow.cookie : 0);
     memcpy(&flowMod.match, &flow.match, sizeof(flow.match));
-    if (mod != FlowEdit::DEL) {
+    if (mod == FlowEdit::ADD || mod == FlowEdit::MOD) {
         flowMod.ofpacts_len = flow.ofpacts_len;
         flowMod.ofpacts = (ofpact*)flow.ofpacts;
     }
     flowMod.command = mod == FlowEdit::ADD ? OFPFC_ADD :
-            (mod == FlowEdit::MOD ? OFPFC_MODIFY_STRICT : OFPFC_DELETE_STRICT);
+            (mod == FlowEdit::MOD ? OFPFC_MODIFY_STRICT :
+             (mod == FlowEdit::DEL ? OFPFC_DELETE_STRICT : OFPFC_DELETE));
     /* fill out defaults */
     flowMod.modify_cookie = false;
     flowMod.idle_timeout = OFP_FLOW_PERMANENT;
@@ -155,6 +385,75 @@ FlowExecutor::EncodeFlowMod(const FlowEdit::Entry& edit,
     return EncodeMod<FlowEdit::Entry>(edit, ofVersion);
 }
 
+/* Derive a flow mod from the cached encoding of the flow mod that
+   adds the same entry.  From OpenFlow 1.1 on, the add, modify-strict
+   and delete-strict messages for an entry differ only in the command,
+   the cookie mask, and the instructions that a delete leaves out. */
+static ofpbuf *DeriveFlowMod(const ofpbuf *add, FlowEdit::type mod) {
+    static const size_t fixedLen =
+        sizeof(ofp_header) + sizeof(ofp11_flow_mod);
+    const ofp_header *addHdr = (const ofp_header *)add->data;
+
+    size_t len = add->size;
+    if (mod == FlowEdit::DEL) {
+        const ofp11_match_header *mh = (const ofp11_match_header *)
+            ((const char *)add->data + fixedLen);
+        len = fixedLen + ROUND_UP(ntohs(mh->length), 8);
+    }
+
+    ofpbuf *msg = ofpraw_alloc(OFPRAW_OFPT11_FLOW_MOD,
+                               addHdr->version, len - fixedLen);
+    ovs_be32 xid = ((ofp_header *)msg->data)->xid;
+    ofpbuf_put(msg, (const char *)add->data + fixedLen, len - fixedLen);
+    memcpy(msg->data, add->data, fixedLen);
+
+    ofp_header *hdr = (ofp_header *)msg->data;
+    hdr->xid = xid;
+    hdr->length = htons(len);
+    if (mod != FlowEdit::ADD) {
+        ofp11_flow_mod *ofm = (ofp11_flow_mod *)(hdr + 1);
+        ofm->command = mod == FlowEdit::MOD
+            ? OFPFC_MODIFY_STRICT : OFPFC_DELETE_STRICT;
+        ofm->cookie_mask = OVS_BE64_MAX;
+    }
+    return msg;
+}
+
+ofpbuf *
+FlowExecutor::EncodeCachedFlowMod(const FlowEdit::Entry& edit,
+                                  int ofVersion) {
+    if (ofVersion < OFP12_VERSION || edit.first == FlowEdit::DEL_COOKIE)
+        return EncodeMod<FlowEdit::Entry>(edit, ofVersion);
+
+    FlowEntry& fe = *edit.second;
+    ofpbuf *add = fe.encoding.load();
+    if (add == NULL && edit.first != FlowEdit::DEL) {
+        ofpbuf *enc =
+            EncodeMod<FlowEdit::Entry>(FlowEdit::Entry(FlowEdit::ADD,
+                                                       edit.second),
+                                       ofVersion);
+        if (fe.encoding.compare_exchange_strong(add, enc))
+            add = enc;
+        else
+            ofpbuf_delete(enc);
+    }
+    if (add == NULL || ((const ofp_header *)add->data)->version != ofVersion)
+        return EncodeMod<FlowEdit::Entry>(edit, ofVersion);
+    return DeriveFlowMod(add, edit.first);
+}
+
+ofpbuf *
+FlowExecutor::Encode(const FlowEdit::Entry& edit, int ofVersion) {
+    if (encodingCache)
+        return EncodeCachedFlowMod(edit, ofVersion);
+    return EncodeMod<FlowEdit::Entry>(edit, ofVersion);
+}
+
+ofpbuf *
+FlowExecutor::Encode(const GroupEdit::Entry& edit, int ofVersion) {
+    return EncodeMod<GroupEdit::Entry>(edit, ofVersion);
+}
+
 ofpbuf *
 FlowExecutor::EncodeGroupMod(const GroupEdit::Entry& edit,
                              int ofVersion) {
@@ -164,53 +463,64 @@ FlowExecutor::EncodeGroupMod(const GroupEdit::Entry& edit,
 template<typename T>
 int
 FlowExecutor::DoExecuteNoBlock(const T& fe,
-        const boost::optional<ovs_be32>& barrXid) {
+        const boost::optional<ovs_be32>& barrXid,
+        const boost::optional<uint32_t>& bundleId,
+        size_t offset) {
     ofp_version ofVersion = (ofp_version)swConn->GetProtocolVersion();
 
+    std::vector<ofpbuf*> msgs;
+    msgs.reserve(fe.edits.size());
     for (const typename T::Entry& e : fe.edits) {
-        ofpbuf *msg = EncodeMod<typename T::Entry>(e, ofVersion);
-        ovs_be32 xid = ((ofp_header *)msg->data)->xid;
-        if (barrXid) {
-            mutex_guard lock(reqMtx);
-            requests[barrXid.get()].reqXids.insert(xid);
+        ofpbuf *msg = Encode(e, ofVersion);
+        if (bundleId) {
+            ofputil_bundle_add_msg bam;
+            memset(&bam, 0, sizeof(bam));
+            bam.bundle_id = bundleId.get();
+            bam.flags = BUNDLE_FLAGS;
+            bam.msg = (ofp_header *)msg->data;
+            ofpbuf *bundleMsg = ofputil_encode_bundle_add(ofVersion, &bam);
+            ofpbuf_delete(msg);
+            msg = bundleMsg;
         }
         LOG(DEBUG) << "[" << swConn->getSwitchName() << "] "
-                   << "Executing xid=" << ntohl(xid) << ", " << e;
-        int error = swConn->SendMessage(msg);
-        if (error) {
-            LOG(ERROR) << "[" << swConn->getSwitchName() << "] "
-                       << "Error sending flow mod message: "
-                       << ovs_strerror(error);
-            return error;
+                   << "Executing xid="
+                   << ntohl(((ofp_header *)msg->data)->xid) << ", " << e;
+        msgs.push_back(msg);
+    }
+    if (barrXid) {
+        mutex_guard lock(reqMtx);
+        RequestMap::iterator itr = requests.find(barrXid.get());
+        if (itr != requests.end()) {
+            size_t index = offset;
+            for (ofpbuf *msg : msgs) {
+                ovs_be32 xid = ((ofp_header *)msg->data)->xid;
+                itr->second.reqXids[xid] = index++;
+                reqBarriers[xid] = barrXid.get();
+            }
         }
     }
-    return 0;
-}
-
-int
-FlowExecutor::WaitOnBarrier(ofpbuf *barrReq) {
-    ovs_be32 barrXid = ((ofp_header *)barrReq->data)->xid;
-    LOG(DEBUG) << "[" << swConn->getSwitchName() << "] "
-               << "Sending barrier request xid=" << barrXid;
-    int err = swConn->SendMessage(barrReq);
-    if (err) {
+    int error = swConn->SendMessages(msgs);
+    if (error) {
         LOG(ERROR) << "[" << swConn->getSwitchName() << "] "
-                   << "Error sending barrier request: "
-                   << ovs_strerror(err);
-        mutex_guard lock(reqMtx);
-        requests.erase(barrXid);
-        return err;
+                   << "Error sending flow mod message: "
+                   << ovs_strerror(error);
     }
+    return error;
+}
 
-    mutex_guard lock(reqMtx);
-    RequestState& barrReqState = requests[barrXid];
-    while (barrReqState.done == false) {
-        reqCondVar.wait(lock);
+void
+FlowExecutor::RemoveRequest(RequestMap::iterator itr, RequestState& state) {
+    state = std::move(itr->second);
+    requests.erase(itr);
+    for (const auto& kv : state.reqXids) {
+        reqBarriers.erase(kv.first);
     }
-    int reqStatus = barrReqState.status;
-    requests.erase(barrXid);
+}
 
-    return reqStatus;
+void
+FlowExecutor::ReleaseInFlight(size_t numMsgs) {
+    inFlight -= numMsgs;
+    reqCondVar.notify_all();
 }
 
 void
@@ -222,13 +532,23 @@ FlowExecutor::Handle(SwitchConnection *, int msgType, ofpbuf *msg) {
 
     switch (msgType) {
     case OFPTYPE_ERROR:
-        for (RequestMap::value_type& kv : requests) {
-            RequestState& req = kv.second;
-            if (req.reqXids.find(recvXid) != req.reqXids.end()) {
-                ofperr err = ofperr_decode_msg(msgHdr, NULL);
-                req.status = err;
+        {
+            auto bitr = reqBarriers.find(recvXid);
+            if (bitr == reqBarriers.end())
+                break;
+            RequestMap::iterator itr = requests.find(bitr->second);
+            if (itr == requests.end())
                 break;
+            RequestState& req = itr->second;
+            ofperr err = ofperr_decode_msg(msgHdr, NULL);
+            size_t index = req.reqXids[recvXid];
+            if (index != CTRL_INDEX) {
+                if (req.errors.empty())
+                    req.errors.resize(req.numMsgs, 0);
+                req.errors[index] = err;
             }
+            if (req.status == 0)
+                req.status = err;
         }
         break;
 
@@ -236,8 +556,13 @@ FlowExecutor::Handle(SwitchConnection *, int msgType, ofpbuf *msg) {
         {
             RequestMap::iterator itr = requests.find(recvXid);
             if (itr != requests.end()) {    // request complete
-                itr->second.done = true;
-                reqCondVar.notify_all();
+                RequestState state;
+                RemoveRequest(itr, state);
+                lock.unlock();
+                if (state.cb)
+                    state.cb(state.status, state.errors);
+                lock.lock();
+                ReleaseInFlight(state.numMsgs);
             }
         }
         break;
@@ -251,13 +576,24 @@ FlowExecutor::Handle(SwitchConnection *, int msgType, ofpbuf *msg) {
 void
 FlowExecutor::Connected(SwitchConnection*) {
     /* If connection was re-established, fail outstanding requests */
+    std::vector<RequestState> failed;
     mutex_guard lock(reqMtx);
-    for (RequestMap::value_type& kv : requests) {
-        RequestState& req = kv.second;
-        req.status = ENOTCONN;
-        req.done = true;
+    bundleSupport = BUNDLES_UNKNOWN;
+    while (!requests.empty()) {
+        failed.emplace_back();
+        RemoveRequest(requests.begin(), failed.back());
     }
-    reqCondVar.notify_all();
+    lock.unlock();
+
+    size_t numMsgs = 0;
+    for (RequestState& req : failed) {
+        if (req.cb)
+            req.cb(ENOTCONN, req.errors);
+        numMsgs += req.numMsgs;
+    }
+
+    lock.lock();
+    ReleaseInFlight(numMsgs);
 }
 
 } // namespace ovsagent
@@ -24,7 +24,7 @@ typedef std::lock_guard<std::mutex> mutex_guard;
 
 namespace ovsagent {
 
-FlowReader::FlowReader() : swConn(NULL) {
+FlowReader::FlowReader() : swConn(NULL), monitorConn(NULL) {
 }
 
 FlowReader::~FlowReader() {
@@ -34,17 +34,34 @@ void FlowReader::installListenersForConnection(SwitchConnection *conn) {
     swConn = conn;
     conn->RegisterMessageHandler(OFPTYPE_FLOW_STATS_REPLY, this);
     conn->RegisterMessageHandler(OFPTYPE_GROUP_DESC_STATS_REPLY, this);
+    conn->RegisterMessageHandler(OFPTYPE_AGGREGATE_STATS_REPLY, this);
 }
 
 void FlowReader::uninstallListenersForConnection(SwitchConnection *conn) {
     conn->UnregisterMessageHandler(OFPTYPE_FLOW_STATS_REPLY, this);
     conn->RegisterMessageHandler(OFPTYPE_GROUP_DESC_STATS_REPLY, this);
+    conn->UnregisterMessageHandler(OFPTYPE_AGGREGATE_STATS_REPLY, this);
+}
+
+void FlowReader::installMonitorListenersForConnection(SwitchConnection *conn) {
+    monitorConn = conn;
+    conn->RegisterMessageHandler(OFPTYPE_FLOW_MONITOR_STATS_REPLY, this);
+    conn->RegisterMessageHandler(OFPTYPE_FLOW_MONITOR_PAUSED, this);
+}
+
+void FlowReader::uninstallMonitorListenersForConnection(SwitchConnection *conn) {
+    conn->UnregisterMessageHandler(OFPTYPE_FLOW_MONITOR_STATS_REPLY, this);
+    conn->UnregisterMessageHandler(OFPTYPE_FLOW_MONITOR_PAUSED, this);
+    mutex_guard lock(reqMtx);
+    monitorConn = NULL;
+    monitorCb = FlowUpdateCb();
 }
 
 void FlowReader::clear() {
     mutex_guard lock(reqMtx);
     flowRequests.clear();
     groupRequests.clear();
+    countRequests.clear();
 }
 
 bool FlowReader::getFlows(uint8_t tableId, const FlowCb& cb) {
@@ -61,12 +78,36 @@ bool FlowReader::getGroups(const GroupCb& cb) {
     return sendRequest<GroupCb, GroupCbMap>(req, cb, groupRequests);
 }
 
-ofpbuf *FlowReader::createFlowRequest(uint8_t tableId, match* m) {
+bool FlowReader::getFlowCount(uint8_t tableId, const FlowCountCb& cb) {
+    ofpbuf *req = createFlowRequest(tableId, NULL, true);
+    return sendRequest<FlowCountCb, FlowCountCbMap>(req, cb, countRequests);
+}
+
+bool FlowReader::monitorFlows(const FlowUpdateCb& cb) {
+    SwitchConnection *conn;
+    {
+        mutex_guard lock(reqMtx);
+        conn = monitorConn;
+        monitorCb = cb;
+    }
+    if (conn == NULL)
+        return false;
+
+    int err = conn->SendMessage(createMonitorRequest());
+    if (err != 0) {
+        LOG(ERROR) << "Failed to send flow monitor request: "
+            << ovs_strerror(err);
+    }
+    return (err == 0);
+}
+
+ofpbuf *FlowReader::createFlowRequest(uint8_t tableId, match* m,
+                                      bool aggregate) {
     ofp_version ofVer = (ofp_version)swConn->GetProtocolVersion();
     ofputil_protocol proto = ofputil_protocol_from_ofp_version(ofVer);
 
     ofputil_flow_stats_request fsr;
-    fsr.aggregate = false;
+    fsr.aggregate = aggregate;
     if (m) {
         memcpy(&fsr.match, m, sizeof(fsr.match));
     } else {
@@ -86,6 +127,22 @@ ofpbuf *FlowReader::createGroupRequest() {
         ((ofp_version)swConn->GetProtocolVersion(), OFPG_ALL);
 }
 
+ofpbuf *FlowReader::createMonitorRequest() {
+    // Changes made by the monitoring connection itself are not
+    // reported, but it never writes any flows
+    ofputil_flow_monitor_request fmr;
+    fmr.id = 0;
+    fmr.flags = (nx_flow_monitor_flags)
+        (NXFMF_ADD | NXFMF_DELETE | NXFMF_MODIFY | NXFMF_ACTIONS);
+    fmr.out_port = OFPP_NONE;
+    fmr.table_id = 0xff;
+    match_init_catchall(&fmr.match);
+
+    ofpbuf *req = ofpbuf_new(0);
+    ofputil_append_flow_monitor_request(&fmr, req);
+    return req;
+}
+
 // XXX TODO need a way to time out requests
 template <typename U, typename V>
 bool FlowReader::sendRequest(ofpbuf *req, const U& cb, V& reqMap) {
@@ -112,6 +169,70 @@ void FlowReader::Handle(SwitchConnection*, int msgType, ofpbuf *msg) {
     } else if (msgType == OFPTYPE_GROUP_DESC_STATS_REPLY) {
         handleReply<GroupEdit::EntryList, GroupCb, GroupCbMap>(msg,
                                                                groupRequests);
+    } else if (msgType == OFPTYPE_AGGREGATE_STATS_REPLY) {
+        handleReply<uint64_t, FlowCountCb, FlowCountCbMap>(msg,
+                                                           countRequests);
+    } else if (msgType == OFPTYPE_FLOW_MONITOR_STATS_REPLY) {
+        handleFlowUpdates(msg);
+    } else if (msgType == OFPTYPE_FLOW_MONITOR_PAUSED) {
+        // The switch has too many updates queued for us, and will
+        // only catch up later
+        LOG(WARNING) << "Flow monitor paused by switch";
+        FlowUpdateCb cb;
+        {
+            mutex_guard lock(reqMtx);
+            cb = monitorCb;
+        }
+        if (cb)
+            cb(NXFME_ADDED, FlowEntryPtr());
+    }
+}
+
+void FlowReader::handleFlowUpdates(ofpbuf *msg) {
+    FlowUpdateCb cb;
+    {
+        mutex_guard lock(reqMtx);
+        cb = monitorCb;
+    }
+    if (!cb)
+        return;
+
+    while (true) {
+        ofputil_flow_update update;
+        match m;
+        update.match = &m;
+
+        ofpbuf actsBuf;
+        ofpbuf_init(&actsBuf, 32);
+        int ret = ofputil_decode_flow_update(&update, msg, &actsBuf);
+        if (ret != 0) {
+            ofpbuf_uninit(&actsBuf);
+            if (ret != EOF) {
+                LOG(ERROR) << "Failed to decode flow update: "
+                    << ovs_strerror(ret);
+            }
+            break;
+        }
+        if (update.event == NXFME_ABBREV) {
+            ofpbuf_uninit(&actsBuf);
+            continue;
+        }
+
+        FlowEntryPtr entry(new FlowEntry());
+        ofputil_flow_stats* fs = entry->entry;
+        fs->table_id = update.table_id;
+        fs->priority = update.priority;
+        fs->cookie = update.cookie;
+        fs->idle_timeout = update.idle_timeout;
+        fs->hard_timeout = update.hard_timeout;
+        memcpy(&fs->match, &m, sizeof(fs->match));
+        fs->ofpacts = ActionBuilder::getActionsFromBuffer(&actsBuf,
+                                                          fs->ofpacts_len);
+        ofpbuf_uninit(&actsBuf);
+        override_raw_actions(fs->ofpacts, fs->ofpacts_len);
+
+        LOG(DEBUG) << "Got flow update " << update.event << ": " << *entry;
+        cb(update.event, entry);
     }
 }
 
@@ -177,6 +298,24 @@ void FlowReader::decodeReply(ofpbuf *msg, FlowEntryList& recvFlows,
     } while (true);
 }
 
+template<>
+void FlowReader::decodeReply(ofpbuf *msg, uint64_t& flowCount,
+        bool& replyDone) {
+    ofputil_aggregate_stats as;
+    int ret = ofputil_decode_aggregate_stats_reply(&as,
+                                                   (ofp_header*)msg->data);
+    if (ret != 0) {
+        LOG(ERROR) << "Failed to decode aggregate stats reply: "
+            << ovs_strerror(ret);
+        // No table matches this count, so the table is treated as
+        // changed
+        flowCount = UINT64_MAX;
+    } else {
+        flowCount = as.flow_count;
+    }
+    replyDone = true;
+}
+
 template<>
 void FlowReader::decodeReply(ofpbuf *msg, GroupEdit::EntryList& recv,
         bool& replyDone) {
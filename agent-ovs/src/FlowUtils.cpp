@@ -10,8 +10,10 @@
 #include "FlowUtils.h"
 #include "RangeMask.h"
 #include "FlowBuilder.h"
+#include "FlowEntryArena.h"
 #include "eth.h"
 #include "ovs-shim.h"
+#include "ovs-ofputil.h"
 
 #include <modelgbp/l2/EtherTypeEnumT.hpp>
 #include <modelgbp/l4/TcpFlagsEnumT.hpp>
@@ -21,6 +23,8 @@
 
 #include <vector>
 #include <functional>
+#include <unordered_map>
+#include <cstring>
 
 namespace ovsagent {
 namespace flowutils {
@@ -118,13 +122,172 @@ static flow_func make_flow_functor(const network::subnet_t& ss,
     return std::bind(applyRemoteSub, _1, func, addr, ss.second, _2);
 }
 
-void add_classifier_entries(L24Classifier& clsfr, ClassAction act,
-                            boost::optional<const network::subnets_t&> sourceSub,
-                            boost::optional<const network::subnets_t&> destSub,
-                            uint8_t nextTable, uint16_t priority,
-                            uint32_t flags, uint64_t cookie,
-                            uint32_t svnid, uint32_t dvnid,
-                            /* out */ FlowEntryList& entries) {
+static void match_class_state(FlowBuilder& f, ClassAction act) {
+    switch (act) {
+    case flowutils::CA_REFLEX_REV:
+        f.conntrackState(0, FlowBuilder::CT_TRACKED);
+        break;
+    case flowutils::CA_REFLEX_REV_ALLOW:
+        f.conntrackState(FlowBuilder::CT_TRACKED |
+                         FlowBuilder::CT_ESTABLISHED,
+                         FlowBuilder::CT_TRACKED |
+                         FlowBuilder::CT_ESTABLISHED |
+                         FlowBuilder::CT_INVALID |
+                         FlowBuilder::CT_NEW);
+        break;
+    default:
+        // nothing
+        break;
+    }
+}
+
+static void add_class_action(FlowBuilder& f, ClassAction act,
+                             uint8_t nextTable) {
+    switch (act) {
+    case flowutils::CA_REFLEX_REV:
+        f.action().conntrack(0, MFF_REG6, 0, nextTable);
+        break;
+    case flowutils::CA_REFLEX_FWD:
+        f.action().conntrack(ActionBuilder::CT_COMMIT,
+                             MFF_REG6);
+
+        // fall through
+    case flowutils::CA_REFLEX_REV_ALLOW:
+    case flowutils::CA_ALLOW:
+        f.action().go(nextTable);
+        break;
+    case flowutils::CA_DENY:
+    default:
+        // nothing
+        break;
+    }
+}
+
+/* The values of one dimension of a classifier's match.  Each adds to
+   the match of a flow, or returns false if the flow can't match. */
+typedef vector<flow_func> match_dim_t;
+
+static bool match_any(FlowBuilder&, uint16_t) {
+    return true;
+}
+
+/* Add the flows for a classifier as a conjunctive match with a
+   clause for each dimension of the match that has more than one
+   value, if that takes fewer flows than their cross product.
+   Returns false without adding anything otherwise. */
+static bool
+classifier_conj_entries(L24Classifier& clsfr, ClassAction act,
+                        const network::subnets_t& effSourceSub,
+                        const network::subnets_t& effDestSub,
+                        const MaskList& srcPorts, const MaskList& dstPorts,
+                        const vector<uint32_t>& tcpFlagsVec,
+                        uint32_t tcpFlags,
+                        uint8_t nextTable, uint16_t priority,
+                        uint32_t flags, ovs_be64 ckbe,
+                        uint32_t svnid, uint32_t dvnid,
+                        const conj_id_alloc_t& conjIdAlloc,
+                        /* out */ FlowEntryList& entries) {
+    using modelgbp::l4::TcpFlagsEnumT;
+
+    // Leave out subnets of the wrong address family, which can't
+    // match, before counting.  The scratch flow only collects their
+    // matches.
+    FlowBuilder scratch;
+    uint16_t etht = match_protocol(scratch, clsfr);
+    auto sub_dim = [&](const network::subnets_t& subs,
+                       FlowBuilderFunc func) {
+        match_dim_t dim;
+        for (const network::subnet_t& sub : subs) {
+            flow_func ff(make_flow_functor(sub, func));
+            if (!ff)
+                dim.push_back(match_any);
+            else if (ff(scratch, etht))
+                dim.push_back(ff);
+        }
+        return dim;
+    };
+
+    vector<match_dim_t> dims(5);
+    dims[0] = sub_dim(effSourceSub, &FlowBuilder::ipSrc);
+    dims[1] = sub_dim(effDestSub, &FlowBuilder::ipDst);
+    for (const Mask& sm : srcPorts) {
+        dims[2].push_back([sm](FlowBuilder& f, uint16_t) {
+                f.tpSrc(sm.first, sm.second);
+                return true;
+            });
+    }
+    for (const Mask& dm : dstPorts) {
+        dims[3].push_back([dm](FlowBuilder& f, uint16_t) {
+                f.tpDst(dm.first, dm.second);
+                return true;
+            });
+    }
+    for (uint32_t flagMask : tcpFlagsVec) {
+        dims[4].push_back([flagMask, tcpFlags](FlowBuilder& f, uint16_t) {
+                if (tcpFlags != TcpFlagsEnumT::CONST_UNSPECIFIED)
+                    match_tcp_flags(f, flagMask);
+                return true;
+            });
+    }
+
+    size_t crossProduct = 1;
+    size_t conjunctive = 1;
+    uint8_t nClauses = 0;
+    for (const match_dim_t& dim : dims) {
+        crossProduct *= dim.size();
+        if (dim.size() > 1) {
+            conjunctive += dim.size();
+            nClauses += 1;
+        }
+    }
+    if (nClauses < 2 || conjunctive >= crossProduct)
+        return false;
+
+    // Every clause flow matches the single values of the other
+    // dimensions as well as its own value
+    uint32_t conjId = conjIdAlloc();
+    uint8_t clause = 0;
+    for (size_t i = 0; i < dims.size(); ++i) {
+        if (dims[i].size() < 2)
+            continue;
+        clause += 1;
+        for (const flow_func& value : dims[i]) {
+            FlowBuilder f;
+            flowutils::match_group(f, priority, svnid, dvnid);
+            match_protocol(f, clsfr);
+            for (size_t j = 0; j < dims.size(); ++j) {
+                if (dims[j].size() == 1)
+                    dims[j].front()(f, etht);
+            }
+            value(f, etht);
+            f.action().conjunction(conjId, clause, nClauses);
+            entries.push_back(f.build());
+        }
+    }
+
+    FlowBuilder f;
+    f.cookie(ckbe);
+    f.flags(flags);
+    flowutils::match_group(f, priority, svnid, dvnid);
+    f.conjId(conjId);
+    add_class_action(f, act, nextTable);
+    entries.push_back(f.build());
+    return true;
+}
+
+/* Add the flows for a classifier.  If conjs is set, the flows match
+   like CA_DENY flows but act as a clause of the conjunctions.  If
+   conjIdAlloc is set, they may be encoded as a conjunctive match. */
+static ClassEncoding
+classifier_entries(L24Classifier& clsfr, ClassAction act,
+                   boost::optional<const network::subnets_t&> sourceSub,
+                   boost::optional<const network::subnets_t&> destSub,
+                   uint8_t nextTable, uint16_t priority,
+                   uint32_t flags, uint64_t cookie,
+                   uint32_t svnid, uint32_t dvnid,
+                   const ConjList* conjs,
+                   const conj_id_alloc_t* conjIdAlloc,
+                   /* out */ FlowEntryList& entries) {
     using modelgbp::l4::TcpFlagsEnumT;
 
     ovs_be64 ckbe = ovs_htonll(cookie);
@@ -153,6 +316,14 @@ void add_classifier_entries(L24Classifier& clsfr, ClassAction act,
     network::subnets_t effSourceSub(compute_eff_sub(sourceSub));
     network::subnets_t effDestSub(compute_eff_sub(destSub));
 
+    if (conjIdAlloc && *conjIdAlloc && !conjs &&
+        (act == CA_DENY || act == CA_ALLOW || act == CA_REFLEX_FWD) &&
+        classifier_conj_entries(clsfr, act, effSourceSub, effDestSub,
+                                srcPorts, dstPorts, tcpFlagsVec, tcpFlags,
+                                nextTable, priority, flags, ckbe,
+                                svnid, dvnid, *conjIdAlloc, entries))
+        return CE_CONJUNCTION;
+
     for (const network::subnet_t& ss : effSourceSub) {
         flow_func src_func(make_flow_functor(ss, &FlowBuilder::ipSrc));
 
@@ -166,23 +337,7 @@ void add_classifier_entries(L24Classifier& clsfr, ClassAction act,
                         f.cookie(ckbe);
                         f.flags(flags);
 
-                        switch (act) {
-                        case flowutils::CA_REFLEX_REV:
-                            f.conntrackState(0, FlowBuilder::CT_TRACKED);
-                            break;
-                        case flowutils::CA_REFLEX_REV_ALLOW:
-                            f.conntrackState(FlowBuilder::CT_TRACKED |
-                                             FlowBuilder::CT_ESTABLISHED,
-                                             FlowBuilder::CT_TRACKED |
-                                             FlowBuilder::CT_ESTABLISHED |
-                                             FlowBuilder::CT_INVALID |
-                                             FlowBuilder::CT_NEW);
-                            break;
-                        default:
-                            // nothing
-                            break;
-                        }
-
+                        match_class_state(f, act);
                         flowutils::match_group(f, priority, svnid, dvnid);
                         uint16_t etht = match_protocol(f, clsfr);
 
@@ -204,30 +359,98 @@ void add_classifier_entries(L24Classifier& clsfr, ClassAction act,
                             break;
                         }
 
-                        switch (act) {
-                        case flowutils::CA_REFLEX_REV:
-                            f.action().conntrack(0, MFF_REG6, 0, nextTable);
-                            break;
-                        case flowutils::CA_REFLEX_FWD:
-                            f.action().conntrack(ActionBuilder::CT_COMMIT,
-                                                 MFF_REG6);
-
-                            // fall through
-                        case flowutils::CA_REFLEX_REV_ALLOW:
-                        case flowutils::CA_ALLOW:
-                            f.action().go(nextTable);
-                            break;
-                        case flowutils::CA_DENY:
-                        default:
-                            // nothing
-                            break;
+                        if (conjs) {
+                            for (const Conjunction& c : *conjs)
+                                f.action().conjunction(c.id, c.clause,
+                                                       c.nClauses);
+                            entries.push_back(f.build());
+                            continue;
                         }
+
+                        add_class_action(f, act, nextTable);
                         entries.push_back(f.build());
                     }
                 }
             }
         }
     }
+    return CE_CROSS_PRODUCT;
+}
+
+void add_classifier_entries(L24Classifier& clsfr, ClassAction act,
+                            boost::optional<const network::subnets_t&> sourceSub,
+                            boost::optional<const network::subnets_t&> destSub,
+                            uint8_t nextTable, uint16_t priority,
+                            uint32_t flags, uint64_t cookie,
+                            uint32_t svnid, uint32_t dvnid,
+                            /* out */ FlowEntryList& entries) {
+    classifier_entries(clsfr, act, sourceSub, destSub, nextTable,
+                       priority, flags, cookie, svnid, dvnid, NULL, NULL,
+                       entries);
+}
+
+ClassEncoding
+add_classifier_entries(L24Classifier& clsfr, ClassAction act,
+                       boost::optional<const network::subnets_t&> sourceSub,
+                       boost::optional<const network::subnets_t&> destSub,
+                       uint8_t nextTable, uint16_t priority,
+                       uint32_t flags, uint64_t cookie,
+                       uint32_t svnid, uint32_t dvnid,
+                       const conj_id_alloc_t& conjIdAlloc,
+                       /* out */ FlowEntryList& entries) {
+    return classifier_entries(clsfr, act, sourceSub, destSub, nextTable,
+                              priority, flags, cookie, svnid, dvnid, NULL,
+                              &conjIdAlloc, entries);
+}
+
+void add_classifier_conj_entries(L24Classifier& clsfr,
+                                 uint16_t priority, const ConjList& conjs,
+                                 /* out */ FlowEntryList& entries) {
+    classifier_entries(clsfr, CA_DENY, boost::none, boost::none, 0,
+                       priority, 0, 0, 0, 0, &conjs, NULL, entries);
+}
+
+void merge_conjunction_entries(FlowEntryList& entries) {
+    // Index of the clause entries kept, by hash of their match
+    std::unordered_multimap<uint32_t, size_t> clauses;
+    FlowEntryList merged;
+    merged.reserve(entries.size());
+
+    for (FlowEntryPtr& fe : entries) {
+        ofputil_flow_stats* e = fe->entry;
+        if (!action_conj_only(e->ofpacts, e->ofpacts_len)) {
+            merged.push_back(std::move(fe));
+            continue;
+        }
+        uint32_t hash = match_hash(&e->match, e->priority);
+        auto range = clauses.equal_range(hash);
+        auto it = range.first;
+        for (; it != range.second; ++it) {
+            if (merged[it->second]->matchEq(fe.get()))
+                break;
+        }
+        if (it == range.second) {
+            clauses.emplace(hash, merged.size());
+            merged.push_back(std::move(fe));
+            continue;
+        }
+
+        FlowEntryPtr& kept = merged[it->second];
+        if (kept->actionEq(fe.get()))
+            continue;
+        // the actions are replaced, which an arena entry can't own
+        kept = FlowEntryArena::promote(kept);
+        ofputil_flow_stats* k = kept->entry;
+        size_t len = k->ofpacts_len + e->ofpacts_len;
+        char* ofpacts = (char*)malloc(len);
+        memcpy(ofpacts, k->ofpacts, k->ofpacts_len);
+        memcpy(ofpacts + k->ofpacts_len, e->ofpacts, e->ofpacts_len);
+        free((void*)k->ofpacts);
+        k->ofpacts = (struct ofpact*)ofpacts;
+        k->ofpacts_len = len;
+        kept->clearEncoding();
+    }
+    entries.swap(merged);
 }
 
 FlowBuilder& match_dhcp_req(FlowBuilder& fb, bool v4) {
@@ -244,5 +467,34 @@ FlowBuilder& match_dhcp_req(FlowBuilder& fb, bool v4) {
     return fb;
 }
 
+FlowEntryPtr copy_endpoint_flow(const FlowEntry& tmpl, uint32_t ofPort,
+                                const uint8_t* macAddr,
+                                const boost::asio::ip::address* ipAddr) {
+    FlowEntryArena* arena = FlowEntryArena::current();
+    FlowEntryPtr fe(arena ? arena->newEntry() : FlowEntryPtr(new FlowEntry()));
+    ofputil_flow_stats* entry = fe->entry;
+    *entry = *tmpl.entry;
+
+    size_t len = tmpl.entry->ofpacts_len;
+    ofpact* ofpacts =
+        (ofpact*)(arena ? arena->allocate(len) : malloc(len));
+    memcpy(ofpacts, tmpl.entry->ofpacts, len);
+    ovs_be32 port = htonl(ofPort);
+    set_field_action_values(ofpacts, len, MFF_REG7, &port);
+    set_field_action_values(ofpacts, len, MFF_ETH_DST, macAddr);
+    entry->ofpacts = ofpacts;
+
+    if (ipAddr == NULL) {
+        match_set_dl_dst(&entry->match, *(eth_addr*)macAddr);
+    } else if (ipAddr->is_v4()) {
+        match_set_nw_dst(&entry->match, htonl(ipAddr->to_v4().to_ulong()));
+    } else {
+        boost::asio::ip::address_v6::bytes_type bytes =
+            ipAddr->to_v6().to_bytes();
+        match_set_ipv6_dst(&entry->match, (struct in6_addr*)bytes.data());
+    }
+    return fe;
+}
+
 } // namespace flowutils
 } // namespace ovsagent
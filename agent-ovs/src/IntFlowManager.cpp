@@ -40,6 +40,7 @@
 #include "Packets.h"
 #include "Network.h"
 #include "FlowUtils.h"
+#include "FlowEntryArena.h"
 #include "FlowConstants.h"
 #include "FlowBuilder.h"
 
@@ -61,6 +62,7 @@ using boost::ref;
 using boost::optional;
 using boost::asio::deadline_timer;
 using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
 using boost::asio::ip::address_v6;
 using boost::asio::placeholders::error;
 using std::chrono::milliseconds;
@@ -78,7 +80,8 @@ namespace ovsagent {
 
 static const char* ID_NAMESPACES[] =
     {"floodDomain", "bridgeDomain", "routingDomain",
-     "externalNetwork", "l24classifierRule", "service"};
+     "externalNetwork", "l24classifierRule", "service",
+     "contractConjunction"};
 
 static const char* ID_NMSPC_FD            = ID_NAMESPACES[0];
 static const char* ID_NMSPC_BD            = ID_NAMESPACES[1];
@@ -86,6 +89,13 @@ static const char* ID_NMSPC_RD            = ID_NAMESPACES[2];
 static const char* ID_NMSPC_EXTNET        = ID_NAMESPACES[3];
 static const char* ID_NMSPC_L24CLASS_RULE = ID_NAMESPACES[4];
 static const char* ID_NMSPC_SERVICE       = ID_NAMESPACES[5];
+static const char* ID_NMSPC_CONJ          = ID_NAMESPACES[6];
+
+/* Task queue lanes.  Endpoints are rendered ahead of a backlog of
+   policy changes, and both ahead of services. */
+static const string ENDPOINT_LANE("endpoint");
+static const string POLICY_LANE("policy");
+static const string SERVICE_LANE("service");
 
 IntFlowManager::IntFlowManager(Agent& agent_,
                                SwitchManager& switchManager_,
@@ -98,14 +108,20 @@ IntFlowManager::IntFlowManager(Agent& agent_,
     floodScope(FLOOD_DOMAIN), tunnelPortStr("4789"),
     virtualRouterEnabled(false), routerAdv(false),
     virtualDHCPEnabled(false), conntrackEnabled(false),
+    contractConjEnabled(false),
     advertManager(agent, *this), isSyncing(false), stopping(false) {
     // set up flow tables
     switchManager.setMaxFlowTables(NUM_FLOW_TABLES);
 
     memset(routerMac, 0, sizeof(routerMac));
     memset(dhcpMac, 0, sizeof(dhcpMac));
+    memset(&renderStats, 0, sizeof(renderStats));
     tunnelDst = address::from_string("127.0.0.1");
 
+    taskQueue.addLane(ENDPOINT_LANE, 4);
+    taskQueue.addLane(POLICY_LANE, 2);
+    taskQueue.addLane(SERVICE_LANE, 1);
+
     agent.getFramework().registerPeerStatusListener(this);
 }
 
@@ -220,6 +236,10 @@ void IntFlowManager::enableConnTrack() {
     conntrackEnabled = true;
 }
 
+void IntFlowManager::enableContractConjunctions() {
+    contractConjEnabled = true;
+}
+
 address IntFlowManager::getEPGTunnelDst(const URI& epgURI) {
     if (encapType != IntFlowManager::ENCAP_VXLAN &&
         encapType != IntFlowManager::ENCAP_IVXLAN)
@@ -245,7 +265,8 @@ void IntFlowManager::endpointUpdated(const std::string& uuid) {
 
     advertManager.scheduleEndpointAdv(uuid);
     taskQueue.dispatch(uuid,
-                       bind(&IntFlowManager::handleEndpointUpdate, this, uuid));
+                       bind(&IntFlowManager::handleEndpointUpdate, this, uuid),
+                       ENDPOINT_LANE);
 }
 
 void IntFlowManager::serviceUpdated(const std::string& uuid) {
@@ -254,7 +275,8 @@ void IntFlowManager::serviceUpdated(const std::string& uuid) {
     advertManager.scheduleServiceAdv(uuid);
     taskQueue.dispatch(uuid,
                        bind(&IntFlowManager::handleServiceUpdate,
-                            this, uuid));
+                            this, uuid),
+                       SERVICE_LANE);
 }
 
 void IntFlowManager::rdConfigUpdated(const opflex::modb::URI& rdURI) {
@@ -266,7 +288,8 @@ void IntFlowManager::egDomainUpdated(const opflex::modb::URI& egURI) {
 
     taskQueue.dispatch(egURI.toString(),
                        bind(&IntFlowManager::handleEndpointGroupDomainUpdate,
-                            this, egURI));
+                            this, egURI),
+                       POLICY_LANE);
 }
 
 void IntFlowManager::domainUpdated(class_id_t cid, const URI& domURI) {
@@ -274,14 +297,16 @@ void IntFlowManager::domainUpdated(class_id_t cid, const URI& domURI) {
 
     taskQueue.dispatch(domURI.toString(),
                        bind(&IntFlowManager::handleDomainUpdate,
-                            this, cid, domURI));
+                            this, cid, domURI),
+                       POLICY_LANE);
 }
 
 void IntFlowManager::contractUpdated(const opflex::modb::URI& contractURI) {
     if (stopping) return;
     taskQueue.dispatch(contractURI.toString(),
                        bind(&IntFlowManager::handleContractUpdate,
-                            this, contractURI));
+                            this, contractURI),
+                       POLICY_LANE);
 }
 
 void IntFlowManager::configUpdated(const opflex::modb::URI& configURI) {
@@ -350,6 +375,59 @@ bool IntFlowManager::getGroupForwardingInfo(const URI& epgURI, uint32_t& vnid,
     return true;
 }
 
+string IntFlowManager::getGroupFingerprint(const URI& epgURI) {
+    ostringstream ss;
+    PolicyManager& polMgr = agent.getPolicyManager();
+    uint32_t epgVnid, rdId, bdId, fgrpId;
+    optional<URI> fgrpURI, bdURI, rdURI;
+    if (getGroupForwardingInfo(epgURI, epgVnid, rdURI, rdId,
+                               bdURI, bdId, fgrpURI, fgrpId)) {
+        ss << epgVnid << " " << rdId << " " << bdId << " " << fgrpId;
+        if (fgrpURI)
+            ss << " " << fgrpURI.get();
+        optional<shared_ptr<FloodDomain> > fd = polMgr.getFDForGroup(epgURI);
+        if (fd) {
+            FloodDomain& f = *fd.get();
+            ss << " fd "
+               << (int)f.getArpMode(AddressResModeEnumT::CONST_UNICAST)
+               << " "
+               << (int)f.getNeighborDiscMode(AddressResModeEnumT::
+                                             CONST_UNICAST)
+               << " "
+               << (int)f.getUnknownFloodMode(UnknownFloodModeEnumT::
+                                             CONST_DROP)
+               << " "
+               << (int)f.getBcastFloodMode(BcastFloodModeEnumT::
+                                           CONST_NORMAL);
+        }
+        ss << " " << (int)polMgr.getEffectiveRoutingMode(epgURI);
+    }
+    ss << " tun " << getTunnelPort() << " " << encapType;
+    return ss.str();
+}
+
+string IntFlowManager::getGroupVnidFingerprint(const URI& uri) {
+    unordered_set<URI> uris;
+    unordered_set<uint32_t> ids;
+    uris.insert(uri);
+    getGroupVnid(uris, ids);
+    ostringstream ss;
+    for (uint32_t id : ids)
+        ss << id;
+    return ss.str();
+}
+
+IntFlowManager::RenderStats IntFlowManager::getRenderStats() {
+    std::lock_guard<std::mutex> guard(renderStatsMutex);
+    return renderStats;
+}
+
+void IntFlowManager::countRerender(uint64_t editsBefore) {
+    if (switchManager.getEditCount() != editsBefore) return;
+    std::lock_guard<std::mutex> guard(renderStatsMutex);
+    renderStats.noopRerenders += 1;
+}
+
 // Match helper functions
 static FlowBuilder& matchEpg(FlowBuilder& fb,
                              IntFlowManager::EncapType encapType,
@@ -951,7 +1029,64 @@ static void matchActionServiceProto(FlowBuilder& flow, uint8_t proto,
     }
 }
 
+const IntFlowManager::EndpointTemplates&
+IntFlowManager::getEndpointTemplates(const URI& epgURI,
+                                     const string& fingerprint,
+                                     uint32_t epgVnid, uint32_t rdId,
+                                     uint32_t bdId) {
+    EndpointTemplates& t = endpointTemplates[epgURI];
+    if (t.bridgeDst && t.fingerprint == fingerprint)
+        return t;
+
+    // The port, MAC and IP address placeholders are replaced by
+    // flowutils::copy_endpoint_flow()
+    static const uint8_t NO_MAC[6] = {0, 0, 0, 0, 0, 0};
+    t.fingerprint = fingerprint;
+    // The templates outlive the render, so they are kept out of its
+    // arena
+    t.bridgeDst = FlowEntryArena::promote
+        (FlowBuilder().priority(10).ethDst(NO_MAC).reg(4, bdId)
+         .action()
+         .reg(MFF_REG2, epgVnid)
+         .reg(MFF_REG7, 0)
+         .go(POL_TABLE_ID)
+         .parent().build());
+
+    address ips[] = {address_v4::any(), address_v6::any()};
+    for (const address& ipAddr : ips) {
+        FlowBuilder e0;
+        matchDestDom(e0, 0, rdId);
+        e0.priority(500)
+            .ethDst(getRouterMacAddr())
+            .ipDst(ipAddr)
+            .action()
+            .reg(MFF_REG2, epgVnid)
+            .reg(MFF_REG7, 0)
+            .ethSrc(getRouterMacAddr())
+            .ethDst(NO_MAC)
+            .decTtl()
+            .metadata(flow::meta::ROUTED, flow::meta::ROUTED)
+            .go(POL_TABLE_ID);
+        (ipAddr.is_v4() ? t.routeDstV4 : t.routeDstV6) =
+            FlowEntryArena::promote(e0.build());
+    }
+
+    std::lock_guard<std::mutex> guard(renderStatsMutex);
+    renderStats.templateBuilds += 1;
+    return t;
+}
+
 void IntFlowManager::handleEndpointUpdate(const string& uuid) {
+    bool rerender = endpointRerenders.erase(uuid) > 0;
+    uint64_t edits = switchManager.getEditCount();
+    FlowEntryArena arena;
+    FlowEntryArena::Scope scope(arena);
+    renderEndpoint(uuid);
+    if (rerender)
+        countRerender(edits);
+}
+
+void IntFlowManager::renderEndpoint(const string& uuid) {
 
     LOG(DEBUG) << "Updating endpoint " << uuid;
 
@@ -967,6 +1102,7 @@ void IntFlowManager::handleEndpointUpdate(const string& uuid) {
         switchManager.clearFlows(uuid, SERVICE_DST_TABLE_ID);
         switchManager.clearFlows(uuid, OUT_TABLE_ID);
         removeEndpointFromFloodGroup(uuid);
+        endpointDeps.removeObject(uuid);
         return;
     }
     const Endpoint& endPoint = *epWrapper.get();
@@ -1010,6 +1146,25 @@ void IntFlowManager::handleEndpointUpdate(const string& uuid) {
     FlowEntryList elOutput;
 
     optional<URI> epgURI = epMgr.getComputedEPG(uuid);
+
+    // Record the groups before reading them for the flows, so that a
+    // group that changes from here on renders the endpoint again
+    string epgFingerprint;
+    {
+        DependencyGraph::input_map_t inputs;
+        if (epgURI) {
+            epgFingerprint = getGroupFingerprint(epgURI.get());
+            inputs[epgURI.get().toString()] = epgFingerprint;
+        }
+        for (const Endpoint::IPAddressMapping& ipm :
+                 endPoint.getIPAddressMappings()) {
+            if (ipm.getEgURI())
+                inputs[ipm.getEgURI().get().toString()] =
+                    getGroupFingerprint(ipm.getEgURI().get());
+        }
+        endpointDeps.setInputs(uuid, inputs);
+    }
+
     bool hasForwardingInfo = false;
     uint32_t epgVnid, rdId, bdId, fgrpId;
     optional<URI> fgrpURI, bdURI, rdURI;
@@ -1057,13 +1212,15 @@ void IntFlowManager::handleEndpointUpdate(const string& uuid) {
                             epgVnid, bdId, fgrpId, rdId);
 
         /* Bridge, route, and output flows */
+        const EndpointTemplates& templates =
+            getEndpointTemplates(epgURI.get(), epgFingerprint,
+                                 epgVnid, rdId, bdId);
+        size_t templateFlows = 0;
         if (bdId != 0 && hasMac && ofPort != OFPP_NONE) {
-            FlowBuilder().priority(10).ethDst(macAddr).reg(4, bdId)
-                .action()
-                .reg(MFF_REG2, epgVnid)
-                .reg(MFF_REG7, ofPort)
-                .go(POL_TABLE_ID)
-                .parent().build(elBridgeDst);
+            elBridgeDst.push_back(flowutils::
+                                  copy_endpoint_flow(*templates.bridgeDst,
+                                                     ofPort, macAddr, NULL));
+            templateFlows += 1;
         }
 
         if (rdId != 0 && bdId != 0 && ofPort != OFPP_NONE) {
@@ -1110,22 +1267,12 @@ void IntFlowManager::handleEndpointUpdate(const string& uuid) {
                     if (network::is_link_local(ipAddr))
                         continue;
 
-                    {
-                        FlowBuilder e0;
-                        matchDestDom(e0, 0, rdId);
-                        e0.priority(500)
-                            .ethDst(getRouterMacAddr())
-                            .ipDst(ipAddr)
-                            .action()
-                            .reg(MFF_REG2, epgVnid)
-                            .reg(MFF_REG7, ofPort)
-                            .ethSrc(getRouterMacAddr())
-                            .ethDst(macAddr)
-                            .decTtl()
-                            .metadata(flow::meta::ROUTED, flow::meta::ROUTED)
-                            .go(POL_TABLE_ID)
-                            .parent().build(elRouteDst);
-                    }
+                    elRouteDst.push_back(flowutils::copy_endpoint_flow
+                                         (ipAddr.is_v4()
+                                          ? *templates.routeDstV4
+                                          : *templates.routeDstV6,
+                                          ofPort, macAddr, &ipAddr));
+                    templateFlows += 1;
 
                 }
 
@@ -1216,6 +1363,11 @@ void IntFlowManager::handleEndpointUpdate(const string& uuid) {
             }
         }
 
+        if (templateFlows > 0) {
+            std::lock_guard<std::mutex> guard(renderStatsMutex);
+            renderStats.templateFlows += templateFlows;
+        }
+
         if (ofPort != OFPP_NONE) {
             // If a packet has a routing action applied, we'll allow it to
             // hairpin for ordinary default output action or reverse NAT
@@ -1815,6 +1967,7 @@ void IntFlowManager::handleEndpointGroupDomainUpdate(const URI& epgURI) {
         switchManager.clearFlows(epgId, OUT_TABLE_ID);
         switchManager.clearFlows(epgId, BRIDGE_TABLE_ID);
         updateMulticastList(boost::none, epgURI);
+        endpointTemplates.erase(epgURI);
         return;
     }
 
@@ -1983,17 +2136,45 @@ void IntFlowManager::handleEndpointGroupDomainUpdate(const URI& epgURI) {
         rdConfigUpdated(rdURI);
     }
 
-    // note this combines with the IPM group endpoints from above:
+    // Render again only the endpoints and contracts that read
+    // different attributes of the group, and those not rendered yet,
+    // but advertise all the endpoints of the group again.
+    // Note this combines with the IPM group endpoints from above:
     epMgr.getEndpointsForGroup(epgURI, epUuids);
+    unordered_set<string> rerenderEps;
+    size_t skipped = endpointDeps.getChanged(epgId,
+                                             getGroupFingerprint(epgURI),
+                                             rerenderEps);
     for (const string& uuid : epUuids) {
         advertManager.scheduleEndpointAdv(uuid);
+        if (!endpointDeps.hasObject(uuid))
+            rerenderEps.insert(uuid);
+    }
+    for (const string& uuid : rerenderEps) {
+        endpointRerenders.insert(uuid);
         endpointUpdated(uuid);
     }
 
     PolicyManager::uri_set_t contractURIs;
     polMgr.getContractsForGroup(epgURI, contractURIs);
+    unordered_set<string> changedContracts;
+    skipped += contractDeps.getChanged(epgId,
+                                       getGroupVnidFingerprint(epgURI),
+                                       changedContracts);
+    size_t rerenders = rerenderEps.size();
     for (const URI& contract : contractURIs) {
+        const string& contractId = contract.toString();
+        if (contractDeps.hasObject(contractId) &&
+            changedContracts.find(contractId) == changedContracts.end())
+            continue;
+        contractRerenders.insert(contract);
         contractUpdated(contract);
+        rerenders += 1;
+    }
+    {
+        std::lock_guard<std::mutex> guard(renderStatsMutex);
+        renderStats.rerenders += rerenders;
+        renderStats.skippedRerenders += skipped;
     }
 
     optional<string> epgMcastIp = polMgr.getMulticastIPForGroup(epgURI);
@@ -2282,13 +2463,19 @@ IntFlowManager::createGroupMod(uint16_t type, uint32_t groupId,
     entry->mod->command = type;
     entry->mod->group_id = groupId;
 
+    // Order the buckets so that the group is the same however the
+    // endpoints were added, and buckets inserted one at a time land
+    // where a full modification would put them
+    std::set<uint32_t> ports;
     for (const Ep2PortMap::value_type& kv : ep2port) {
         if (onlyPromiscuous && !kv.second.second)
             continue;
-
-        ofputil_bucket *bkt = createBucket(kv.second.first);
+        ports.insert(kv.second.first);
+    }
+    for (uint32_t port : ports) {
+        ofputil_bucket *bkt = createBucket(port);
         ActionBuilder ab;
-        ab.output(kv.second.first)
+        ab.output(port)
             .build(bkt);
         ovs_list_push_back(&entry->mod->buckets, &bkt->list_node);
     }
@@ -2309,6 +2496,96 @@ uint32_t IntFlowManager::getPromId(uint32_t fgrpId) {
     return ((1<<31) | fgrpId);
 }
 
+GroupEdit::Entry
+IntFlowManager::createInsertBucketMod(uint32_t groupId, uint32_t port,
+                                      uint32_t afterBucketId) {
+    GroupEdit::Entry entry(new GroupEdit::GroupMod());
+    entry->mod->command = OFPGC15_INSERT_BUCKET;
+    entry->mod->group_id = groupId;
+    entry->mod->command_bucket_id = afterBucketId;
+
+    ofputil_bucket *bkt = createBucket(port);
+    ActionBuilder ab;
+    ab.output(port)
+        .build(bkt);
+    ovs_list_push_back(&entry->mod->buckets, &bkt->list_node);
+    return entry;
+}
+
+GroupEdit::Entry
+IntFlowManager::createRemoveBucketMod(uint32_t groupId, uint32_t port) {
+    GroupEdit::Entry entry(new GroupEdit::GroupMod());
+    entry->mod->command = OFPGC15_REMOVE_BUCKET;
+    entry->mod->group_id = groupId;
+    entry->mod->command_bucket_id = port;
+    return entry;
+}
+
+bool IntFlowManager::useBucketCommands() {
+    SwitchConnection* conn = switchManager.getConnection();
+    return conn != NULL && conn->GetProtocolVersion() >= OFP15_VERSION;
+}
+
+void
+IntFlowManager::updateFloodBucket(uint32_t groupId, const Ep2PortMap& epMap,
+                                  const string& epUUID,
+                                  const optional<std::pair<uint32_t, bool> >&
+                                  oldPort,
+                                  const optional<std::pair<uint32_t, bool> >&
+                                  newPort,
+                                  bool prom) {
+    GroupEdit ge;
+    size_t groupMods = 0;
+    size_t bucketMods = 0;
+    if (!useBucketCommands()) {
+        ge.edits.push_back(createGroupMod(OFPGC11_MODIFY, groupId,
+                                          epMap, prom));
+        groupMods += 1;
+    } else {
+        optional<uint32_t> oldP, newP;
+        if (oldPort && (!prom || oldPort->second))
+            oldP = oldPort->first;
+        if (newPort && (!prom || newPort->second))
+            newP = newPort->first;
+        if (oldP == newP)
+            return;
+
+        // A port that another endpoint in the group uses keeps its
+        // bucket.  A new bucket goes after that of the closest lower
+        // port to keep the order of createGroupMod.
+        bool oldUsed = false;
+        bool newUsed = false;
+        uint32_t after = OFPG15_BUCKET_FIRST;
+        for (const Ep2PortMap::value_type& kv : epMap) {
+            if (kv.first == epUUID || (prom && !kv.second.second))
+                continue;
+            uint32_t port = kv.second.first;
+            if (oldP && port == oldP.get())
+                oldUsed = true;
+            if (newP) {
+                if (port == newP.get())
+                    newUsed = true;
+                else if (port < newP.get() &&
+                         (after == OFPG15_BUCKET_FIRST || port > after))
+                    after = port;
+            }
+        }
+        if (oldP && !oldUsed)
+            ge.edits.push_back(createRemoveBucketMod(groupId, oldP.get()));
+        if (newP && !newUsed)
+            ge.edits.push_back(createInsertBucketMod(groupId, newP.get(),
+                                                     after));
+        bucketMods = ge.edits.size();
+    }
+    {
+        std::lock_guard<std::mutex> guard(renderStatsMutex);
+        renderStats.floodGroupMods += groupMods;
+        renderStats.floodBucketMods += bucketMods;
+    }
+    for (const GroupEdit::Entry& e : ge.edits)
+        switchManager.writeGroupMod(e);
+}
+
 void
 IntFlowManager::updateEndpointFloodGroup(const opflex::modb::URI& fgrpURI,
                                       const Endpoint& endPoint, uint32_t epPort,
@@ -2339,12 +2616,14 @@ IntFlowManager::updateEndpointFloodGroup(const opflex::modb::URI& fgrpURI,
             removeEndpointFromFloodGroup(epUUID);
         }
         if (epItr == epMap.end() || epItr->second != epPair) {
+            optional<std::pair<uint32_t, bool> > oldPair;
+            if (epItr != epMap.end())
+                oldPair = epItr->second;
             epMap[epUUID] = epPair;
-            GroupEdit::Entry e = createGroupMod(OFPGC11_MODIFY, fgrpId, epMap);
-            switchManager.writeGroupMod(e);
-            GroupEdit::Entry e2 =
-                createGroupMod(OFPGC11_MODIFY, getPromId(fgrpId), epMap, true);
-            switchManager.writeGroupMod(e2);
+            updateFloodBucket(fgrpId, epMap, epUUID,
+                              oldPair, epPair, false);
+            updateFloodBucket(getPromId(fgrpId), epMap, epUUID,
+                              oldPair, epPair, true);
         }
     } else {
         /* Remove EP attachment to old floodgroup, if any */
@@ -2398,23 +2677,29 @@ void IntFlowManager::removeEndpointFromFloodGroup(const std::string& epUUID) {
          ++itr) {
         const URI& fgrpURI = itr->first;
         Ep2PortMap& epMap = itr->second;
-        if (epMap.erase(epUUID) == 0) {
+        Ep2PortMap::iterator epItr = epMap.find(epUUID);
+        if (epItr == epMap.end()) {
             continue;
         }
+        std::pair<uint32_t, bool> oldPair = epItr->second;
+        epMap.erase(epItr);
         uint32_t fgrpId = getId(FloodDomain::CLASS_ID, fgrpURI);
-        uint16_t type = epMap.empty() ?
-                OFPGC11_DELETE : OFPGC11_MODIFY;
+        if (!epMap.empty()) {
+            updateFloodBucket(fgrpId, epMap, epUUID,
+                              oldPair, boost::none, false);
+            updateFloodBucket(getPromId(fgrpId), epMap, epUUID,
+                              oldPair, boost::none, true);
+            break;
+        }
         GroupEdit::Entry e0 =
-                createGroupMod(type, fgrpId, epMap);
+                createGroupMod(OFPGC11_DELETE, fgrpId, epMap);
         GroupEdit::Entry e1 =
-                createGroupMod(type, getPromId(fgrpId), epMap, true);
-        if (epMap.empty()) {
-            string fgrpStrId = "fd:" + fgrpURI.toString();
-            switchManager.clearFlows(fgrpStrId, OUT_TABLE_ID);
-            switchManager.clearFlows(fgrpStrId, BRIDGE_TABLE_ID);
-            switchManager.clearFlows(fgrpStrId, LEARN_TABLE_ID);
-            floodGroupMap.erase(fgrpURI);
-        }
+                createGroupMod(OFPGC11_DELETE, getPromId(fgrpId), epMap, true);
+        string fgrpStrId = "fd:" + fgrpURI.toString();
+        switchManager.clearFlows(fgrpStrId, OUT_TABLE_ID);
+        switchManager.clearFlows(fgrpStrId, BRIDGE_TABLE_ID);
+        switchManager.clearFlows(fgrpStrId, LEARN_TABLE_ID);
+        floodGroupMap.erase(fgrpURI);
         switchManager.writeGroupMod(e0);
         switchManager.writeGroupMod(e1);
         break;
@@ -2468,12 +2753,28 @@ void IntFlowManager::addContractRules(FlowEntryList& entryList,
 
 void
 IntFlowManager::handleContractUpdate(const opflex::modb::URI& contractURI) {
+    bool rerender = contractRerenders.erase(contractURI) > 0;
+    uint64_t edits = switchManager.getEditCount();
+    FlowEntryArena arena;
+    FlowEntryArena::Scope scope(arena);
+    renderContract(contractURI);
+    if (rerender)
+        countRerender(edits);
+}
+
+void IntFlowManager::renderContract(const URI& contractURI) {
     LOG(DEBUG) << "Updating contract " << contractURI;
 
     const string& contractId = contractURI.toString();
     PolicyManager& polMgr = agent.getPolicyManager();
     if (!polMgr.contractExists(contractURI)) {  // Contract removed
+        ContractConj none;
+        updateContractConjunctions(contractURI, none);
+        contract_slice_map_t noSlices;
+        updateContractSlices(contractURI, PolicyManager::rule_list_t(),
+                             noSlices);
         switchManager.clearFlows(contractId, POL_TABLE_ID);
+        contractDeps.removeObject(contractId);
         return;
     }
     PolicyManager::uri_set_t provURIs;
@@ -2483,6 +2784,17 @@ IntFlowManager::handleContractUpdate(const opflex::modb::URI& contractURI) {
     polMgr.getContractConsumers(contractURI, consURIs);
     polMgr.getContractIntra(contractURI, intraURIs);
 
+    // Record the group VNIDs before reading them for the flows
+    {
+        DependencyGraph::input_map_t inputs;
+        for (const PolicyManager::uri_set_t* uris :
+                 {&provURIs, &consURIs, &intraURIs}) {
+            for (const URI& u : *uris)
+                inputs[u.toString()] = getGroupVnidFingerprint(u);
+        }
+        contractDeps.setInputs(contractId, inputs);
+    }
+
     typedef unordered_set<uint32_t> id_set_t;
     id_set_t provIds;
     id_set_t consIds;
@@ -2501,34 +2813,293 @@ IntFlowManager::handleContractUpdate(const opflex::modb::URI& contractURI) {
                << ", #rules=" << rules.size();
 
     FlowEntryList entryList;
+    contract_slice_map_t slices;
 
-    for (const uint32_t& pvnid : provIds) {
-        for (const uint32_t& cvnid : consIds) {
-            if (pvnid == cvnid)
-                continue;
-
-            /*
-             * Collapse bidirectional rules - if consumer 'cvnid' is
-             * also a provider and provider 'pvnid' is also a
-             * consumer, then add entry for cvnid to pvnid traffic
-             * only.
-             */
-            bool allowBidirectional =
-                provIds.find(cvnid) == provIds.end() ||
-                consIds.find(pvnid) == consIds.end();
+    if (contractConjEnabled) {
+        addContractConjunctions(entryList, contractURI,
+                                provIds, consIds, rules);
+    } else {
+        for (const uint32_t& pvnid : provIds) {
+            for (const uint32_t& cvnid : consIds) {
+                if (pvnid == cvnid)
+                    continue;
 
-            addContractRules(entryList, pvnid, cvnid,
-                             allowBidirectional,
-                             rules);
+                /*
+                 * Collapse bidirectional rules - if consumer 'cvnid' is
+                 * also a provider and provider 'pvnid' is also a
+                 * consumer, then add entry for cvnid to pvnid traffic
+                 * only.
+                 */
+                bool allowBidirectional =
+                    provIds.find(cvnid) == provIds.end() ||
+                    consIds.find(pvnid) == consIds.end();
+
+                slices[contract_slice_key_t(pvnid, cvnid)] =
+                    allowBidirectional;
+            }
         }
     }
     for (const uint32_t& ivnid : intraIds) {
-        addContractRules(entryList, ivnid, ivnid, false, rules);
+        slices[contract_slice_key_t(ivnid, ivnid)] = false;
     }
 
+    updateContractSlices(contractURI, rules, slices);
     switchManager.writeFlow(contractId, POL_TABLE_ID, entryList);
 }
 
+static string getContractSliceId(const URI& contractURI,
+                                 uint32_t pvnid, uint32_t cvnid) {
+    ostringstream ss;
+    ss << contractURI.toString() << " " << pvnid << " " << cvnid;
+    return ss.str();
+}
+
+static bool sameRules(const PolicyManager::rule_list_t& lhs,
+                      const PolicyManager::rule_list_t& rhs) {
+    if (lhs.size() != rhs.size())
+        return false;
+    auto rit = rhs.begin();
+    for (const shared_ptr<PolicyRule>& rule : lhs) {
+        // PolicyRule equality ignores the priority, which the flows
+        // depend on
+        if (*rule != **rit || rule->getPriority() != (*rit)->getPriority())
+            return false;
+        ++rit;
+    }
+    return true;
+}
+
+void IntFlowManager::
+updateContractSlices(const URI& contractURI,
+                     const PolicyManager::rule_list_t& rules,
+                     contract_slice_map_t& slices) {
+    ContractRender& last = contractRenders[contractURI];
+    bool rulesChanged = !sameRules(last.rules, rules);
+
+    for (const contract_slice_map_t::value_type& kv : slices) {
+        if (!rulesChanged) {
+            auto it = last.slices.find(kv.first);
+            if (it != last.slices.end() && it->second == kv.second)
+                continue;
+        }
+        FlowEntryList entryList;
+        addContractRules(entryList, kv.first.first, kv.first.second,
+                         kv.second, rules);
+        switchManager.writeFlow(getContractSliceId(contractURI,
+                                                   kv.first.first,
+                                                   kv.first.second),
+                                POL_TABLE_ID, entryList);
+    }
+    for (const contract_slice_map_t::value_type& kv : last.slices) {
+        if (slices.find(kv.first) == slices.end())
+            switchManager.clearFlows(getContractSliceId(contractURI,
+                                                        kv.first.first,
+                                                        kv.first.second),
+                                     POL_TABLE_ID);
+    }
+
+    if (slices.empty()) {
+        contractRenders.erase(contractURI);
+    } else {
+        last.rules = rules;
+        last.slices = std::move(slices);
+    }
+}
+
+/* Conjunctions of contract rules match the source group, the
+   destination group and the classifier, in that order */
+static const uint8_t CONJ_SRC = 1;
+static const uint8_t CONJ_DST = 2;
+static const uint8_t CONJ_CLASSIFIER = 3;
+static const uint8_t CONJ_CLAUSES = 3;
+
+static string getConjIdKey(const URI& contractURI, const URI& classifierURI,
+                           uint16_t priority, bool in) {
+    ostringstream ss;
+    ss << contractURI.toString() << " " << classifierURI.toString()
+       << " " << priority << (in ? " in" : " out");
+    return ss.str();
+}
+
+uint32_t IntFlowManager::getContractConjId(const URI& contractURI,
+                                           const URI& classifierURI,
+                                           uint16_t priority, bool in) {
+    return idGen.getId(ID_NMSPC_CONJ,
+                       getConjIdKey(contractURI, classifierURI,
+                                    priority, in));
+}
+
+void IntFlowManager::
+addContractConjunctions(FlowEntryList& entryList,
+                        const URI& contractURI,
+                        const unordered_set<uint32_t>& provIds,
+                        const unordered_set<uint32_t>& consIds,
+                        const PolicyManager::rule_list_t& rules) {
+    ContractConj conj;
+
+    /*
+     * Unlike the pairwise rendering, a group that both provides and
+     * consumes the contract matches the conjunctions for traffic to
+     * itself.  The intra-group policy flows have a higher priority
+     * than any rule, so this only matters for groups that require a
+     * contract for intra-group traffic.
+     */
+    if (!provIds.empty() && !consIds.empty()) {
+        for (const shared_ptr<PolicyRule>& pc : rules) {
+            uint8_t dir = pc->getDirection();
+            const shared_ptr<L24Classifier>& cls = pc->getL24Classifier();
+            const URI& clsURI = cls->getURI();
+            uint64_t cookie = getId(L24Classifier::CLASS_ID, clsURI);
+            uint16_t prio = pc->getPriority();
+
+            for (bool in : {true, false}) {
+                if (dir != DirectionEnumT::CONST_BIDIRECTIONAL &&
+                    dir != (in ? DirectionEnumT::CONST_IN
+                            : DirectionEnumT::CONST_OUT))
+                    continue;
+                const unordered_set<uint32_t>& srcIds =
+                    in ? consIds : provIds;
+                const unordered_set<uint32_t>& dstIds =
+                    in ? provIds : consIds;
+
+                string idKey = getConjIdKey(contractURI, clsURI, prio, in);
+                uint32_t conjId = idGen.getId(ID_NMSPC_CONJ, idKey);
+                conj.ids.insert(idKey);
+                for (uint32_t svnid : srcIds)
+                    conj.clauses[conj_clause_key_t(prio, CONJ_SRC, svnid)]
+                        .insert(conjId);
+                for (uint32_t dvnid : dstIds)
+                    conj.clauses[conj_clause_key_t(prio, CONJ_DST, dvnid)]
+                        .insert(conjId);
+                conj_clause_key_t clsKey(prio, CONJ_CLASSIFIER, cookie);
+                conj.clauses[clsKey].insert(conjId);
+                conjClassifiers[clsKey] = cls;
+
+                FlowBuilder f;
+                f.priority(prio)
+                    .cookie(ovs_htonll(cookie))
+                    .flags(OFPUTIL_FF_SEND_FLOW_REM)
+                    .conjId(conjId);
+                // The policy stats are counted by group pair, so
+                // match a side that has only one group to keep its
+                // counters attributable
+                if (srcIds.size() == 1)
+                    f.reg(0, *srcIds.begin());
+                if (dstIds.size() == 1)
+                    f.reg(2, *dstIds.begin());
+                if (pc->getAllow())
+                    f.action().go(IntFlowManager::OUT_TABLE_ID);
+                entryList.push_back(f.build());
+            }
+        }
+    }
+
+    updateContractConjunctions(contractURI, conj);
+}
+
+void IntFlowManager::updateContractConjunctions(const URI& contractURI,
+                                                ContractConj& conj) {
+    std::set<conj_clause_key_t> changed;
+    auto it = contractConjs.find(contractURI);
+    if (it != contractConjs.end()) {
+        for (const conj_clause_map_t::value_type& kv : it->second.clauses) {
+            std::set<uint32_t>& conjIds = conjClauses[kv.first];
+            for (uint32_t conjId : kv.second)
+                conjIds.erase(conjId);
+            changed.insert(kv.first);
+        }
+        for (const string& idKey : it->second.ids) {
+            if (conj.ids.find(idKey) == conj.ids.end())
+                idGen.erase(ID_NMSPC_CONJ, idKey);
+        }
+    }
+    for (const conj_clause_map_t::value_type& kv : conj.clauses) {
+        conjClauses[kv.first].insert(kv.second.begin(), kv.second.end());
+        changed.insert(kv.first);
+    }
+
+    // The classifier clauses of a priority are written together
+    std::set<uint16_t> classifierPrios;
+    for (const conj_clause_key_t& key : changed) {
+        if (std::get<1>(key) == CONJ_CLASSIFIER)
+            classifierPrios.insert(std::get<0>(key));
+        else
+            writeConjClause(key);
+    }
+    for (uint16_t prio : classifierPrios)
+        writeClassifierConjClauses(prio);
+
+    if (conj.ids.empty())
+        contractConjs.erase(contractURI);
+    else
+        contractConjs[contractURI] = std::move(conj);
+}
+
+void IntFlowManager::writeConjClause(const conj_clause_key_t& key) {
+    uint16_t prio;
+    uint8_t clause;
+    uint32_t id;
+    std::tie(prio, clause, id) = key;
+
+    ostringstream objId;
+    objId << "conj:" << prio << ":" << (int)clause << ":" << id;
+
+    conj_clause_map_t::const_iterator it = conjClauses.find(key);
+    if (it == conjClauses.end() || it->second.empty()) {
+        conjClauses.erase(key);
+        switchManager.clearFlows(objId.str(), POL_TABLE_ID);
+        return;
+    }
+
+    FlowBuilder f;
+    flowutils::match_group(f, prio,
+                           clause == CONJ_SRC ? id : 0,
+                           clause == CONJ_DST ? id : 0);
+    for (uint32_t conjId : it->second)
+        f.action().conjunction(conjId, clause, CONJ_CLAUSES);
+    FlowEntryList el;
+    el.push_back(f.build());
+    switchManager.writeFlow(objId.str(), POL_TABLE_ID, el);
+}
+
+void IntFlowManager::writeClassifierConjClauses(uint16_t prio) {
+    ostringstream objId;
+    objId << "conj:" << prio << ":" << (int)CONJ_CLASSIFIER;
+
+    // Different classifiers can have flows with the same match, which
+    // must share a single flow with the conjunctions of all of them
+    FlowEntryList el;
+    auto it = conjClauses.lower_bound(conj_clause_key_t(prio,
+                                                        CONJ_CLASSIFIER, 0));
+    while (it != conjClauses.end() && std::get<0>(it->first) == prio &&
+           std::get<1>(it->first) == CONJ_CLASSIFIER) {
+        if (it->second.empty()) {
+            conjClassifiers.erase(it->first);
+            it = conjClauses.erase(it);
+            continue;
+        }
+        auto cit = conjClassifiers.find(it->first);
+        if (cit != conjClassifiers.end()) {
+            flowutils::ConjList conjs;
+            for (uint32_t conjId : it->second) {
+                flowutils::Conjunction c =
+                    {conjId, CONJ_CLASSIFIER, CONJ_CLAUSES};
+                conjs.push_back(c);
+            }
+            flowutils::add_classifier_conj_entries(*cit->second, prio,
+                                                   conjs, el);
+        }
+        ++it;
+    }
+
+    if (el.empty()) {
+        switchManager.clearFlows(objId.str(), POL_TABLE_ID);
+        return;
+    }
+    flowutils::merge_conjunction_entries(el);
+    switchManager.writeFlow(objId.str(), POL_TABLE_ID, el);
+}
+
 void IntFlowManager::initPlatformConfig() {
 
     using namespace modelgbp::platform;
@@ -2658,6 +3229,12 @@ static bool serviceIdGarbageCb(ServiceManager& serviceManager,
     return (bool)serviceManager.getService(str);
 }
 
+static bool conjIdGarbageCb(PolicyManager& policyManager,
+                            const std::string& nmspc,
+                            const std::string& str) {
+    return policyManager.contractExists(URI(str.substr(0, str.find(' '))));
+}
+
 void IntFlowManager::cleanup() {
     for (size_t i = 0; i < sizeof(ID_NAMESPACE_CB)/sizeof(IdCb); i++) {
         string ns(ID_NAMESPACES[i]);
@@ -2673,6 +3250,12 @@ void IntFlowManager::cleanup() {
     agent.getAgentIOService()
         .dispatch(bind(&IdGenerator::collectGarbage, ref(idGen),
                        ID_NMSPC_SERVICE, sgcb));
+
+    IdGenerator::garbage_cb_t cgcb =
+        bind(conjIdGarbageCb, std::ref(agent.getPolicyManager()), _1, _2);
+    agent.getAgentIOService()
+        .dispatch(bind(&IdGenerator::collectGarbage, ref(idGen),
+                       ID_NMSPC_CONJ, cgcb));
 }
 
 const char * IntFlowManager::getIdNamespace(class_id_t cid) {
@@ -2773,8 +3356,9 @@ void IntFlowManager::writeMulticastGroups() {
 }
 
 std::vector<FlowEdit>
-IntFlowManager::reconcileFlows(std::vector<TableState> flowTables,
-                               std::vector<FlowEntryList>& recvFlows) {
+IntFlowManager::
+reconcileFlows(const std::vector<const TableState*>& flowTables,
+               std::vector<FlowEntryList>& recvFlows) {
     // special handling for learning table - reconcile using
     // PacketInHandler reactive reconciler
     FlowEntryList learnFlows;
@@ -2801,7 +3385,9 @@ void IntFlowManager::checkGroupEntry(GroupMap& recvGroups,
         recv = itr->second;
     }
     GroupEdit::Entry e0 = createGroupMod(comm, groupId, epMap, prom);
-    if (!GroupEdit::groupEq(e0, recv)) {
+    // Buckets are removed by ID once bucket commands are in use, so
+    // their IDs have to match too
+    if (!GroupEdit::groupEq(e0, recv, useBucketCommands())) {
         ge.edits.push_back(e0);
     }
     if (itr != recvGroups.end()) {
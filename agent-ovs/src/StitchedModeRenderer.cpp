@@ -47,7 +47,13 @@ StitchedModeRenderer::StitchedModeRenderer(Agent& agent_)
       tunnelEpManager(&agent_), tunnelRemotePort(0), uplinkVlan(0),
       virtualRouter(true), routerAdv(true),
       connTrack(true), ctZoneRangeStart(0), ctZoneRangeEnd(0),
-      started(false) {
+      contractConjunctions(false), classifierConjunctions(false),
+      secGroupBits(false), renderingThreads(1),
+      maxFlowModsInFlight(0), flowBatching(false),
+      flowBatchMaxFlowMods(0), flowBatchMaxDelayMs(0),
+      flowBundles(false), flowBundleMinFlowMods(0),
+      incrementalSync(false), encodingCache(false), objectCookies(false),
+      auxConnections(false), bucketCommands(false), started(false) {
 
 }
 
@@ -95,6 +101,13 @@ void StitchedModeRenderer::start() {
         intFlowManager.enableConnTrack();
         accessFlowManager.enableConnTrack();
     }
+    if (contractConjunctions)
+        intFlowManager.enableContractConjunctions();
+    if (classifierConjunctions)
+        accessFlowManager.enableClassifierConjunctions();
+    if (secGroupBits)
+        accessFlowManager.enableSecGroupBits();
+    accessFlowManager.setWorkerThreads(renderingThreads);
 
     intFlowManager.setEncapType(encapType);
     intFlowManager.setEncapIface(encapIface);
@@ -109,6 +122,30 @@ void StitchedModeRenderer::start() {
     intFlowManager.setMulticastGroupFile(mcastGroupFile);
     intFlowManager.setEndpointAdv(endpointAdvMode);
 
+    intFlowExecutor.SetMaxInFlight(maxFlowModsInFlight);
+    accessFlowExecutor.SetMaxInFlight(maxFlowModsInFlight);
+    intFlowExecutor.EnableBundles(flowBundles, flowBundleMinFlowMods);
+    accessFlowExecutor.EnableBundles(flowBundles, flowBundleMinFlowMods);
+    intFlowExecutor.EnableEncodingCache(encodingCache);
+    accessFlowExecutor.EnableEncodingCache(encodingCache);
+    if (flowBatching) {
+        intSwitchManager.setFlowBatching(flowBatchMaxFlowMods,
+                                         flowBatchMaxDelayMs);
+        accessSwitchManager.setFlowBatching(flowBatchMaxFlowMods,
+                                            flowBatchMaxDelayMs);
+    }
+
+    intSwitchManager.setIncrementalSync(incrementalSync);
+    accessSwitchManager.setIncrementalSync(incrementalSync);
+    intSwitchManager.setAuxConnections(auxConnections);
+    accessSwitchManager.setAuxConnections(auxConnections);
+    // Only the integration bridge has flood groups
+    intSwitchManager.setBucketCommands(bucketCommands);
+    if (objectCookies) {
+        intSwitchManager.enableObjectCookies(idGen, "intFlowCookie");
+        accessSwitchManager.enableObjectCookies(idGen, "accessFlowCookie");
+    }
+
     intSwitchManager.registerStateHandler(&intFlowManager);
     intSwitchManager.start(intBridgeName);
     if (accessBridgeName != "") {
@@ -121,9 +158,10 @@ void StitchedModeRenderer::start() {
         accessFlowManager.start();
     }
 
-    pktInHandler.registerConnection(intSwitchManager.getConnection(),
+    pktInHandler.registerConnection(intSwitchManager.getPacketInConnection(),
                                     (accessBridgeName != "")
-                                    ? accessSwitchManager.getConnection()
+                                    ? accessSwitchManager
+                                      .getPacketInConnection()
                                     : NULL);
     pktInHandler.setPortMapper(&intSwitchManager.getPortMapper(),
                                (accessBridgeName != "")
@@ -138,18 +176,19 @@ void StitchedModeRenderer::start() {
         to_string(basic_random_generator<std::mt19937>(urng)());
 
     interfaceStatsManager.
-        registerConnection(intSwitchManager.getConnection(),
+        registerConnection(intSwitchManager.getStatsConnection(),
                            (accessBridgeName != "")
-                           ? accessSwitchManager.getConnection()
+                           ? accessSwitchManager.getStatsConnection()
                            : NULL);
     interfaceStatsManager.start();
     contractStatsManager.setAgentUUID(agentUUID);
-    contractStatsManager.registerConnection(intSwitchManager.getConnection());
+    contractStatsManager
+        .registerConnection(intSwitchManager.getStatsConnection());
     contractStatsManager.start();
     if (accessBridgeName != "") {
         secGrpStatsManager.setAgentUUID(agentUUID);
         secGrpStatsManager.
-            registerConnection(accessSwitchManager.getConnection());
+            registerConnection(accessSwitchManager.getStatsConnection());
         secGrpStatsManager.start();
     }
 
@@ -192,6 +231,43 @@ void StitchedModeRenderer::stop() {
     }
 }
 
+void StitchedModeRenderer::reportSwitchStats(SwitchManager& switchManager) {
+    SwitchManager::FlowBatchStats stats = switchManager.getFlowBatchStats();
+    LOG(INFO) << "[" << switchManager.getConnection()->getSwitchName() << "] "
+              << "Flow writes: batches=" << stats.batches
+              << " flow_mods=" << stats.flowMods
+              << " max_flow_mods=" << stats.maxFlowMods
+              << " failed_flow_mods=" << stats.failedFlowMods
+              << " max_flush_latency_us=" << stats.maxFlushLatencyUs
+              << " send_queue=" << stats.sendQueueDepth
+              << " max_send_queue=" << stats.maxSendQueueDepth;
+}
+
+void StitchedModeRenderer::reportTaskStats(const std::string& name,
+                                           TaskQueue& taskQueue) {
+    for (const auto& kv : taskQueue.getAllLaneStats()) {
+        const TaskQueue::LaneStats& stats = kv.second;
+        LOG(INFO) << "[" << name << "] "
+                  << "Task lane " << kv.first
+                  << ": depth=" << stats.depth
+                  << " tasks=" << stats.tasks
+                  << " coalesced=" << stats.coalesced
+                  << " max_wait_us=" << stats.maxWaitUs
+                  << " max_run_us=" << stats.maxRunUs;
+    }
+}
+
+void StitchedModeRenderer::reportStats() {
+    if (!started) return;
+
+    reportSwitchStats(intSwitchManager);
+    reportTaskStats(intBridgeName, intFlowManager.getTaskQueue());
+    if (accessBridgeName != "") {
+        reportSwitchStats(accessSwitchManager);
+        reportTaskStats(accessBridgeName, accessFlowManager.getTaskQueue());
+    }
+}
+
 Renderer* StitchedModeRenderer::create(Agent& agent) {
     return new StitchedModeRenderer(agent);
 }
@@ -235,6 +311,23 @@ void StitchedModeRenderer::setProperties(const ptree& properties) {
     static const std::string FLOWID_CACHE_DIR("flowid-cache-dir");
     static const std::string MCAST_GROUP_FILE("mcast-group-file");
 
+    static const std::string MAX_FLOW_MODS_IN_FLIGHT("flow-writes."
+                                                     "max-in-flight");
+    static const std::string FLOW_BATCH("flow-writes.batch.enabled");
+    static const std::string FLOW_BATCH_MAX_MODS("flow-writes.batch."
+                                                 "max-flow-mods");
+    static const std::string FLOW_BATCH_MAX_DELAY("flow-writes.batch."
+                                                  "max-delay");
+    static const std::string FLOW_BUNDLES("flow-writes.bundles.enabled");
+    static const std::string FLOW_BUNDLE_MIN_MODS("flow-writes.bundles."
+                                                  "min-flow-mods");
+    static const std::string INCREMENTAL_SYNC("flow-writes."
+                                              "incremental-sync");
+    static const std::string ENCODING_CACHE("flow-writes.encoding-cache");
+    static const std::string OBJECT_COOKIES("flow-writes.object-cookies");
+    static const std::string AUX_CONNECTIONS("flow-writes.aux-connections");
+    static const std::string BUCKET_COMMANDS("flow-writes.bucket-commands");
+
     static const std::string CONN_TRACK("forwarding.connection-tracking."
                                         "enabled");
     static const std::string CONN_TRACK_RANGE_START("forwarding."
@@ -243,6 +336,15 @@ void StitchedModeRenderer::setProperties(const ptree& properties) {
     static const std::string CONN_TRACK_RANGE_END("forwarding."
                                                   "connection-tracking."
                                                   "zone-range.end");
+    static const std::string CONTRACT_CONJ("forwarding.contract-conjunctions."
+                                           "enabled");
+    static const std::string CLASSIFIER_CONJ("forwarding."
+                                             "classifier-conjunctions."
+                                             "enabled");
+    static const std::string SEC_GROUP_BITS("forwarding.security-group-bits."
+                                            "enabled");
+    static const std::string RENDERING_THREADS("forwarding."
+                                               "rendering-threads");
 
     intBridgeName =
         properties.get<std::string>(OVS_BRIDGE_NAME, "br-int");
@@ -310,12 +412,30 @@ void StitchedModeRenderer::setProperties(const ptree& properties) {
     connTrack = properties.get<bool>(CONN_TRACK, true);
     ctZoneRangeStart = properties.get<uint16_t>(CONN_TRACK_RANGE_START, 1);
     ctZoneRangeEnd = properties.get<uint16_t>(CONN_TRACK_RANGE_END, 65534);
+    contractConjunctions = properties.get<bool>(CONTRACT_CONJ, false);
+    classifierConjunctions = properties.get<bool>(CLASSIFIER_CONJ, false);
+    secGroupBits = properties.get<bool>(SEC_GROUP_BITS, false);
+    renderingThreads = properties.get<size_t>(RENDERING_THREADS, 1);
 
     flowIdCache = properties.get<std::string>(FLOWID_CACHE_DIR,
                                               DEF_FLOWID_CACHEDIR);
 
     mcastGroupFile = properties.get<std::string>(MCAST_GROUP_FILE,
                                                  DEF_MCAST_GROUPFILE);
+
+    maxFlowModsInFlight =
+        properties.get<size_t>(MAX_FLOW_MODS_IN_FLIGHT, 4096);
+    flowBatching = properties.get<bool>(FLOW_BATCH, false);
+    flowBatchMaxFlowMods =
+        properties.get<size_t>(FLOW_BATCH_MAX_MODS, 1024);
+    flowBatchMaxDelayMs = properties.get<long>(FLOW_BATCH_MAX_DELAY, 5);
+    flowBundles = properties.get<bool>(FLOW_BUNDLES, false);
+    flowBundleMinFlowMods = properties.get<size_t>(FLOW_BUNDLE_MIN_MODS, 0);
+    incrementalSync = properties.get<bool>(INCREMENTAL_SYNC, false);
+    encodingCache = properties.get<bool>(ENCODING_CACHE, false);
+    objectCookies = properties.get<bool>(OBJECT_COOKIES, false);
+    auxConnections = properties.get<bool>(AUX_CONNECTIONS, false);
+    bucketCommands = properties.get<bool>(BUCKET_COMMANDS, false);
 }
 
 static bool connTrackIdGarbageCb(EndpointManager& endpointManager,
@@ -12,8 +12,7 @@
 #include <sys/eventfd.h>
 #include <string>
 #include <fstream>
-
-#include <boost/scope_exit.hpp>
+#include <algorithm>
 
 #include <unordered_map>
 
@@ -40,7 +39,9 @@ const std::chrono::seconds MAX_ECHO_INTERVAL(30);
 namespace ovsagent {
 
 SwitchConnection::SwitchConnection(const std::string& swName) :
-    switchName(swName), ofConn(NULL) {
+    switchName(swName), ofConn(NULL), minProtoVersion(OFP10_VERSION),
+    maxProtoVersion(-1), asyncMessages(-1), auxiliary(false),
+    sendQueueDepth(0), maxSendQueueDepth(0), writtenMsgs(0), ackedMsgs(0) {
     connThread = NULL;
     ofProtoVersion = OFP10_VERSION;
     isDisconnecting = false;
@@ -97,6 +98,7 @@ SwitchConnection::Connect(int protoVer) {
     }
 
     ofProtoVersion = protoVer;
+    minProtoVersion = protoVer;
     int err = doConnectOF();
     if (err != 0) {
         LOG(ERROR) << "Failed to connect to " << switchName << ": "
@@ -112,7 +114,10 @@ SwitchConnection::doConnectOF() {
     swPath.append("unix:").append(ovs_rundir()).append("/")
             .append(switchName).append(".mgmt");
 
-    uint32_t versionBitmap = 1u << ofProtoVersion;
+    // Reconnects offer the same versions as the first connection
+    uint32_t versionBitmap = 1u << minProtoVersion;
+    if (maxProtoVersion > minProtoVersion)
+        versionBitmap |= 1u << maxProtoVersion;
     vconn *newConn;
     int error;
     error = vconn_open_block(swPath.c_str(), versionBitmap, DSCP_DEFAULT,
@@ -123,18 +128,21 @@ SwitchConnection::doConnectOF() {
 
     /* Verify we have the correct protocol version */
     int connVersion = vconn_get_version(newConn);
-    if (connVersion != ofProtoVersion) {
+    if (!(versionBitmap & (1u << connVersion))) {
         LOG(WARNING) << "Remote supports version " << connVersion <<
-                ", wanted " << ofProtoVersion;
+                ", wanted " << minProtoVersion;
     }
     LOG(INFO) << "Connected to switch " << swPath
-            << " using protocol version " << ofProtoVersion;
+            << " using protocol version " << connVersion;
     {
         mutex_guard lock(connMtx);
         lastEchoTime = std::chrono::steady_clock::now();
         cleanupOFConn();
         ofConn = newConn;
         ofProtoVersion = connVersion;
+        // Nothing written before is answered on the new connection
+        pendingBarriers.clear();
+        ackedMsgs = writtenMsgs.load();
     }
     return 0;
 }
@@ -284,6 +292,8 @@ SwitchConnection::receiveOFMessage() {
         } else {
             ofptype type;
             if (!ofptype_decode(&type, (ofp_header *)recvMsg->data)) {
+                if (type == OFPTYPE_BARRIER_REPLY)
+                    handleBarrierReply(((ofp_header *)recvMsg->data)->xid);
                 HandlerMap::const_iterator itr = msgHandlers.find(type);
                 if (itr != msgHandlers.end()) {
                     for (MessageHandler *h : itr->second) {
@@ -299,40 +309,124 @@ SwitchConnection::receiveOFMessage() {
 
 int
 SwitchConnection::SendMessage(ofpbuf *msg) {
-    BOOST_SCOPE_EXIT((&msg)) {
-        if (msg) {
-            ofpbuf_delete(msg);
-        }
-    } BOOST_SCOPE_EXIT_END
-    while(true) {
-        mutex_guard lock(connMtx);
-        if (!IsConnectedLocked()) {
-            return ENOTCONN;
-        }
-        int err = vconn_send(ofConn, msg);
-        if (err == 0) {
-            msg = NULL;
-            return 0;
-        } else if (err != EAGAIN) {
-            LOG(ERROR) << "Error sending OF message: " << ovs_strerror(err);
-            return err;
-        } else {
-            vconn_run(ofConn);
-            vconn_send_wait(ofConn);
+    std::vector<ofpbuf*> msgs(1, msg);
+    return SwitchConnection::SendMessages(msgs);
+}
+
+int
+SwitchConnection::SendMessages(std::vector<ofpbuf*>& msgs) {
+    sendQueueDepth += msgs.size();
+    updateMaxSendQueueDepth();
+
+    int err = 0;
+    size_t sent = 0;
+    {
+        std::unique_lock<std::mutex> lock(connMtx);
+        while (sent < msgs.size()) {
+            if (!IsConnectedLocked()) {
+                err = ENOTCONN;
+                break;
+            }
+            // The message belongs to the connection once sent
+            const ofp_header* oh = (const ofp_header*)msgs[sent]->data;
+            ofptype type;
+            bool barrier = !ofptype_decode(&type, oh) &&
+                type == OFPTYPE_BARRIER_REQUEST;
+            uint32_t xid = oh->xid;
+            err = vconn_send(ofConn, msgs[sent]);
+            if (err == 0) {
+                msgs[sent++] = NULL;
+                uint64_t written = ++writtenMsgs;
+                sendQueueDepth -= 1;
+                if (barrier)
+                    pendingBarriers.push_back(std::make_pair(xid, written));
+            } else if (err != EAGAIN) {
+                LOG(ERROR) << "Error sending OF message: "
+                           << ovs_strerror(err);
+                break;
+            } else {
+                vconn_run(ofConn);
+                vconn_send_wait(ofConn);
+                // Let the monitor thread drain replies while the
+                // switch catches up, or both sides can stall
+                lock.unlock();
+                std::this_thread::yield();
+                lock.lock();
+                err = 0;
+            }
         }
     }
+    for (size_t i = sent; i < msgs.size(); ++i) {
+        ofpbuf_delete(msgs[i]);
+        sendQueueDepth -= 1;
+    }
+    msgs.clear();
+    return err;
+}
+
+void
+SwitchConnection::handleBarrierReply(uint32_t xid) {
+    // The switch answers barriers in order, so the earlier ones have
+    // been answered too
+    mutex_guard lock(connMtx);
+    auto it = std::find_if(pendingBarriers.begin(), pendingBarriers.end(),
+                           [xid](const std::pair<uint32_t, uint64_t>& b) {
+                               return b.first == xid;
+                           });
+    if (it == pendingBarriers.end())
+        return;
+    ackedMsgs = it->second;
+    pendingBarriers.erase(pendingBarriers.begin(), it + 1);
+}
+
+void
+SwitchConnection::updateMaxSendQueueDepth() {
+    size_t depth = GetSendQueueDepth();
+    size_t maxDepth = maxSendQueueDepth.load();
+    while (depth > maxDepth &&
+           !maxSendQueueDepth.compare_exchange_weak(maxDepth, depth));
+}
+
+size_t
+SwitchConnection::GetSendQueueDepth() {
+    // Read the acknowledged count first, so it does not pass the
+    // written count
+    uint64_t acked = ackedMsgs;
+    return sendQueueDepth + (writtenMsgs - acked);
+}
+
+size_t
+SwitchConnection::GetMaxSendQueueDepth() {
+    return maxSendQueueDepth;
+}
+
+void
+SwitchConnection::SetAsyncMessages(int messages) {
+    asyncMessages = messages;
+}
+
+void
+SwitchConnection::SetAuxiliary() {
+    auxiliary = true;
+}
+
+void
+SwitchConnection::SetMaxProtocolVersion(int protoVer) {
+    maxProtoVersion = protoVer;
 }
 
 void
 SwitchConnection::FireOnConnectListeners() {
     if (GetProtocolVersion() >= OFP12_VERSION) {
-        // Set controller role to MASTER
+        // Set controller role to MASTER, or EQUAL for an auxiliary
+        // connection so that it doesn't demote the main one
         ofpbuf *b0;
         ofp12_role_request *rr;
         b0 = ofpraw_alloc(OFPRAW_OFPT12_ROLE_REQUEST,
                           GetProtocolVersion(), sizeof *rr);
         rr = (ofp12_role_request*)ofpbuf_put_zeros(b0, sizeof *rr);
-        rr->role = htonl(OFPCR12_ROLE_MASTER);
+        rr->role = htonl(auxiliary ? OFPCR12_ROLE_EQUAL
+                                   : OFPCR12_ROLE_MASTER);
         SendMessage(b0);
     }
     {
@@ -356,6 +450,24 @@ SwitchConnection::FireOnConnectListeners() {
         pif->format = htonl(NXPIF_NXT_PACKET_IN);
         SendMessage(b2);
     }
+    if (asyncMessages >= 0) {
+        // Limit the asynchronous messages sent on this connection
+        ofp_version version = (ofp_version)GetProtocolVersion();
+        ofputil_async_cfg ac = ofputil_async_cfg_default(version);
+        static const std::pair<int, ofputil_async_msg_type> types[] = {
+            {ASYNC_PACKET_IN, OAM_PACKET_IN},
+            {ASYNC_PORT_STATUS, OAM_PORT_STATUS},
+            {ASYNC_FLOW_REMOVED, OAM_FLOW_REMOVED},
+        };
+        for (const auto& t : types) {
+            if (asyncMessages & t.first) continue;
+            ac.master[t.second] = 0;
+            ac.slave[t.second] = 0;
+        }
+        SendMessage(ofputil_encode_set_async_config(&ac,
+                                                    (1u << OAM_N_TYPES) - 1,
+                                                    version));
+    }
     notifyConnectListeners();
 }
 
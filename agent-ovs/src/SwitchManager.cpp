@@ -8,12 +8,18 @@
 
 #include "SwitchManager.h"
 #include "FlowBuilder.h"
+#include "FlowConstants.h"
 #include "logging.h"
 
 #include <boost/asio/placeholders.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "ovs-ofputil.h"
+#include "ovs-shim.h"
+
+#include <cstring>
+#include <random>
+#include <algorithm>
 
 namespace ovsagent {
 
@@ -26,25 +32,66 @@ using boost::asio::placeholders::error;
 
 const long DEFAULT_SYNC_DELAY_ON_CONNECT_MSEC = 5000;
 
+// Table outside the range used by any pipeline that holds the flow
+// marking the switch as synced by this switch manager
+static const uint8_t SYNC_MARKER_TABLE_ID = 253;
+
+// Errors reported by the flow executor are either OpenFlow errors
+// from the switch or errno values
+static const char* executeErrorStr(int err) {
+    if (ofperr_is_valid((ofperr)err))
+        return ofperr_to_string((ofperr)err);
+    return strerror(err);
+}
+
 SwitchManager::SwitchManager(Agent& agent_,
                              FlowExecutor& flowExecutor_,
                              FlowReader& flowReader_,
                              PortMapper& portMapper_)
-    : agent(agent_),
+    : incrementalSync(false), auxConnections(false), bucketCommands(false),
+      agent(agent_),
       flowExecutor(flowExecutor_),
       flowReader(flowReader_),
       portMapper(portMapper_), stateHandler(NULL),
       connectDelayMs(DEFAULT_SYNC_DELAY_ON_CONNECT_MSEC),
       stopping(false), syncEnabled(false), syncing(false),
-      syncInProgress(false), syncPending(false) {
-
+      syncInProgress(false), syncPending(false),
+      batchMaxFlowMods(0), batchMaxDelayMs(0), batchTimerArmed(false),
+      markerDone(false), markerFound(false),
+      markerWritten(false), changesLost(false), objCookieIds(NULL),
+      editCount(0) {
+    memset(&batchStats, 0, sizeof(batchStats));
+
+    std::random_device rd;
+    syncGeneration = ((uint64_t)rd() << 32) | rd();
 }
 
 void SwitchManager::start(const std::string& swName) {
     connection.reset(new SwitchConnection(swName));
+    if (bucketCommands)
+        connection->SetMaxProtocolVersion(OFP15_VERSION);
     portMapper.InstallListenersForConnection(connection.get());
     flowExecutor.InstallListenersForConnection(connection.get());
     flowReader.installListenersForConnection(connection.get());
+    if (incrementalSync) {
+        monitorConnection.reset(new SwitchConnection(swName));
+        // The monitor only needs the flow updates, and must not get
+        // a second copy of the packet-ins and flow removals
+        monitorConnection->SetAsyncMessages(0);
+        flowReader
+            .installMonitorListenersForConnection(monitorConnection.get());
+    }
+    if (auxConnections) {
+        connection->SetAsyncMessages(SwitchConnection::ASYNC_PORT_STATUS);
+        packetInConnection.reset(new SwitchConnection(swName));
+        packetInConnection->SetAuxiliary();
+        packetInConnection
+            ->SetAsyncMessages(SwitchConnection::ASYNC_PACKET_IN);
+        statsConnection.reset(new SwitchConnection(swName));
+        statsConnection->SetAuxiliary();
+        statsConnection
+            ->SetAsyncMessages(SwitchConnection::ASYNC_FLOW_REMOVED);
+    }
 
     // Start out in syncing mode to avoid writing to the flow tables;
     // we'll update cached state only.
@@ -52,8 +99,19 @@ void SwitchManager::start(const std::string& swName) {
 }
 
 void SwitchManager::connect() {
+    if (monitorConnection) {
+        // Flow monitoring is only available with OpenFlow 1.0.
+        // Subscribe before the first sync reads the tables, so that
+        // the sync is not followed by a needless full read.
+        monitorConnection->RegisterOnConnectListener(this);
+        monitorConnection->Connect(OFP10_VERSION);
+    }
     connection->RegisterOnConnectListener(this);
     connection->Connect(OFP13_VERSION);
+    if (packetInConnection)
+        packetInConnection->Connect(OFP13_VERSION);
+    if (statsConnection)
+        statsConnection->Connect(OFP13_VERSION);
 }
 
 void SwitchManager::stop() {
@@ -65,16 +123,35 @@ void SwitchManager::stop() {
         portMapper.UninstallListenersForConnection(connection.get());
         connection->UnregisterOnConnectListener(this);
     }
+    if (monitorConnection) {
+        flowReader
+            .uninstallMonitorListenersForConnection(monitorConnection.get());
+        monitorConnection->UnregisterOnConnectListener(this);
+    }
 
     if (connectTimer) {
         connectTimer->cancel();
     }
+
+    std::lock_guard<std::mutex> guard(batchMutex);
+    if (batchTimer) {
+        batchTimer->cancel();
+    }
 }
 
 void SwitchManager::setMaxFlowTables(int max) {
+    assert(max <= SYNC_MARKER_TABLE_ID);
     flowTables.resize(max);
+    tableMutexes.reset(new std::mutex[max]);
     recvFlows.resize(max);
     tableDone.resize(max);
+    syncTables.resize(max);
+    deferredEdits.resize(max);
+    recvCounts.resize(max);
+    countDone.resize(max);
+
+    std::lock_guard<std::mutex> guard(dirtyMutex);
+    dirtyTables.resize(max);
 }
 
 void SwitchManager::enableSync() {
@@ -111,15 +188,123 @@ void SwitchManager::setSyncDelayOnConnect(long delay) {
     connectDelayMs = delay;
 }
 
+void SwitchManager::setFlowBatching(size_t maxFlowMods, long maxDelayMs) {
+    std::lock_guard<std::mutex> guard(batchMutex);
+    if (batchMaxFlowMods > 0 && !batch.edits.empty())
+        sendFlowBatch();
+    batchMaxFlowMods = maxFlowMods;
+    batchMaxDelayMs = maxDelayMs;
+    if (batchMaxFlowMods > 0 && !batchTimer)
+        batchTimer.reset(new deadline_timer(agent.getAgentIOService()));
+}
+
+SwitchManager::FlowBatchStats SwitchManager::getFlowBatchStats() {
+    FlowBatchStats stats;
+    {
+        std::lock_guard<std::mutex> guard(batchStatsMutex);
+        stats = batchStats;
+    }
+    if (connection) {
+        stats.sendQueueDepth = connection->GetSendQueueDepth();
+        stats.maxSendQueueDepth = connection->GetMaxSendQueueDepth();
+    }
+    return stats;
+}
+
+void SwitchManager::setIncrementalSync(bool enabled) {
+    incrementalSync = enabled;
+}
+
+void SwitchManager::setAuxConnections(bool enabled) {
+    auxConnections = enabled;
+}
+
+void SwitchManager::setBucketCommands(bool enabled) {
+    bucketCommands = enabled;
+}
+
+void SwitchManager::enableObjectCookies(IdGenerator& idGen,
+                                        const std::string& nmspc) {
+    objCookieIds = &idGen;
+    objCookieNmspc = nmspc;
+    // The IDs occupy the object bits of the cookie
+    objCookieIds->initNamespace(objCookieNmspc, 1, 0x7fffffff);
+}
+
+uint64_t SwitchManager::getObjectCookie(const std::string& objId) {
+    if (!objCookieIds)
+        return 0;
+    uint32_t id = objCookieIds->getId(objCookieNmspc, objId);
+    if (id == 0 || id == static_cast<uint32_t>(-1))
+        return 0;
+    return ovs_htonll((uint64_t)id << 32);
+}
+
+void SwitchManager::releaseObjectCookie(const std::string& objId) {
+    if (!objCookieIds)
+        return;
+    for (size_t i = 0; i < flowTables.size(); ++i) {
+        std::lock_guard<std::mutex> guard(tableMutexes[i]);
+        if (flowTables[i].hasObject(objId))
+            return;
+    }
+    objCookieIds->erase(objCookieNmspc, objId);
+}
+
+std::vector<std::unique_lock<std::mutex> > SwitchManager::lockTables() {
+    std::vector<std::unique_lock<std::mutex> > locks;
+    for (size_t i = 0; i < flowTables.size(); ++i)
+        locks.emplace_back(tableMutexes[i]);
+    return locks;
+}
+
+size_t SwitchManager::coalesceDeletes(int tableId, uint64_t objCookie,
+                                      FlowEdit& diffs) {
+    if (objCookie == 0)
+        return 0;
+    auto inRange = [objCookie](const FlowEdit::Entry& e) {
+        return e.first == FlowEdit::DEL &&
+            (e.second->entry->cookie & flow::cookie::OBJECT_MASK) ==
+            objCookie;
+    };
+    size_t count = std::count_if(diffs.edits.begin(), diffs.edits.end(),
+                                 inRange);
+    if (count < 2)
+        return 0;
+
+    // The range is deleted first, so that flows of other objects
+    // that take the place of the deleted ones are added after it
+    FlowEntryPtr range(new FlowEntry());
+    range->entry->table_id = tableId;
+    range->entry->cookie = objCookie;
+    FlowEdit coalesced;
+    coalesced.edits.reserve(diffs.edits.size() - count + 1);
+    coalesced.add(FlowEdit::DEL_COOKIE, range);
+    for (const FlowEdit::Entry& e : diffs.edits) {
+        if (!inRange(e))
+            coalesced.edits.push_back(e);
+    }
+    diffs.edits.swap(coalesced.edits);
+    return count;
+}
+
 void SwitchManager::Connected(SwitchConnection *swConn) {
     if (stopping) return;
+    if (swConn == monitorConnection.get()) {
+        agent.getAgentIOService()
+            .dispatch(bind(&SwitchManager::handleMonitorConnection, this));
+        return;
+    }
     agent.getAgentIOService()
         .dispatch(bind(&SwitchManager::handleConnection, this, swConn));
 }
 
 void SwitchManager::handleConnection(SwitchConnection *sw) {
     flowReader.clear();
-    syncInProgress = false;
+    {
+        auto locks = lockTables();
+        syncInProgress = false;
+    }
     syncPending = false;
 
     if (syncEnabled) {
@@ -143,6 +328,60 @@ void SwitchManager::handleConnection(SwitchConnection *sw) {
     }
 }
 
+void SwitchManager::handleMonitorConnection() {
+    LOG(DEBUG) << "[" << connection->getSwitchName() << "] "
+               << "Subscribing to flow table changes";
+    {
+        // Nothing was monitored while the monitor was disconnected
+        std::lock_guard<std::mutex> guard(dirtyMutex);
+        changesLost = true;
+    }
+    flowReader.monitorFlows(bind(&SwitchManager::flowUpdated,
+                                 this, _1, _2));
+}
+
+void SwitchManager::flowUpdated(int event, const FlowEntryPtr& fe) {
+    if (stopping) return;
+    agent.getAgentIOService()
+        .dispatch(bind(&SwitchManager::handleFlowUpdate, this, event, fe));
+}
+
+void SwitchManager::handleFlowUpdate(int event, const FlowEntryPtr& fe) {
+    if (!fe) {
+        std::lock_guard<std::mutex> guard(dirtyMutex);
+        changesLost = true;
+        return;
+    }
+
+    uint8_t tableId = fe->entry->table_id;
+    if (tableId >= flowTables.size())
+        return;
+
+    // Our own writes are reported too, and are expected to match the
+    // table state.  A write that was overtaken by a later one only
+    // costs an unneeded read of the table.
+    FlowEntryPtr cur;
+    {
+        std::lock_guard<std::mutex> guard(tableMutexes[tableId]);
+        cur = flowTables[tableId].getEntry(fe);
+    }
+    bool expected = (event == NXFME_DELETED)
+        ? !cur : (cur && cur->actionEq(fe.get()));
+    if (!expected) {
+        LOG(DEBUG) << "[" << connection->getSwitchName() << "] "
+                   << "Unexpected change in table " << (int)tableId
+                   << ": " << *fe;
+        markTableDirty(tableId);
+    }
+}
+
+void SwitchManager::markTableDirty(int tableId) {
+    if (!incrementalSync) return;
+    std::lock_guard<std::mutex> guard(dirtyMutex);
+    if (tableId >= 0 && static_cast<size_t>(tableId) < dirtyTables.size())
+        dirtyTables[tableId] = true;
+}
+
 void SwitchManager::onConnectTimer(const boost::system::error_code& ec) {
     connectTimer.reset();
     if (stopping) return;
@@ -156,22 +395,72 @@ bool SwitchManager::writeFlow(const std::string& objId, int tableId,
 
     assert(tableId >= 0 &&
            static_cast<size_t>(tableId) < flowTables.size());
-    for (FlowEntryPtr& fe : el)
-        fe->entry->table_id = tableId;
+    uint64_t objCookie = getObjectCookie(objId);
+    for (FlowEntryPtr& fe : el) {
+        if (fe->entry->table_id != tableId) {
+            fe->entry->table_id = tableId;
+            fe->clearEncoding();
+        }
+    }
     TableState& tab = flowTables[tableId];
+    std::unique_lock<std::mutex> guard(tableMutexes[tableId]);
 
     FlowEdit diffs;
-    tab.apply(objId, el, diffs);
-    if (!syncing) {
+    tab.apply(objId, el, diffs, objCookie);
+    editCount += diffs.edits.size();
+    // The flows of the object are only deleted by cookie once none
+    // of them is left in the table
+    if (!syncing && !diffs.edits.empty() && !tab.hasObject(objId))
+        coalesceDeletes(tableId, objCookie, diffs);
+    if (syncing && syncInProgress && incrementalSync &&
+        !syncTables[tableId]) {
+        // This table is not being read back from the switch, so the
+        // edits are written once the sync completes
+        FlowEdit& held = deferredEdits[tableId];
+        held.edits.insert(held.edits.end(),
+                          diffs.edits.begin(), diffs.edits.end());
+    } else if (!syncing && !diffs.edits.empty() && batchMaxFlowMods > 0) {
+        // Leave the edits to be sent along with those of other
+        // objects
+        success = queueFlowEdits(objId, diffs, guard);
+    } else if (!syncing && !diffs.edits.empty()) {
         // If a sync is in progress, don't write to the flow tables
         // while we are reading and reconciling with the current
-        // flows.
-        if (!(success = flowExecutor.Execute(diffs))) {
-            LOG(ERROR) << "[" << connection->getSwitchName() << "] "
+        // flows.  Otherwise hand the edits to the switch without
+        // waiting for it, so that the caller can go on computing
+        // flows for other objects.  The table is released before
+        // sending, once the edits are sure to go out in order.  Room
+        // in the flow executor is waited for first, so that a full
+        // pipeline does not stall the other writers behind sendMutex.
+        flowExecutor.WaitForInFlight(diffs.edits.size());
+        std::unique_lock<std::mutex> sendGuard(sendMutex);
+        guard.unlock();
+        std::string swName = connection->getSwitchName();
+        FlowExecutor::CompletionCb cb =
+            [this, swName, objId, tableId, diffs]
+            (int status, const std::vector<int>& errors) {
+            if (status == 0) return;
+            markTableDirty(tableId);
+            LOG(ERROR) << "[" << swName << "] "
+                       << "Writing flows for " << objId << " failed: "
+                       << executeErrorStr(status);
+            for (size_t i = 0; i < errors.size(); ++i) {
+                if (errors[i] == 0) continue;
+                LOG(ERROR) << "[" << swName << "] "
+                           << "Flow mod rejected: " << diffs.edits[i]
+                           << ": " << executeErrorStr(errors[i]);
+            }
+        };
+        if (!(success = flowExecutor.ExecuteAsync(diffs, cb))) {
+            markTableDirty(tableId);
+            LOG(ERROR) << "[" << swName << "] "
                        << "Writing flows for " << objId << " failed";
-
         }
     }
+    if (guard.owns_lock())
+        guard.unlock();
+    if (el.empty())
+        releaseObjectCookie(objId);
     el.clear();
 
     return success;
@@ -195,31 +484,154 @@ bool SwitchManager::clearFlows(const std::string& objId, int tableId) {
     return writeFlow(objId, tableId, empty);
 }
 
+bool SwitchManager::queueFlowEdits(const std::string& objId,
+                                   const FlowEdit& diffs,
+                                   std::unique_lock<std::mutex>& tableGuard) {
+    std::lock_guard<std::mutex> guard(batchMutex);
+    tableGuard.unlock();
+    if (batch.edits.empty())
+        batchStart = std::chrono::steady_clock::now();
+    batch.edits.insert(batch.edits.end(),
+                       diffs.edits.begin(), diffs.edits.end());
+    batchObjIds.insert(batchObjIds.end(), diffs.edits.size(), objId);
+
+    if (batch.edits.size() >= batchMaxFlowMods)
+        return sendFlowBatch();
+
+    if (!batchTimerArmed) {
+        batchTimerArmed = true;
+        batchTimer->expires_from_now(milliseconds(batchMaxDelayMs));
+        batchTimer->async_wait(bind(&SwitchManager::onBatchTimer,
+                                    this, error));
+    }
+    return true;
+}
+
+void SwitchManager::onBatchTimer(const boost::system::error_code& ec) {
+    std::lock_guard<std::mutex> guard(batchMutex);
+    batchTimerArmed = false;
+    if (ec || stopping) return;
+    if (!batch.edits.empty())
+        sendFlowBatch();
+}
+
+void SwitchManager::flushFlowBatch() {
+    std::lock_guard<std::mutex> guard(batchMutex);
+    if (!batch.edits.empty())
+        sendFlowBatch();
+}
+
+bool SwitchManager::sendFlowBatch() {
+    // The batch is handed over while still holding batchMutex, so
+    // batches reach the switch in the order they were filled.  The
+    // completion callback must therefore not take batchMutex.
+    flowExecutor.WaitForInFlight(batch.edits.size());
+    std::lock_guard<std::mutex> sendGuard(sendMutex);
+    std::shared_ptr<FlowEdit> edits = std::make_shared<FlowEdit>();
+    std::shared_ptr<std::vector<std::string> > objIds =
+        std::make_shared<std::vector<std::string> >();
+    edits->edits.swap(batch.edits);
+    objIds->swap(batchObjIds);
+    std::chrono::steady_clock::time_point start = batchStart;
+
+    std::string swName = connection->getSwitchName();
+    size_t numMods = edits->edits.size();
+    LOG(DEBUG) << "[" << swName << "] "
+               << "Sending batch of " << numMods << " flow mods";
+    {
+        std::lock_guard<std::mutex> sguard(batchStatsMutex);
+        batchStats.batches += 1;
+        batchStats.flowMods += numMods;
+        if (numMods > batchStats.maxFlowMods)
+            batchStats.maxFlowMods = numMods;
+    }
+
+    FlowExecutor::CompletionCb cb =
+        [this, swName, edits, objIds, start]
+        (int status, const std::vector<int>& errors) {
+        uint64_t latency =
+            std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::steady_clock::now() - start).count();
+        uint64_t failed = 0;
+        for (size_t i = 0; i < errors.size(); ++i) {
+            if (errors[i] == 0) continue;
+            failed += 1;
+            markTableDirty(edits->edits[i].second->entry->table_id);
+            LOG(ERROR) << "[" << swName << "] "
+                       << "Writing flows for " << (*objIds)[i]
+                       << " failed: flow mod rejected: "
+                       << edits->edits[i]
+                       << ": " << executeErrorStr(errors[i]);
+        }
+        if (status != 0 && failed == 0) {
+            for (const FlowEdit::Entry& e : edits->edits)
+                markTableDirty(e.second->entry->table_id);
+            LOG(ERROR) << "[" << swName << "] "
+                       << "Writing batch of " << edits->edits.size()
+                       << " flow mods failed: " << executeErrorStr(status);
+        }
+
+        std::lock_guard<std::mutex> sguard(batchStatsMutex);
+        batchStats.failedFlowMods += failed;
+        batchStats.totalFlushLatencyUs += latency;
+        if (latency > batchStats.maxFlushLatencyUs)
+            batchStats.maxFlushLatencyUs = latency;
+    };
+    bool success = flowExecutor.ExecuteAsync(*edits, cb);
+    if (!success) {
+        for (const FlowEdit::Entry& e : edits->edits)
+            markTableDirty(e.second->entry->table_id);
+        LOG(ERROR) << "[" << swName << "] "
+                   << "Writing batch of " << numMods << " flow mods failed";
+    }
+    return success;
+}
+
 bool SwitchManager::writeGroupMod(const GroupEdit::Entry& e) {
+    editCount += 1;
+
     // If a sync is in progress, don't write to the group table while
     // we are reading and reconciling with the current groups.
     if (syncing) {
         return true;
     }
 
+    // Flows written before the group may refer to it, or may need to
+    // stop referring to it before it's removed
+    if (batchMaxFlowMods > 0)
+        flushFlowBatch();
+
+    flowExecutor.WaitForInFlight(1);
+    std::lock_guard<std::mutex> sendGuard(sendMutex);
     GroupEdit ge;
     ge.edits.push_back(e);
-    bool success = flowExecutor.Execute(ge);
+    std::string swName = connection->getSwitchName();
+    uint32_t groupId = e->mod->group_id;
+    FlowExecutor::CompletionCb cb =
+        [swName, groupId](int status, const std::vector<int>&) {
+        if (status == 0) return;
+        LOG(ERROR) << "[" << swName << "] "
+                   << "Group mod failed for group-id=" << groupId
+                   << ": " << executeErrorStr(status);
+    };
+    bool success = flowExecutor.ExecuteAsync(ge, cb);
     if (!success) {
-        LOG(ERROR) << "[" << connection->getSwitchName() << "] "
-                   << "Group mod failed for group-id=" << e->mod->group_id;
+        LOG(ERROR) << "[" << swName << "] "
+                   << "Group mod failed for group-id=" << groupId;
     }
     return success;
 }
 
 void SwitchManager::diffTableState(int tableId, const FlowEntryList& el,
                                    /* out */ FlowEdit& diffs) {
+    std::lock_guard<std::mutex> guard(tableMutexes[tableId]);
     const TableState& tab = flowTables[tableId];
     tab.diffSnapshot(el, diffs);
 }
 
 void SwitchManager::forEachCookieMatch(int tableId,
                                        TableState::cookie_callback_t& cb) {
+    std::lock_guard<std::mutex> guard(tableMutexes[tableId]);
     const TableState& tab = flowTables[tableId];
     tab.forEachCookieMatch(cb);
 }
@@ -231,18 +643,162 @@ void SwitchManager::initiateSync() {
         syncPending = true;
         return;
     }
+    auto locks = lockTables();
     syncInProgress = true;
     syncPending = false;
     syncing = true;
+
+    {
+        // Edits waiting in the batch are already in the table state
+        // and will be written by the reconciliation, or along with
+        // the other edits held during the sync
+        std::lock_guard<std::mutex> guard(batchMutex);
+        if (incrementalSync) {
+            for (const FlowEdit::Entry& e : batch.edits)
+                deferredEdits[e.second->entry->table_id].edits.push_back(e);
+        }
+        batch.edits.clear();
+        batchObjIds.clear();
+    }
     LOG(INFO) << "[" << connection->getSwitchName() << "] "
               << "Sync initiated";
 
     clearSyncState();
 
+    bool incremental = false;
+    if (incrementalSync) {
+        // The edits held for tables being read by an interrupted
+        // sync were dropped
+        for (size_t i = 0; i < flowTables.size(); ++i) {
+            if (syncTables[i])
+                markTableDirty(i);
+            syncTables[i] = false;
+        }
+
+        std::lock_guard<std::mutex> guard(dirtyMutex);
+        incremental = markerWritten && !changesLost &&
+            monitorConnection && monitorConnection->IsConnected();
+    }
+
+    if (incremental) {
+        // Find out whether this is still the switch we last synced
+        // with, and which tables changed while disconnected
+        flowReader.getFlows(SYNC_MARKER_TABLE_ID,
+                            bind(&SwitchManager::gotMarker, this, _1, _2));
+        for (size_t i = 0; i < flowTables.size(); ++i)
+            flowReader.getFlowCount(i, bind(&SwitchManager::gotFlowCount,
+                                            this, i, _1, _2));
+    } else {
+        startSync(std::vector<bool>(flowTables.size(), true));
+    }
+}
+
+void SwitchManager::startSync(const std::vector<bool>& tables) {
+    bool full = std::find(tables.begin(), tables.end(), false) == tables.end();
+    {
+        std::lock_guard<std::mutex> guard(dirtyMutex);
+        for (size_t i = 0; i < flowTables.size(); ++i) {
+            if (tables[i])
+                dirtyTables[i] = false;
+        }
+        if (full)
+            changesLost = false;
+    }
+
+    for (size_t i = 0; i < flowTables.size(); ++i) {
+        syncTables[i] = tables[i];
+        if (tables[i]) {
+            // The reconciliation covers any edits held so far
+            deferredEdits[i].edits.clear();
+        } else {
+            tableDone[i] = true;
+        }
+    }
+
     flowReader.getGroups(bind(&SwitchManager::gotGroups, this, _1, _2));
 
-    for (size_t i = 0; i < flowTables.size(); ++i)
+    for (size_t i = 0; i < flowTables.size(); ++i) {
+        if (!tables[i]) continue;
         flowReader.getFlows(i, bind(&SwitchManager::gotFlows, this, i, _1, _2));
+    }
+}
+
+void SwitchManager::gotMarker(const FlowEntryList& flows, bool done) {
+    for (const FlowEntryPtr& fe : flows) {
+        if (fe->entry->cookie == ovs_htonll(syncGeneration))
+            markerFound = true;
+    }
+    markerDone = done;
+    if (done)
+        checkStateDone();
+}
+
+void SwitchManager::gotFlowCount(int tableId, uint64_t count, bool done) {
+    assert(tableId >= 0 &&
+           static_cast<size_t>(tableId) < flowTables.size());
+
+    recvCounts[tableId] = count;
+    countDone[tableId] = done;
+    if (done)
+        checkStateDone();
+}
+
+void SwitchManager::checkStateDone() {
+    bool allDone = markerDone;
+    for (size_t i = 0; allDone && i < flowTables.size(); ++i) {
+        allDone = allDone && countDone[i];
+    }
+
+    if (allDone) {
+        agent.getAgentIOService()
+            .dispatch(bind(&SwitchManager::startIncrementalSync, this));
+    }
+}
+
+void SwitchManager::startIncrementalSync() {
+    if (!syncInProgress) return;
+
+    auto locks = lockTables();
+    const std::string& swName = connection->getSwitchName();
+    std::vector<bool> tables(flowTables.size(), true);
+    if (!markerFound) {
+        LOG(INFO) << "[" << swName << "] "
+                  << "Sync marker not found, reading all flow tables";
+        startSync(tables);
+        return;
+    }
+
+    bool lost;
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> guard(dirtyMutex);
+        lost = changesLost;
+        for (size_t i = 0; i < flowTables.size(); ++i) {
+            // The edits held so far have not reached the switch
+            int64_t expected = flowTables[i].size();
+            for (const FlowEdit::Entry& e : deferredEdits[i].edits) {
+                if (e.first == FlowEdit::ADD)
+                    expected -= 1;
+                else if (e.first == FlowEdit::DEL)
+                    expected += 1;
+            }
+            tables[i] = dirtyTables[i] || expected < 0 ||
+                recvCounts[i] != static_cast<uint64_t>(expected);
+            if (tables[i])
+                count += 1;
+        }
+    }
+    if (lost) {
+        LOG(INFO) << "[" << swName << "] "
+                  << "Flow table changes may have been missed, "
+                  << "reading all flow tables";
+        std::fill(tables.begin(), tables.end(), true);
+    } else {
+        LOG(INFO) << "[" << swName << "] "
+                  << "Reading " << count << " of " << flowTables.size()
+                  << " flow tables";
+    }
+    startSync(tables);
 }
 
 void SwitchManager::gotGroups(const GroupEdit::EntryList& groups,
@@ -290,32 +846,57 @@ void SwitchManager::checkRecvDone() {
 
 void SwitchManager::completeSync() {
     assert(syncInProgress == true);
+    // Writes from other threads wait until the reconciliation is
+    // computed, so that none of them is left out of it and then held
+    auto locks = lockTables();
+    GroupEdit ge;
+    std::vector<FlowEdit> diffs;
     if (stateHandler) {
-        GroupEdit ge = stateHandler->reconcileGroups(recvGroups);
-        bool success = flowExecutor.Execute(ge);
-        if (!success) {
-            LOG(ERROR) << "[" << connection->getSwitchName() << "] "
-                       << "Failed to execute group table changes";
+        ge = stateHandler->reconcileGroups(recvGroups);
+        // Tables that were not read back are left out of the
+        // reconciliation, and only get the edits held during the sync
+        std::vector<const TableState*> tables(flowTables.size());
+        for (size_t i = 0; i < flowTables.size(); ++i) {
+            if (syncTables[i])
+                tables[i] = &flowTables[i];
         }
-
-        std::vector<FlowEdit> diffs =
-            stateHandler->reconcileFlows(flowTables, recvFlows);
+        diffs = stateHandler->reconcileFlows(tables, recvFlows);
         for (size_t i = 0; i < flowTables.size(); ++i) {
-            bool success = flowExecutor.Execute(diffs[i]);
-            if (!success) {
-                LOG(ERROR) << "[" << connection->getSwitchName() << "] "
-                           << "Failed to execute diffs on table=" << i;
-            }
+            if (!syncTables[i])
+                diffs[i].edits.swap(deferredEdits[i].edits);
         }
     }
-
+    for (size_t i = 0; i < flowTables.size(); ++i) {
+        deferredEdits[i].edits.clear();
+        syncTables[i] = false;
+    }
     clearSyncState();
 
+    // The writes that follow are sent after the reconciliation, but
+    // may compute their edits while it is being sent
+    std::unique_lock<std::mutex> sendGuard(sendMutex);
+    syncInProgress = false;
+    syncing = false;
+    locks.clear();
+    if (stateHandler) {
+        // Group changes go first since the new flows may refer to
+        // the new groups.  With bundles enabled, the switch applies
+        // all of it at once.
+        bool success = flowExecutor.ExecuteAll(ge, diffs);
+        if (!success) {
+            LOG(ERROR) << "[" << connection->getSwitchName() << "] "
+                       << "Failed to execute group and flow table changes";
+            for (size_t i = 0; i < flowTables.size(); ++i)
+                markTableDirty(i);
+        }
+    }
+    if (incrementalSync)
+        writeSyncMarker();
+    sendGuard.unlock();
+
     if (stateHandler) {
         stateHandler->completeSync();
     }
-    syncInProgress = false;
-    syncing = false;
 
     LOG(INFO) << "[" << connection->getSwitchName() << "] "
               <<"Sync complete";
@@ -326,13 +907,44 @@ void SwitchManager::completeSync() {
     }
 }
 
+void SwitchManager::writeSyncMarker() {
+    // The marker matches every packet that reaches its table, which
+    // no pipeline does
+    FlowEntryPtr marker =
+        FlowBuilder().priority(0).cookie(ovs_htonll(syncGeneration)).build();
+    marker->entry->table_id = SYNC_MARKER_TABLE_ID;
+    FlowEdit fe;
+    fe.add(FlowEdit::ADD, marker);
+
+    std::string swName = connection->getSwitchName();
+    FlowExecutor::CompletionCb cb =
+        [this, swName](int status, const std::vector<int>&) {
+        if (status != 0) {
+            LOG(ERROR) << "[" << swName << "] "
+                       << "Writing sync marker failed: "
+                       << executeErrorStr(status);
+        }
+        std::lock_guard<std::mutex> guard(dirtyMutex);
+        markerWritten = (status == 0);
+    };
+    if (!flowExecutor.ExecuteAsync(fe, cb)) {
+        LOG(ERROR) << "[" << swName << "] "
+                   << "Writing sync marker failed";
+        std::lock_guard<std::mutex> guard(dirtyMutex);
+        markerWritten = false;
+    }
+}
+
 void SwitchManager::clearSyncState() {
     for (size_t i = 0; i < flowTables.size(); ++i) {
         recvFlows[i].clear();
         tableDone[i] = false;
+        countDone[i] = false;
     }
     recvGroups.clear();
     groupsDone = false;
+    markerDone = false;
+    markerFound = false;
 }
 
 } // namespace ovsagent
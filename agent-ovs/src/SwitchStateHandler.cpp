@@ -10,14 +10,18 @@
 #include "SwitchManager.h"
 #include "logging.h"
 
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
 namespace ovsagent {
 
 std::vector<FlowEdit>
-SwitchStateHandler::reconcileFlows(std::vector<TableState> flowTables,
-                                   std::vector<FlowEntryList>& recvFlows) {
-    std::vector<FlowEdit> diffs(flowTables.size());
-    for (size_t i = 0; i < flowTables.size(); ++i) {
-        flowTables[i].diffSnapshot(recvFlows[i], diffs[i]);
+SwitchStateHandler::
+reconcileFlows(const std::vector<const TableState*>& flowTables,
+               std::vector<FlowEntryList>& recvFlows) {
+    std::vector<FlowEdit> diffs = diffTables(flowTables, recvFlows);
+    for (size_t i = 0; i < diffs.size(); ++i) {
         LOG(DEBUG) << "Table=" << i << ", snapshot has "
                    << diffs[i].edits.size() << " diff(s)";
         for (const FlowEdit::Entry& e : diffs[i].edits) {
@@ -28,6 +32,37 @@ SwitchStateHandler::reconcileFlows(std::vector<TableState> flowTables,
     return diffs;
 }
 
+std::vector<FlowEdit>
+SwitchStateHandler::
+diffTables(const std::vector<const TableState*>& flowTables,
+           const std::vector<FlowEntryList>& recvFlows,
+           size_t maxThreads) {
+    std::vector<FlowEdit> diffs(flowTables.size());
+
+    // Each worker takes the next table not yet diffed, so a few
+    // large tables don't leave the other workers idle
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < flowTables.size()) {
+            if (flowTables[i])
+                flowTables[i]->diffSnapshot(recvFlows[i], diffs[i]);
+        }
+    };
+
+    if (maxThreads == 0)
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t numThreads = std::min(maxThreads, flowTables.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < numThreads; ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& t : threads)
+        t.join();
+
+    return diffs;
+}
+
 GroupEdit SwitchStateHandler::reconcileGroups(GroupMap& recvGroups) {
     return GroupEdit();
 }
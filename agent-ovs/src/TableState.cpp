@@ -9,10 +9,11 @@
 #include <unordered_map>
 #include <unordered_set>
 
-#include <boost/functional/hash.hpp>
 #include <boost/optional.hpp>
 
 #include "TableState.h"
+#include "FlowEntryArena.h"
+#include "FlowConstants.h"
 #include "logging.h"
 #include "ovs-shim.h"
 #include "ovs-ofputil.h"
@@ -25,27 +26,6 @@ extern "C" {
 }
 
 
-namespace ovsagent {
-
-struct match_key_t {
-    uint16_t prio;
-    struct match match;
-};
-
-} /* namespace ovsagent */
-
-namespace std {
-
-template<> struct hash<ovsagent::match_key_t> {
-    size_t operator()(const ovsagent::match_key_t& match_key) const noexcept {
-        size_t hashv = match_hash(&match_key.match, 0);
-        boost::hash_combine(hashv, match_key.prio);
-        return hashv;
-    }
-};
-
-} /* namespace std */
-
 namespace ovsagent {
 
 using std::ostream;
@@ -55,17 +35,29 @@ using boost::optional;
 
 /** FlowEntry **/
 
-FlowEntry::FlowEntry() {
+FlowEntry::FlowEntry() : encoding(NULL), arenaEntry(false) {
     entry = (ofputil_flow_stats*)calloc(1, sizeof(ofputil_flow_stats));
 }
 
+FlowEntry::FlowEntry(ofputil_flow_stats* stats)
+    : entry(stats), encoding(NULL), arenaEntry(true) {}
+
 FlowEntry::~FlowEntry() {
+    clearEncoding();
+    if (arenaEntry)
+        return;
     if (entry->ofpacts) {
         free((void *)entry->ofpacts);
     }
     free(entry);
 }
 
+void FlowEntry::clearEncoding() {
+    ofpbuf* msg = encoding.exchange(NULL);
+    if (msg)
+        ofpbuf_delete(msg);
+}
+
 bool
 FlowEntry::matchEq(const FlowEntry *rhs) {
     const ofputil_flow_stats *feRhs = rhs->entry;
@@ -103,7 +95,7 @@ ostream & operator<<(ostream& os, const match& m) {
 }
 
 ostream& operator<<(ostream& os, const FlowEdit::Entry& fe) {
-    static const char *op[] = {"ADD", "MOD", "DEL"};
+    static const char *op[] = {"ADD", "MOD", "DEL", "DEL_COOKIE"};
     os << op[fe.first] << "|" << *(fe.second);
     return os;
 }
@@ -141,14 +133,14 @@ GroupEdit::GroupMod::~GroupMod() {
 }
 
 bool GroupEdit::groupEq(const GroupEdit::Entry& lhs,
-                        const GroupEdit::Entry& rhs) {
+                        const GroupEdit::Entry& rhs, bool compareBucketIds) {
     if (lhs == rhs) {
         return true;
     }
     if (lhs == NULL || rhs == NULL) {
         return false;
     }
-    return group_mod_equal(lhs->mod, rhs->mod);
+    return group_mod_equal(lhs->mod, rhs->mod, compareBucketIds);
 }
 
 ostream & operator<<(ostream& os, const GroupEdit::Entry& ge) {
@@ -159,10 +151,22 @@ ostream & operator<<(ostream& os, const GroupEdit::Entry& ge) {
     case OFPGC11_ADD:      os << "ADD"; break;
     case OFPGC11_MODIFY:   os << "MOD"; break;
     case OFPGC11_DELETE:   os << "DEL"; break;
+    case OFPGC15_INSERT_BUCKET: os << "INSERT_BUCKET"; break;
+    case OFPGC15_REMOVE_BUCKET: os << "REMOVE_BUCKET"; break;
     default:               os << "Unknown";
     }
     os << "|group_id=" << mod.group_id << ",type="
        << groupTypeStr[std::min<uint8_t>(4, mod.type)];
+    if (mod.command == OFPGC15_INSERT_BUCKET ||
+        mod.command == OFPGC15_REMOVE_BUCKET) {
+        os << ",command_bucket_id=";
+        switch (mod.command_bucket_id) {
+        case OFPG15_BUCKET_FIRST: os << "first"; break;
+        case OFPG15_BUCKET_LAST:  os << "last"; break;
+        case OFPG15_BUCKET_ALL:   os << "all"; break;
+        default:                  os << mod.command_bucket_id;
+        }
+    }
 
     ofputil_bucket *bkt;
     LIST_FOR_EACH (bkt, list_node, &mod.buckets) {
@@ -176,27 +180,151 @@ ostream & operator<<(ostream& os, const GroupEdit::Entry& ge) {
 
 /** TableState **/
 
-typedef std::vector<FlowEntryPtr> flow_vec_t;
-typedef std::pair<std::string, FlowEntryPtr> obj_id_flow_t;
+/*
+ * The table state is indexed by a 64-bit fingerprint of the priority
+ * and match of each flow rather than by a copy of the match, which
+ * is several hundred bytes.  Every lookup is verified against the
+ * flow entries themselves, so a fingerprint collision only costs an
+ * extra comparison.  Object IDs are interned so that each flow
+ * carries a small integer rather than a copy of the object ID.
+ */
+
+typedef uint32_t obj_id_t;
+typedef std::pair<obj_id_t, FlowEntryPtr> obj_id_flow_t;
+/* All the flows for one priority and match, in the order they were
+   written.  The first one is the flow in the switch table. */
 typedef std::vector<obj_id_flow_t> obj_id_flow_vec_t;
-typedef std::unordered_map<match_key_t, obj_id_flow_vec_t> match_obj_map_t;
-typedef std::unordered_map<match_key_t, flow_vec_t> match_map_t;
-typedef std::unordered_map<std::string, match_map_t> entry_map_t;
-typedef std::unordered_set<match_key_t> cookie_set_t;
-typedef std::unordered_map<uint64_t, cookie_set_t> cookie_map_t;
-
-bool operator==(const match_key_t& lhs, const match_key_t& rhs) {
-    return lhs.prio == rhs.prio && match_equal(&lhs.match, &rhs.match);
+/* The distinct priority/matches that share a fingerprint */
+typedef std::vector<obj_id_flow_vec_t> match_bucket_t;
+typedef std::unordered_map<uint64_t, match_bucket_t> match_obj_map_t;
+/* The flows written by an object, one per priority/match, along with
+   their fingerprints */
+typedef std::vector<std::pair<uint64_t, FlowEntryPtr> > obj_flow_vec_t;
+
+static uint64_t matchFingerprint(const FlowEntryPtr& fe) {
+    const ofputil_flow_stats* e = fe->entry;
+    return ((uint64_t)match_hash(&e->match, e->priority) << 32) |
+        match_hash(&e->match, ~(uint32_t)e->priority);
 }
-bool operator!=(const match_key_t& lhs, const match_key_t& rhs) {
-    return !(lhs == rhs);
+
+static bool matchKeyEq(const FlowEntryPtr& lhs, const FlowEntryPtr& rhs) {
+    return lhs->entry->priority == rhs->entry->priority &&
+        match_equal(&lhs->entry->match, &rhs->entry->match);
 }
 
+/* Index of flows by fingerprint, for the flows of a single apply or
+   snapshot.  The last flow written for a priority/match wins. */
+class FlowIndex {
+public:
+    size_t size() const { return flows.size(); }
+    bool empty() const { return flows.empty(); }
+
+    void insert(const FlowEntryPtr& fe) {
+        uint64_t fp = matchFingerprint(fe);
+        auto range = index.equal_range(fp);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (matchKeyEq(flows[it->second].second, fe)) {
+                flows[it->second].second = fe;
+                return;
+            }
+        }
+        index.insert(std::make_pair(fp, flows.size()));
+        flows.push_back(std::make_pair(fp, fe));
+    }
+
+    /* Get the position of the flow with the same priority and match,
+       or size() if there is none */
+    size_t find(uint64_t fp, const FlowEntryPtr& fe) const {
+        auto range = index.equal_range(fp);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (matchKeyEq(flows[it->second].second, fe))
+                return it->second;
+        }
+        return flows.size();
+    }
+
+    obj_flow_vec_t flows;
+
+private:
+    std::unordered_multimap<uint64_t, size_t> index;
+};
+
 class TableState::TableStateImpl {
 public:
-    entry_map_t entry_map;
+    TableStateImpl() : num_entries(0) {}
+
     match_obj_map_t match_obj_map;
-    cookie_map_t cookie_map;
+    /* number of priority/match entries in match_obj_map */
+    size_t num_entries;
+
+    /* interned object IDs */
+    std::unordered_map<std::string, obj_id_t> obj_ids;
+    std::vector<std::string> obj_names;
+    std::vector<obj_id_t> free_obj_ids;
+    /* flows written by each object, by object ID */
+    std::vector<obj_flow_vec_t> entry_map;
+
+    obj_id_t internObjId(const std::string& objId) {
+        auto it = obj_ids.find(objId);
+        if (it != obj_ids.end())
+            return it->second;
+
+        obj_id_t id;
+        if (!free_obj_ids.empty()) {
+            id = free_obj_ids.back();
+            free_obj_ids.pop_back();
+            obj_names[id] = objId;
+        } else {
+            id = obj_names.size();
+            obj_names.push_back(objId);
+            entry_map.emplace_back();
+        }
+        obj_ids[objId] = id;
+        return id;
+    }
+
+    void releaseObjId(obj_id_t id) {
+        obj_ids.erase(obj_names[id]);
+        std::string().swap(obj_names[id]);
+        obj_flow_vec_t().swap(entry_map[id]);
+        free_obj_ids.push_back(id);
+    }
+
+    /* Find the flows for the priority and match of the given flow */
+    obj_id_flow_vec_t* findMatch(uint64_t fp, const FlowEntryPtr& fe) {
+        match_obj_map_t::iterator it = match_obj_map.find(fp);
+        if (it == match_obj_map.end())
+            return NULL;
+        for (obj_id_flow_vec_t& flows : it->second) {
+            if (matchKeyEq(flows.front().second, fe))
+                return &flows;
+        }
+        return NULL;
+    }
+
+    void addMatch(uint64_t fp, obj_id_t objId, const FlowEntryPtr& fe) {
+        match_bucket_t& bucket = match_obj_map[fp];
+        bucket.emplace_back();
+        bucket.back().push_back(make_pair(objId, fe));
+        num_entries += 1;
+    }
+
+    void eraseMatch(uint64_t fp, const obj_id_flow_vec_t* flows) {
+        match_obj_map_t::iterator it = match_obj_map.find(fp);
+        if (it == match_obj_map.end())
+            return;
+        match_bucket_t& bucket = it->second;
+        for (match_bucket_t::iterator bit = bucket.begin();
+             bit != bucket.end(); ++bit) {
+            if (&*bit == flows) {
+                bucket.erase(bit);
+                num_entries -= 1;
+                break;
+            }
+        }
+        if (bucket.empty())
+            match_obj_map.erase(it);
+    }
 };
 
 TableState::TableState() : pimpl(new TableStateImpl()) { }
@@ -210,109 +338,131 @@ TableState::~TableState() {
 
 void TableState::diffSnapshot(const FlowEntryList& oldEntries,
                               FlowEdit& diffs) const {
-    typedef std::pair<bool, FlowEntryPtr> visited_fe_t;
-    typedef std::unordered_map<match_key_t, visited_fe_t> old_entry_map_t;
-
     diffs.edits.clear();
 
-    old_entry_map_t old_entries;
+    FlowIndex old_entries;
     for (const FlowEntryPtr& fe : oldEntries) {
-        match_key_t key;
-        key.prio = fe->entry->priority;
-        key.match = fe->entry->match;
-        old_entries[key] = make_pair(false, fe);
+        old_entries.insert(fe);
     }
+    vector<bool> visited(old_entries.size(), false);
 
     // Add/mod any matches in the object map
     for (match_obj_map_t::value_type& e : pimpl->match_obj_map) {
-        old_entry_map_t::iterator it = old_entries.find(e.first);
-        if (it == old_entries.end()) {
-            diffs.add(FlowEdit::ADD, e.second.front().second);
-        } else {
-            it->second.first = true;
-            FlowEntryPtr& olde = it->second.second;
-            FlowEntryPtr& newe = e.second.front().second;
-            if (!newe->actionEq(olde.get())) {
-                diffs.add(FlowEdit::MOD, newe);
+        for (obj_id_flow_vec_t& flows : e.second) {
+            FlowEntryPtr& newe = flows.front().second;
+            size_t i = old_entries.find(e.first, newe);
+            if (i == old_entries.size()) {
+                diffs.add(FlowEdit::ADD, newe);
+            } else {
+                visited[i] = true;
+                FlowEntryPtr& olde = old_entries.flows[i].second;
+                if (!newe->actionEq(olde.get())) {
+                    diffs.add(FlowEdit::MOD, newe);
+                }
             }
         }
     }
 
     // Remove unvisited entries from the old entry list
-    for (old_entry_map_t::value_type& e : old_entries) {
-        if (e.second.first) continue;
-        diffs.add(FlowEdit::DEL, e.second.second);
+    for (size_t i = 0; i < old_entries.size(); ++i) {
+        if (visited[i]) continue;
+        diffs.add(FlowEdit::DEL, old_entries.flows[i].second);
     }
 }
 
+// The cookie an entry gets in the table once given the object cookie
+static uint64_t tableCookie(const FlowEntryPtr& fe, uint64_t objCookie) {
+    uint64_t cookie = fe->entry->cookie;
+    if ((ovs_ntohll(cookie) >> 32) == 0)
+        cookie |= objCookie;
+    return cookie;
+}
+
 void TableState::forEachCookieMatch(cookie_callback_t& cb) const {
-    for (const auto& cookies : pimpl->cookie_map) {
-        for (const auto& match_key : cookies.second) {
-            cb(ovs_ntohll(cookies.first), match_key.prio, match_key.match);
+    for (const match_obj_map_t::value_type& e : pimpl->match_obj_map) {
+        for (const obj_id_flow_vec_t& flows : e.second) {
+            const ofputil_flow_stats* entry = flows.front().second->entry;
+            // flows without a cookie of their own are left out even
+            // if they carry an object cookie
+            if ((entry->cookie & ~flow::cookie::OBJECT_MASK) == 0)
+                continue;
+            cb(ovs_ntohll(entry->cookie), entry->priority, entry->match);
         }
     }
 }
 
-static void updateCookieMap(cookie_map_t& cookie_map,
-                            uint64_t oldCookie, uint64_t newCookie,
-                            const struct match_key_t& match) {
-    if (oldCookie == newCookie)
-        return;
-    if (oldCookie != 0) {
-        cookie_map_t::iterator it = cookie_map.find(oldCookie);
-        if (it != cookie_map.end()) {
-            it->second.erase(match);
-            if (it->second.size() == 0)
-                cookie_map.erase(it);
+bool TableState::hasObject(const std::string& objId) const {
+    return pimpl->obj_ids.find(objId) != pimpl->obj_ids.end();
+}
+
+FlowEntryPtr TableState::getEntry(const FlowEntryPtr& fe) const {
+    uint64_t fp = matchFingerprint(fe);
+    match_obj_map_t::const_iterator it = pimpl->match_obj_map.find(fp);
+    if (it != pimpl->match_obj_map.end()) {
+        for (const obj_id_flow_vec_t& flows : it->second) {
+            if (matchKeyEq(flows.front().second, fe))
+                return flows.front().second;
         }
     }
+    return FlowEntryPtr();
+}
 
-    if (newCookie != 0) {
-        cookie_set_t& cset = cookie_map[newCookie];
-        cset.insert(match);
-    }
+size_t TableState::size() const {
+    return pimpl->num_entries;
 }
 
-void TableState::apply(const std::string& objId,
+void TableState::apply(const std::string& objIdStr,
                        FlowEntryList& newEntries,
-                       /* out */ FlowEdit& diffs) {
+                       /* out */ FlowEdit& diffs,
+                       uint64_t objCookie) {
     diffs.edits.clear();
 
-    match_map_t new_entries;
+    FlowIndex new_entries;
     for (const FlowEntryPtr& fe : newEntries) {
-        match_key_t key;
-        key.prio = fe->entry->priority;
-        key.match = fe->entry->match;
-        new_entries[key].push_back(fe);
+        new_entries.insert(fe);
     }
 
-    // load new entries
-    for (match_map_t::value_type& e : new_entries) {
+    auto idit = pimpl->obj_ids.find(objIdStr);
+    if (idit == pimpl->obj_ids.end() && new_entries.empty())
+        return;
+    obj_id_t objId = pimpl->internObjId(objIdStr);
+
+    // load new entries.  An entry that is the same as the one in the
+    // table is dropped in favour of it, and the others are promoted
+    // out of the arena they were built in, if any, as the table keeps
+    // them, with the object cookie set.
+    for (obj_flow_vec_t::value_type& e : new_entries.flows) {
+        FlowEntryPtr& tomod = e.second;
+
         // check if there's an overlapping match already in the table
-        match_obj_map_t::iterator oit = pimpl->match_obj_map.find(e.first);
+        obj_id_flow_vec_t* flows = pimpl->findMatch(e.first, tomod);
 
-        if (oit != pimpl->match_obj_map.end()) {
+        if (flows != NULL) {
             // there is an existing entry
-            FlowEntryPtr& tomod = e.second.back();
-            if (oit->second.front().first == objId) {
+            obj_id_flow_t& front = flows->front();
+            if (front.first == objId) {
                 // it's for the same object ID.  Replace it.
-                updateCookieMap(pimpl->cookie_map,
-                                oit->second.front().second->entry->cookie,
-                                tomod->entry->cookie,
-                                e.first);
-
-                if (!oit->second.front().second->actionEq(tomod.get())) {
-                    oit->second.front().second = tomod;
+                if (!front.second->actionEq(tomod.get())) {
+                    tomod = FlowEntryArena::promote(tomod, objCookie);
+                    front.second = tomod;
                     diffs.add(FlowEdit::MOD, tomod);
+                } else if (front.second->entry->cookie !=
+                           tableCookie(tomod, objCookie)) {
+                    // keep the new cookie for forEachCookieMatch
+                    tomod = FlowEntryArena::promote(tomod, objCookie);
+                    front.second = tomod;
+                } else {
+                    tomod = front.second;
                 }
             } else {
                 // There are entries from other objects already there.
                 // just add/update it in the queue but don't generate
                 // diff
-                obj_id_flow_vec_t::iterator fvit = oit->second.begin()+1;
+                tomod = FlowEntryArena::promote(tomod, objCookie);
+                obj_id_flow_vec_t::iterator fvit = flows->begin()+1;
                 bool found = false;
                 bool actionEq = true;
-                while (fvit != oit->second.end()) {
+                while (fvit != flows->end()) {
                     if (fvit->first == objId) {
                         *fvit = make_pair(objId, tomod);
                         found = true;
@@ -327,99 +477,77 @@ void TableState::apply(const std::string& objId,
                         // it's only a warning if there are duplicate
                         // matches with different actions.
                         LOG(WARNING) << "Duplicate match for "
-                                     << objId << " (conflicts with "
-                                     << oit->second.front().first << "): "
-                                     << *tomod;
+                                     << objIdStr << " (conflicts with "
+                                     << pimpl->obj_names[front.first]
+                                     << "): " << *tomod;
                     }
 
-                    oit->second.push_back(make_pair(objId, tomod));
+                    flows->push_back(make_pair(objId, tomod));
                 }
             }
         } else {
             // there is no existing entry.  Add a new one
-            FlowEntryPtr& toadd = e.second.back();
-
-            updateCookieMap(pimpl->cookie_map,
-                            0, toadd->entry->cookie,
-                            e.first);
-
-            pimpl->match_obj_map[e.first].push_back(make_pair(objId, toadd));
-            diffs.add(FlowEdit::ADD, toadd);
+            tomod = FlowEntryArena::promote(tomod, objCookie);
+            pimpl->addMatch(e.first, objId, tomod);
+            diffs.add(FlowEdit::ADD, tomod);
         }
     }
 
     // check for deleted entries
-    entry_map_t::iterator itr = pimpl->entry_map.find(objId);
-    if (itr != pimpl->entry_map.end()) {
-        for (match_map_t::value_type& e : itr->second) {
-            match_map_t::iterator mit = new_entries.find(e.first);
-            if (mit == new_entries.end()) {
-                match_obj_map_t::iterator oit =
-                    pimpl->match_obj_map.find(e.first);
-                if (oit != pimpl->match_obj_map.end()) {
-                    if (oit->second.front().first == objId) {
-                        // this object is the one in the flow table,
-                        // so remove it
-                        FlowEntryPtr& todel = oit->second.front().second;
-
-                        if (oit->second.size() == 1) {
-                            // No conflicted entries queued
-                            updateCookieMap(pimpl->cookie_map,
-                                            todel->entry->cookie, 0,
-                                            e.first);
-
-                            diffs.add(FlowEdit::DEL, todel);
-                            pimpl->match_obj_map.erase(oit);
-                        } else {
-                            // Need to add the next entry back to the
-                            // table now that the first instance is
-                            // removed
-                            FlowEntryPtr& old = oit->second[0].second;
-                            FlowEntryPtr& tomod = oit->second[1].second;
-
-                            updateCookieMap(pimpl->cookie_map,
-                                            old->entry->cookie,
-                                            tomod->entry->cookie,
-                                            e.first);
-
-                            if (!todel->actionEq(tomod.get()))
-                                diffs.add(FlowEdit::MOD, tomod);
-                            oit->second.erase(oit->second.begin());
-                        }
-                    } else {
-                        // This object is queued behind another
-                        // object.  Just remove it without generating
-                        // diff.
-                        obj_id_flow_vec_t::iterator fvit = oit->second.begin()+1;
-                        while (fvit != oit->second.end()) {
-                            if (fvit->first == objId)
-                                fvit = oit->second.erase(fvit);
-                            else
-                                ++fvit;
-                        }
-                    }
-                }
+    for (const obj_flow_vec_t::value_type& e : pimpl->entry_map[objId]) {
+        if (new_entries.find(e.first, e.second) != new_entries.size())
+            continue;
+
+        obj_id_flow_vec_t* flows = pimpl->findMatch(e.first, e.second);
+        if (flows == NULL)
+            continue;
+
+        if (flows->front().first == objId) {
+            // this object is the one in the flow table, so remove it
+            FlowEntryPtr todel = flows->front().second;
+
+            if (flows->size() == 1) {
+                // No conflicted entries queued
+                diffs.add(FlowEdit::DEL, todel);
+                pimpl->eraseMatch(e.first, flows);
+            } else {
+                // Need to add the next entry back to the table now
+                // that the first instance is removed
+                FlowEntryPtr& tomod = (*flows)[1].second;
+                // A modify can't change the cookie, so the flow is
+                // replaced if the next entry's cookie differs
+                if (todel->entry->cookie != tomod->entry->cookie)
+                    diffs.add(FlowEdit::ADD, tomod);
+                else if (!todel->actionEq(tomod.get()))
+                    diffs.add(FlowEdit::MOD, tomod);
+                flows->erase(flows->begin());
+            }
+        } else {
+            // This object is queued behind another object.  Just
+            // remove it without generating diff.
+            obj_id_flow_vec_t::iterator fvit = flows->begin()+1;
+            while (fvit != flows->end()) {
+                if (fvit->first == objId)
+                    fvit = flows->erase(fvit);
+                else
+                    ++fvit;
             }
         }
     }
 
     if (diffs.edits.size() > 0) {
-        LOG(DEBUG) << "ObjId=" << objId << ", #diffs = " << diffs.edits.size();
+        LOG(DEBUG) << "ObjId=" << objIdStr
+                   << ", #diffs = " << diffs.edits.size();
         for (const FlowEdit::Entry& e : diffs.edits) {
             LOG(DEBUG) << e;
         }
     }
 
     /* newEntries.empty() => delete */
-    if (new_entries.empty() && itr != pimpl->entry_map.end()) {
-        itr->second.swap(new_entries);
-        pimpl->entry_map.erase(itr);
+    if (new_entries.empty()) {
+        pimpl->releaseObjId(objId);
     } else {
-        if (itr == pimpl->entry_map.end()) {
-            pimpl->entry_map[objId].swap(new_entries);
-        } else {
-            itr->second.swap(new_entries);
-        }
+        pimpl->entry_map[objId].swap(new_entries.flows);
     }
 }
 
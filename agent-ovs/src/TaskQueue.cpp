@@ -10,20 +10,110 @@
 #include "logging.h"
 
 #include <functional>
+#include <algorithm>
 
 namespace ovsagent {
 
+const std::string TaskQueue::DEFAULT_LANE("default");
+
 TaskQueue::TaskQueue(boost::asio::io_service& io_service_)
     : io_service(io_service_) {
+    lanes[DEFAULT_LANE];
+}
+
+TaskQueue::~TaskQueue() {
+    stopWorkers();
+}
+
+void TaskQueue::addLane(const std::string& lane, unsigned weight) {
+    std::unique_lock<std::mutex> guard(queueMutex);
+    lanes[lane].weight = weight > 0 ? weight : 1;
+}
+
+void TaskQueue::startWorkers(size_t numWorkers) {
+    if (workerService || numWorkers == 0) return;
+    workerService.reset(new boost::asio::io_service());
+    workerWork.reset(new boost::asio::io_service::work(*workerService));
+    for (size_t i = 0; i < numWorkers; ++i)
+        workers.emplace_back([this]() { workerService->run(); });
+}
+
+void TaskQueue::stopWorkers() {
+    if (!workerService) return;
+    workerWork.reset();
+    workerService->stop();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    workerService.reset();
+
+    std::unique_lock<std::mutex> guard(queueMutex);
+    queuedItems.clear();
+    for (auto& kv : lanes) {
+        kv.second.ready.clear();
+        kv.second.current = 0;
+        kv.second.stats.depth = 0;
+    }
+}
+
+void TaskQueue::post() {
+    boost::asio::io_service& service =
+        workerService ? *workerService : io_service;
+    service.post(std::bind(&TaskQueue::run_task, this));
+}
+
+void TaskQueue::makeReady(const std::string& taskId, TaskState& state) {
+    lanes[state.lane].ready.push_back(taskId);
+    post();
+}
 
+TaskQueue::Lane* TaskQueue::nextLane() {
+    // Smooth weighted round robin over the lanes with ready tasks
+    Lane* best = NULL;
+    long total = 0;
+    for (auto& kv : lanes) {
+        Lane& lane = kv.second;
+        if (lane.ready.empty()) continue;
+        lane.current += lane.weight;
+        total += lane.weight;
+        if (best == NULL || lane.current > best->current)
+            best = &lane;
+    }
+    if (best != NULL)
+        best->current -= total;
+    return best;
+}
+
+static uint64_t toUs(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
 }
 
-void TaskQueue::run_task(const std::string& taskId,
-                         const std::function<void ()>& task) {
+void TaskQueue::run_task() {
+    // Each ready task posts one run, which runs the next task by lane
+    // weight rather than the task that posted it
+    std::string taskId;
+    std::function<void ()> task;
+    Lane* lane;
     {
         std::unique_lock<std::mutex> guard(queueMutex);
-        queuedItems.erase(taskId);
+        lane = nextLane();
+        if (lane == NULL) return;
+        taskId = lane->ready.front();
+        lane->ready.pop_front();
+
+        TaskState& state = queuedItems[taskId];
+        state.queued = false;
+        state.running = true;
+        task.swap(state.task);
+
+        uint64_t wait = toUs(clock::now() - state.dispatched);
+        lane->stats.depth -= 1;
+        lane->stats.tasks += 1;
+        lane->stats.totalWaitUs += wait;
+        if (wait > lane->stats.maxWaitUs)
+            lane->stats.maxWaitUs = wait;
     }
+    clock::time_point start = clock::now();
     try {
         task();
     } catch (const std::exception& e) {
@@ -32,15 +122,77 @@ void TaskQueue::run_task(const std::string& taskId,
     } catch (...) {
         LOG(ERROR) << "Unknown error while executing task " << taskId;
     }
+    uint64_t run = toUs(clock::now() - start);
+    {
+        std::unique_lock<std::mutex> guard(queueMutex);
+        lane->stats.totalRunUs += run;
+        if (run > lane->stats.maxRunUs)
+            lane->stats.maxRunUs = run;
+
+        // A task dispatched again while this one ran waited for it
+        // to complete
+        auto it = queuedItems.find(taskId);
+        if (it == queuedItems.end()) return;
+        if (it->second.queued) {
+            it->second.running = false;
+            makeReady(taskId, it->second);
+        } else {
+            queuedItems.erase(it);
+        }
+    }
 }
 
 void TaskQueue::dispatch(const std::string& taskId,
-                         const std::function<void ()>& task) {
-    {
-        std::unique_lock<std::mutex> guard(queueMutex);
-        if (!queuedItems.insert(taskId).second) return;
+                         const std::function<void ()>& task,
+                         const std::string& lane) {
+    std::unique_lock<std::mutex> guard(queueMutex);
+    const std::string& laneName =
+        lanes.find(lane) != lanes.end() ? lane : DEFAULT_LANE;
+    TaskState& state = queuedItems[taskId];
+    state.task = task;
+    if (state.queued) {
+        Lane& old = lanes[state.lane];
+        old.stats.coalesced += 1;
+        if (state.lane == laneName)
+            return;
+
+        // The task moves to the lane of the latest dispatch, at the
+        // back of its queue
+        old.stats.depth -= 1;
+        if (!state.running) {
+            auto it = std::find(old.ready.begin(), old.ready.end(), taskId);
+            if (it != old.ready.end())
+                old.ready.erase(it);
+        }
+        state.lane = laneName;
+        Lane& moved = lanes[state.lane];
+        moved.stats.depth += 1;
+        if (!state.running)
+            moved.ready.push_back(taskId);
+        return;
     }
-    io_service.post(std::bind(&TaskQueue::run_task, this, taskId, task));
+    state.queued = true;
+    state.lane = laneName;
+    state.dispatched = clock::now();
+    lanes[state.lane].stats.depth += 1;
+    if (!state.running)
+        makeReady(taskId, state);
+}
+
+TaskQueue::LaneStats TaskQueue::getLaneStats(const std::string& lane) {
+    std::unique_lock<std::mutex> guard(queueMutex);
+    auto it = lanes.find(lane);
+    if (it == lanes.end())
+        return LaneStats();
+    return it->second.stats;
+}
+
+std::map<std::string, TaskQueue::LaneStats> TaskQueue::getAllLaneStats() {
+    std::unique_lock<std::mutex> guard(queueMutex);
+    std::map<std::string, LaneStats> stats;
+    for (const auto& kv : lanes)
+        stats[kv.first] = kv.second.stats;
+    return stats;
 }
 
 } // namespace ovsagent
@@ -53,6 +53,37 @@ public:
      */
     void enableConnTrack();
 
+    /**
+     * Enable rendering security group rules as conjunctive matches
+     * when that takes fewer flows
+     */
+    void enableClassifierConjunctions();
+
+    /**
+     * Enable rendering the rules of each security group once, matched
+     * on a bit for the group in registers 8 to 15 that the flows of
+     * its endpoints set, instead of once for each security group set
+     * in use.  At most 256 security groups can be in use at a time.
+     */
+    void enableSecGroupBits();
+
+    /**
+     * Render endpoints and security groups on a pool of worker
+     * threads rather than on the agent's io_service thread
+     *
+     * @param numThreads the number of worker threads, or at most 1 to
+     * render on the io_service thread
+     */
+    void setWorkerThreads(size_t numThreads);
+
+    /**
+     * Get the task queue the manager renders on, whose lane counters
+     * report the rendering backlog
+     *
+     * @return the task queue
+     */
+    TaskQueue& getTaskQueue() { return taskQueue; }
+
     /**
      * Start the access flow manager
      */
@@ -113,9 +144,15 @@ private:
     void createStaticFlows();
     void handleEndpointUpdate(const std::string& uuid);
     void handleSecGrpUpdate(const opflex::modb::URI& uri);
+    void handleSecGrpRulesUpdate(const opflex::modb::URI& secGrp);
     void handlePortStatusUpdate(const std::string& portName, uint32_t portNo);
     void handleSecGrpSetUpdate(const EndpointListener::uri_set_t& secGrps,
                                const std::string& secGrpsId);
+    void addSecGrpRules(const opflex::modb::URI& secGrp,
+                        const std::string& secGrpsIdStr,
+                        uint32_t secGrpSetId,
+                        FlowEntryList& secGrpIn,
+                        FlowEntryList& secGrpOut);
 
     Agent& agent;
     SwitchManager& switchManager;
@@ -124,6 +161,9 @@ private:
     TaskQueue taskQueue;
 
     bool conntrackEnabled;
+    bool classifierConjEnabled;
+    bool secGrpBitsEnabled;
+    size_t workerThreads;
     bool stopping;
 };
 
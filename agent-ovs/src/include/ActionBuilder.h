@@ -30,6 +30,7 @@ struct ofpact;
 namespace ovsagent {
 
 class FlowBuilder;
+class FlowEntryArena;
 
 /**
  * Class to help construct the actions part of a table entry incrementally.
@@ -38,8 +39,10 @@ class ActionBuilder : boost::noncopyable {
 public:
     /**
      * Construct an action builder with a parent flow builder
+     * @param fb the parent flow builder
+     * @param arena the arena the actions are built in, or NULL
      */
-    ActionBuilder(FlowBuilder& fb);
+    ActionBuilder(FlowBuilder& fb, FlowEntryArena* arena = NULL);
     ActionBuilder();
     ~ActionBuilder();
 
@@ -49,6 +52,14 @@ public:
      */
     void build(ofputil_flow_stats *dstEntry);
 
+    /**
+     * Construct and install the action structure to 'dstEntry', with
+     * the actions allocated from an arena
+     * @param dstEntry the entry to write to
+     * @param arena the arena the entry belongs to
+     */
+    void build(ofputil_flow_stats *dstEntry, FlowEntryArena& arena);
+
     /**
      * Construct and install the action structure to 'dstMod'
      * @param dstMod the entry to write to
@@ -363,6 +374,20 @@ public:
                              uint32_t arg,
                              mf_field_id dst);
 
+    /**
+     * Make the flow a clause of a conjunctive match.  A flow with
+     * conjunction actions may not have any other actions, but may be
+     * a clause of several conjunctive matches.
+     *
+     * @param id the conjunction ID, which flows matching the
+     * conjunction match in their conj_id field
+     * @param clause the clause of the conjunction this flow matches,
+     * from 1 to nClauses
+     * @param nClauses the number of clauses in the conjunction
+     */
+    ActionBuilder& conjunction(uint32_t id, uint8_t clause,
+                               uint8_t nClauses);
+
     /**
      * Extract and return an array of flow actions from a buffer used
      * for constructing those actions.
@@ -22,6 +22,7 @@
 #include <boost/property_tree/ptree.hpp>
 #include <boost/optional.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/noncopyable.hpp>
 #include <opflex/ofcore/OFFramework.h>
 #include <modelgbp/metadata/metadata.hpp>
@@ -163,6 +164,25 @@ private:
     boost::optional<std::string> sslCaStore;
     boost::optional<std::string> sslClientCert;
     boost::optional<std::string> sslClientCertPass;
+    boost::optional<std::string> roleRouting;
+    boost::optional<size_t> wqHighMessages;
+    boost::optional<size_t> wqLowMessages;
+    boost::optional<size_t> wqHighBytes;
+    boost::optional<size_t> wqLowBytes;
+    boost::optional<std::string> compressionMode;
+    boost::optional<int> compressionLevel;
+    boost::optional<long> statsInterval;
+
+    /**
+     * Log the current statistics of the agent
+     */
+    void reportStats();
+
+    /**
+     * Timer callback to report the statistics periodically
+     */
+    void onStatsTimer(const boost::system::error_code& ec);
+    std::unique_ptr<boost::asio::deadline_timer> statsTimer;
 
     /**
      * Thread for asynchronous tasks
@@ -0,0 +1,94 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Include file for DependencyGraph
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#pragma once
+#ifndef OVSAGENT_DEPENDENCY_GRAPH_H
+#define OVSAGENT_DEPENDENCY_GRAPH_H
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ovsagent {
+
+/**
+ * Record the inputs each rendered object read, so that a change to
+ * an input re-renders only the objects that read a different value
+ * of it.  An input is named by a key, and the value an object read
+ * is summarized by a fingerprint that must compare equal exactly when
+ * the rendered output would be the same.
+ *
+ * Not thread safe; the objects must be rendered from one thread.
+ */
+class DependencyGraph : private boost::noncopyable {
+public:
+    /**
+     * The inputs read by an object, mapping the key of each input to
+     * the fingerprint of the value read
+     */
+    typedef std::unordered_map<std::string, std::string> input_map_t;
+
+    /**
+     * Set the inputs an object read when it was last rendered,
+     * replacing those recorded before
+     *
+     * @param object the ID of the object
+     * @param inputs the inputs read.  The map is left empty.
+     */
+    void setInputs(const std::string& object, input_map_t& inputs);
+
+    /**
+     * Forget an object, for example when it is removed
+     *
+     * @param object the ID of the object
+     */
+    void removeObject(const std::string& object);
+
+    /**
+     * Check whether inputs are recorded for an object
+     *
+     * @param object the ID of the object
+     * @return true if the object has been rendered and not removed
+     */
+    bool hasObject(const std::string& object) const;
+
+    /**
+     * Get the objects that read an input when its value had a
+     * different fingerprint
+     *
+     * @param input the key of the input
+     * @param value the fingerprint of the current value of the input
+     * @param objects the objects to re-render are added to this set
+     * @return the number of objects that read the input with the same
+     * fingerprint, which need not be re-rendered
+     */
+    size_t getChanged(const std::string& input, const std::string& value,
+                      /* out */ std::unordered_set<std::string>& objects)
+        const;
+
+    /**
+     * Get the number of objects recorded
+     *
+     * @return the number of objects
+     */
+    size_t size() const { return objects.size(); }
+
+private:
+    std::unordered_map<std::string, input_map_t> objects;
+    std::unordered_map<std::string,
+                       std::unordered_set<std::string> > dependents;
+};
+
+} /* namespace ovsagent */
+
+#endif /* OVSAGENT_DEPENDENCY_GRAPH_H */
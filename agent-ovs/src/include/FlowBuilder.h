@@ -20,11 +20,17 @@
 
 namespace ovsagent {
 
+class FlowEntryArena;
+
 /**
  * Build a flow entry
  */
 class FlowBuilder {
 public:
+    /**
+     * Construct a flow builder, whose entry is allocated from the
+     * current FlowEntryArena of the thread if there is one
+     */
     FlowBuilder();
     ~FlowBuilder();
 
@@ -304,7 +310,16 @@ public:
      */
     FlowBuilder& ctLabel(ovs_u128 ctLabel, ovs_u128 mask);
 
+    /**
+     * Match packets that matched every clause of the given
+     * conjunctive match
+     * @param conjId the ID of the conjunction
+     * @return this flow builder for chaining
+     */
+    FlowBuilder& conjId(uint32_t conjId);
+
 private:
+    FlowEntryArena* arena_;
     std::unique_ptr<ActionBuilder> action_;
     FlowEntryPtr entry_;
     uint16_t ethType_;
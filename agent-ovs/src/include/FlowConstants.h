@@ -71,6 +71,14 @@ extern const uint64_t ICMP_ERROR_V4;
  */
 extern const uint64_t ICMP_ERROR_V6;
 
+/**
+ * The bits of the cookie that identify the object that wrote a flow,
+ * when the switch manager gives each object its own range of
+ * cookies.  Flows whose cookies already use any of the upper 32
+ * bits, such as those above, are left out of the object's range.
+ */
+extern const uint64_t OBJECT_MASK;
+
 } // namespace cookie
 
 namespace meta {
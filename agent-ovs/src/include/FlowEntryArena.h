@@ -0,0 +1,127 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#pragma once
+#ifndef OVSAGENT_FLOWENTRYARENA_H_
+#define OVSAGENT_FLOWENTRYARENA_H_
+
+#include "TableState.h"
+
+#include <boost/noncopyable.hpp>
+
+#include <memory>
+#include <stddef.h>
+
+namespace ovsagent {
+
+/**
+ * An arena that flow entries built while rendering an object are
+ * allocated from: the entry, its shared pointer control block, its
+ * flow stats and its actions are carved from large chunks instead of
+ * being allocated one by one.  The chunks are released together once
+ * the arena and every entry allocated from it are gone.
+ *
+ * Most entries built by a render are dropped as soon as the table
+ * state finds them unchanged.  Those the table state keeps are
+ * promoted to entries of their own, so an arena does not outlive
+ * the render that used it.
+ *
+ * An arena is not thread safe, and is used by a single render on a
+ * single thread.
+ */
+class FlowEntryArena : private boost::noncopyable {
+public:
+    /**
+     * Create an arena
+     *
+     * @param chunkSize the size of the chunks allocated
+     */
+    explicit FlowEntryArena(size_t chunkSize = DEFAULT_CHUNK_SIZE);
+    ~FlowEntryArena();
+
+    /**
+     * Default size of the chunks of an arena
+     */
+    static const size_t DEFAULT_CHUNK_SIZE;
+
+    /**
+     * Allocate a new empty flow entry from the arena
+     *
+     * @return the new flow entry
+     */
+    FlowEntryPtr newEntry();
+
+    /**
+     * Allocate memory for the actions of an entry of the arena
+     *
+     * @param size the number of bytes to allocate
+     * @return the memory allocated, aligned for any type
+     */
+    void* allocate(size_t size);
+
+    /**
+     * Get the number of chunks allocated by the arena
+     *
+     * @return the number of chunks
+     */
+    size_t getChunkCount() const;
+
+    /**
+     * Get the arena that the flow builders created on this thread
+     * allocate their entries from, set by a Scope
+     *
+     * @return the arena, or NULL if there is none
+     */
+    static FlowEntryArena* current();
+
+    /**
+     * Get a flow entry that does not belong to an arena with the same
+     * contents as the given flow entry, except that the object cookie
+     * given is added to its cookie if that leaves the upper 32 bits
+     * clear
+     *
+     * @param fe the flow entry
+     * @param objCookie the object cookie, in network byte order, or 0
+     * @return fe itself if it does not belong to an arena and its
+     * cookie is unchanged, or else a copy of it
+     */
+    static FlowEntryPtr promote(const FlowEntryPtr& fe,
+                                uint64_t objCookie = 0);
+
+    /**
+     * Make an arena the current arena of the thread for the lifetime
+     * of the scope
+     */
+    class Scope : private boost::noncopyable {
+    public:
+        /**
+         * Make the arena current
+         *
+         * @param arena the arena
+         */
+        explicit Scope(FlowEntryArena& arena);
+
+        /**
+         * Restore the arena that was current before
+         */
+        ~Scope();
+
+    private:
+        FlowEntryArena* previous;
+    };
+
+private:
+    class Chunks;
+    template <typename T> class Allocator;
+    std::shared_ptr<Chunks> chunks;
+};
+
+} // namespace ovsagent
+
+#endif /* OVSAGENT_FLOWENTRYARENA_H_ */
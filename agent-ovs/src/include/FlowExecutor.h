@@ -14,10 +14,12 @@
 
 #include <boost/optional.hpp>
 
-#include <unordered_set>
 #include <unordered_map>
+#include <vector>
+#include <functional>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 
 namespace ovsagent {
 
@@ -34,6 +36,19 @@ public:
     FlowExecutor();
     virtual ~FlowExecutor();
 
+    /**
+     * Callback invoked once the switch has acted upon all the
+     * messages of an asynchronous execution.
+     *
+     * @param status 0 on success, otherwise the error code for the
+     * first message that was rejected, or ENOTCONN if the connection
+     * was reset before the switch replied
+     * @param errors the error code for each edit, in the order of
+     * the edits, or an empty vector if no edit was rejected
+     */
+    typedef std::function<void (int status,
+                                const std::vector<int>& errors)> CompletionCb;
+
     /**
      * Construct and send flow-modification messages corresponding
      * to the flow-edits specified. Waits till all the messages
@@ -74,6 +89,118 @@ public:
      */
     virtual bool ExecuteNoBlock(const GroupEdit& ge);
 
+    /**
+     * Construct and send flow-modification messages corresponding
+     * to the flow-edits specified, followed by a barrier, and return
+     * without waiting for the barrier reply.  Any number of
+     * executions can be outstanding at once, subject to the limit
+     * set with SetMaxInFlight().
+     *
+     * The callback is invoked from the switch connection thread (or
+     * from the calling thread if the switch replies before this
+     * returns), and must not call back into the executor.
+     *
+     * @param fe The flow modifications
+     * @param cb callback to invoke on completion
+     * @return false if any error occurs while sending messages, in
+     * which case the callback will not be invoked; true otherwise
+     */
+    virtual bool ExecuteAsync(const FlowEdit& fe, const CompletionCb& cb);
+
+    /**
+     * Construct and send group-modification messages corresponding
+     * to the group-edits specified without waiting for the switch to
+     * act on them.
+     *
+     * @param ge The group modifications
+     * @param cb callback to invoke on completion
+     * @return false if any error occurs while sending messages, in
+     * which case the callback will not be invoked; true otherwise
+     * @see ExecuteAsync(const FlowEdit&, const CompletionCb&)
+     */
+    virtual bool ExecuteAsync(const GroupEdit& ge, const CompletionCb& cb);
+
+    /**
+     * Send the group-modification messages for the group-edits
+     * followed by the flow-modification messages for each of the
+     * flow-edits, and wait till they have been acted upon.  If
+     * bundles are enabled, the messages are sent in a single atomic
+     * OpenFlow bundle so that the switch never exposes a partially
+     * applied set of edits.  If the switch turns out not to support
+     * bundles, the edits are sent again without one.
+     *
+     * @param ge The group modifications
+     * @param fes The flow modifications
+     * @return false if any error occurs while sending messages or
+     * an error reply was received, true otherwise
+     */
+    virtual bool ExecuteAll(const GroupEdit& ge,
+                            const std::vector<FlowEdit>& fes);
+
+    /**
+     * Enable or disable the use of OpenFlow bundles.  When enabled,
+     * ExecuteAll() commits its edits in one atomic bundle.  Once
+     * the switch has been found to support bundles, other executions
+     * of at least minMsgs messages are bundled as well.
+     *
+     * @param enabled true to use bundles
+     * @param minMsgs the number of messages from which an execution
+     * other than ExecuteAll() is bundled, or 0 to bundle only
+     * ExecuteAll()
+     */
+    void EnableBundles(bool enabled, size_t minMsgs = 0);
+
+    /**
+     * Enable or disable caching flow mod encodings on flow entries.
+     * Once an entry has been added or modified, the encoded flow mod
+     * that adds it is kept with the entry, and later flow mods for
+     * the entry, including its modification and deletion, are
+     * derived from it instead of being encoded again.  This costs
+     * the size of the flow mod for every flow in the tables.
+     *
+     * @param enabled true to cache encodings
+     */
+    void EnableEncodingCache(bool enabled);
+
+    /**
+     * Set the maximum number of flow/group-modification messages
+     * that may be awaiting a barrier reply.  Executions that would
+     * exceed the limit block until earlier executions complete.  An
+     * execution larger than the limit is still sent once nothing
+     * else is in flight.  Messages are released only after the
+     * completion callback has returned.
+     *
+     * @param max the maximum number of messages in flight, or 0 for
+     * no limit
+     */
+    void SetMaxInFlight(size_t max);
+
+    /**
+     * Get the number of flow/group-modification messages currently
+     * awaiting a barrier reply
+     *
+     * @return the number of messages in flight
+     */
+    size_t GetInFlight();
+
+    /**
+     * Wait until an execution of the given number of messages would
+     * be sent without exceeding the limit set with SetMaxInFlight().
+     * Callers that serialize their executions with a lock of their
+     * own call this before taking it, so that other threads are not
+     * stalled behind the lock while the switch catches up.  Another
+     * execution may still take the room before the caller's is
+     * sent, in which case that one blocks as usual.
+     *
+     * Must not be called from the switch connection thread, nor may
+     * a completion callback take any lock held by a caller of this
+     * or of an execution that can block, since the callbacks are
+     * what release the messages in flight.
+     *
+     * @param numMsgs the number of messages to be sent
+     */
+    void WaitForInFlight(size_t numMsgs);
+
     /**
      * Register all the necessary event listeners on connection.
      * @param conn Connection to register
@@ -101,6 +228,19 @@ public:
     static ofpbuf *EncodeFlowMod(const FlowEdit::Entry& edit,
                                  int ofVersion);
 
+    /**
+     * Construct a flow-modification message for the specified
+     * flow-edit from the encoding cached on its flow entry.  The
+     * encoding is cached first if there is none and the edit adds or
+     * modifies the entry.  Only OpenFlow 1.2 and later encodings are
+     * cached.
+     * @param edit The flow modification
+     * @param ofVersion OpenFlow version to use for encoding
+     * @return flow-modification message
+     */
+    static ofpbuf *EncodeCachedFlowMod(const FlowEdit::Entry& edit,
+                                       int ofVersion);
+
     /**
      * Construct a group-modification message for the specified group-edit.
      * @param edit The group modification
@@ -119,6 +259,17 @@ private:
     template<typename T>
     bool ExecuteInt(const T& fe);
 
+    /**
+     * Internal helper function to execute flow/group-edits
+     * asynchronously.
+     *
+     * @param fe The flow/group modification
+     * @param cb callback to invoke on completion
+     * @return true on success, false otherwise
+     */
+    template<typename T>
+    bool ExecuteIntAsync(const T& fe, const CompletionCb& cb);
+
     /**
      * Internal helper function to execute non-blocking flow/group-edits.
      *
@@ -134,12 +285,55 @@ private:
      * a barrier request.
      * @param fe The flow/group modifications
      * @param barrXid ID of barrier request to associate with
+     * @param bundleId ID of the bundle to add the messages to
+     * @param offset index of the first edit within the request
      * @return 0 on success, error code if any error occurs while
      * sending messages
      */
     template<typename T>
     int DoExecuteNoBlock(const T& fe,
-            const boost::optional<uint32_t>& barrXid);
+            const boost::optional<uint32_t>& barrXid,
+            const boost::optional<uint32_t>& bundleId = boost::none,
+            size_t offset = 0);
+
+    /**
+     * Function that sends the modification messages of a request
+     * given its barrier request ID and optional bundle ID
+     */
+    typedef std::function<int (uint32_t barrXid,
+                               const boost::optional<uint32_t>& bundleId)>
+    ModSender;
+
+    /**
+     * Register a request, send its modification messages, wrapped
+     * in a bundle if requested, and then a barrier request.
+     *
+     * @param numMsgs the number of modification messages
+     * @param bundle true to send the messages in a bundle
+     * @param cb callback to invoke on completion
+     * @param sendMods function that sends the modification messages
+     * @return true on success, false otherwise
+     */
+    bool SendRequest(size_t numMsgs, bool bundle, const CompletionCb& cb,
+                     const ModSender& sendMods);
+
+    /**
+     * Send a bundle control request associated with a barrier
+     * request.
+     *
+     * @param type the type of bundle control request
+     * @param bundleId the bundle ID
+     * @param barrXid ID of barrier request to associate with
+     * @return 0 on success, error code otherwise
+     */
+    int SendBundleCtrl(uint16_t type, uint32_t bundleId, uint32_t barrXid);
+
+    /**
+     * Execute the edits of ExecuteAll() in a single bundle.
+     *
+     * @return 0 on success, otherwise an error code
+     */
+    int ExecuteBundle(const GroupEdit& ge, const std::vector<FlowEdit>& fes);
 
     /**
      * Internal helper function to construct an OpenFlow message from
@@ -154,13 +348,15 @@ private:
     ofpbuf *EncodeMod(const T& edit, int ofVersion);
 
     /**
-     * Send the barrier request specified and wait for a reply.
-     * @param barrReq Barrier request to send
-     * @return 0 on success, error code if any error occurs while
-     * sending barrier message or an error reply was received for any of
-     * the associated messages
+     * Construct the message for a flow-edit, using the encoding
+     * cache if it is enabled
      */
-    int WaitOnBarrier(ofpbuf *barrReq);
+    ofpbuf *Encode(const FlowEdit::Entry& edit, int ofVersion);
+
+    /**
+     * Construct the message for a group-edit
+     */
+    ofpbuf *Encode(const GroupEdit::Entry& edit, int ofVersion);
 
     SwitchConnection *swConn;
 
@@ -169,15 +365,57 @@ private:
      * need to be tracked.
      */
     struct RequestState {
-        RequestState() : status(0), done(false) {}
+        RequestState() : status(0), numMsgs(0) {}
 
-        std::unordered_set<uint32_t> reqXids;
+        /* Map of request IDs to the index of their edit, or
+           CTRL_INDEX for bundle control requests */
+        std::unordered_map<uint32_t, size_t> reqXids;
+        std::vector<int> errors;
         int status;
-        bool done;
+        size_t numMsgs;
+        CompletionCb cb;
     };
+    static const size_t CTRL_INDEX = SIZE_MAX;
     /* Map of barrier request IDs to RequestState */
     typedef std::unordered_map<uint32_t, RequestState> RequestMap;
     RequestMap requests;
+    /* Map of request IDs to the ID of the barrier that follows them */
+    std::unordered_map<uint32_t, uint32_t> reqBarriers;
+
+    size_t maxInFlight;
+    size_t inFlight;
+
+    enum BundleSupport {
+        BUNDLES_UNKNOWN,
+        BUNDLES_SUPPORTED,
+        BUNDLES_UNSUPPORTED
+    };
+    bool bundlesEnabled;
+    size_t bundleMinMsgs;
+    /* whether the switch is known to support bundles, reset on
+       every new connection */
+    BundleSupport bundleSupport;
+    uint32_t nextBundleId;
+
+    std::atomic<bool> encodingCache;
+
+    /**
+     * Remove a request from the request maps.  Its messages still
+     * count as in flight until ReleaseInFlight() is called.  Must be
+     * called with reqMtx held.
+     *
+     * @param itr the request to remove
+     * @param state returns the state of the request
+     */
+    void RemoveRequest(RequestMap::iterator itr, RequestState& state);
+
+    /**
+     * Stop counting messages as in flight and wake up any callers
+     * waiting for room.  Must be called with reqMtx held.
+     *
+     * @param numMsgs the number of messages to release
+     */
+    void ReleaseInFlight(size_t numMsgs);
 
     std::mutex reqMtx;
     std::condition_variable reqCondVar;
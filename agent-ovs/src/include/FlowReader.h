@@ -46,6 +46,21 @@ public:
      */
     void uninstallListenersForConnection(SwitchConnection *conn);
 
+    /**
+     * Register the event listeners needed to monitor flow table
+     * changes on a connection.  Flow monitoring is only available
+     * for OpenFlow 1.0 connections, so this is normally a second
+     * connection to the same switch.
+     * @param conn Connection to register
+     */
+    void installMonitorListenersForConnection(SwitchConnection *conn);
+
+    /**
+     * Unregister the flow monitor event listeners from connection.
+     * @param conn Connection to unregister from
+     */
+    void uninstallMonitorListenersForConnection(SwitchConnection *conn);
+
     /**
      * Callback function to process a list of flow-table entries.
      */
@@ -87,6 +102,45 @@ public:
      */
     virtual bool getGroups(const GroupCb& cb);
 
+    /**
+     * Callback function to process the number of entries in a
+     * flow-table.  The count is UINT64_MAX if the reply could not be
+     * decoded.
+     */
+    typedef std::function<void (uint64_t, bool)> FlowCountCb;
+
+    /**
+     * Get the number of entries in the specified flow-table.
+     *
+     * @param tableId ID of flow-table to count
+     * @param cb Callback function to invoke when the count is
+     * received
+     * @return true if request for the count was sent successfully
+     */
+    virtual bool getFlowCount(uint8_t tableId, const FlowCountCb& cb);
+
+    /**
+     * Callback function to process a change made to a flow table.
+     * The arguments are the kind of change, one of NXFME_ADDED,
+     * NXFME_DELETED or NXFME_MODIFIED, and the flow entry after the
+     * change, or before it for a deletion.  An empty flow entry
+     * means that the switch stopped reporting changes for a while
+     * and some of them may have been lost.
+     */
+    typedef std::function<void (int, const FlowEntryPtr&)> FlowUpdateCb;
+
+    /**
+     * Subscribe to the changes made to any flow table, on the
+     * connection registered with
+     * installMonitorListenersForConnection().  The switch reports
+     * only changes made after the subscription, and the
+     * subscription ends when the connection does.
+     *
+     * @param cb Callback function to invoke for each change
+     * @return true if the subscription request was sent successfully
+     */
+    virtual bool monitorFlows(const FlowUpdateCb& cb);
+
     /* Interface: MessageHandler */
     void Handle(SwitchConnection *c, int msgType, ofpbuf *msg);
 
@@ -101,10 +155,12 @@ private:
      *
      * @param tableId ID of flow-table to read
      * @param m A match to request, or NULL to match all
-     * all
+     * @param aggregate Request only the aggregate counters for
+     * the matching flows
      * @return flow-table read request
      */
-    ofpbuf *createFlowRequest(uint8_t tableId, struct match* m = NULL);
+    ofpbuf *createFlowRequest(uint8_t tableId, struct match* m = NULL,
+                              bool aggregate = false);
 
     /**
      * Create a request for reading all entries of group-table.
@@ -113,6 +169,22 @@ private:
      */
     ofpbuf *createGroupRequest();
 
+    /**
+     * Create a request to monitor additions, modifications and
+     * deletions in all flow tables.
+     *
+     * @return flow monitor request
+     */
+    ofpbuf *createMonitorRequest();
+
+    /**
+     * Decode the flow updates in a flow monitor reply and invoke the
+     * monitor callback for each.
+     *
+     * @param msg The received reply message
+     */
+    void handleFlowUpdates(ofpbuf *msg);
+
     /**
      * Send specified read request on the connection and update
      * internal structures to track replies.
@@ -147,6 +219,7 @@ private:
     void decodeReply(ofpbuf *msg, T& recv, bool& replyDone);
 
     SwitchConnection *swConn;
+    SwitchConnection *monitorConn;
 
     std::mutex reqMtx;
 
@@ -154,6 +227,9 @@ private:
     FlowCbMap flowRequests;
     typedef std::unordered_map<uint32_t, GroupCb> GroupCbMap;
     GroupCbMap groupRequests;
+    typedef std::unordered_map<uint32_t, FlowCountCb> FlowCountCbMap;
+    FlowCountCbMap countRequests;
+    FlowUpdateCb monitorCb;
 };
 
 }   // namespace ovsagent
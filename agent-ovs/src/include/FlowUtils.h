@@ -19,6 +19,8 @@
 
 #include <boost/optional.hpp>
 
+#include <vector>
+#include <functional>
 #include <stdint.h>
 
 namespace ovsagent {
@@ -98,6 +100,115 @@ void add_classifier_entries(modelgbp::gbpe::L24Classifier& clsfr,
                             uint32_t svnid, uint32_t dvnid,
                             /* out */ FlowEntryList& entries);
 
+/**
+ * How the entries for a classifier were encoded
+ */
+enum ClassEncoding {
+    /**
+     * One entry for every combination of source and destination
+     * subnet, source and destination port mask and TCP flags
+     */
+    CE_CROSS_PRODUCT,
+    /**
+     * A conjunctive match with a clause for each of those that has
+     * more than one value, and one entry with the action that
+     * matches the conjunction
+     */
+    CE_CONJUNCTION
+};
+
+/**
+ * Allocate the ID for the conjunctive match of a classifier's
+ * entries
+ */
+typedef std::function<uint32_t()> conj_id_alloc_t;
+
+/**
+ * Create flow entries for the classifier specified and append them
+ * to the provided list, as a conjunctive match if that takes fewer
+ * entries than the cross product.  Only CA_DENY, CA_ALLOW and
+ * CA_REFLEX_FWD entries are made conjunctive.  The clause entries
+ * have no cookie; the entry that matches the conjunction has the
+ * cookie, flags and actions.
+ *
+ * Clause entries in the list with the same match and priority must
+ * be merged with merge_conjunction_entries before the list is
+ * written.
+ *
+ * @param classifier Classifier object to get matching rules from
+ * @param act an action to take for the flows
+ * @param sourceSub A set of source networks to which the rule should apply
+ * @param destSub A set of dest networks to which the rule should apply
+ * @param nextTable the table to send to if the traffic is allowed
+ * @param priority Priority of the entry created
+ * @param cookie Cookie of the entry created
+ * @param svnid VNID of the source endpoint group for the entry
+ * @param dvnid VNID of the destination endpoint group for the entry
+ * @param conjIdAlloc called to get the conjunction ID if the entries
+ * are made conjunctive, or empty to always use the cross product
+ * @param entries List to append entry to
+ * @return the encoding used
+ */
+ClassEncoding
+add_classifier_entries(modelgbp::gbpe::L24Classifier& clsfr,
+                       ClassAction act,
+                       boost::optional<const network::subnets_t&> sourceSub,
+                       boost::optional<const network::subnets_t&> destSub,
+                       uint8_t nextTable, uint16_t priority,
+                       uint32_t flags, uint64_t cookie,
+                       uint32_t svnid, uint32_t dvnid,
+                       const conj_id_alloc_t& conjIdAlloc,
+                       /* out */ FlowEntryList& entries);
+
+/**
+ * Merge entries in the list that have the same match and priority
+ * and only conjunction actions into one entry with all of their
+ * conjunction actions, since OVS requires a single flow for each
+ * clause match.
+ *
+ * @param entries the list of entries to merge
+ */
+void merge_conjunction_entries(FlowEntryList& entries);
+
+/**
+ * A conjunctive match that a flow is a clause of
+ */
+struct Conjunction {
+    /**
+     * The conjunction ID
+     */
+    uint32_t id;
+    /**
+     * The clause of the conjunction, from 1 to nClauses
+     */
+    uint8_t clause;
+    /**
+     * The number of clauses in the conjunction
+     */
+    uint8_t nClauses;
+};
+
+/**
+ * A list of conjunctions
+ */
+typedef std::vector<Conjunction> ConjList;
+
+/**
+ * Create flow entries matching the classifier specified as a clause
+ * of each of the given conjunctive matches and append them to the
+ * provided list.  The entries have no cookie and do not match the
+ * source or destination group.
+ *
+ * @param classifier Classifier object to get matching rules from
+ * @param priority Priority of the entry created, which must be the
+ * priority of the conjunctions
+ * @param conjs the conjunctions that the entries are a clause of
+ * @param entries List to append entry to
+ */
+void add_classifier_conj_entries(modelgbp::gbpe::L24Classifier& clsfr,
+                                 uint16_t priority, const ConjList& conjs,
+                                 /* out */ FlowEntryList& entries);
+
 /**
  * Add a match entry for the DHCP v4 and v6 request
  *
@@ -108,6 +219,25 @@ void add_classifier_entries(modelgbp::gbpe::L24Classifier& clsfr,
  */
 FlowBuilder& match_dhcp_req(FlowBuilder& fb, bool v4);
 
+/**
+ * Copy a flow entry built with placeholder values for the endpoint
+ * fields, setting in the copy the port of the endpoint in the REG7
+ * action, its MAC address in any Ethernet destination action, and
+ * its IP address in the destination match, or its MAC address when
+ * no IP address is given.  The copy is allocated from the current
+ * FlowEntryArena of the thread, if any.
+ *
+ * @param tmpl the flow entry to copy
+ * @param ofPort the port of the endpoint
+ * @param macAddr the MAC address of the endpoint
+ * @param ipAddr the IP address of the endpoint, or NULL
+ *
+ * @return the new flow entry
+ */
+FlowEntryPtr copy_endpoint_flow(const FlowEntry& tmpl, uint32_t ofPort,
+                                const uint8_t* macAddr,
+                                const boost::asio::ip::address* ipAddr);
+
 } // namespace flowutils
 } // namespace ovsagent
 
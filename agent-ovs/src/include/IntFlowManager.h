@@ -17,6 +17,7 @@
 #include "AdvertManager.h"
 #include "RDConfig.h"
 #include "TaskQueue.h"
+#include "DependencyGraph.h"
 #include "SwitchStateHandler.h"
 
 #include <opflex/ofcore/PeerStatusListener.h>
@@ -27,6 +28,10 @@
 
 #include <utility>
 #include <unordered_map>
+#include <map>
+#include <set>
+#include <tuple>
+#include <mutex>
 
 namespace ovsagent {
 
@@ -157,6 +162,14 @@ public:
      */
     void enableConnTrack();
 
+    /**
+     * Render the rules of contracts between different groups as
+     * conjunctive matches on the source group, destination group and
+     * classifier, rather than as a flow for each combination of
+     * provider, consumer and rule.
+     */
+    void enableContractConjunctions();
+
     /**
      * Enable or disable the virtual routing
      *
@@ -225,6 +238,52 @@ public:
      */
     const uint8_t *getDHCPMacAddr() { return dhcpMac; }
 
+    /**
+     * Get the task queue the manager renders on, whose lane counters
+     * report the rendering backlog
+     *
+     * @return the task queue
+     */
+    TaskQueue& getTaskQueue() { return taskQueue; }
+
+    /**
+     * Counters for endpoints and contracts rendered again because an
+     * endpoint group they depend on changed, and for the endpoint
+     * flows copied from the templates of their group
+     */
+    struct RenderStats {
+        /** Number of re-renders triggered by a group change */
+        uint64_t rerenders;
+        /** Number of those re-renders that changed no flows or
+            groups */
+        uint64_t noopRerenders;
+        /** Number of dependents of a changed group that were not
+            rendered again because the group attributes they read
+            were unchanged */
+        uint64_t skippedRerenders;
+        /** Number of times the endpoint flow templates of a group
+            were built */
+        uint64_t templateBuilds;
+        /** Number of endpoint flows copied from a template */
+        uint64_t templateFlows;
+        /** Number of flood group modifications for an endpoint
+            joining or leaving that carried every bucket of the
+            group */
+        uint64_t floodGroupMods;
+        /** Number of flood group modifications for an endpoint
+            joining or leaving that inserted or removed a single
+            bucket */
+        uint64_t floodBucketMods;
+    };
+
+    /**
+     * Get the counters for re-renders triggered by group changes, for
+     * endpoint flow templates and for flood group updates
+     *
+     * @return a copy of the current counters
+     */
+    RenderStats getRenderStats();
+
     /**
      * Get the name space string
      * @return the name space string
@@ -233,7 +292,7 @@ public:
 
     /* Interface: SwitchStateHandler */
     virtual std::vector<FlowEdit>
-    reconcileFlows(std::vector<TableState> flowTables,
+    reconcileFlows(const std::vector<const TableState*>& flowTables,
                    std::vector<FlowEntryList>& recvFlows);
     virtual GroupEdit reconcileGroups(GroupMap& recvGroups);
     virtual void completeSync();
@@ -294,6 +353,21 @@ public:
      */
     uint32_t getId(opflex::modb::class_id_t cid, const opflex::modb::URI& uri);
 
+    /**
+     * Get or generate the ID of the conjunctive match for a contract
+     * rule when contracts are rendered with conjunctions
+     *
+     * @param contractURI URI of the contract
+     * @param classifierURI URI of the classifier of the rule
+     * @param priority the priority of the rule
+     * @param in true for traffic from consumers to providers, false
+     * for traffic from providers to consumers
+     * @return the conjunction ID
+     */
+    uint32_t getContractConjId(const opflex::modb::URI& contractURI,
+                               const opflex::modb::URI& classifierURI,
+                               uint16_t priority, bool in);
+
     /**
      * Set fill in tunnel metadata in an action builder
      * @param ab the action builder
@@ -312,6 +386,31 @@ public:
      */
     static uint32_t getPromId(uint32_t fgrpId);
 
+    /**
+     * Create a group modification that inserts the bucket of an
+     * endpoint port into a flood group
+     *
+     * @param groupId the ID of the group
+     * @param port the port of the endpoint, also used as the bucket ID
+     * @param afterBucketId the ID of the bucket to insert the new
+     * bucket after, or OFPG15_BUCKET_FIRST
+     * @return Group-table modification entry
+     */
+    static GroupEdit::Entry createInsertBucketMod(uint32_t groupId,
+                                                  uint32_t port,
+                                                  uint32_t afterBucketId);
+
+    /**
+     * Create a group modification that removes the bucket of an
+     * endpoint port from a flood group
+     *
+     * @param groupId the ID of the group
+     * @param port the port of the endpoint, also used as the bucket ID
+     * @return Group-table modification entry
+     */
+    static GroupEdit::Entry createRemoveBucketMod(uint32_t groupId,
+                                                  uint32_t port);
+
     /**
      * Get the tunnel destination to use for the given endpoint group.
      * @param epgURI the group URI
@@ -468,6 +567,30 @@ private:
             boost::optional<opflex::modb::URI>& rdURI, uint32_t& rdId,
             boost::optional<opflex::modb::URI>& bdURI, uint32_t& bdId,
             boost::optional<opflex::modb::URI>& fdURI, uint32_t& fdId);
+
+    /**
+     * Get a fingerprint of every attribute of an endpoint group, and
+     * of the uplink, that the flows of its endpoints depend on
+     */
+    std::string getGroupFingerprint(const opflex::modb::URI& egURI);
+
+    /**
+     * Get a fingerprint of the VNID the flows of a contract use for
+     * a group or external network
+     */
+    std::string getGroupVnidFingerprint(const opflex::modb::URI& uri);
+
+    /**
+     * Render the flows of an endpoint, recording the group
+     * attributes it read
+     */
+    void renderEndpoint(const std::string& uuid);
+
+    /**
+     * Render the flows of a contract, recording the group VNIDs it
+     * read
+     */
+    void renderContract(const opflex::modb::URI& contractURI);
     void updateGroupSubnets(const opflex::modb::URI& egUri,
                             uint32_t bdId, uint32_t rdId);
     void updateEPGFlood(const opflex::modb::URI& epgURI,
@@ -509,7 +632,9 @@ private:
                                std::pair<uint32_t, bool> > Ep2PortMap;
 
     /**
-     * Construct a group-table modification.
+     * Construct a group-table modification.  The endpoint buckets
+     * are ordered by port, with each port present once, followed by
+     * the tunnel bucket.
      *
      * @param type The modification type
      * @param groupId Identifier for the flow group to edit
@@ -538,6 +663,39 @@ private:
                          uint32_t groupId, const Ep2PortMap& epMap,
                          bool prom, GroupEdit& ge);
 
+    /**
+     * Check if the switch accepts the commands that insert and remove
+     * the buckets of a group, which OVS only encodes from OpenFlow
+     * 1.5
+     *
+     * @return true if flood groups can be updated a bucket at a time
+     */
+    bool useBucketCommands();
+
+    /**
+     * Update the bucket of an endpoint in a flood group that already
+     * exists, removing the bucket for its old port and inserting one
+     * for its new port where no other endpoint in the group uses
+     * them.  Falls back to modifying the whole group if the switch
+     * does not accept bucket commands.
+     *
+     * @param groupId ID of the group
+     * @param epMap endpoints in the group, already updated
+     * @param epUUID UUID of the endpoint
+     * @param oldPort the old port and promiscuous mode of the
+     * endpoint, if it was in the group
+     * @param newPort the new port and promiscuous mode of the
+     * endpoint, if it is in the group
+     * @param prom if the group has promiscuous mode endpoints only
+     */
+    void updateFloodBucket(uint32_t groupId, const Ep2PortMap& epMap,
+                           const std::string& epUUID,
+                           const boost::optional<std::pair<uint32_t, bool> >&
+                           oldPort,
+                           const boost::optional<std::pair<uint32_t, bool> >&
+                           newPort,
+                           bool prom);
+
     Agent& agent;
     SwitchManager& switchManager;
     IdGenerator& idGen;
@@ -556,6 +714,7 @@ private:
     bool routerAdv;
     bool virtualDHCPEnabled;
     bool conntrackEnabled;
+    bool contractConjEnabled;
     uint8_t dhcpMac[6];
     std::string flowIdCache;
     std::string mcastGroupFile;
@@ -616,6 +775,133 @@ private:
                                  const uint32_t cvnid,
                                  bool allowBidirectional,
                                  const PolicyManager::rule_list_t& rules);
+
+    /*
+     * The flows of a contract between each provider and consumer
+     * group, and for each group with intra-group policy from it, are
+     * written as slices with object IDs of their own.  A slice is
+     * keyed by the provider and consumer VNIDs, or by the same VNID
+     * twice for an intra-group slice, which a provider/consumer slice
+     * never is.  The value is whether bidirectional rules were
+     * rendered both ways in the slice.
+     */
+    typedef std::pair<uint32_t, uint32_t> contract_slice_key_t;
+    typedef std::map<contract_slice_key_t, bool> contract_slice_map_t;
+
+    /* The rules and slices each contract was last rendered with */
+    struct ContractRender {
+        PolicyManager::rule_list_t rules;
+        contract_slice_map_t slices;
+    };
+    std::unordered_map<opflex::modb::URI, ContractRender> contractRenders;
+
+    /**
+     * Render the slices of a contract that are new or changed since
+     * it was last rendered, and clear those it no longer has.  All
+     * slices are rendered again if the rules changed.
+     */
+    void updateContractSlices(const opflex::modb::URI& contractURI,
+                              const PolicyManager::rule_list_t& rules,
+                              contract_slice_map_t& slices);
+
+    /*
+     * The clauses of the conjunctions of contract rules, keyed by
+     * priority, clause number and the group ID or classifier ID the
+     * clause matches.  Conjunctions from any contract that share a
+     * clause share its flows, since OVS requires a single flow for
+     * each match and priority.
+     */
+    typedef std::tuple<uint16_t, uint8_t, uint32_t> conj_clause_key_t;
+    typedef std::map<conj_clause_key_t, std::set<uint32_t> > conj_clause_map_t;
+    conj_clause_map_t conjClauses;
+    std::map<conj_clause_key_t,
+             std::shared_ptr<modelgbp::gbpe::L24Classifier> > conjClassifiers;
+
+    /* The clauses and conjunction ID keys used by each contract */
+    struct ContractConj {
+        conj_clause_map_t clauses;
+        std::unordered_set<std::string> ids;
+    };
+    std::unordered_map<opflex::modb::URI, ContractConj> contractConjs;
+
+    /**
+     * Render the rules of a contract between its providers and
+     * consumers as conjunctions, adding the conj_id flows to the
+     * entry list and updating the shared clause flows
+     */
+    void addContractConjunctions(FlowEntryList& entryList,
+                                 const opflex::modb::URI& contractURI,
+                                 const std::unordered_set<uint32_t>& provIds,
+                                 const std::unordered_set<uint32_t>& consIds,
+                                 const PolicyManager::rule_list_t& rules);
+
+    /**
+     * Replace the conjunctions of a contract, rewriting the shared
+     * clauses they use or used, and releasing the IDs of the
+     * conjunctions that are gone.  Removes them if conj is empty.
+     */
+    void updateContractConjunctions(const opflex::modb::URI& contractURI,
+                                    ContractConj& conj);
+
+    /**
+     * Write the flow of a shared source or destination group clause
+     */
+    void writeConjClause(const conj_clause_key_t& key);
+
+    /**
+     * Write the flows of the classifier clauses of a priority, merging
+     * the conjunctions of the flows with the same match
+     */
+    void writeClassifierConjClauses(uint16_t prio);
+
+    /*
+     * The fingerprints of the endpoint groups each endpoint read, and
+     * of the VNIDs of the groups each contract read, when it was last
+     * rendered.  A group change renders again only those whose
+     * fingerprints differ, or that have not been rendered.
+     */
+    DependencyGraph endpointDeps;
+    DependencyGraph contractDeps;
+
+    /* The endpoints and contracts queued to render again because of a
+       group change */
+    std::unordered_set<std::string> endpointRerenders;
+    std::unordered_set<opflex::modb::URI> contractRerenders;
+
+    /*
+     * The bridge and route flows of the endpoints of a group, which
+     * differ between endpoints only in port, MAC and IP address.
+     * They are built once with placeholder values for those, and
+     * copied for each endpoint with the placeholders replaced.  The
+     * templates are built again when the fingerprint of the group
+     * changes.
+     */
+    struct EndpointTemplates {
+        std::string fingerprint;
+        FlowEntryPtr bridgeDst;
+        FlowEntryPtr routeDstV4;
+        FlowEntryPtr routeDstV6;
+    };
+    std::unordered_map<opflex::modb::URI, EndpointTemplates>
+        endpointTemplates;
+
+    /**
+     * Get the endpoint flow templates of a group, building them if
+     * the group has none or had a different fingerprint
+     */
+    const EndpointTemplates&
+    getEndpointTemplates(const opflex::modb::URI& epgURI,
+                         const std::string& fingerprint,
+                         uint32_t epgVnid, uint32_t rdId, uint32_t bdId);
+
+    std::mutex renderStatsMutex;
+    RenderStats renderStats;
+
+    /**
+     * Count a re-render as a no-op if the edit count of the switch
+     * manager is the same as before it
+     */
+    void countRerender(uint64_t editsBefore);
 };
 
 } // namespace ovsagent
@@ -59,6 +59,13 @@ public:
      */
     virtual void stop() = 0;
 
+    /**
+     * Log the current statistics of the renderer.  Called
+     * periodically from the agent's IO service when statistics
+     * reporting is enabled.
+     */
+    virtual void reportStats() {}
+
     /**
      * Get the Agent object
      */
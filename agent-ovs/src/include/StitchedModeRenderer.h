@@ -64,6 +64,7 @@ public:
     virtual void setProperties(const boost::property_tree::ptree& properties);
     virtual void start();
     virtual void stop();
+    virtual void reportStats();
 
 private:
     IdGenerator idGen;
@@ -107,9 +108,35 @@ private:
     bool connTrack;
     uint16_t ctZoneRangeStart;
     uint16_t ctZoneRangeEnd;
+    bool contractConjunctions;
+    bool classifierConjunctions;
+    bool secGroupBits;
+    size_t renderingThreads;
+    size_t maxFlowModsInFlight;
+    bool flowBatching;
+    size_t flowBatchMaxFlowMods;
+    long flowBatchMaxDelayMs;
+    bool flowBundles;
+    size_t flowBundleMinFlowMods;
+    bool incrementalSync;
+    bool encodingCache;
+    bool objectCookies;
+    bool auxConnections;
+    bool bucketCommands;
 
     bool started;
 
+    /**
+     * Log the flow write statistics of a switch manager
+     */
+    static void reportSwitchStats(SwitchManager& switchManager);
+
+    /**
+     * Log the statistics of each lane of a flow manager's task queue
+     */
+    static void reportTaskStats(const std::string& name,
+                                TaskQueue& taskQueue);
+
     /**
      * Timer callback to clean up IDs that have been erased
      */
@@ -11,11 +11,14 @@
 #define OVSAGENT_SWITCHCONNECTION_H_
 
 #include <queue>
+#include <deque>
 #include <list>
 #include <unordered_map>
 #include <thread>
 #include <mutex>
 #include <chrono>
+#include <atomic>
+#include <vector>
 
 struct vconn;
 struct ofpbuf;
@@ -118,6 +121,68 @@ public:
      */
     virtual int SendMessage(struct ofpbuf *msg);
 
+    /**
+     * Send a batch of OpenFlow messages to the switch in order,
+     * taking the connection lock once for the whole batch rather
+     * than once per message.  Takes ownership of the messages and
+     * clears the vector; messages that could not be sent are freed.
+     * @param msgs the messages to send
+     * @return 0 on success, openvswitch error code on failure
+     */
+    virtual int SendMessages(std::vector<struct ofpbuf*>& msgs);
+
+    /**
+     * Get the number of messages handed to SendMessage() or
+     * SendMessages() that the switch has not yet been seen to
+     * process: those not yet written to the connection, and those
+     * written since the last barrier request that was answered.
+     */
+    size_t GetSendQueueDepth();
+
+    /**
+     * Get the largest send queue depth seen on this connection
+     */
+    size_t GetMaxSendQueueDepth();
+
+    /**
+     * Classes of asynchronous messages the switch can send
+     */
+    enum AsyncMessage {
+        /** Packets sent to the controller */
+        ASYNC_PACKET_IN = 1 << 0,
+        /** Changes to the switch ports */
+        ASYNC_PORT_STATUS = 1 << 1,
+        /** Flows removed from the flow tables */
+        ASYNC_FLOW_REMOVED = 1 << 2
+    };
+
+    /**
+     * Choose the asynchronous messages the switch sends on this
+     * connection.  The choice is applied each time the connection is
+     * established, before the on-connect listeners are notified.
+     * Before OpenFlow 1.3, the Nicira extension is used.  Must be
+     * called before Connect().
+     * @param messages a mask of AsyncMessage values
+     */
+    void SetAsyncMessages(int messages);
+
+    /**
+     * Make this an auxiliary connection.  The switch grants the
+     * master role to one connection at a time, so an auxiliary
+     * connection takes the equal role instead, which still allows
+     * it to modify the flow tables.  Must be called before Connect().
+     */
+    void SetAuxiliary();
+
+    /**
+     * Also offer a later protocol version than the one passed to
+     * Connect() when negotiating with the switch, and use it if the
+     * switch supports it.  GetProtocolVersion() returns the version
+     * negotiated.  Must be called before Connect().
+     * @param protoVer the later OpenFlow version to offer
+     */
+    void SetMaxProtocolVersion(int protoVer);
+
     /**
      * Returns the OpenFlow protocol version being used by the connection.
      */
@@ -189,11 +254,29 @@ private:
     std::string switchName;
     vconn *ofConn;
     int ofProtoVersion;
+    int minProtoVersion;
+    int maxProtoVersion;
+    int asyncMessages;
+    bool auxiliary;
 
     bool isDisconnecting;
 
     std::unique_ptr<std::thread> connThread;
     std::mutex connMtx;
+    // Messages handed to SendMessage(s) and not yet written
+    std::atomic<size_t> sendQueueDepth;
+    std::atomic<size_t> maxSendQueueDepth;
+    // Messages written since connecting, and the number of them the
+    // barrier replies show were processed by the switch
+    std::atomic<uint64_t> writtenMsgs;
+    std::atomic<uint64_t> ackedMsgs;
+    // The xid of each barrier request written and not yet answered,
+    // with the number of messages written up to it.  Protected by
+    // connMtx.
+    std::deque<std::pair<uint32_t, uint64_t> > pendingBarriers;
+
+    void updateMaxSendQueueDepth();
+    void handleBarrierReply(uint32_t xid);
 
     typedef std::list<MessageHandler *>     HandlerList;
     typedef std::unordered_map<int, HandlerList> HandlerMap;
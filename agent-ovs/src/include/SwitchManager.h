@@ -25,6 +25,9 @@
 
 #include <string>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 
 namespace ovsagent {
 
@@ -95,6 +98,154 @@ public:
      */
     void setSyncDelayOnConnect(long delay);
 
+    /**
+     * Enable batching of flow writes.  The flow mods produced by
+     * writeFlow() for any number of objects are collected and sent
+     * as one stream followed by a single barrier, once the batch
+     * reaches the given size or the oldest write in it reaches the
+     * given age.  Errors reported by the switch are still attributed
+     * to the object whose write produced the flow mod.
+     *
+     * @param maxFlowMods the number of flow mods at which a batch is
+     * sent, or 0 to disable batching
+     * @param maxDelayMs the longest time in milliseconds a flow mod
+     * waits in a batch before it is sent
+     */
+    void setFlowBatching(size_t maxFlowMods, long maxDelayMs);
+
+    /**
+     * Send any flow mods waiting in the current batch
+     */
+    void flushFlowBatch();
+
+    /**
+     * Counters for batched flow writes
+     */
+    struct FlowBatchStats {
+        /** Number of batches sent, each followed by one barrier */
+        uint64_t batches;
+        /** Number of flow mods sent in batches */
+        uint64_t flowMods;
+        /** Largest number of flow mods sent in one batch */
+        uint64_t maxFlowMods;
+        /** Number of batched flow mods rejected by the switch */
+        uint64_t failedFlowMods;
+        /** Sum over acknowledged batches of the time from the first
+            write in the batch until the barrier reply, in
+            microseconds */
+        uint64_t totalFlushLatencyUs;
+        /** Longest time from the first write in a batch until the
+            barrier reply, in microseconds */
+        uint64_t maxFlushLatencyUs;
+        /** Number of messages on the main connection that the switch
+            has not yet been seen to process */
+        uint64_t sendQueueDepth;
+        /** Largest number of messages on the main connection that the
+            switch had not yet been seen to process */
+        uint64_t maxSendQueueDepth;
+    };
+
+    /**
+     * Get the counters for batched flow writes, along with the
+     * backlog of the main connection
+     *
+     * @return a copy of the current counters
+     */
+    FlowBatchStats getFlowBatchStats();
+
+    /**
+     * Get the number of flow and group edits computed from the writes
+     * so far, whether or not they have been sent yet.  A write that
+     * leaves the count unchanged did not change the switch state.
+     *
+     * @return the number of edits
+     */
+    uint64_t getEditCount() { return editCount; }
+
+    /**
+     * Enable incremental synchronization after a reconnect.  While
+     * connected, a flow monitor on a second, OpenFlow 1.0
+     * connection reports the changes made to the flow tables by
+     * anyone else, and tables whose writes fail are noted as well.
+     * After each sync, a marker flow identifying this switch manager
+     * is written to a table outside the managed range.
+     *
+     * When the connection is reestablished, the marker and the
+     * number of flows in each table are read first.  If the marker
+     * is still there and the monitor has been running throughout,
+     * only the tables that changed or whose flow count differs are
+     * read back and reconciled, and the other tables just receive
+     * the writes made in the meantime.  Otherwise all the tables are
+     * read back as usual.
+     *
+     * Must be called before start().
+     *
+     * @param enabled true to enable incremental synchronization
+     */
+    void setIncrementalSync(bool enabled);
+
+    /**
+     * Carry packet-ins and statistics on connections of their own.
+     * Each auxiliary connection has its own receive thread, so large
+     * statistics replies and bursts of packet-ins don't hold up the
+     * barrier replies that flow programming waits for.  The switch
+     * sends packet-ins only on the packet-in connection, removed
+     * flow notifications only on the statistics connection, and
+     * port changes only on the main connection.
+     *
+     * Must be called before start().
+     *
+     * @param enabled true to open auxiliary connections
+     */
+    void setAuxConnections(bool enabled);
+
+    /**
+     * Offer OpenFlow 1.5 on the main connection, falling back to
+     * OpenFlow 1.3 if the switch does not support it.  With OpenFlow
+     * 1.5, group buckets can be inserted and removed one at a time
+     * rather than rewriting the whole group.  Everything else sent
+     * and received on the main connection, flow mods and flow reads
+     * included, uses the version negotiated too.
+     *
+     * Must be called before start().
+     *
+     * @param enabled true to offer OpenFlow 1.5
+     */
+    void setBucketCommands(bool enabled);
+
+    /**
+     * Give each object its own range of flow cookies, so that the
+     * flows an object has in a table can be removed with a single
+     * flow mod.  The object's ID, allocated from the given namespace,
+     * is stored in the bits of flow::cookie::OBJECT_MASK of each flow
+     * it writes whose cookie leaves the upper 32 bits clear.  When
+     * writing the flows of an object leaves two or more of them to
+     * be deleted, they are deleted with one flow mod that matches
+     * that cookie range instead of a strict delete for each.
+     *
+     * Must be called before start().
+     *
+     * @param idGen the ID generator used to allocate the IDs
+     * @param nmspc the namespace to allocate the IDs from, which
+     * must not be shared with another switch manager
+     */
+    void enableObjectCookies(IdGenerator& idGen, const std::string& nmspc);
+
+    /**
+     * Replace the deletions in a flow edit of the flows in a range
+     * of object cookies with a single deletion of the whole range,
+     * if there are at least two of them.  Only to be used once the
+     * object has no flows left in the table, since the range also
+     * covers the flows that are kept.
+     *
+     * @param tableId the table the edit applies to
+     * @param objCookie the object cookie, in network byte order
+     * @param diffs the edit to rewrite
+     * @return the number of deletions replaced
+     */
+    static size_t coalesceDeletes(int tableId, uint64_t objCookie,
+                                  FlowEdit& diffs);
+
     /* Interface: OnConnectListener */
     virtual void Connected(SwitchConnection *swConn);
 
@@ -112,6 +263,30 @@ public:
      */
     SwitchConnection* getConnection() { return connection.get(); }
 
+    /**
+     * Get the connection to use for packet-ins and the packet-outs
+     * and flows written in response to them.  This is the main
+     * connection unless auxiliary connections are enabled.
+     *
+     * @return the connection
+     */
+    SwitchConnection* getPacketInConnection() {
+        return packetInConnection ? packetInConnection.get()
+                                  : connection.get();
+    }
+
+    /**
+     * Get the connection to use for statistics requests and removed
+     * flow notifications.  This is the main connection unless
+     * auxiliary connections are enabled.
+     *
+     * @return the connection
+     */
+    SwitchConnection* getStatsConnection() {
+        return statsConnection ? statsConnection.get()
+                               : connection.get();
+    }
+
     /**
      * Get the port mapper for this switch
      */
@@ -123,11 +298,18 @@ public:
     FlowReader& getFlowReader() { return flowReader; }
 
     /**
-     * Write the given flow list to the flow table
+     * Write the given flow list to the flow table.  The resulting
+     * flow mods are sent to the switch without waiting for it to act
+     * on them; any errors reported later by the switch are logged
+     * against the object and the individual flow.  If flow batching
+     * is enabled, the flow mods may wait to be sent along with those
+     * of other objects.  Objects can write flows from different
+     * threads; the writes to a table are serialized.
      *
      * @param objId the ID for the object associated with the flow
      * @param tableId the tableId for the flow table
      * @param el the list of flows to write
+     * @return false if the flow mods could not be sent
      */
     bool writeFlow(const std::string& objId, int tableId, FlowEntryList& el);
 
@@ -191,6 +373,37 @@ protected:
      */
     std::unique_ptr<SwitchConnection> connection;
 
+    /**
+     * Connection used to monitor flow table changes, if incremental
+     * synchronization is enabled
+     */
+    std::unique_ptr<SwitchConnection> monitorConnection;
+
+    /**
+     * True if incremental synchronization is enabled
+     */
+    bool incrementalSync;
+
+    /**
+     * Auxiliary connection for packet-ins, if enabled
+     */
+    std::unique_ptr<SwitchConnection> packetInConnection;
+
+    /**
+     * Auxiliary connection for statistics, if enabled
+     */
+    std::unique_ptr<SwitchConnection> statsConnection;
+
+    /**
+     * True if auxiliary connections are enabled
+     */
+    bool auxConnections;
+
+    /**
+     * True if OpenFlow 1.5 is offered on the main connection
+     */
+    bool bucketCommands;
+
 private:
     /**
      * Begin reconciliation by reading all the flows and groups from the
@@ -198,6 +411,64 @@ private:
      */
     void initiateSync();
 
+    /**
+     * Start reading the given tables and all the groups from the
+     * switch.  Writes to the other tables are held until the sync
+     * completes.  Called with the tables locked.
+     */
+    void startSync(const std::vector<bool>& tables);
+
+    /**
+     * Callback function provided to FlowReader to process the
+     * sync marker flows
+     */
+    void gotMarker(const FlowEntryList& flows, bool done);
+
+    /**
+     * Callback function provided to FlowReader to process the
+     * number of flows in a table
+     */
+    void gotFlowCount(int tableId, uint64_t count, bool done);
+
+    /**
+     * Determine if the marker and all flow counts were received;
+     * starts reading the tables that need to be reconciled if so.
+     */
+    void checkStateDone();
+
+    /**
+     * Choose the tables to read back for an incremental sync from the
+     * marker and flow counts
+     */
+    void startIncrementalSync();
+
+    /**
+     * Write the sync marker flow after a sync
+     */
+    void writeSyncMarker();
+
+    /**
+     * Note that a table may no longer match its table state
+     */
+    void markTableDirty(int tableId);
+
+    /**
+     * Callback function provided to FlowReader to process changes
+     * reported by the flow monitor
+     */
+    void flowUpdated(int event, const FlowEntryPtr& fe);
+
+    /**
+     * Check a change reported by the flow monitor against the table
+     * state
+     */
+    void handleFlowUpdate(int event, const FlowEntryPtr& fe);
+
+    /**
+     * Subscribe to flow table changes on the monitor connection
+     */
+    void handleMonitorConnection();
+
     /**
      * Compare flows/groups read from switch to determine the differences
      * and make modification to eliminate those differences.
@@ -229,14 +500,59 @@ private:
      */
     void clearSyncState();
 
+    /**
+     * Add flow edits for an object to the current batch, and send
+     * the batch if it is full.  Releases the lock of the table once
+     * the edits are sure to be sent in order.
+     */
+    bool queueFlowEdits(const std::string& objId, const FlowEdit& diffs,
+                        std::unique_lock<std::mutex>& tableGuard);
+
+    /**
+     * Send the current batch.  Must be called with batchMutex held.
+     */
+    bool sendFlowBatch();
+
+    /**
+     * Get the cookie for the range of an object, or 0 if object
+     * cookies are not enabled or no ID can be allocated
+     */
+    uint64_t getObjectCookie(const std::string& objId);
+
+    /**
+     * Release the cookie range of an object once it has no flows
+     * left in any table
+     */
+    void releaseObjectCookie(const std::string& objId);
+
+    /**
+     * Lock every flow table, so that the sync state can change
+     * without racing writes from other threads
+     */
+    std::vector<std::unique_lock<std::mutex> > lockTables();
+
+    void onBatchTimer(const boost::system::error_code& ec);
+
     Agent& agent;
     FlowExecutor& flowExecutor;
     FlowReader& flowReader;
     PortMapper& portMapper;
     SwitchStateHandler* stateHandler;
 
-    // table state
+    // table state, each table guarded by its own mutex along with
+    // the sync state of the table.  Writing the sync state takes all
+    // of them.
     std::vector<TableState> flowTables;
+    std::unique_ptr<std::mutex[]> tableMutexes;
+
+    // held while edits are handed to the flow executor.  It is taken
+    // before the table locks are released, so that edits are sent in
+    // the order they were computed without holding the tables.  Taken
+    // after any table lock and after batchMutex, and only once the
+    // flow executor has room for the edits, so that other writers do
+    // not wait on it while the switch catches up.  No completion
+    // callback may take it.
+    std::mutex sendMutex;
 
     // connection state
     void handleConnection(SwitchConnection *sw);
@@ -256,6 +572,39 @@ private:
 
     SwitchStateHandler::GroupMap recvGroups;
     bool groupsDone;
+
+    // incremental sync state
+    uint64_t syncGeneration;
+    std::vector<bool> syncTables;
+    std::vector<FlowEdit> deferredEdits;
+    bool markerDone;
+    bool markerFound;
+    std::vector<uint64_t> recvCounts;
+    std::vector<bool> countDone;
+
+    std::mutex dirtyMutex;
+    std::vector<bool> dirtyTables;
+    bool markerWritten;
+    bool changesLost;
+
+    // flow write batching state
+    size_t batchMaxFlowMods;
+    long batchMaxDelayMs;
+    std::mutex batchMutex;
+    FlowEdit batch;
+    std::vector<std::string> batchObjIds;
+    std::chrono::steady_clock::time_point batchStart;
+    std::unique_ptr<boost::asio::deadline_timer> batchTimer;
+    bool batchTimerArmed;
+
+    std::mutex batchStatsMutex;
+    FlowBatchStats batchStats;
+
+    // object cookie state
+    IdGenerator* objCookieIds;
+    std::string objCookieNmspc;
+
+    std::atomic<uint64_t> editCount;
 };
 
 } // namespace ovsagent
@@ -40,16 +40,37 @@ public:
      * Compare flows read from switch and make modification to eliminate
      * differences.
      *
-     * @param flowTables the current flow table state
+     * @param flowTables the current flow table state, or NULL for
+     * the tables that were not read back from the switch.  The state
+     * is borrowed from the switch manager, which does not change it
+     * until this returns.
      * @param recvFlows the flows received from the switch to
      * reconcile against, with a flow entry list per table.  It is
      * safe to modify this vector.
      * @return the necessary edits to reconcile the flows
      */
     virtual std::vector<FlowEdit>
-    reconcileFlows(std::vector<TableState> flowTables,
+    reconcileFlows(const std::vector<const TableState*>& flowTables,
                    std::vector<FlowEntryList>& recvFlows);
 
+    /**
+     * Compute the differences between the flow table state and the
+     * flows received from the switch for every table.  The tables
+     * are split among up to the given number of threads.
+     *
+     * @param flowTables the current flow table state, or NULL for
+     * the tables to leave without edits
+     * @param recvFlows the flows received from the switch, with a
+     * flow entry list per table
+     * @param maxThreads the largest number of threads to use, or 0
+     * to use one per hardware thread
+     * @return the edits for each table
+     */
+    static std::vector<FlowEdit>
+    diffTables(const std::vector<const TableState*>& flowTables,
+               const std::vector<FlowEntryList>& recvFlows,
+               size_t maxThreads = 0);
+
     /**
      * A map from a group table ID to an associated group edit
      */
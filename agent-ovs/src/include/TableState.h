@@ -15,9 +15,11 @@
 #include <vector>
 #include <utility>
 #include <memory>
+#include <atomic>
 #include <boost/noncopyable.hpp>
 
 struct ofputil_flow_stats;
+struct ofpbuf;
 struct ofputil_group_mod;
 struct match;
 
@@ -29,6 +31,15 @@ namespace ovsagent {
 class FlowEntry : private boost::noncopyable {
 public:
     FlowEntry();
+
+    /**
+     * Create a flow entry whose flow stats and actions belong to a
+     * FlowEntryArena, which frees them rather than the entry
+     *
+     * @param stats the zeroed flow stats allocated from the arena
+     */
+    explicit FlowEntry(struct ofputil_flow_stats* stats);
+
     ~FlowEntry();
 
     /**
@@ -45,10 +56,36 @@ public:
      */
     bool actionEq(const FlowEntry *rhs);
 
+    /**
+     * Drop the cached encoding of the flow mod that adds this entry.
+     * Must be called if the entry is changed after it may have been
+     * written to a switch.
+     */
+    void clearEncoding();
+
+    /**
+     * Check whether the flow stats and actions of this entry belong
+     * to a FlowEntryArena.  Their actions must then be allocated from
+     * the arena too, or the entry promoted before they are replaced.
+     *
+     * @return true if the entry belongs to an arena
+     */
+    bool isArenaEntry() const { return arenaEntry; }
+
     /**
      * The flow entry
      */
     struct ofputil_flow_stats* entry;
+
+    /**
+     * The flow mod that adds this entry, as encoded by a flow
+     * executor with its encoding cache enabled, or NULL.  Once set,
+     * it is not changed until cleared.
+     */
+    std::atomic<struct ofpbuf*> encoding;
+
+private:
+    bool arenaEntry;
 };
 /**
  * A shared pointer to a flow entry
@@ -94,7 +131,13 @@ public:
         /**
          * Delete flows
          */
-        DEL
+        DEL,
+        /**
+         * Delete all the flows in the table of the entry whose
+         * cookie matches the cookie of the entry in the bits of
+         * flow::cookie::OBJECT_MASK
+         */
+        DEL_COOKIE
     };
 
     /**
@@ -160,10 +203,12 @@ public:
      *
      * @param lhs One of the groups to compare
      * @param rhs The other group to compare
+     * @param compareBucketIds compare the IDs of the buckets too,
+     * which the switch only preserves from OpenFlow 1.5
      * @return true if groups are equal
      */
     static bool groupEq(const GroupEdit::Entry& lhs,
-            const GroupEdit::Entry& rhs);
+            const GroupEdit::Entry& rhs, bool compareBucketIds = false);
 
     /**
      * The group edits that need to be made
@@ -191,10 +236,18 @@ public:
 
     /**
      * Update cached entry-list corresponding to given object-id
+     *
+     * @param objId the object ID
+     * @param el the new entries of the object
+     * @param diffs the edits needed to bring the switch up to date
+     * @param objCookie the object cookie, in network byte order, that
+     * the entries the table keeps are given if their cookie leaves
+     * the upper 32 bits clear, or 0
      */
     void apply(const std::string& objId,
                FlowEntryList& el,
-               /* out */ FlowEdit& diffs);
+               /* out */ FlowEdit& diffs,
+               uint64_t objCookie = 0);
 
     /**
      * Compute the differences between provided table-entries and all the
@@ -213,6 +266,14 @@ public:
     typedef std::function<void (uint64_t, uint16_t, const struct match&)>
     cookie_callback_t;
 
+    /**
+     * Check whether the table holds any flows for an object
+     *
+     * @param objId the object ID
+     * @return true if the object has flows in the table
+     */
+    bool hasObject(const std::string& objId) const;
+
     /**
      * Call the callback synchronously for each unique cookie and flow
      * table match in the flow table.
@@ -221,6 +282,23 @@ public:
      */
     void forEachCookieMatch(cookie_callback_t& cb) const;
 
+    /**
+     * Get the entry currently in the table with the same priority
+     * and match as the given entry
+     *
+     * @param fe the entry to look up
+     * @return the entry in the table, or an empty pointer if there
+     * is none
+     */
+    FlowEntryPtr getEntry(const FlowEntryPtr& fe) const;
+
+    /**
+     * Get the number of entries currently in the table
+     *
+     * @return the number of distinct priority/match entries
+     */
+    size_t size() const;
+
 private:
     class TableStateImpl;
     TableStateImpl* pimpl;
@@ -13,16 +13,30 @@
 
 #include <boost/asio/io_service.hpp>
 
-#include <unordered_set>
+#include <unordered_map>
+#include <map>
+#include <deque>
 #include <string>
 #include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
 #include <functional>
 
 namespace ovsagent {
 
 /**
  * Queue tasks using a boost::asio::io_service so that the same task
- * is not queued multiple times
+ * is not queued multiple times.  The tasks can instead run on a pool
+ * of worker threads, in which case tasks with different task IDs run
+ * in parallel but those with the same ID never run at the same time.
+ *
+ * Tasks are dispatched into named lanes.  Each time a task is to run,
+ * a lane with waiting tasks is chosen by smooth weighted round robin
+ * over the lanes' weights, and its oldest task runs, so that a
+ * backlog in a low weight lane only slows a higher weight lane in
+ * proportion to the weights.
  */
 class TaskQueue {
 public:
@@ -32,26 +46,148 @@ public:
      */
     TaskQueue(boost::asio::io_service& io_service);
 
+    /**
+     * Stop any worker threads
+     */
+    ~TaskQueue();
+
+    /**
+     * The lane tasks are dispatched into when no lane is given, with
+     * a weight of 1
+     */
+    static const std::string DEFAULT_LANE;
+
+    /**
+     * Add a lane, or change the weight of an existing lane
+     *
+     * @param lane the name of the lane
+     * @param weight the share of task runs the lane gets relative to
+     * the other lanes while they all have tasks waiting.  Must be
+     * positive.
+     */
+    void addLane(const std::string& lane, unsigned weight);
+
+    /**
+     * Run the tasks dispatched from now on on a pool of worker
+     * threads of their own rather than on the io_service.  The tasks
+     * must then be safe to run in parallel with other tasks of the
+     * queue that have a different task ID.
+     *
+     * @param numWorkers the number of worker threads
+     */
+    void startWorkers(size_t numWorkers);
+
+    /**
+     * Stop the worker threads, dropping the tasks that haven't begun
+     * executing
+     */
+    void stopWorkers();
+
     /**
      * Dispatch the given task with the specified task ID.  If a task
      * with the given task ID has already been queued and not been
-     * executed, the task will not be queued again.  The task can be
-     * queued again once it has begun executing.
+     * executed, the task replaces it and keeps its place in the
+     * queue, so only the latest task runs.  If the task is
+     * dispatched into another lane, it moves to the back of that
+     * lane instead.  If a task with the ID is
+     * executing, the task will run once the execution in progress
+     * completes, however many times it is dispatched meanwhile.
      *
      * @param taskId a unique ID for the task
      * @param task a function to execute for the task.  This will be
      * copied onto the task queue
+     * @param lane the lane to queue the task in.  Tasks dispatched
+     * into a lane that was not added go in the default lane.
      */
     void dispatch(const std::string& taskId,
-                  const std::function<void ()>& task);
+                  const std::function<void ()>& task,
+                  const std::string& lane = DEFAULT_LANE);
+
+    /**
+     * Counters for the tasks of a lane
+     */
+    struct LaneStats {
+        /** Number of tasks queued in the lane and not yet executing */
+        uint64_t depth;
+        /** Number of tasks that have executed */
+        uint64_t tasks;
+        /** Number of dispatches that replaced a queued task */
+        uint64_t coalesced;
+        /** Sum of the time the tasks waited from their dispatch until
+            they began executing, in microseconds */
+        uint64_t totalWaitUs;
+        /** Longest time a task waited, in microseconds */
+        uint64_t maxWaitUs;
+        /** Sum of the time the tasks executed, in microseconds */
+        uint64_t totalRunUs;
+        /** Longest time a task executed, in microseconds */
+        uint64_t maxRunUs;
+    };
+
+    /**
+     * Get the counters for a lane
+     *
+     * @param lane the name of the lane
+     * @return a copy of the current counters, or zeroed counters if
+     * there is no such lane
+     */
+    LaneStats getLaneStats(const std::string& lane);
+
+    /**
+     * Get the counters for every lane
+     *
+     * @return a copy of the current counters, by lane name
+     */
+    std::map<std::string, LaneStats> getAllLaneStats();
 
 private:
-    void run_task(const std::string& taskId,
-                  const std::function<void ()>& task);
+    typedef std::chrono::steady_clock clock;
+
+    void run_task();
+    void post();
 
     boost::asio::io_service& io_service;
+    std::unique_ptr<boost::asio::io_service> workerService;
+    std::unique_ptr<boost::asio::io_service::work> workerWork;
+    std::vector<std::thread> workers;
+
+    /**
+     * The tasks that are queued or executing
+     */
+    struct TaskState {
+        TaskState() : queued(false), running(false) {}
+
+        /** The task is queued to execute */
+        bool queued;
+        /** The task is executing */
+        bool running;
+        /** The latest task dispatched that has not begun executing */
+        std::function<void ()> task;
+        /** The lane the task is queued in */
+        std::string lane;
+        /** When the task was first dispatched since it last ran */
+        clock::time_point dispatched;
+    };
+
+    /**
+     * A lane and the IDs of its tasks that are ready to execute, in
+     * the order they became ready
+     */
+    struct Lane {
+        Lane() : weight(1), current(0), stats() {}
+
+        unsigned weight;
+        long current;
+        std::deque<std::string> ready;
+        LaneStats stats;
+    };
+
+    Lane* nextLane();
+    void makeReady(const std::string& taskId, TaskState& state);
+
     std::mutex queueMutex;
-    std::unordered_set<std::string> queuedItems;
+    std::unordered_map<std::string, TaskState> queuedItems;
+    std::map<std::string, Lane> lanes;
 };
 
 } // namespace ovsagent
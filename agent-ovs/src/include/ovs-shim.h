@@ -33,10 +33,12 @@ extern "C" {
     struct flow;
 
     /**
-     * Check if group mod is equal
+     * Check if group mod is equal, comparing the bucket IDs too if
+     * compare_bucket_ids is nonzero
      */
     int group_mod_equal(struct ofputil_group_mod* lgm,
-                        struct ofputil_group_mod* rgm);
+                        struct ofputil_group_mod* rgm,
+                        int compare_bucket_ids);
 
     /**
      * Check for action equality (ofpact_equal)
@@ -201,12 +203,35 @@ extern "C" {
                        uint32_t arg,
                        int dst);
 
+    /**
+     * conjunction
+     */
+    void act_conjunction(struct ofpbuf* buf,
+                         uint32_t id,
+                         uint8_t clause,
+                         uint8_t nClauses);
+
+    /**
+     * Check whether the actions are all conjunction actions
+     */
+    int action_conj_only(const struct ofpact* ofpacts,
+                         size_t ofpacts_len);
+
     /**
      * Get the value of the output reg action
      */
     uint32_t get_output_reg_value(const struct ofpact* ofpacts,
                                   size_t ofpacts_len);
 
+    /**
+     * Set the value of every set field action on the given field,
+     * leaving its mask as it is
+     *
+     * @return the number of actions changed
+     */
+    int set_field_action_values(struct ofpact* ofpacts, size_t ofpacts_len,
+                                int field_id, const void* value);
+
     /**
      * malloc a dp_packet
      */
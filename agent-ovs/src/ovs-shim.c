@@ -16,6 +16,7 @@
 #include <lib/dp-packet.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 void format_action(const struct ofpact* acts, size_t ofpacts_len,
                    struct ds* str) {
@@ -28,7 +29,8 @@ int action_equal(const struct ofpact* lhs, size_t lhs_len,
 }
 
 int group_mod_equal(struct ofputil_group_mod* lgm,
-                    struct ofputil_group_mod* rgm) {
+                    struct ofputil_group_mod* rgm,
+                    int compare_bucket_ids) {
     if (lgm->group_id == rgm->group_id &&
         lgm->type == rgm->type) {
         int lempty = ovs_list_is_empty(&lgm->buckets);
@@ -44,9 +46,12 @@ int group_mod_equal(struct ofputil_group_mod* lgm,
         struct ofputil_bucket *lbkt = ofputil_bucket_list_front(&lgm->buckets);
         struct ofputil_bucket *rbkt = ofputil_bucket_list_front(&rgm->buckets);
         while (lbkt != lhead && rbkt != rhead) {
-            /* Buckets IDs are not compared because they are assigned by the
-             * switch prior to OpenFlow 1.5
+            /* Buckets IDs are only compared when asked to because they
+             * are assigned by the switch prior to OpenFlow 1.5
              */
+            if (compare_bucket_ids && lbkt->bucket_id != rbkt->bucket_id) {
+                return 0;
+            }
             if (!ofpacts_equal(lbkt->ofpacts, lbkt->ofpacts_len,
                                rbkt->ofpacts, rbkt->ofpacts_len)) {
                 return 0;
@@ -270,6 +275,28 @@ void act_multipath(struct ofpbuf* buf,
     initSubField(&act->dst, dst);
 }
 
+void act_conjunction(struct ofpbuf* buf,
+                     uint32_t id,
+                     uint8_t clause,
+                     uint8_t nClauses) {
+    struct ofpact_conjunction* act = ofpact_put_CONJUNCTION(buf);
+    act->id = id;
+    act->clause = clause - 1;
+    act->n_clauses = nClauses;
+}
+
+int action_conj_only(const struct ofpact* ofpacts,
+                     size_t ofpacts_len) {
+    const struct ofpact* a;
+    if (ofpacts_len == 0)
+        return 0;
+    OFPACT_FOR_EACH (a, ofpacts, ofpacts_len) {
+        if (a->type != OFPACT_CONJUNCTION)
+            return 0;
+    }
+    return 1;
+}
+
 uint32_t get_output_reg_value(const struct ofpact* ofpacts,
                               size_t ofpacts_len) {
     const struct ofpact* a;
@@ -286,6 +313,23 @@ uint32_t get_output_reg_value(const struct ofpact* ofpacts,
     return OFPP_NONE;
 }
 
+int set_field_action_values(struct ofpact* ofpacts, size_t ofpacts_len,
+                            int field_id, const void* value) {
+    struct ofpact* a;
+    int count = 0;
+    OFPACT_FOR_EACH (a, ofpacts, ofpacts_len) {
+        if (a->type == OFPACT_SET_FIELD) {
+            struct ofpact_set_field* sf = ofpact_get_SET_FIELD(a);
+            const struct mf_field *mf = sf->field;
+            if (mf->id == field_id) {
+                memcpy(&sf->value, value, mf->n_bytes);
+                count += 1;
+            }
+        }
+    }
+    return count;
+}
+
 struct dp_packet* alloc_dpp() {
     return (struct dp_packet*)malloc(sizeof(struct dp_packet));
 }
@@ -70,6 +70,11 @@ public:
     void initExpDhcpEp(shared_ptr<Endpoint>& ep);
 };
 
+#define ADDF(flow) addExpFlowEntry(expTables, flow)
+enum TABLE {
+    GRP = 0, IN_POL = 1, OUT_POL = 2, OUT = 3,
+};
+
 BOOST_FIXTURE_TEST_CASE(endpoint, AccessFlowManagerFixture) {
     setConnected();
 
@@ -275,10 +280,201 @@ BOOST_FIXTURE_TEST_CASE(secGrp, AccessFlowManagerFixture) {
     WAIT_FOR_TABLES("remote-addsubnets", 500);
 }
 
-#define ADDF(flow) addExpFlowEntry(expTables, flow)
-enum TABLE {
-    GRP = 0, IN_POL = 1, OUT_POL = 2, OUT = 3,
-};
+BOOST_FIXTURE_TEST_CASE(secGrpConjunction, AccessFlowManagerFixture) {
+    accessFlowManager.enableClassifierConjunctions();
+    createObjects();
+    createPolicyObjects();
+
+    /* 2 remote subnets x 2 source port masks x 2 destination port
+       masks, which take 7 flows as a conjunction instead of 8 */
+    shared_ptr<L24Classifier> classifier10;
+    {
+        Mutator mutator(framework, "policyreg");
+        classifier10 = space->addGbpeL24Classifier("classifier10");
+        classifier10->setEtherT(modelgbp::l2::EtherTypeEnumT::CONST_IPV4)
+            .setProt(6 /* TCP */)
+            .setSFromPort(66).setSToPort(69)
+            .setDFromPort(80).setDToPort(85);
+
+        shared_ptr<modelgbp::gbp::Subnets> rs =
+            space->addGbpSubnets("subnets_rule1");
+        rs->addGbpSubnet("subnets_rule1_1")
+            ->setAddress("192.168.0.0")
+            .setPrefixLen(16);
+        rs->addGbpSubnet("subnets_rule1_2")
+            ->setAddress("10.0.0.0")
+            .setPrefixLen(8);
+        /* can't match IPv4 so isn't counted */
+        rs->addGbpSubnet("subnets_rule1_3")
+            ->setAddress("fd80::")
+            .setPrefixLen(32);
+
+        secGrp1 = space->addGbpSecGroup("secgrp1");
+        secGrp1->addGbpSecGroupSubject("1_subject1")
+            ->addGbpSecGroupRule("1_1_rule1")
+            ->setDirection(DirectionEnumT::CONST_IN).setOrder(100)
+            .addGbpRuleToClassifierRSrc(classifier10->getURI().toString());
+        secGrp1->addGbpSecGroupSubject("1_subject1")
+            ->addGbpSecGroupRule("1_1_rule1")
+            ->addGbpSecGroupRuleToRemoteAddressRSrc(rs->getURI().toString());
+        mutator.commit();
+    }
+
+    ep0.reset(new Endpoint("0-0-0-0"));
+    ep0->addSecurityGroup(secGrp1->getURI());
+    epSrc.updateEndpoint(*ep0);
+
+    uint16_t prio = PolicyManager::MAX_POLICY_RULE_PRIORITY;
+    const string setStr = secGrp1->getURI().toString();
+    const string clsStr = classifier10->getURI().toString();
+    uint32_t setId = idGen.getId("secGroupSet", setStr);
+    uint32_t cookie = idGen.getId("l24classifierRule", clsStr);
+    uint32_t conjId = idGen.getId("secGroupConjunction",
+                                  setStr + " " + setStr + " " +
+                                  clsStr + " in");
+
+    initExpStatic();
+    ADDF(Bldr().table(IN_POL).priority(prio).tcp().reg(SEPG, setId)
+         .isIpSrc("192.168.0.0/16")
+         .actions().conjunction(conjId, 1, 3).done());
+    ADDF(Bldr().table(IN_POL).priority(prio).tcp().reg(SEPG, setId)
+         .isIpSrc("10.0.0.0/8")
+         .actions().conjunction(conjId, 1, 3).done());
+    ADDF(Bldr().table(IN_POL).priority(prio).tcp().reg(SEPG, setId)
+         .isTpSrc(0x42, 0xfffe)
+         .actions().conjunction(conjId, 2, 3).done());
+    ADDF(Bldr().table(IN_POL).priority(prio).tcp().reg(SEPG, setId)
+         .isTpSrc(0x44, 0xfffe)
+         .actions().conjunction(conjId, 2, 3).done());
+    ADDF(Bldr().table(IN_POL).priority(prio).tcp().reg(SEPG, setId)
+         .isTpDst(0x50, 0xfffc)
+         .actions().conjunction(conjId, 3, 3).done());
+    ADDF(Bldr().table(IN_POL).priority(prio).tcp().reg(SEPG, setId)
+         .isTpDst(0x54, 0xfffe)
+         .actions().conjunction(conjId, 3, 3).done());
+    ADDF(Bldr().table(IN_POL).priority(prio).cookie(cookie)
+         .reg(SEPG, setId).isConjId(conjId)
+         .actions().go(OUT).done());
+    WAIT_FOR_TABLES("conjunction", 500);
+}
+
+BOOST_FIXTURE_TEST_CASE(secGrpBits, AccessFlowManagerFixture) {
+    accessFlowManager.enableSecGroupBits();
+    setConnected();
+    createObjects();
+    createPolicyObjects();
+    {
+        Mutator mutator(framework, "policyreg");
+        secGrp1 = space->addGbpSecGroup("secgrp1");
+        secGrp1->addGbpSecGroupSubject("1_subject1")
+            ->addGbpSecGroupRule("1_1_rule1")
+            ->setDirection(DirectionEnumT::CONST_IN).setOrder(100)
+            .addGbpRuleToClassifierRSrc(classifier1->getURI().toString());
+        secGrp2 = space->addGbpSecGroup("secgrp2");
+        secGrp2->addGbpSecGroupSubject("2_subject1")
+            ->addGbpSecGroupRule("2_1_rule1")
+            ->setDirection(DirectionEnumT::CONST_BIDIRECTIONAL).setOrder(20)
+            .addGbpRuleToClassifierRSrc(classifier5->getURI().toString());
+        mutator.commit();
+    }
+
+    ep0.reset(new Endpoint("0-0-0-0"));
+    ep0->setAccessInterface("ep0-access");
+    ep0->setAccessUplinkInterface("ep0-uplink");
+    ep0->addSecurityGroup(secGrp1->getURI());
+    ep0->addSecurityGroup(secGrp2->getURI());
+    portmapper.ports[ep0->getAccessInterface().get()] = 42;
+    portmapper.ports[ep0->getAccessUplinkInterface().get()] = 24;
+    portmapper.RPortMap[42] = ep0->getAccessInterface().get();
+    portmapper.RPortMap[24] = ep0->getAccessUplinkInterface().get();
+    epSrc.updateEndpoint(*ep0);
+
+    ep1.reset(new Endpoint("0-0-0-1"));
+    ep1->setAccessInterface("ep1-access");
+    ep1->setAccessUplinkInterface("ep1-uplink");
+    ep1->addSecurityGroup(secGrp1->getURI());
+    portmapper.ports[ep1->getAccessInterface().get()] = 17;
+    portmapper.ports[ep1->getAccessUplinkInterface().get()] = 18;
+    portmapper.RPortMap[17] = ep1->getAccessInterface().get();
+    portmapper.RPortMap[18] = ep1->getAccessUplinkInterface().get();
+    epSrc.updateEndpoint(*ep1);
+
+    uint16_t prio = PolicyManager::MAX_POLICY_RULE_PRIORITY;
+    uint32_t bit1 = 1 << (idGen.getId("secGroupBit",
+                                      secGrp1->getURI().toString()) - 1);
+    uint32_t bit2 = 1 << (idGen.getId("secGroupBit",
+                                      secGrp2->getURI().toString()) - 1);
+    uint32_t cookie1 = idGen.getId("l24classifierRule",
+                                   classifier1->getURI().toString());
+    uint32_t cookie5 = idGen.getId("l24classifierRule",
+                                   classifier5->getURI().toString());
+    uint32_t zone0 = idGen.getId("conntrack", ep0->getUUID());
+    uint32_t zone1 = idGen.getId("conntrack", ep1->getUUID());
+
+    /* the rules of each group are written once, whatever the sets of
+       groups of the endpoints */
+    initExpStatic();
+    ADDF(Bldr().table(GRP).priority(100).in(42)
+         .actions().load(RD, zone0).loadReg(8, bit1 | bit2)
+         .load(OUTPORT, 24).go(OUT_POL).done());
+    ADDF(Bldr().table(GRP).priority(100).in(24)
+         .actions().load(RD, zone0).loadReg(8, bit1 | bit2)
+         .load(OUTPORT, 42).go(IN_POL).done());
+    ADDF(Bldr().table(GRP).priority(100).in(17)
+         .actions().load(RD, zone1).loadReg(8, bit1)
+         .load(OUTPORT, 18).go(OUT_POL).done());
+    ADDF(Bldr().table(GRP).priority(100).in(18)
+         .actions().load(RD, zone1).loadReg(8, bit1)
+         .load(OUTPORT, 17).go(IN_POL).done());
+    ADDF(Bldr().table(IN_POL).priority(prio).cookie(cookie1)
+         .tcp().isReg(8, bit1, bit1).isTpDst(80).actions().go(OUT).done());
+    ADDF(Bldr().table(IN_POL).priority(prio).cookie(cookie5)
+         .isReg(8, bit2, bit2).isEth(0x8906).actions().go(OUT).done());
+    ADDF(Bldr().table(OUT_POL).priority(prio).cookie(cookie5)
+         .isReg(8, bit2, bit2).isEth(0x8906).actions().go(OUT).done());
+    WAIT_FOR_TABLES("bits", 500);
+
+    /* the rules of a group no endpoint is in are removed */
+    std::set<URI> secGrps;
+    secGrps.insert(secGrp1->getURI());
+    ep0->setSecurityGroups(secGrps);
+    epSrc.updateEndpoint(*ep0);
+
+    clearExpFlowTables();
+    initExpStatic();
+    ADDF(Bldr().table(GRP).priority(100).in(42)
+         .actions().load(RD, zone0).loadReg(8, bit1)
+         .load(OUTPORT, 24).go(OUT_POL).done());
+    ADDF(Bldr().table(GRP).priority(100).in(24)
+         .actions().load(RD, zone0).loadReg(8, bit1)
+         .load(OUTPORT, 42).go(IN_POL).done());
+    ADDF(Bldr().table(GRP).priority(100).in(17)
+         .actions().load(RD, zone1).loadReg(8, bit1)
+         .load(OUTPORT, 18).go(OUT_POL).done());
+    ADDF(Bldr().table(GRP).priority(100).in(18)
+         .actions().load(RD, zone1).loadReg(8, bit1)
+         .load(OUTPORT, 17).go(IN_POL).done());
+    ADDF(Bldr().table(IN_POL).priority(prio).cookie(cookie1)
+         .tcp().isReg(8, bit1, bit1).isTpDst(80).actions().go(OUT).done());
+    WAIT_FOR_TABLES("group-unused", 500);
+
+    /* endpoints with no group still use the empty set */
+    ep1->setSecurityGroups(std::set<URI>());
+    epSrc.updateEndpoint(*ep1);
+
+    clearExpFlowTables();
+    initExpStatic();
+    ADDF(Bldr().table(GRP).priority(100).in(42)
+         .actions().load(RD, zone0).loadReg(8, bit1)
+         .load(OUTPORT, 24).go(OUT_POL).done());
+    ADDF(Bldr().table(GRP).priority(100).in(24)
+         .actions().load(RD, zone0).loadReg(8, bit1)
+         .load(OUTPORT, 42).go(IN_POL).done());
+    initExpEp(ep1);
+    ADDF(Bldr().table(IN_POL).priority(prio).cookie(cookie1)
+         .tcp().isReg(8, bit1, bit1).isTpDst(80).actions().go(OUT).done());
+    WAIT_FOR_TABLES("no-group", 500);
+}
 
 void AccessFlowManagerFixture::initExpStatic() {
     ADDF(Bldr().table(OUT).priority(1).isMdAct(0)
@@ -0,0 +1,57 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Heap allocation counter for benchmarks, which replaces the malloc
+ * functions of glibc with ones that count their calls
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include "AllocCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+
+static std::atomic<size_t> allocs(0);
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) throw() {
+    allocs++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) throw() {
+    allocs++;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) throw() {
+    allocs++;
+    return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+namespace ovsagent {
+
+bool allocCountEnabled() {
+#ifdef __GLIBC__
+    return true;
+#else
+    return false;
+#endif
+}
+
+size_t getAllocCount() {
+    return allocs;
+}
+
+} // namespace ovsagent
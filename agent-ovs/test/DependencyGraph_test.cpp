@@ -0,0 +1,66 @@
+/*
+ * Test suite for class DependencyGraph
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include "DependencyGraph.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace ovsagent {
+
+using std::string;
+using std::unordered_set;
+
+BOOST_AUTO_TEST_SUITE(DependencyGraph_test)
+
+BOOST_AUTO_TEST_CASE(changed) {
+    DependencyGraph graph;
+    DependencyGraph::input_map_t inputs;
+
+    inputs["group1"] = "vnid=1";
+    graph.setInputs("ep1", inputs);
+    BOOST_CHECK(inputs.empty());
+    inputs["group1"] = "vnid=1";
+    inputs["group2"] = "vnid=2";
+    graph.setInputs("ep2", inputs);
+    inputs["group2"] = "vnid=2";
+    graph.setInputs("ep3", inputs);
+    BOOST_CHECK_EQUAL(3, graph.size());
+    BOOST_CHECK(graph.hasObject("ep1"));
+    BOOST_CHECK(!graph.hasObject("ep4"));
+
+    // Only objects that read a different value are changed
+    unordered_set<string> changed;
+    BOOST_CHECK_EQUAL(2, graph.getChanged("group1", "vnid=1", changed));
+    BOOST_CHECK(changed.empty());
+    BOOST_CHECK_EQUAL(0, graph.getChanged("group2", "vnid=3", changed));
+    BOOST_CHECK(changed == unordered_set<string>({"ep2", "ep3"}));
+    changed.clear();
+    BOOST_CHECK_EQUAL(0, graph.getChanged("group3", "vnid=3", changed));
+    BOOST_CHECK(changed.empty());
+
+    // Inputs no longer read drop the dependency
+    inputs["group2"] = "vnid=3";
+    graph.setInputs("ep2", inputs);
+    graph.getChanged("group1", "vnid=4", changed);
+    BOOST_CHECK(changed == unordered_set<string>({"ep1"}));
+    changed.clear();
+    BOOST_CHECK_EQUAL(1, graph.getChanged("group2", "vnid=3", changed));
+    BOOST_CHECK(changed == unordered_set<string>({"ep3"}));
+
+    changed.clear();
+    graph.removeObject("ep3");
+    BOOST_CHECK(!graph.hasObject("ep3"));
+    graph.getChanged("group2", "vnid=4", changed);
+    BOOST_CHECK(changed == unordered_set<string>({"ep2"}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
@@ -0,0 +1,131 @@
+/*
+ * Test suite for class FlowEntryArena.
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+#include "FlowEntryArena.h"
+#include "FlowBuilder.h"
+#include "TableState.h"
+#include "logging.h"
+
+#include "ovs-shim.h"
+#include "ovs-ofputil.h"
+
+using namespace ovsagent;
+
+BOOST_AUTO_TEST_SUITE(FlowEntryArena_test)
+
+static FlowEntryPtr makeFlow(uint32_t port, size_t numActions = 1) {
+    FlowBuilder fb;
+    fb.priority(10).inPort(port);
+    for (size_t i = 0; i < numActions; ++i)
+        fb.action().reg(MFF_REG0, i);
+    return fb.action().output(port + 1).parent().build();
+}
+
+BOOST_AUTO_TEST_CASE(build) {
+    FlowEntryPtr heap = makeFlow(5);
+    FlowEntryPtr longHeap = makeFlow(6, 50);
+    BOOST_CHECK(!heap->isArenaEntry());
+
+    FlowEntryArena arena(4096);
+    FlowEntryArena::Scope scope(arena);
+    FlowEntryPtr fe = makeFlow(5);
+    // actions that outgrow the stub the arena gives them
+    FlowEntryPtr longFe = makeFlow(6, 50);
+
+    BOOST_CHECK(fe->isArenaEntry());
+    BOOST_CHECK(fe->matchEq(heap.get()));
+    BOOST_CHECK(fe->actionEq(heap.get()));
+    BOOST_CHECK(longFe->isArenaEntry());
+    BOOST_CHECK(longFe->matchEq(longHeap.get()));
+    BOOST_CHECK(longFe->actionEq(longHeap.get()));
+
+    FlowEntryPtr promoted = FlowEntryArena::promote(fe);
+    BOOST_CHECK(!promoted->isArenaEntry());
+    BOOST_CHECK(promoted->matchEq(fe.get()));
+    BOOST_CHECK(promoted->actionEq(fe.get()));
+    BOOST_CHECK(FlowEntryArena::promote(heap) == heap);
+}
+
+BOOST_AUTO_TEST_CASE(chunks) {
+    FlowEntryArena arena(4096);
+    BOOST_CHECK_EQUAL(0, arena.getChunkCount());
+    {
+        FlowEntryArena::Scope scope(arena);
+        BOOST_CHECK(FlowEntryArena::current() == &arena);
+        {
+            FlowEntryArena inner;
+            FlowEntryArena::Scope innerScope(inner);
+            BOOST_CHECK(FlowEntryArena::current() == &inner);
+        }
+        BOOST_CHECK(FlowEntryArena::current() == &arena);
+        for (uint32_t i = 0; i < 32; ++i)
+            makeFlow(i);
+    }
+    BOOST_CHECK(FlowEntryArena::current() == NULL);
+    BOOST_CHECK(arena.getChunkCount() > 1);
+
+    // Entries keep the memory of the arena alive
+    FlowEntryPtr fe;
+    {
+        FlowEntryArena shortLived;
+        FlowEntryArena::Scope scope(shortLived);
+        fe = makeFlow(5);
+    }
+    BOOST_CHECK(fe->matchEq(makeFlow(5).get()));
+    BOOST_CHECK(fe->actionEq(makeFlow(5).get()));
+}
+
+BOOST_AUTO_TEST_CASE(apply) {
+    TableState state;
+    FlowEdit diffs;
+    FlowEntryList el;
+
+    {
+        FlowEntryArena arena;
+        FlowEntryArena::Scope scope(arena);
+        el.push_back(makeFlow(1));
+        el.push_back(makeFlow(2));
+        state.apply("test", el, diffs);
+    }
+    BOOST_REQUIRE_EQUAL(2, diffs.edits.size());
+    for (const FlowEdit::Entry& e : diffs.edits) {
+        BOOST_CHECK(!e.second->isArenaEntry());
+        BOOST_CHECK(!state.getEntry(e.second)->isArenaEntry());
+    }
+    FlowEntryPtr kept = state.getEntry(makeFlow(1));
+
+    // The same flows again are dropped in favour of those in the
+    // table, and a changed flow is promoted
+    el.clear();
+    {
+        FlowEntryArena arena;
+        FlowEntryArena::Scope scope(arena);
+        el.push_back(makeFlow(1));
+        FlowBuilder changed;
+        changed.priority(10).inPort(2).action().output(7);
+        el.push_back(changed.build());
+        state.apply("test", el, diffs);
+    }
+    BOOST_REQUIRE_EQUAL(1, diffs.edits.size());
+    BOOST_CHECK_EQUAL(FlowEdit::MOD, diffs.edits[0].first);
+    BOOST_CHECK(!diffs.edits[0].second->isArenaEntry());
+    BOOST_CHECK(state.getEntry(makeFlow(1)) == kept);
+    BOOST_CHECK(!state.getEntry(makeFlow(2))->isArenaEntry());
+
+    el.clear();
+    state.apply("test", el, diffs);
+    BOOST_CHECK_EQUAL(2, diffs.edits.size());
+    BOOST_CHECK_EQUAL(0, state.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,13 @@
  */
 
 #include <vector>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <boost/test/unit_test.hpp>
 #include <boost/assign/list_inserter.hpp>
 
@@ -28,13 +35,17 @@ using namespace ovsagent;
 class MockExecutorConnection : public SwitchConnection {
 public:
     MockExecutorConnection() : SwitchConnection("mockBridge"),
-        errReply(ofperr(0)), reconnectReply(false) {
+        errReply(ofperr(0)), reconnectReply(false), rejectBundles(false),
+        deferReplies(false),
+        rtt(0), stopping(false) {
     }
     ~MockExecutorConnection() {
+        StopReplies();
     }
 
     int GetProtocolVersion() { return OFP13_VERSION; }
     int SendMessage(ofpbuf *msg);
+    int SendMessages(std::vector<ofpbuf*>& msgs);
 
     void Expect(const FlowEdit& fe) {
         expectedEdits = fe;
@@ -43,11 +54,67 @@ public:
         errReply = err;
     }
 
+    /* Hold barrier replies until FlushReplies() is called */
+    void DeferReplies() {
+        deferReplies = true;
+    }
+
+    /* Deliver each barrier reply from another thread, rttMs after
+       the barrier request was sent */
+    void ReplyAfter(int rttMs) {
+        rtt = std::chrono::milliseconds(rttMs);
+        replyThread = std::thread(&MockExecutorConnection::replyLoop, this);
+    }
+
+    void FlushReplies();
+
+    /* Stop the reply thread and drop any undelivered replies */
+    void StopReplies();
+
+    /* A message sent to the switch, as seen by the switch */
+    struct Frame {
+        ofptype type;
+        /* for bundle messages */
+        uint32_t bundleId;
+        uint16_t flags;
+        /* control request type for bundle control messages */
+        uint16_t ctrlType;
+        /* type of the message inside bundle add messages */
+        ofptype innerType;
+    };
+
     FlowEdit expectedEdits;
     ovs_be32 lastXid;
     ofperr errReply;
     bool reconnectReply;
+    /* Reply to bundle messages as a switch without bundle support */
+    bool rejectBundles;
+    std::vector<Frame> frames;
+    /* the number of messages in each call to SendMessages() */
+    std::vector<size_t> batches;
     FlowExecutor *executor;
+
+private:
+    struct Reply {
+        std::chrono::steady_clock::time_point due;
+        std::vector<ofpbuf*> errs;
+        ofpbuf *barrier;
+    };
+
+    void checkFlowMod(const ofp_header *msgHdr);
+
+    void deliver(Reply& r);
+    void replyLoop();
+
+    bool deferReplies;
+    std::chrono::milliseconds rtt;
+    std::mutex replyMtx;
+    std::condition_variable replyCond;
+    std::deque<Reply> replies;
+    /* error replies to send before the next barrier reply */
+    std::vector<ofpbuf*> pendingErrs;
+    std::thread replyThread;
+    bool stopping;
 };
 
 class FlowExecutorFixture {
@@ -58,6 +125,7 @@ public:
         createTestFlows();
     }
     ~FlowExecutorFixture() {
+        conn.StopReplies();
         fexec.UninstallListenersForConnection(&conn);
         flows.clear();
     }
@@ -88,6 +156,17 @@ BOOST_FIXTURE_TEST_CASE(noblock, FlowExecutorFixture) {
     BOOST_CHECK(conn.expectedEdits.edits.empty());
 }
 
+BOOST_FIXTURE_TEST_CASE(batchsend, FlowExecutorFixture) {
+    FlowEdit fe;
+    assign::push_back(fe.edits)(FlowEdit::ADD, flows[0])
+            (FlowEdit::ADD, flows[1])(FlowEdit::DEL, flows[0]);
+    conn.Expect(fe);
+    BOOST_CHECK(fexec.ExecuteNoBlock(fe));
+    BOOST_CHECK_EQUAL(1, conn.batches.size());
+    BOOST_CHECK_EQUAL(3, conn.batches[0]);
+    BOOST_CHECK_EQUAL(3, conn.frames.size());
+}
+
 BOOST_FIXTURE_TEST_CASE(moderror, FlowExecutorFixture) {
     FlowEdit fe;
     assign::push_back(fe.edits)(FlowEdit::MOD, flows[0]);
@@ -104,72 +183,466 @@ BOOST_FIXTURE_TEST_CASE(reconnect, FlowExecutorFixture) {
     BOOST_CHECK(fexec.Execute(fe) == false);
 }
 
+BOOST_FIXTURE_TEST_CASE(async, FlowExecutorFixture) {
+    conn.DeferReplies();
+
+    std::vector<int> statuses;
+    FlowExecutor::CompletionCb cb =
+        [&statuses](int status, const std::vector<int>& errors) {
+        statuses.push_back(status);
+        BOOST_CHECK(errors.empty());
+    };
+
+    FlowEdit fe1;
+    assign::push_back(fe1.edits)(FlowEdit::ADD, flows[0])
+        (FlowEdit::ADD, flows[1]);
+    conn.Expect(fe1);
+    BOOST_CHECK(fexec.ExecuteAsync(fe1, cb));
+
+    FlowEdit fe2;
+    assign::push_back(fe2.edits)(FlowEdit::DEL, flows[1]);
+    conn.Expect(fe2);
+    BOOST_CHECK(fexec.ExecuteAsync(fe2, cb));
+
+    // both windows are outstanding at once
+    BOOST_CHECK(statuses.empty());
+    BOOST_CHECK_EQUAL(3u, fexec.GetInFlight());
+
+    conn.FlushReplies();
+    BOOST_CHECK_EQUAL(2u, statuses.size());
+    BOOST_CHECK_EQUAL(0u, fexec.GetInFlight());
+}
+
+BOOST_FIXTURE_TEST_CASE(asyncerror, FlowExecutorFixture) {
+    conn.DeferReplies();
+
+    int status = -1;
+    std::vector<int> errors;
+    FlowEdit fe;
+    assign::push_back(fe.edits)(FlowEdit::ADD, flows[0])
+        (FlowEdit::MOD, flows[1]);
+    conn.Expect(fe);
+    conn.ReplyWithError(OFPERR_OFPFMFC_TABLE_FULL);
+    BOOST_CHECK(fexec.ExecuteAsync(fe,
+                                   [&](int s, const std::vector<int>& e) {
+                                       status = s;
+                                       errors = e;
+                                   }));
+    conn.FlushReplies();
+
+    // the error is attributed to the second edit only
+    BOOST_CHECK_EQUAL(OFPERR_OFPFMFC_TABLE_FULL, status);
+    BOOST_REQUIRE_EQUAL(2u, errors.size());
+    BOOST_CHECK_EQUAL(0, errors[0]);
+    BOOST_CHECK_EQUAL(OFPERR_OFPFMFC_TABLE_FULL, errors[1]);
+}
+
+BOOST_FIXTURE_TEST_CASE(asyncreconnect, FlowExecutorFixture) {
+    conn.DeferReplies();
+
+    int status = -1;
+    FlowEdit fe;
+    assign::push_back(fe.edits)(FlowEdit::MOD, flows[0]);
+    conn.Expect(fe);
+    BOOST_CHECK(fexec.ExecuteAsync(fe,
+                                   [&](int s, const std::vector<int>&) {
+                                       status = s;
+                                   }));
+    fexec.Connected(&conn);
+    BOOST_CHECK_EQUAL(ENOTCONN, status);
+    BOOST_CHECK_EQUAL(0u, fexec.GetInFlight());
+
+    // the late reply is ignored
+    conn.FlushReplies();
+    BOOST_CHECK_EQUAL(ENOTCONN, status);
+}
+
+BOOST_FIXTURE_TEST_CASE(maxinflight, FlowExecutorFixture) {
+    conn.ReplyAfter(50);
+    fexec.SetMaxInFlight(2);
+
+    std::atomic<int> done(0);
+    FlowExecutor::CompletionCb cb =
+        [&done](int, const std::vector<int>&) { done += 1; };
+
+    FlowEdit fe1;
+    assign::push_back(fe1.edits)(FlowEdit::ADD, flows[0])
+        (FlowEdit::ADD, flows[1]);
+    conn.Expect(fe1);
+    BOOST_CHECK(fexec.ExecuteAsync(fe1, cb));
+    BOOST_CHECK_EQUAL(0, done);
+
+    // blocks until the first window is acknowledged and its
+    // callback has run
+    FlowEdit fe2;
+    assign::push_back(fe2.edits)(FlowEdit::DEL, flows[0]);
+    conn.Expect(fe2);
+    BOOST_CHECK(fexec.ExecuteAsync(fe2, cb));
+    BOOST_CHECK(done >= 1);
+    BOOST_CHECK(fexec.GetInFlight() <= 2u);
+
+    // waiting for room for another two messages returns once the
+    // second window is acknowledged too
+    fexec.WaitForInFlight(2);
+    BOOST_CHECK_EQUAL(2, done);
+    BOOST_CHECK_EQUAL(0u, fexec.GetInFlight());
+}
+
+BOOST_FIXTURE_TEST_CASE(pipeline, FlowExecutorFixture) {
+    // Write a stream of small per-object batches to a switch that
+    // holds back its barrier replies.  Every batch is written without
+    // waiting for the barrier of the one before, so all of them are in
+    // flight at once.  The time this saves is measured by
+    // barrier_bench.
+    static const int BATCHES = 50;
+    conn.DeferReplies();
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    int done = 0;
+    int failed = 0;
+    FlowExecutor::CompletionCb cb =
+        [&](int status, const std::vector<int>&) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (status != 0) failed += 1;
+        done += 1;
+        cond.notify_all();
+    };
+
+    FlowEdit fe;
+    assign::push_back(fe.edits)(FlowEdit::ADD, flows[0])
+        (FlowEdit::ADD, flows[1]);
+    for (int i = 0; i < BATCHES; ++i) {
+        conn.Expect(fe);
+        BOOST_CHECK(fexec.ExecuteAsync(fe, cb));
+    }
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        BOOST_CHECK_EQUAL(0, done);
+    }
+    int barriers = 0;
+    for (const MockExecutorConnection::Frame& f : conn.frames) {
+        if (f.type == OFPTYPE_BARRIER_REQUEST)
+            barriers += 1;
+    }
+    BOOST_CHECK_EQUAL(BATCHES, barriers);
+    BOOST_CHECK(fexec.GetInFlight() >= (size_t)BATCHES);
+
+    conn.FlushReplies();
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (done < BATCHES)
+            cond.wait(lock);
+    }
+    BOOST_CHECK_EQUAL(0, failed);
+    BOOST_CHECK_EQUAL(0u, fexec.GetInFlight());
+}
+
+BOOST_FIXTURE_TEST_CASE(bundle, FlowExecutorFixture) {
+    fexec.EnableBundles(true, 2);
+
+    FlowEdit fe1;
+    assign::push_back(fe1.edits)(FlowEdit::ADD, flows[0]);
+    FlowEdit fe2;
+    assign::push_back(fe2.edits)(FlowEdit::MOD, flows[1])
+        (FlowEdit::DEL, flows[0]);
+    FlowEdit all;
+    assign::push_back(all.edits)(FlowEdit::ADD, flows[0])
+        (FlowEdit::MOD, flows[1])(FlowEdit::DEL, flows[0]);
+    conn.Expect(all);
+    BOOST_CHECK(fexec.ExecuteAll(GroupEdit(), {fe1, fe2}));
+
+    // open, one add per flow mod, commit, then the barrier
+    BOOST_REQUIRE_EQUAL(6u, conn.frames.size());
+    BOOST_CHECK(conn.frames[0].type == OFPTYPE_BUNDLE_CONTROL);
+    BOOST_CHECK_EQUAL(OFPBCT_OPEN_REQUEST, conn.frames[0].ctrlType);
+    uint32_t bundleId = conn.frames[0].bundleId;
+    for (size_t i = 0; i < 5; ++i) {
+        BOOST_CHECK_EQUAL(bundleId, conn.frames[i].bundleId);
+        BOOST_CHECK_EQUAL(OFPBF_ATOMIC | OFPBF_ORDERED, conn.frames[i].flags);
+    }
+    for (size_t i = 1; i < 4; ++i) {
+        BOOST_CHECK(conn.frames[i].type == OFPTYPE_BUNDLE_ADD_MESSAGE);
+        BOOST_CHECK(conn.frames[i].innerType == OFPTYPE_FLOW_MOD);
+    }
+    BOOST_CHECK(conn.frames[4].type == OFPTYPE_BUNDLE_CONTROL);
+    BOOST_CHECK_EQUAL(OFPBCT_COMMIT_REQUEST, conn.frames[4].ctrlType);
+    BOOST_CHECK(conn.frames[5].type == OFPTYPE_BARRIER_REQUEST);
+
+    // now that the switch is known to support bundles, large enough
+    // executions are bundled too
+    conn.frames.clear();
+    conn.Expect(fe2);
+    BOOST_CHECK(fexec.Execute(fe2));
+    BOOST_REQUIRE_EQUAL(5u, conn.frames.size());
+    BOOST_CHECK(conn.frames[0].type == OFPTYPE_BUNDLE_CONTROL);
+    BOOST_CHECK(conn.frames[0].bundleId != bundleId);
+
+    conn.frames.clear();
+    conn.Expect(fe1);
+    BOOST_CHECK(fexec.Execute(fe1));
+    BOOST_REQUIRE_EQUAL(2u, conn.frames.size());
+    BOOST_CHECK(conn.frames[0].type == OFPTYPE_FLOW_MOD);
+}
+
+BOOST_FIXTURE_TEST_CASE(bundleerror, FlowExecutorFixture) {
+    fexec.EnableBundles(true);
+
+    FlowEdit fe;
+    assign::push_back(fe.edits)(FlowEdit::ADD, flows[0])
+        (FlowEdit::ADD, flows[1]);
+    conn.Expect(fe);
+    conn.ReplyWithError(OFPERR_OFPFMFC_TABLE_FULL);
+    BOOST_CHECK(fexec.ExecuteAll(GroupEdit(), {fe}) == false);
+
+    // the failed bundle is not retried without a bundle
+    BOOST_CHECK_EQUAL(5u, conn.frames.size());
+}
+
+BOOST_FIXTURE_TEST_CASE(bundleunsupported, FlowExecutorFixture) {
+    fexec.EnableBundles(true, 1);
+    conn.rejectBundles = true;
+
+    FlowEdit fe;
+    assign::push_back(fe.edits)(FlowEdit::ADD, flows[0])
+        (FlowEdit::MOD, flows[1]);
+    conn.Expect(fe);
+    BOOST_CHECK(fexec.ExecuteAll(GroupEdit(), {fe}));
+
+    // the rejected bundle is followed by the plain flow mods
+    BOOST_REQUIRE_EQUAL(8u, conn.frames.size());
+    BOOST_CHECK(conn.frames[0].type == OFPTYPE_BUNDLE_CONTROL);
+    BOOST_CHECK(conn.frames[4].type == OFPTYPE_BARRIER_REQUEST);
+    BOOST_CHECK(conn.frames[5].type == OFPTYPE_FLOW_MOD);
+    BOOST_CHECK(conn.frames[6].type == OFPTYPE_FLOW_MOD);
+    BOOST_CHECK(conn.frames[7].type == OFPTYPE_BARRIER_REQUEST);
+
+    // bundles are not attempted again on this connection
+    conn.frames.clear();
+    conn.Expect(fe);
+    BOOST_CHECK(fexec.ExecuteAll(GroupEdit(), {fe}));
+    BOOST_REQUIRE_EQUAL(3u, conn.frames.size());
+    BOOST_CHECK(conn.frames[0].type == OFPTYPE_FLOW_MOD);
+}
+
+BOOST_FIXTURE_TEST_CASE(bundledisabled, FlowExecutorFixture) {
+    FlowEdit fe;
+    assign::push_back(fe.edits)(FlowEdit::ADD, flows[0]);
+    conn.Expect(fe);
+    BOOST_CHECK(fexec.ExecuteAll(GroupEdit(), {fe}));
+    BOOST_REQUIRE_EQUAL(2u, conn.frames.size());
+    BOOST_CHECK(conn.frames[0].type == OFPTYPE_FLOW_MOD);
+    BOOST_CHECK(conn.frames[1].type == OFPTYPE_BARRIER_REQUEST);
+}
+
+/* Check that a message derived from the cached encoding matches the
+   message encoded from scratch, apart from the transaction id */
+static void checkCachedEncoding(const FlowEdit::Entry& edit) {
+    ofpbuf *plain = FlowExecutor::EncodeFlowMod(edit, OFP13_VERSION);
+    ofpbuf *cached = FlowExecutor::EncodeCachedFlowMod(edit, OFP13_VERSION);
+    BOOST_REQUIRE_EQUAL(plain->size, cached->size);
+    ((ofp_header *)cached->data)->xid = ((ofp_header *)plain->data)->xid;
+    BOOST_CHECK(memcmp(plain->data, cached->data, plain->size) == 0);
+    ofpbuf_delete(plain);
+    ofpbuf_delete(cached);
+}
+
+BOOST_FIXTURE_TEST_CASE(encodingcache, FlowExecutorFixture) {
+    // a delete of an entry that was never written isn't cached
+    checkCachedEncoding(FlowEdit::Entry(FlowEdit::DEL, flows[0]));
+    BOOST_CHECK(flows[0]->encoding.load() == NULL);
+
+    for (const FlowEntryPtr& f : flows) {
+        checkCachedEncoding(FlowEdit::Entry(FlowEdit::ADD, f));
+        BOOST_CHECK(f->encoding.load() != NULL);
+        checkCachedEncoding(FlowEdit::Entry(FlowEdit::ADD, f));
+        checkCachedEncoding(FlowEdit::Entry(FlowEdit::MOD, f));
+        checkCachedEncoding(FlowEdit::Entry(FlowEdit::DEL, f));
+        f->clearEncoding();
+        BOOST_CHECK(f->encoding.load() == NULL);
+    }
+
+    fexec.EnableEncodingCache(true);
+    FlowEdit fe;
+    assign::push_back(fe.edits)
+        (FlowEdit::MOD, flows[0])(FlowEdit::DEL, flows[0])
+        (FlowEdit::ADD, flows[1]);
+    conn.Expect(fe);
+    BOOST_CHECK(fexec.Execute(fe));
+    BOOST_CHECK(flows[0]->encoding.load() != NULL);
+    BOOST_CHECK(flows[1]->encoding.load() != NULL);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 int MockExecutorConnection::SendMessage(ofpbuf *msg) {
-    uint16_t COMM[] = {OFPFC_ADD, OFPFC_MODIFY_STRICT, OFPFC_DELETE_STRICT};
     ofp_header *msgHdr = (ofp_header *)msg->data;
     ofptype type;
     ofptype_decode(&type, msgHdr);
     BOOST_CHECK(type == OFPTYPE_FLOW_MOD ||
-            type == OFPTYPE_BARRIER_REQUEST);
+                type == OFPTYPE_BARRIER_REQUEST ||
+                type == OFPTYPE_BUNDLE_CONTROL ||
+                type == OFPTYPE_BUNDLE_ADD_MESSAGE);
+    Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.type = type;
+
     if (type == OFPTYPE_FLOW_MOD) {
-        ofputil_flow_mod fm;
-        ofpbuf ofpacts;
-        ofpbuf_init(&ofpacts, 64);
-        int err = ofputil_decode_flow_mod
-            (&fm, msgHdr, ofputil_protocol_from_ofp_version
-             ((ofp_version)GetProtocolVersion()),
-                &ofpacts, OFPP_MAX, 255);
-        fm.ofpacts = ActionBuilder::getActionsFromBuffer(&ofpacts,
-                fm.ofpacts_len);
-        ofpbuf_uninit(&ofpacts);
-        BOOST_CHECK_EQUAL(err, 0);
-        BOOST_CHECK(!expectedEdits.edits.empty());
-        lastXid = msgHdr->xid;
-
-        FlowEdit::Entry edit = expectedEdits.edits.front();
-        ofputil_flow_stats &ee = *(edit.second->entry);
-        expectedEdits.edits.erase(expectedEdits.edits.begin());
-        BOOST_CHECK(COMM[edit.first] == fm.command);
-        BOOST_CHECK(ee.table_id == fm.table_id);
-        BOOST_CHECK(ee.priority == fm.priority);
-        BOOST_CHECK(ee.cookie ==
-                (fm.command == OFPFC_ADD ? fm.new_cookie : fm.cookie));
-        BOOST_CHECK(fm.cookie_mask ==
-                    (fm.command == OFPFC_ADD ? 0 : ~((uint64_t)0)));
-        BOOST_CHECK(match_equal(&ee.match, &fm.match));
-        if (fm.command == OFPFC_DELETE_STRICT) {
-            BOOST_CHECK_EQUAL(fm.ofpacts_len, 0);
-        } else {
-            BOOST_CHECK(action_equal(ee.ofpacts, ee.ofpacts_len,
-                                     fm.ofpacts, fm.ofpacts_len));
-        }
-        free((void *)fm.ofpacts);
+        checkFlowMod(msgHdr);
+    } else if (type == OFPTYPE_BUNDLE_CONTROL) {
+        ofputil_bundle_ctrl_msg bc;
+        BOOST_CHECK_EQUAL(0, ofputil_decode_bundle_ctrl(msgHdr, &bc));
+        frame.bundleId = bc.bundle_id;
+        frame.flags = bc.flags;
+        frame.ctrlType = bc.type;
+        if (rejectBundles)
+            pendingErrs.push_back(ofperr_encode_reply(OFPERR_OFPBRC_BAD_TYPE,
+                                                      msgHdr));
+    } else if (type == OFPTYPE_BUNDLE_ADD_MESSAGE) {
+        ofputil_bundle_add_msg bam;
+        BOOST_CHECK_EQUAL(0, ofputil_decode_bundle_add(msgHdr, &bam,
+                                                       &frame.innerType));
+        frame.bundleId = bam.bundle_id;
+        frame.flags = bam.flags;
+        if (rejectBundles)
+            pendingErrs.push_back(ofperr_encode_reply(OFPERR_OFPBRC_BAD_TYPE,
+                                                      msgHdr));
+        else if (frame.innerType == OFPTYPE_FLOW_MOD)
+            checkFlowMod(bam.msg);
     } else if (type == OFPTYPE_BARRIER_REQUEST) {
-         BOOST_CHECK(expectedEdits.edits.empty());
+         // the flow mods in a rejected bundle are never checked
+         BOOST_CHECK(!pendingErrs.empty() || expectedEdits.edits.empty());
 
          if (reconnectReply) {
+             frames.push_back(frame);
              ofpbuf_delete(msg);
              executor->Connected(this);
              return 0;
          }
-         struct ofpbuf *barrRep =
-             ofpraw_alloc_reply(OFPRAW_OFPT11_BARRIER_REPLY, msgHdr, 0);
+         Reply r;
+         r.due = std::chrono::steady_clock::now() + rtt;
+         r.errs.swap(pendingErrs);
+         r.barrier = ofpraw_alloc_reply(OFPRAW_OFPT11_BARRIER_REPLY,
+                                        msgHdr, 0);
          if (errReply != 0) {
              msgHdr->xid = lastXid;
-             struct ofpbuf *reply = ofperr_encode_reply(errReply, msgHdr);
-             executor->Handle(this, OFPTYPE_ERROR, reply);
-             ofpbuf_delete(reply);
+             r.errs.push_back(ofperr_encode_reply(errReply, msgHdr));
+         }
+         if (deferReplies || replyThread.joinable()) {
+             std::unique_lock<std::mutex> lock(replyMtx);
+             replies.push_back(r);
+             replyCond.notify_all();
+         } else {
+             deliver(r);
          }
-         executor->Handle(this, OFPTYPE_BARRIER_REPLY, barrRep);
-         ofpbuf_delete(barrRep);
     }
 
+    frames.push_back(frame);
     ofpbuf_delete(msg);
     return 0;
 }
 
+int MockExecutorConnection::SendMessages(std::vector<ofpbuf*>& msgs) {
+    batches.push_back(msgs.size());
+    for (ofpbuf* msg : msgs)
+        SendMessage(msg);
+    msgs.clear();
+    return 0;
+}
+
+void MockExecutorConnection::checkFlowMod(const ofp_header *msgHdr) {
+    uint16_t COMM[] = {OFPFC_ADD, OFPFC_MODIFY_STRICT, OFPFC_DELETE_STRICT};
+    ofputil_flow_mod fm;
+    ofpbuf ofpacts;
+    ofpbuf_init(&ofpacts, 64);
+    int err = ofputil_decode_flow_mod
+        (&fm, msgHdr, ofputil_protocol_from_ofp_version
+         ((ofp_version)GetProtocolVersion()),
+            &ofpacts, OFPP_MAX, 255);
+    fm.ofpacts = ActionBuilder::getActionsFromBuffer(&ofpacts,
+            fm.ofpacts_len);
+    ofpbuf_uninit(&ofpacts);
+    BOOST_CHECK_EQUAL(err, 0);
+    BOOST_REQUIRE(!expectedEdits.edits.empty());
+    lastXid = msgHdr->xid;
+
+    FlowEdit::Entry edit = expectedEdits.edits.front();
+    ofputil_flow_stats &ee = *(edit.second->entry);
+    expectedEdits.edits.erase(expectedEdits.edits.begin());
+    BOOST_CHECK(COMM[edit.first] == fm.command);
+    BOOST_CHECK(ee.table_id == fm.table_id);
+    BOOST_CHECK(ee.priority == fm.priority);
+    BOOST_CHECK(ee.cookie ==
+            (fm.command == OFPFC_ADD ? fm.new_cookie : fm.cookie));
+    BOOST_CHECK(fm.cookie_mask ==
+                (fm.command == OFPFC_ADD ? 0 : ~((uint64_t)0)));
+    BOOST_CHECK(match_equal(&ee.match, &fm.match));
+    if (fm.command == OFPFC_DELETE_STRICT) {
+        BOOST_CHECK_EQUAL(fm.ofpacts_len, 0);
+    } else {
+        BOOST_CHECK(action_equal(ee.ofpacts, ee.ofpacts_len,
+                                 fm.ofpacts, fm.ofpacts_len));
+    }
+    free((void *)fm.ofpacts);
+}
+
+void MockExecutorConnection::deliver(Reply& r) {
+    for (ofpbuf* err : r.errs) {
+        executor->Handle(this, OFPTYPE_ERROR, err);
+        ofpbuf_delete(err);
+    }
+    executor->Handle(this, OFPTYPE_BARRIER_REPLY, r.barrier);
+    ofpbuf_delete(r.barrier);
+}
+
+void MockExecutorConnection::FlushReplies() {
+    std::deque<Reply> ready;
+    {
+        std::unique_lock<std::mutex> lock(replyMtx);
+        ready.swap(replies);
+    }
+    for (Reply& r : ready)
+        deliver(r);
+}
+
+void MockExecutorConnection::StopReplies() {
+    {
+        std::unique_lock<std::mutex> lock(replyMtx);
+        stopping = true;
+        replyCond.notify_all();
+    }
+    if (replyThread.joinable())
+        replyThread.join();
+    for (Reply& r : replies) {
+        for (ofpbuf* err : r.errs)
+            ofpbuf_delete(err);
+        ofpbuf_delete(r.barrier);
+    }
+    replies.clear();
+    for (ofpbuf* err : pendingErrs)
+        ofpbuf_delete(err);
+    pendingErrs.clear();
+}
+
+void MockExecutorConnection::replyLoop() {
+    std::unique_lock<std::mutex> lock(replyMtx);
+    while (!stopping) {
+        if (replies.empty()) {
+            replyCond.wait(lock);
+            continue;
+        }
+        if (std::chrono::steady_clock::now() < replies.front().due) {
+            replyCond.wait_until(lock, replies.front().due);
+            continue;
+        }
+        Reply r = replies.front();
+        replies.pop_front();
+        lock.unlock();
+        deliver(r);
+        lock.lock();
+    }
+}
+
 void FlowExecutorFixture::createTestFlows() {
     FlowBuilder e0;
     e0.priority(100)
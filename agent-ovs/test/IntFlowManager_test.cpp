@@ -145,6 +145,9 @@ public:
     /** Initialize contract 3 flows */
     void initExpCon3();
 
+    /** Initialize contract 1 flows rendered with conjunctions */
+    void initExpCon1Conj();
+
     /** Initialize subnet-scoped flow entries */
     void initSubnets(PolicyManager::subnet_vector_t sns,
                      uint32_t bdId = 1, uint32_t rdId = 1);
@@ -165,6 +168,8 @@ public:
     // Test drivers
     void epgTest();
     void routeModeTest();
+    void routedEpsTest();
+    void disableRoutingTest();
     void arpModeTest();
     void fdTest();
     void groupFloodTest();
@@ -419,6 +424,79 @@ BOOST_FIXTURE_TEST_CASE(routemode_vlan, VlanIntFlowManagerFixture) {
     routeModeTest();
 }
 
+/* Render the endpoints of epg0 in a routed bridge domain */
+void IntFlowManagerFixture::routedEpsTest() {
+    setConnected();
+    intFlowManager.egDomainUpdated(epg0->getURI());
+    initExpStatic();
+    initExpEpg(epg0);
+    initExpBd();
+    initExpEp(ep0, epg0);
+    initExpEp(ep2, epg0);
+    WAIT_FOR_TABLES("create", 500);
+}
+
+/* Disable routing in the bridge domain of epg0 */
+void IntFlowManagerFixture::disableRoutingTest() {
+    {
+        Mutator mutator(framework, policyOwner);
+        bd0->setRoutingMode(RoutingModeEnumT::CONST_DISABLED);
+        mutator.commit();
+    }
+    WAIT_FOR(policyMgr.getBDForGroup(epg0->getURI()).get()
+             ->getRoutingMode(RoutingModeEnumT::CONST_ENABLED) ==
+             RoutingModeEnumT::CONST_DISABLED, 500);
+    intFlowManager.egDomainUpdated(epg0->getURI());
+
+    clearExpFlowTables();
+    initExpStatic();
+    initExpEpg(epg0);
+    initExpBd(1, 1, false);
+    initExpEp(ep0, epg0, 0, 1, 1, true, false);
+    initExpEp(ep2, epg0, 0, 1, 1, true, false);
+    WAIT_FOR_TABLES("disable", 500);
+}
+
+BOOST_FIXTURE_TEST_CASE(groupDependencies, VxlanIntFlowManagerFixture) {
+    routedEpsTest();
+    BOOST_CHECK(intFlowManager.getRenderStats().rerenders >= 2);
+
+    /* an update that changes nothing the endpoints read */
+    uint64_t skipped = intFlowManager.getRenderStats().skippedRerenders;
+    intFlowManager.egDomainUpdated(epg0->getURI());
+    WAIT_FOR(intFlowManager.getRenderStats().skippedRerenders >= skipped + 2,
+             500);
+
+    /* disable routing, which the endpoints read */
+    uint64_t rerenders = intFlowManager.getRenderStats().rerenders;
+    disableRoutingTest();
+
+    IntFlowManager::RenderStats stats = intFlowManager.getRenderStats();
+    BOOST_CHECK(stats.rerenders >= rerenders + 2);
+    BOOST_CHECK(stats.noopRerenders <= stats.rerenders);
+}
+
+BOOST_FIXTURE_TEST_CASE(endpointTemplates, VxlanIntFlowManagerFixture) {
+    routedEpsTest();
+
+    /* endpoints of a group that did not change copy its templates */
+    IntFlowManager::RenderStats before = intFlowManager.getRenderStats();
+    BOOST_CHECK(before.templateBuilds >= 1);
+    BOOST_CHECK(before.templateFlows > before.templateBuilds);
+    intFlowManager.endpointUpdated(ep0->getUUID());
+    intFlowManager.endpointUpdated(ep2->getUUID());
+    WAIT_FOR(intFlowManager.getRenderStats().templateFlows >
+             before.templateFlows, 500);
+    BOOST_CHECK_EQUAL(before.templateBuilds,
+                      intFlowManager.getRenderStats().templateBuilds);
+
+    /* disabling routing changes the group, so the templates are
+       built again */
+    disableRoutingTest();
+    BOOST_CHECK(intFlowManager.getRenderStats().templateBuilds >
+                before.templateBuilds);
+}
+
 void IntFlowManagerFixture::arpModeTest() {
     /* setup entries for epg0 connected to fd0 */
     setConnected();
@@ -660,6 +738,95 @@ BOOST_FIXTURE_TEST_CASE(fd_vlan, VlanIntFlowManagerFixture) {
     fdTest();
 }
 
+static GroupEdit::Entry findGroup(const GroupEdit& ge, uint32_t groupId) {
+    for (const GroupEdit::Entry& e : ge.edits) {
+        if (e->mod->group_id == groupId)
+            return e;
+    }
+    return GroupEdit::Entry();
+}
+
+BOOST_FIXTURE_TEST_CASE(fd_buckets, VxlanIntFlowManagerFixture) {
+    MockSwitchConnection* conn =
+        static_cast<MockSwitchConnection*>(switchManager.getConnection());
+    conn->protoVersion = OFP15_VERSION;
+    setConnected();
+
+    portmapper.ports[ep2->getInterfaceName().get()] = ep2_port;
+    {
+        Mutator m1(framework, policyOwner);
+        epg0->addGbpEpGroupToNetworkRSrc()
+            ->setTargetFloodDomain(fd0->getURI());
+        m1.commit();
+    }
+    WAIT_FOR(policyMgr.getFDForGroup(epg0->getURI()) != boost::none, 500);
+
+    exec.Clear();
+    exec.ExpectGroup(FlowEdit::ADD, ge_fd0 + ge_bkt_ep0 + ge_bkt_tun);
+    exec.ExpectGroup(FlowEdit::ADD, ge_fd0_prom + ge_bkt_tun);
+    intFlowManager.endpointUpdated(ep0->getUUID());
+    WAIT_FOR(exec.IsGroupEmpty(), 500);
+
+    /* a joining endpoint inserts its bucket only, ahead of the
+       higher port of ep0, and leaves the promiscuous group alone */
+    exec.ExpectGroup("INSERT_BUCKET",
+                     ge_fd0 + ",command_bucket_id=first" + ge_bkt_ep2);
+    intFlowManager.endpointUpdated(ep2->getUUID());
+    WAIT_FOR(exec.IsGroupEmpty(), 500);
+
+    /* a port change moves the bucket after that of ep0 */
+    uint32_t ep2_port_new = 90;
+    string ge_bkt_ep2_new = Bldr(",bucket=").bktId(ep2_port_new)
+        .bktActions().outPort(ep2_port_new).done();
+    portmapper.ports[ep2->getInterfaceName().get()] = ep2_port_new;
+    exec.ExpectGroup("REMOVE_BUCKET", ge_fd0 + ",command_bucket_id=" +
+                     std::to_string(ep2_port));
+    exec.ExpectGroup("INSERT_BUCKET", ge_fd0 + ",command_bucket_id=" +
+                     std::to_string(portmapper.FindPort(
+                                        ep0->getInterfaceName().get())) +
+                     ge_bkt_ep2_new);
+    intFlowManager.endpointUpdated(ep2->getUUID());
+    WAIT_FOR(exec.IsGroupEmpty(), 500);
+
+    IntFlowManager::RenderStats stats = intFlowManager.getRenderStats();
+    BOOST_CHECK_EQUAL(3, stats.floodBucketMods);
+    BOOST_CHECK_EQUAL(0, stats.floodGroupMods);
+
+    /* reconciliation expects the buckets in the order they were
+       inserted in */
+    SwitchStateHandler::GroupMap recvGroups;
+    GroupEdit ge = intFlowManager.reconcileGroups(recvGroups);
+    GroupEdit::Entry fd0Group = findGroup(ge, 1);
+    BOOST_REQUIRE(fd0Group);
+    std::stringstream ss;
+    ss << fd0Group;
+    BOOST_CHECK_EQUAL("ADD|" + ge_fd0 + ge_bkt_ep0 + ge_bkt_ep2_new +
+                      ge_bkt_tun, ss.str());
+
+    /* and finds the groups the switch has unchanged */
+    for (const GroupEdit::Entry& e : ge.edits)
+        recvGroups[e->mod->group_id] = e;
+    BOOST_CHECK(!findGroup(intFlowManager.reconcileGroups(recvGroups), 1));
+
+    /* but for a bucket with the wrong ID */
+    for (const GroupEdit::Entry& e : ge.edits)
+        recvGroups[e->mod->group_id] = e;
+    ofputil_bucket_list_front(&fd0Group->mod->buckets)->bucket_id = 1;
+    BOOST_CHECK(findGroup(intFlowManager.reconcileGroups(recvGroups), 1));
+
+    /* the last endpoint to leave deletes the groups */
+    exec.ExpectGroup("REMOVE_BUCKET", ge_fd0 + ",command_bucket_id=" +
+                     std::to_string(ep2_port_new));
+    epSrc.removeEndpoint(ep2->getUUID());
+    intFlowManager.endpointUpdated(ep2->getUUID());
+    WAIT_FOR(exec.IsGroupEmpty(), 500);
+    exec.ExpectGroup(FlowEdit::DEL, ge_fd0);
+    exec.ExpectGroup(FlowEdit::DEL, ge_fd0_prom);
+    epSrc.removeEndpoint(ep0->getUUID());
+    intFlowManager.endpointUpdated(ep0->getUUID());
+    WAIT_FOR(exec.IsGroupEmpty(), 500);
+}
+
 void IntFlowManagerFixture::groupFloodTest() {
     intFlowManager.setFloodScope(IntFlowManager::ENDPOINT_GROUP);
     setConnected();
@@ -781,6 +948,57 @@ BOOST_FIXTURE_TEST_CASE(policy, VxlanIntFlowManagerFixture) {
     WAIT_FOR_TABLES("remove", 500);
 }
 
+BOOST_FIXTURE_TEST_CASE(policy_membership, VxlanIntFlowManagerFixture) {
+    setConnected();
+
+    createPolicyObjects();
+
+    PolicyManager::uri_set_t egs;
+    WAIT_FOR_DO(egs.size() == 2, 1000, egs.clear();
+                policyMgr.getContractProviders(con1->getURI(), egs));
+    egs.clear();
+    WAIT_FOR_DO(egs.size() == 2, 500, egs.clear();
+                policyMgr.getContractConsumers(con1->getURI(), egs));
+
+    intFlowManager.contractUpdated(con1->getURI());
+    initExpStatic();
+    initExpCon1();
+    WAIT_FOR_TABLES("con1", 500);
+
+    /* a consumer joins */
+    {
+        Mutator mutator(framework, policyOwner);
+        epg4->addGbpEpGroupToConsContractRSrc(con1->getURI().toString());
+        mutator.commit();
+    }
+    egs.clear();
+    WAIT_FOR_DO(egs.size() == 3, 500, egs.clear();
+                policyMgr.getContractConsumers(con1->getURI(), egs));
+    intFlowManager.contractUpdated(con1->getURI());
+
+    clearExpFlowTables();
+    initExpStatic();
+    initExpCon1();
+    WAIT_FOR_TABLES("join", 500);
+
+    /* a consumer leaves */
+    {
+        Mutator mutator(framework, policyOwner);
+        epg3->addGbpEpGroupToConsContractRSrc(con1->getURI().toString())
+            ->unsetTarget();
+        mutator.commit();
+    }
+    egs.clear();
+    WAIT_FOR_DO(egs.size() == 2, 500, egs.clear();
+                policyMgr.getContractConsumers(con1->getURI(), egs));
+    intFlowManager.contractUpdated(con1->getURI());
+
+    clearExpFlowTables();
+    initExpStatic();
+    initExpCon1();
+    WAIT_FOR_TABLES("leave", 500);
+}
+
 BOOST_FIXTURE_TEST_CASE(policy_portrange, VxlanIntFlowManagerFixture) {
     setConnected();
 
@@ -803,6 +1021,40 @@ BOOST_FIXTURE_TEST_CASE(policy_portrange, VxlanIntFlowManagerFixture) {
     WAIT_FOR_TABLES("con3", 500);
 }
 
+BOOST_FIXTURE_TEST_CASE(policy_conjunction, VxlanIntFlowManagerFixture) {
+    intFlowManager.enableContractConjunctions();
+    setConnected();
+
+    createPolicyObjects();
+
+    PolicyManager::uri_set_t egs;
+    WAIT_FOR_DO(egs.size() == 2, 1000, egs.clear();
+                policyMgr.getContractProviders(con1->getURI(), egs));
+    egs.clear();
+    WAIT_FOR_DO(egs.size() == 2, 500, egs.clear();
+                policyMgr.getContractConsumers(con1->getURI(), egs));
+
+    /* add con1 */
+    intFlowManager.contractUpdated(con1->getURI());
+    initExpStatic();
+    initExpCon1Conj();
+    WAIT_FOR_TABLES("con1", 500);
+
+    /* remove, which removes the shared clauses too */
+    Mutator m2(framework, policyOwner);
+    con1->remove();
+    m2.commit();
+    PolicyManager::rule_list_t rules;
+    policyMgr.getContractRules(con1->getURI(), rules);
+    WAIT_FOR_DO(rules.empty(), 500,
+        rules.clear(); policyMgr.getContractRules(con1->getURI(), rules));
+    intFlowManager.contractUpdated(con1->getURI());
+
+    clearExpFlowTables();
+    initExpStatic();
+    WAIT_FOR_TABLES("remove", 500);
+}
+
 void IntFlowManagerFixture::connectTest() {
     exec.ignoredFlowMods.insert(FlowEdit::ADD);
     exec.Expect(FlowEdit::DEL, fe_connect_1);
@@ -1950,6 +2202,59 @@ void IntFlowManagerFixture::initExpCon2() {
     }
 }
 
+void IntFlowManagerFixture::initExpCon1Conj() {
+    uint16_t prio = PolicyManager::MAX_POLICY_RULE_PRIORITY;
+    PolicyManager::uri_set_t ps, cs;
+    unordered_set<uint32_t> pvnids, cvnids;
+
+    policyMgr.getContractProviders(con1->getURI(), ps);
+    policyMgr.getContractConsumers(con1->getURI(), cs);
+    intFlowManager.getGroupVnid(ps, pvnids);
+    intFlowManager.getGroupVnid(cs, cvnids);
+
+    /* the group clauses and conj_id flow of a rule */
+    auto addConj = [&](const shared_ptr<modelgbp::gbpe::L24Classifier>& cls,
+                       uint16_t p, bool in) -> uint32_t {
+        uint32_t conjId =
+            intFlowManager.getContractConjId(con1->getURI(),
+                                             cls->getURI(), p, in);
+        uint32_t cookie = intFlowManager.getId(cls->getClassId(),
+                                               cls->getURI());
+        for (const uint32_t& svnid : (in ? cvnids : pvnids))
+            ADDF(Bldr().table(POL).priority(p).reg(SEPG, svnid)
+                 .actions().conjunction(conjId, 1, 3).done());
+        for (const uint32_t& dvnid : (in ? pvnids : cvnids))
+            ADDF(Bldr().table(POL).priority(p).reg(DEPG, dvnid)
+                 .actions().conjunction(conjId, 2, 3).done());
+        ADDF(Bldr("", SEND_FLOW_REM).table(POL).priority(p)
+             .cookie(cookie).isConjId(conjId)
+             .actions().go(OUT).done());
+        return conjId;
+    };
+
+    /* classifier 1 */
+    uint32_t conjId = addConj(classifier1, prio, true);
+    ADDF(Bldr().table(POL).priority(prio).tcp().isTpDst(80)
+         .actions().conjunction(conjId, 3, 3).done());
+    /* classifier 2 */
+    conjId = addConj(classifier2, prio-128, false);
+    ADDF(Bldr().table(POL).priority(prio-128).arp()
+         .actions().conjunction(conjId, 3, 3).done());
+    /* classifier 6 */
+    conjId = addConj(classifier6, prio-256, true);
+    ADDF(Bldr().table(POL).priority(prio-256).tcp().isTpSrc(22)
+         .isTcpFlags("+syn+ack")
+         .actions().conjunction(conjId, 3, 3).done());
+    /* classifier 7 */
+    conjId = addConj(classifier7, prio-384, true);
+    ADDF(Bldr().table(POL).priority(prio-384).tcp().isTpSrc(21)
+         .isTcpFlags("+ack")
+         .actions().conjunction(conjId, 3, 3).done());
+    ADDF(Bldr().table(POL).priority(prio-384).tcp().isTpSrc(21)
+         .isTcpFlags("+rst")
+         .actions().conjunction(conjId, 3, 3).done());
+}
+
 void IntFlowManagerFixture::initExpCon3() {
     uint32_t epg0_vnid = policyMgr.getVnidForGroup(epg0->getURI()).get();
     uint32_t epg1_vnid = policyMgr.getVnidForGroup(epg1->getURI()).get();
@@ -53,7 +53,7 @@ bool MockFlowExecutor::Execute(const FlowEdit& flowEdits) {
     FlowEdit editCopy = flowEdits;
     std::sort(editCopy.edits.begin(), editCopy.edits.end());
 
-    const char *modStr[] = {"ADD", "MOD", "DEL"};
+    const char *modStr[] = {"ADD", "MOD", "DEL", "DEL_COOKIE"};
     DsP strBuf;
 
     for (const FlowEdit::Entry& ed : editCopy.edits) {
@@ -99,6 +99,27 @@ bool MockFlowExecutor::Execute(const GroupEdit& groupEdits) {
     }
     return true;
 }
+bool MockFlowExecutor::ExecuteAll(const GroupEdit& groupEdits,
+                                  const vector<FlowEdit>& flowEdits) {
+    bool success = Execute(groupEdits);
+    for (const FlowEdit& fe : flowEdits) {
+        if (!Execute(fe))
+            success = false;
+    }
+    return success;
+}
+bool MockFlowExecutor::ExecuteAsync(const FlowEdit& flowEdits,
+                                    const CompletionCb& cb) {
+    bool success = Execute(flowEdits);
+    cb(success ? 0 : EINVAL, vector<int>());
+    return true;
+}
+bool MockFlowExecutor::ExecuteAsync(const GroupEdit& groupEdits,
+                                    const CompletionCb& cb) {
+    bool success = Execute(groupEdits);
+    cb(success ? 0 : EINVAL, vector<int>());
+    return true;
+}
 void MockFlowExecutor::Expect(FlowEdit::type mod, const string& fe) {
     ignoreFlowMods = false;
     flowMods.push_back(mod_t(mod, fe));
@@ -109,10 +130,12 @@ void MockFlowExecutor::Expect(FlowEdit::type mod, const vector<string>& fe) {
         flowMods.push_back(mod_t(mod, s));
 }
 void MockFlowExecutor::ExpectGroup(FlowEdit::type mod, const string& ge) {
+    const char *modStr[] = {"ADD", "MOD", "DEL", "DEL_COOKIE"};
+    ExpectGroup(modStr[mod], ge);
+}
+void MockFlowExecutor::ExpectGroup(const string& command, const string& ge) {
     ignoreGroupMods = false;
-    const char *modStr[] = {"ADD", "MOD", "DEL"};
-    groupMods.push_back(canonicalizeGroupEntryStr(string(modStr[mod]) + "|" +
-                                                  ge));
+    groupMods.push_back(canonicalizeGroupEntryStr(command + "|" + ge));
 }
 void MockFlowExecutor::IgnoreFlowMods() {
     ignoreFlowMods = true;
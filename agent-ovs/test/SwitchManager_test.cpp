@@ -0,0 +1,461 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Test suite for class SwitchManager
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "BaseFixture.h"
+#include "MockSwitchManager.h"
+#include "FlowBuilder.h"
+#include "FlowConstants.h"
+#include "IdGenerator.h"
+#include "logging.h"
+
+using std::vector;
+
+namespace ovsagent {
+
+/**
+ * Flow executor that records each flow edit it is given and can
+ * reject one flow mod in each
+ */
+class BatchFlowExecutor : public MockFlowExecutor {
+public:
+    BatchFlowExecutor() : failEdit(-1) {
+        IgnoreFlowMods();
+    }
+
+    virtual bool ExecuteAsync(const FlowEdit& flowEdits,
+                              const CompletionCb& cb) {
+        vector<int> errors(flowEdits.edits.size(), 0);
+        int status = 0;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            sizes.push_back(flowEdits.edits.size());
+            edits.push_back(flowEdits);
+            if (failEdit >= 0 &&
+                static_cast<size_t>(failEdit) < errors.size()) {
+                errors[failEdit] = EINVAL;
+                status = EINVAL;
+            }
+        }
+        cb(status, errors);
+        return true;
+    }
+
+    vector<size_t> getSizes() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return sizes;
+    }
+
+    vector<FlowEdit> getEdits() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return edits;
+    }
+
+    std::mutex mutex;
+    vector<size_t> sizes;
+    vector<FlowEdit> edits;
+    int failEdit;
+};
+
+class SwitchManagerFixture : public BaseFixture {
+public:
+    SwitchManagerFixture(bool objectCookies = false)
+        : switchManager(agent, exec, reader, portmapper) {
+        switchManager.setMaxFlowTables(1);
+        if (objectCookies)
+            switchManager.enableObjectCookies(idGen, "flowCookie");
+        switchManager.start("br-test");
+    }
+
+    virtual ~SwitchManagerFixture() {
+        switchManager.stop();
+    }
+
+    /* Write flows that match on a port of their own for each object */
+    void writeFlows(const std::string& objId, int count) {
+        uint32_t& port = objPorts[objId];
+        if (port == 0)
+            port = objPorts.size();
+        FlowEntryList el;
+        for (int i = 0; i < count; ++i)
+            el.push_back(FlowBuilder().priority(100 + i).inPort(port)
+                         .ethType(0x0800).build());
+        switchManager.writeFlow(objId, 0, el);
+    }
+
+    std::unordered_map<std::string, uint32_t> objPorts;
+    IdGenerator idGen;
+    BatchFlowExecutor exec;
+    MockFlowReader reader;
+    MockPortMapper portmapper;
+    MockSwitchManager switchManager;
+};
+
+class ObjectCookieFixture : public SwitchManagerFixture {
+public:
+    ObjectCookieFixture() : SwitchManagerFixture(true) {}
+};
+
+static uint64_t objectCookie(const FlowEdit::Entry& e) {
+    return e.second->entry->cookie & flow::cookie::OBJECT_MASK;
+}
+
+/**
+ * Flow reader over the flow tables of a scripted switch.  Records
+ * the tables that are read back.
+ */
+class ScriptedFlowReader : public MockFlowReader {
+public:
+    virtual bool getFlows(uint8_t tableId, const FlowReader::FlowCb& cb) {
+        FlowEntryList res;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            tablesRead.push_back(tableId);
+            for (const FlowEntryPtr& fe : flows) {
+                if (fe->entry->table_id == tableId)
+                    res.push_back(fe);
+            }
+        }
+        cb(res, true);
+        return true;
+    }
+
+    virtual bool getFlowCount(uint8_t tableId,
+                              const FlowReader::FlowCountCb& cb) {
+        cb(countFlows(tableId), true);
+        return true;
+    }
+
+    virtual bool monitorFlows(const FlowReader::FlowUpdateCb& cb) {
+        std::lock_guard<std::mutex> guard(mutex);
+        monitorCb = cb;
+        return true;
+    }
+
+    /* Apply a flow mod to the switch */
+    void apply(FlowEdit::type mod, const FlowEntryPtr& fe) {
+        std::lock_guard<std::mutex> guard(mutex);
+        FlowEntryList::iterator it = flows.begin();
+        while (it != flows.end() && !(*it)->matchEq(fe.get()))
+            ++it;
+        if (mod == FlowEdit::DEL) {
+            if (it != flows.end())
+                flows.erase(it);
+        } else if (it != flows.end()) {
+            *it = fe;
+        } else {
+            flows.push_back(fe);
+        }
+    }
+
+    /* Report a change to the flow monitor */
+    void notify(int event, const FlowEntryPtr& fe) {
+        FlowReader::FlowUpdateCb cb;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            cb = monitorCb;
+        }
+        cb(event, fe);
+    }
+
+    bool isMonitoring() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return (bool)monitorCb;
+    }
+
+    uint64_t countFlows(uint8_t tableId) {
+        std::lock_guard<std::mutex> guard(mutex);
+        uint64_t count = 0;
+        for (const FlowEntryPtr& fe : flows) {
+            if (fe->entry->table_id == tableId)
+                count += 1;
+        }
+        return count;
+    }
+
+    vector<int> takeTablesRead() {
+        std::lock_guard<std::mutex> guard(mutex);
+        vector<int> res;
+        res.swap(tablesRead);
+        return res;
+    }
+
+    /* Lose all the flows, as after a switch restart */
+    void restart() {
+        std::lock_guard<std::mutex> guard(mutex);
+        flows.clear();
+    }
+
+    std::mutex mutex;
+    vector<int> tablesRead;
+};
+
+/**
+ * Flow executor that applies its flow mods to a scripted switch
+ */
+class ScriptedFlowExecutor : public MockFlowExecutor {
+public:
+    ScriptedFlowExecutor(ScriptedFlowReader& reader_) : reader(reader_) {
+        IgnoreFlowMods();
+        IgnoreGroupMods();
+    }
+
+    virtual bool Execute(const FlowEdit& flowEdits) {
+        for (const FlowEdit::Entry& e : flowEdits.edits)
+            reader.apply(e.first, e.second);
+        return true;
+    }
+
+    ScriptedFlowReader& reader;
+};
+
+class CountingStateHandler : public SwitchStateHandler {
+public:
+    CountingStateHandler() : syncs(0) {}
+
+    virtual void completeSync() { syncs += 1; }
+
+    std::atomic<int> syncs;
+};
+
+class IncrementalSyncFixture : public BaseFixture {
+public:
+    IncrementalSyncFixture()
+        : exec(reader), switchManager(agent, exec, reader, portmapper) {
+        switchManager.setMaxFlowTables(3);
+        switchManager.setIncrementalSync(true);
+        switchManager.setSyncDelayOnConnect(0);
+        switchManager.registerStateHandler(&handler);
+        switchManager.start("br-test");
+    }
+
+    virtual ~IncrementalSyncFixture() {
+        switchManager.stop();
+    }
+
+    void writeFlows(const std::string& objId, int tableId) {
+        FlowEntryList el;
+        for (int i = 0; i < 2; ++i)
+            el.push_back(FlowBuilder().priority(100 + i)
+                         .ethType(0x0800).build());
+        switchManager.writeFlow(objId, tableId, el);
+    }
+
+    /* Reconnect to the switch and get the tables read by the sync */
+    vector<int> reconnect() {
+        int syncs = handler.syncs;
+        switchManager.getConnection()->Connect(OFP13_VERSION);
+        WAIT_FOR(handler.syncs == syncs + 1, 1000);
+        return reader.takeTablesRead();
+    }
+
+    ScriptedFlowReader reader;
+    ScriptedFlowExecutor exec;
+    MockPortMapper portmapper;
+    CountingStateHandler handler;
+    MockSwitchManager switchManager;
+};
+
+// Table holding the sync marker flow
+static const int MARKER_TABLE = 253;
+
+BOOST_AUTO_TEST_SUITE(SwitchManager_test)
+
+BOOST_FIXTURE_TEST_CASE(unbatched, SwitchManagerFixture) {
+    writeFlows("obj1", 2);
+    writeFlows("obj2", 2);
+    BOOST_CHECK(exec.getSizes() == vector<size_t>({2, 2}));
+}
+
+BOOST_FIXTURE_TEST_CASE(batchsize, SwitchManagerFixture) {
+    switchManager.setFlowBatching(4, 60000);
+
+    writeFlows("obj1", 2);
+    BOOST_CHECK(exec.getSizes().empty());
+    writeFlows("obj2", 3);
+    BOOST_CHECK(exec.getSizes() == vector<size_t>({5}));
+
+    writeFlows("obj3", 1);
+    BOOST_CHECK(exec.getSizes().size() == 1);
+    switchManager.flushFlowBatch();
+    BOOST_CHECK(exec.getSizes() == vector<size_t>({5, 1}));
+
+    SwitchManager::FlowBatchStats stats = switchManager.getFlowBatchStats();
+    BOOST_CHECK_EQUAL(2U, stats.batches);
+    BOOST_CHECK_EQUAL(6U, stats.flowMods);
+    BOOST_CHECK_EQUAL(5U, stats.maxFlowMods);
+    BOOST_CHECK_EQUAL(0U, stats.failedFlowMods);
+}
+
+BOOST_FIXTURE_TEST_CASE(batchdeadline, SwitchManagerFixture) {
+    switchManager.setFlowBatching(1000, 10);
+
+    writeFlows("obj1", 1);
+    writeFlows("obj2", 1);
+    WAIT_FOR(exec.getSizes().size() == 1, 1000);
+    BOOST_CHECK(exec.getSizes() == vector<size_t>({2}));
+
+    SwitchManager::FlowBatchStats stats = switchManager.getFlowBatchStats();
+    BOOST_CHECK_EQUAL(1U, stats.batches);
+    BOOST_CHECK(stats.maxFlushLatencyUs >= 10000);
+    BOOST_CHECK_EQUAL(stats.maxFlushLatencyUs, stats.totalFlushLatencyUs);
+}
+
+BOOST_FIXTURE_TEST_CASE(batcherrors, SwitchManagerFixture) {
+    exec.failEdit = 1;
+    switchManager.setFlowBatching(3, 60000);
+
+    writeFlows("obj1", 1);
+    writeFlows("obj2", 2);
+    BOOST_CHECK(exec.getSizes() == vector<size_t>({3}));
+
+    SwitchManager::FlowBatchStats stats = switchManager.getFlowBatchStats();
+    BOOST_CHECK_EQUAL(1U, stats.failedFlowMods);
+}
+
+BOOST_FIXTURE_TEST_CASE(auxconnections, SwitchManagerFixture) {
+    BOOST_CHECK(switchManager.getPacketInConnection() ==
+                switchManager.getConnection());
+    BOOST_CHECK(switchManager.getStatsConnection() ==
+                switchManager.getConnection());
+
+    MockSwitchManager auxManager(agent, exec, reader, portmapper);
+    auxManager.setAuxConnections(true);
+    auxManager.start("br-aux");
+    SwitchConnection* main = auxManager.getConnection();
+    SwitchConnection* pktIn = auxManager.getPacketInConnection();
+    SwitchConnection* stats = auxManager.getStatsConnection();
+    BOOST_CHECK(pktIn != NULL && stats != NULL);
+    BOOST_CHECK(pktIn != main && stats != main && pktIn != stats);
+    auxManager.stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(objectcookies, ObjectCookieFixture) {
+    writeFlows("obj1", 4);
+    writeFlows("obj2", 2);
+    vector<FlowEdit> edits = exec.getEdits();
+    BOOST_REQUIRE_EQUAL(2U, edits.size());
+    uint64_t cookie1 = objectCookie(edits[0].edits[0]);
+    uint64_t cookie2 = objectCookie(edits[1].edits[0]);
+    BOOST_CHECK(cookie1 != 0 && cookie2 != 0 && cookie1 != cookie2);
+    for (const FlowEdit::Entry& e : edits[0].edits)
+        BOOST_CHECK_EQUAL(cookie1, objectCookie(e));
+
+    // Flows that already use the upper cookie bits keep their cookie,
+    // and the entries given are not changed
+    FlowEntryPtr neighDisc = FlowBuilder().priority(10).ethType(0x86dd)
+        .cookie(flow::cookie::NEIGH_DISC).build();
+    FlowEntryPtr shared = FlowBuilder().priority(20).ethType(0x0806).build();
+    FlowEntryList el;
+    el.push_back(neighDisc);
+    el.push_back(shared);
+    switchManager.writeFlow("obj3", 0, el);
+    edits = exec.getEdits();
+    BOOST_REQUIRE_EQUAL(3U, edits.size());
+    BOOST_REQUIRE_EQUAL(2U, edits[2].edits.size());
+    for (const FlowEdit::Entry& e : edits[2].edits) {
+        if (e.second->entry->priority == 10)
+            BOOST_CHECK_EQUAL(flow::cookie::NEIGH_DISC,
+                              e.second->entry->cookie);
+        else
+            BOOST_CHECK(objectCookie(e) != 0);
+    }
+    BOOST_CHECK_EQUAL(0U, shared->entry->cookie);
+
+    // The flows removed from an object that keeps others in the
+    // table are deleted one by one
+    writeFlows("obj1", 2);
+    edits = exec.getEdits();
+    BOOST_REQUIRE_EQUAL(4U, edits.size());
+    BOOST_REQUIRE_EQUAL(2U, edits[3].edits.size());
+    for (const FlowEdit::Entry& e : edits[3].edits) {
+        BOOST_CHECK_EQUAL(FlowEdit::DEL, e.first);
+        BOOST_CHECK_EQUAL(cookie1, objectCookie(e));
+    }
+
+    // All the flows of an object are removed with one flow mod
+    switchManager.clearFlows("obj1", 0);
+    edits = exec.getEdits();
+    BOOST_REQUIRE_EQUAL(5U, edits.size());
+    BOOST_REQUIRE_EQUAL(1U, edits[4].edits.size());
+    BOOST_CHECK_EQUAL(FlowEdit::DEL_COOKIE, edits[4].edits[0].first);
+    BOOST_CHECK_EQUAL(cookie1, edits[4].edits[0].second->entry->cookie);
+
+    // A single flow is still deleted on its own
+    writeFlows("obj2", 1);
+    edits = exec.getEdits();
+    BOOST_REQUIRE_EQUAL(6U, edits.size());
+    BOOST_REQUIRE_EQUAL(1U, edits[5].edits.size());
+    BOOST_CHECK_EQUAL(FlowEdit::DEL, edits[5].edits[0].first);
+    BOOST_CHECK_EQUAL(cookie2, objectCookie(edits[5].edits[0]));
+}
+
+BOOST_FIXTURE_TEST_CASE(incrementalsync, IncrementalSyncFixture) {
+    writeFlows("obj0", 0);
+    writeFlows("obj1", 1);
+    writeFlows("obj2", 2);
+
+    // Nothing to compare against on the first sync
+    switchManager.enableSync();
+    switchManager.connect();
+    WAIT_FOR(handler.syncs == 1, 1000);
+    WAIT_FOR(reader.isMonitoring(), 1000);
+    BOOST_CHECK(reader.takeTablesRead() == vector<int>({0, 1, 2}));
+    BOOST_CHECK_EQUAL(1U, reader.countFlows(MARKER_TABLE));
+
+    // Another controller adds a flow to table 1 while connected
+    FlowEntryPtr extra = FlowBuilder().priority(50).ethType(0x0806).build();
+    extra->entry->table_id = 1;
+    reader.apply(FlowEdit::ADD, extra);
+    reader.notify(NXFME_ADDED, extra);
+
+    // A flow is removed from table 2 while disconnected
+    FlowEntryPtr removed = FlowBuilder().priority(100)
+        .ethType(0x0800).build();
+    removed->entry->table_id = 2;
+    reader.apply(FlowEdit::DEL, removed);
+
+    BOOST_CHECK(reconnect() == vector<int>({MARKER_TABLE, 1, 2}));
+    BOOST_CHECK_EQUAL(2U, reader.countFlows(0));
+    BOOST_CHECK_EQUAL(2U, reader.countFlows(1));
+    BOOST_CHECK_EQUAL(2U, reader.countFlows(2));
+
+    // Nothing changed
+    BOOST_CHECK(reconnect() == vector<int>({MARKER_TABLE}));
+
+    // The monitor fell behind, so changes may have been missed
+    reader.notify(NXFME_ADDED, FlowEntryPtr());
+    BOOST_CHECK(reconnect() == vector<int>({0, 1, 2}));
+
+    // The switch restarted and lost its flows, including the marker
+    reader.restart();
+    BOOST_CHECK(reconnect() == vector<int>({MARKER_TABLE, 0, 1, 2}));
+    BOOST_CHECK_EQUAL(2U, reader.countFlows(0));
+    BOOST_CHECK_EQUAL(2U, reader.countFlows(1));
+    BOOST_CHECK_EQUAL(2U, reader.countFlows(2));
+    BOOST_CHECK_EQUAL(1U, reader.countFlows(MARKER_TABLE));
+
+    // The monitor reconnected, so changes may have been missed
+    switchManager.getMonitorConnection()->Connect(OFP10_VERSION);
+    BOOST_CHECK(reconnect() == vector<int>({0, 1, 2}));
+    BOOST_CHECK(reconnect() == vector<int>({MARKER_TABLE}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} /* namespace ovsagent */
@@ -209,6 +209,9 @@ BOOST_FIXTURE_TEST_CASE(apply, TableStateFixture) {
 
     el.clear();
     state.apply("test", el, diffs);
+    BOOST_REQUIRE(1 == diffs.edits.size());
+    BOOST_CHECK_EQUAL(FlowEdit::ADD, diffs.edits[0].first);
+    BOOST_CHECK(diffs.edits[0].second == f2_3);
     cookieMatchSet expCSet4 {
         {0x2, 10, f3_2->entry->match},
         {0x3, 1,  f2_2->entry->match},
@@ -219,6 +222,99 @@ BOOST_FIXTURE_TEST_CASE(apply, TableStateFixture) {
     BOOST_CHECK(expCSet4 == actual);
 }
 
+BOOST_FIXTURE_TEST_CASE(objidreuse, TableStateFixture) {
+    el.push_back(f1_1);
+    state.apply("a", el, diffs);
+    BOOST_REQUIRE(1 == diffs.edits.size());
+
+    el.clear();
+    el.push_back(f1_2);
+    state.apply("b", el, diffs);
+    BOOST_REQUIRE(0 == diffs.edits.size());
+    BOOST_CHECK_EQUAL(1U, state.size());
+    BOOST_CHECK(state.getEntry(f1_2)->actionEq(f1_1.get()));
+
+    // removing "a" promotes the flow queued by "b"
+    el.clear();
+    state.apply("a", el, diffs);
+    BOOST_REQUIRE(1 == diffs.edits.size());
+    BOOST_CHECK_EQUAL(FlowEdit::MOD, diffs.edits[0].first);
+    BOOST_CHECK(diffs.edits[0].second->actionEq(f1_2.get()));
+    BOOST_CHECK(state.getEntry(f1_1)->actionEq(f1_2.get()));
+    BOOST_CHECK(!state.getEntry(f2_1));
+
+    // a new object must not inherit anything from "a"
+    el.push_back(f2_1);
+    state.apply("c", el, diffs);
+    BOOST_REQUIRE(1 == diffs.edits.size());
+    BOOST_CHECK_EQUAL(FlowEdit::ADD, diffs.edits[0].first);
+
+    el.clear();
+    state.apply("a", el, diffs);
+    BOOST_CHECK(0 == diffs.edits.size());
+
+    state.apply("b", el, diffs);
+    BOOST_REQUIRE(1 == diffs.edits.size());
+    BOOST_CHECK_EQUAL(FlowEdit::DEL, diffs.edits[0].first);
+    BOOST_CHECK(diffs.edits[0].second->matchEq(f1_2.get()));
+
+    state.apply("c", el, diffs);
+    BOOST_REQUIRE(1 == diffs.edits.size());
+    BOOST_CHECK_EQUAL(FlowEdit::DEL, diffs.edits[0].first);
+    BOOST_CHECK(diffs.edits[0].second->matchEq(f2_1.get()));
+    BOOST_CHECK_EQUAL(0U, state.size());
+}
+
+BOOST_FIXTURE_TEST_CASE(objectcookie, TableStateFixture) {
+    uint64_t objCookie = ovs_htonll(0x7ull << 32);
+    el.push_back(f1_1);
+    el.push_back(f3_1);
+    state.apply("a", el, diffs, objCookie);
+    BOOST_REQUIRE(2 == diffs.edits.size());
+    for (const FlowEdit::Entry& e : diffs.edits) {
+        BOOST_CHECK_EQUAL(FlowEdit::ADD, e.first);
+        uint64_t base = e.second->matchEq(f1_1.get()) ? 0x0 : 0x1;
+        BOOST_CHECK_EQUAL((0x7ull << 32) | base,
+                          ovs_ntohll(e.second->entry->cookie));
+    }
+    // the entries given are left as they were
+    BOOST_CHECK_EQUAL(0U, f1_1->entry->cookie);
+    BOOST_CHECK_EQUAL(ovs_htonll(0x1), f3_1->entry->cookie);
+
+    // unchanged entries keep the ones already in the table
+    FlowEntryPtr kept = state.getEntry(f1_1);
+    el.clear();
+    el.push_back(f1_1);
+    el.push_back(f3_1);
+    state.apply("a", el, diffs, objCookie);
+    BOOST_CHECK(0 == diffs.edits.size());
+    BOOST_CHECK(kept == state.getEntry(f1_1));
+
+    // only the flows with a cookie of their own are reported
+    cookieMatchSet expCSet {
+        {(0x7ull << 32) | 0x1, 10, f3_1->entry->match}
+    };
+    cookieMatchSet actual;
+    TableState::cookie_callback_t cb =
+        [&actual](uint64_t c,
+                  uint16_t p,
+                  const struct match& m) {
+        actual.insert({c, p, m});
+    };
+    state.forEachCookieMatch(cb);
+    BOOST_CHECK(expCSet == actual);
+
+    el.clear();
+    state.apply("a", el, diffs, objCookie);
+    BOOST_REQUIRE(2 == diffs.edits.size());
+    for (const FlowEdit::Entry& e : diffs.edits) {
+        BOOST_CHECK_EQUAL(FlowEdit::DEL, e.first);
+        BOOST_CHECK_EQUAL(objCookie,
+                          e.second->entry->cookie &
+                          ovs_htonll(0xffffffff00000000ull));
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(diff, TableStateFixture) {
     el.push_back(f1_1);
     el.push_back(f2_1);
@@ -0,0 +1,158 @@
+/*
+ * Test suite for class TaskQueue
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include "TaskQueue.h"
+#include "BaseFixture.h"
+#include "logging.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <chrono>
+
+namespace ovsagent {
+
+BOOST_AUTO_TEST_SUITE(TaskQueue_test)
+
+BOOST_AUTO_TEST_CASE(dedupe) {
+    boost::asio::io_service io;
+    TaskQueue queue(io);
+    int runs = 0;
+    queue.dispatch("a", [&runs]() { runs += 1; });
+    queue.dispatch("a", [&runs]() { runs += 10; });
+    queue.dispatch("b", [&runs]() { runs += 100; });
+    io.run();
+    // The latest task queued for an ID is the one that runs
+    BOOST_CHECK_EQUAL(110, runs);
+
+    // Dispatching a task while it runs queues it again, once
+    io.reset();
+    queue.dispatch("a", [&queue, &runs]() {
+            runs += 1;
+            queue.dispatch("a", [&runs]() { runs += 10; });
+            queue.dispatch("a", [&runs]() { runs += 1000; });
+        });
+    io.run();
+    BOOST_CHECK_EQUAL(1111, runs);
+
+    TaskQueue::LaneStats stats =
+        queue.getLaneStats(TaskQueue::DEFAULT_LANE);
+    BOOST_CHECK_EQUAL(0, stats.depth);
+    BOOST_CHECK_EQUAL(4, stats.tasks);
+    BOOST_CHECK_EQUAL(2, stats.coalesced);
+}
+
+BOOST_AUTO_TEST_CASE(lanes) {
+    boost::asio::io_service io;
+    TaskQueue queue(io);
+    queue.addLane("high", 3);
+    queue.addLane("low", 1);
+
+    std::string order;
+    for (int i = 0; i < 8; ++i) {
+        std::stringstream id;
+        id << i;
+        queue.dispatch("low" + id.str(), [&order]() { order += "L"; },
+                       "low");
+    }
+    for (int i = 0; i < 4; ++i) {
+        std::stringstream id;
+        id << i;
+        queue.dispatch("high" + id.str(), [&order]() { order += "H"; },
+                       "high");
+    }
+    BOOST_CHECK_EQUAL(8, queue.getLaneStats("low").depth);
+    BOOST_CHECK_EQUAL(4, queue.getLaneStats("high").depth);
+
+    // The high lane gets three runs for each run of the low lane
+    // despite the backlog queued ahead of it
+    io.run();
+    BOOST_CHECK_EQUAL("HHLHHLLLLLLL", order);
+
+    TaskQueue::LaneStats stats = queue.getLaneStats("high");
+    BOOST_CHECK_EQUAL(0, stats.depth);
+    BOOST_CHECK_EQUAL(4, stats.tasks);
+    BOOST_CHECK(stats.totalWaitUs >= stats.maxWaitUs);
+    BOOST_CHECK_EQUAL(8, queue.getLaneStats("low").tasks);
+    BOOST_CHECK_EQUAL(0, queue.getLaneStats("missing").tasks);
+}
+
+BOOST_AUTO_TEST_CASE(lanechange) {
+    boost::asio::io_service io;
+    TaskQueue queue(io);
+    queue.addLane("high", 3);
+    queue.addLane("low", 1);
+
+    // A task dispatched again into another lane moves to that lane
+    std::string order;
+    queue.dispatch("a", [&order]() { order += "a"; }, "low");
+    queue.dispatch("b", [&order]() { order += "b"; }, "low");
+    queue.dispatch("a", [&order]() { order += "A"; }, "high");
+    BOOST_CHECK_EQUAL(1, queue.getLaneStats("low").depth);
+    BOOST_CHECK_EQUAL(1, queue.getLaneStats("high").depth);
+
+    io.run();
+    BOOST_CHECK_EQUAL("Ab", order);
+
+    std::map<std::string, TaskQueue::LaneStats> stats =
+        queue.getAllLaneStats();
+    BOOST_CHECK_EQUAL(3, stats.size());
+    BOOST_CHECK_EQUAL(1, stats["high"].tasks);
+    BOOST_CHECK_EQUAL(1, stats["low"].tasks);
+    BOOST_CHECK_EQUAL(1, stats["low"].coalesced);
+}
+
+BOOST_AUTO_TEST_CASE(workers) {
+    static const int NUM_IDS = 8;
+    boost::asio::io_service io;
+    TaskQueue queue(io);
+    queue.startWorkers(4);
+
+    // Tasks with the same ID never overlap, and a task runs after
+    // the last dispatch of its ID
+    std::atomic<int> running[NUM_IDS];
+    std::atomic<int> dispatched[NUM_IDS];
+    std::atomic<int> seen[NUM_IDS];
+    std::atomic<int> overlaps(0);
+    for (int i = 0; i < NUM_IDS; ++i) {
+        running[i] = 0;
+        dispatched[i] = -1;
+        seen[i] = -1;
+    }
+    for (int n = 0; n < 200; ++n) {
+        for (int i = 0; i < NUM_IDS; ++i) {
+            std::stringstream id;
+            id << "task" << i;
+            dispatched[i] = n;
+            queue.dispatch(id.str(), [&, i]() {
+                    if (running[i]++ > 0)
+                        overlaps += 1;
+                    seen[i] = dispatched[i].load();
+                    std::this_thread::sleep_for
+                        (std::chrono::microseconds(50));
+                    running[i]--;
+                });
+        }
+    }
+
+    for (int i = 0; i < NUM_IDS; ++i)
+        WAIT_FOR(seen[i] == 199, 1000);
+    BOOST_CHECK_EQUAL(0, overlaps);
+    queue.stopWorkers();
+
+    // Nothing ran on the io_service
+    BOOST_CHECK_EQUAL(0, io.poll());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
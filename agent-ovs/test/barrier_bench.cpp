@@ -0,0 +1,310 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Barrier latency under packet-in and statistics load benchmark
+ * standalone, which can also time small flow batches written one at
+ * a time against pipelined.  Needs a running Open vSwitch with the
+ * given bridge.
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+
+#include <boost/program_options.hpp>
+
+#include "SwitchConnection.h"
+#include "FlowExecutor.h"
+#include "FlowBuilder.h"
+#include "ActionBuilder.h"
+#include "logging.h"
+
+#include "ovs-shim.h"
+#include "ovs-ofputil.h"
+
+using std::string;
+using std::vector;
+namespace po = boost::program_options;
+using namespace ovsagent;
+
+/* Counts the messages it handles and lets a caller wait for the
+   reply to a barrier */
+class Recorder : public MessageHandler {
+public:
+    Recorder() : count(0), lastXid(0) {}
+
+    void Handle(SwitchConnection*, int msgType, ofpbuf* msg) {
+        std::lock_guard<std::mutex> guard(mtx);
+        count += 1;
+        if (msgType == OFPTYPE_BARRIER_REPLY) {
+            lastXid = ((ofp_header*)msg->data)->xid;
+            cond.notify_all();
+        }
+    }
+
+    bool waitForBarrier(ovs_be32 xid) {
+        std::unique_lock<std::mutex> lock(mtx);
+        return cond.wait_for(lock, std::chrono::seconds(10),
+                             [this, xid]() { return lastXid == xid; });
+    }
+
+    size_t getCount() {
+        std::lock_guard<std::mutex> guard(mtx);
+        return count;
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cond;
+    size_t count;
+    ovs_be32 lastXid;
+};
+
+/* A packet-out whose only action sends the packet back to the
+   controller, so that each one produces a packet-in */
+static ofpbuf* makePacketOut(int version) {
+    static const uint8_t packet[64] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+        0x88, 0xb5
+    };
+    ofputil_packet_out po;
+    memset(&po, 0, sizeof(po));
+    po.buffer_id = UINT32_MAX;
+    po.packet = packet;
+    po.packet_len = sizeof(packet);
+    po.in_port = OFPP_CONTROLLER;
+
+    ActionBuilder ab;
+    ab.controller();
+    ab.build(&po);
+
+    ofputil_protocol proto =
+        ofputil_protocol_from_ofp_version((ofp_version)version);
+    ofpbuf* msg = ofputil_encode_packet_out(&po, proto);
+    free(po.ofpacts);
+    return msg;
+}
+
+/* A request for every flow in every table */
+static ofpbuf* makeFlowStatsRequest(int version) {
+    ofputil_flow_stats_request fsr;
+    memset(&fsr, 0, sizeof(fsr));
+    fsr.aggregate = false;
+    match_init_catchall(&fsr.match);
+    fsr.table_id = 0xff;
+    fsr.out_port = OFPP_ANY;
+    fsr.out_group = OFPG_ANY;
+
+    ofputil_protocol proto =
+        ofputil_protocol_from_ofp_version((ofp_version)version);
+    return ofputil_encode_flow_stats_request(&fsr, proto);
+}
+
+/* Write numBatches batches of two flows, each batch waiting for its
+   barrier before the next is written, then the same batches without
+   waiting, and report how long each takes */
+static int timeFlowBatches(SwitchConnection& conn, size_t numBatches) {
+    static const uint64_t BENCH_COOKIE = 0xbe4c;
+    FlowExecutor executor;
+    executor.InstallListenersForConnection(&conn);
+
+    vector<FlowEdit> batches(numBatches);
+    FlowEdit cleanup;
+    for (size_t i = 0; i < numBatches; ++i) {
+        for (uint32_t port = 1; port <= 2; ++port) {
+            FlowEntryPtr f = FlowBuilder().priority(1)
+                .cookie(BENCH_COOKIE).inPort(port).reg(0, i).build();
+            batches[i].edits.push_back(std::make_pair(FlowEdit::ADD, f));
+            cleanup.edits.push_back(std::make_pair(FlowEdit::DEL, f));
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (const FlowEdit& fe : batches) {
+        if (!executor.Execute(fe)) {
+            std::cerr << "Flow batch failed" << std::endl;
+            return 1;
+        }
+    }
+    auto blocking = std::chrono::steady_clock::now() - start;
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    size_t done = 0;
+    size_t failed = 0;
+    FlowExecutor::CompletionCb cb =
+        [&](int status, const std::vector<int>&) {
+        std::lock_guard<std::mutex> guard(mtx);
+        if (status != 0) failed += 1;
+        done += 1;
+        cond.notify_all();
+    };
+    start = std::chrono::steady_clock::now();
+    for (const FlowEdit& fe : batches)
+        executor.ExecuteAsync(fe, cb);
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cond.wait(lock, [&]() { return done == numBatches; });
+    }
+    auto pipelined = std::chrono::steady_clock::now() - start;
+
+    executor.Execute(cleanup);
+    executor.UninstallListenersForConnection(&conn);
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    std::cout << "flow_batches=" << numBatches
+              << " blocking_us="
+              << duration_cast<microseconds>(blocking).count()
+              << " pipelined_us="
+              << duration_cast<microseconds>(pipelined).count()
+              << " failed=" << failed
+              << std::endl;
+    return failed > 0 ? 1 : 0;
+}
+
+static long percentile(vector<long>& v, double p) {
+    if (v.empty()) return 0;
+    size_t i = std::min(v.size() - 1, (size_t)(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+int main(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Print this help message")
+        ("bridge", po::value<string>()->default_value("br-int"),
+         "Bridge to connect to")
+        ("aux", "Send packet-outs and statistics requests on auxiliary "
+         "connections of their own")
+        ("barriers", po::value<size_t>()->default_value(1000),
+         "Number of barriers to time")
+        ("packet-outs", po::value<size_t>()->default_value(100),
+         "Packet-outs sent to the controller before each barrier")
+        ("stats-requests", po::value<size_t>()->default_value(1),
+         "Flow statistics requests for all flows sent before each "
+         "barrier")
+        ("flow-batches", po::value<size_t>()->default_value(0),
+         "Instead of timing barriers, time this many flow batches "
+         "written one at a time and then pipelined")
+        ;
+
+    string bridge;
+    bool aux;
+    size_t numBarriers, numPacketOuts, numStats, numFlowBatches;
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).
+                  options(desc).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << desc;
+            return 0;
+        }
+        bridge = vm["bridge"].as<string>();
+        aux = vm.count("aux") > 0;
+        numBarriers = vm["barriers"].as<size_t>();
+        numPacketOuts = vm["packet-outs"].as<size_t>();
+        numStats = vm["stats-requests"].as<size_t>();
+        numFlowBatches = vm["flow-batches"].as<size_t>();
+    } catch (po::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    initLogging("error", false /*syslog*/, "", "barrier-bench");
+
+    // Set up the connections the way SwitchManager does
+    SwitchConnection main(bridge);
+    std::unique_ptr<SwitchConnection> pktInConn, statsConn;
+    SwitchConnection* pktIn = &main;
+    SwitchConnection* stats = &main;
+    if (aux) {
+        main.SetAsyncMessages(SwitchConnection::ASYNC_PORT_STATUS);
+        pktInConn.reset(new SwitchConnection(bridge));
+        pktInConn->SetAuxiliary();
+        pktInConn->SetAsyncMessages(SwitchConnection::ASYNC_PACKET_IN);
+        statsConn.reset(new SwitchConnection(bridge));
+        statsConn->SetAuxiliary();
+        statsConn->SetAsyncMessages(SwitchConnection::ASYNC_FLOW_REMOVED);
+        pktIn = pktInConn.get();
+        stats = statsConn.get();
+    }
+
+    Recorder barriers, packetIns, statsReplies;
+    main.RegisterMessageHandler(OFPTYPE_BARRIER_REPLY, &barriers);
+    pktIn->RegisterMessageHandler(OFPTYPE_PACKET_IN, &packetIns);
+    stats->RegisterMessageHandler(OFPTYPE_FLOW_STATS_REPLY, &statsReplies);
+
+    for (SwitchConnection* conn : {&main, pktInConn.get(), statsConn.get()}) {
+        if (!conn) continue;
+        int err = conn->Connect(OFP13_VERSION);
+        if (err) {
+            std::cerr << "Could not connect to " << bridge << ": "
+                      << ovs_strerror(err) << std::endl;
+            return 1;
+        }
+    }
+    int version = main.GetProtocolVersion();
+
+    if (numFlowBatches > 0) {
+        int rc = timeFlowBatches(main, numFlowBatches);
+        for (SwitchConnection* conn :
+                 {&main, pktInConn.get(), statsConn.get()}) {
+            if (conn) conn->Disconnect();
+        }
+        return rc;
+    }
+
+    vector<long> latencies;
+    for (size_t i = 0; i < numBarriers; ++i) {
+        for (size_t j = 0; j < numPacketOuts; ++j)
+            pktIn->SendMessage(makePacketOut(version));
+        for (size_t j = 0; j < numStats; ++j)
+            stats->SendMessage(makeFlowStatsRequest(version));
+
+        ofpbuf* barrier = ofputil_encode_barrier_request((ofp_version)version);
+        ovs_be32 xid = ((ofp_header*)barrier->data)->xid;
+        auto start = std::chrono::steady_clock::now();
+        if (main.SendMessage(barrier) != 0 ||
+            !barriers.waitForBarrier(xid)) {
+            std::cerr << "No reply to barrier " << i << std::endl;
+            return 1;
+        }
+        latencies.push_back(std::chrono::duration_cast
+                            <std::chrono::microseconds>
+                            (std::chrono::steady_clock::now() - start)
+                            .count());
+    }
+
+    std::cout << "aux=" << aux
+              << " barriers=" << numBarriers
+              << " p50_us=" << percentile(latencies, 0.5)
+              << " p99_us=" << percentile(latencies, 0.99)
+              << " max_us=" << percentile(latencies, 1.0)
+              << " packet_ins=" << packetIns.getCount()
+              << " stats_replies=" << statsReplies.getCount()
+              << " max_send_queue=" << main.GetMaxSendQueueDepth()
+              << std::endl;
+
+    for (SwitchConnection* conn : {&main, pktInConn.get(), statsConn.get()}) {
+        if (conn) conn->Disconnect();
+    }
+    return 0;
+}
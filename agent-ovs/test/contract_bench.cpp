@@ -0,0 +1,294 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Contract rendering benchmark standalone: flow counts and install
+ * cost of a contract rendered pairwise or with conjunctions, and the
+ * cost of a group joining it
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <boost/program_options.hpp>
+
+#include <opflex/ofcore/OFFramework.h>
+#include <opflex/modb/Mutator.h>
+#include <modelgbp/metadata/metadata.hpp>
+#include <modelgbp/dmtree/Root.hpp>
+#include <modelgbp/l2/EtherTypeEnumT.hpp>
+
+#include "IntFlowManager.h"
+#include "PolicyManager.h"
+#include "FlowUtils.h"
+#include "FlowBuilder.h"
+#include "FlowExecutor.h"
+#include "TableState.h"
+#include "logging.h"
+
+#include "ovs-shim.h"
+#include "ovs-ofputil.h"
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+namespace po = boost::program_options;
+using modelgbp::gbpe::L24Classifier;
+using namespace ovsagent;
+
+typedef std::chrono::steady_clock::duration duration;
+
+static long toMs(duration d) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+}
+
+/* Flows of the contract, written by one object in the policy table
+   as the agent does, and the time taken to build, apply and encode
+   them */
+static void report(const string& mode, FlowEntryList& flows,
+                   duration buildTime) {
+    auto start = std::chrono::steady_clock::now();
+    TableState state;
+    FlowEdit diffs;
+    size_t numFlows = flows.size();
+    state.apply("contract", flows, diffs);
+    auto applyTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    for (const FlowEdit::Entry& e : diffs.edits) {
+        ofpbuf* msg = FlowExecutor::EncodeFlowMod(e, OFP13_VERSION);
+        bytes += msg->size;
+        ofpbuf_delete(msg);
+    }
+    auto encodeTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << "mode=" << mode
+              << " flows=" << numFlows
+              << " flow_mods=" << diffs.edits.size()
+              << " bytes=" << bytes
+              << " build_ms=" << toMs(buildTime)
+              << " apply_ms=" << toMs(applyTime)
+              << " encode_ms=" << toMs(encodeTime)
+              << std::endl;
+}
+
+/* The flows of every rule from a consumer to a provider.  Each rule
+   has its own priority, as the policy manager assigns them. */
+static void addPair(const vector<shared_ptr<L24Classifier> >& classifiers,
+                    uint32_t pvnid, uint32_t cvnid, FlowEntryList& el) {
+    uint16_t maxPrio = PolicyManager::MAX_POLICY_RULE_PRIORITY;
+    for (size_t i = 0; i < classifiers.size(); ++i) {
+        flowutils::add_classifier_entries(*classifiers[i],
+                                          flowutils::CA_ALLOW,
+                                          boost::none, boost::none,
+                                          IntFlowManager::OUT_TABLE_ID,
+                                          maxPrio - i,
+                                          OFPUTIL_FF_SEND_FLOW_REM,
+                                          i + 1, cvnid, pvnid, el);
+    }
+}
+
+static string sliceId(uint32_t pvnid, uint32_t cvnid) {
+    std::stringstream ss;
+    ss << "contract " << pvnid << " " << cvnid;
+    return ss.str();
+}
+
+/* Time from a consumer group joining the pairwise contract to the
+   flow mods for its flows being encoded, when the whole contract is
+   rendered and diffed again, or when only the slices of the new
+   consumer are */
+static void joinBench(const vector<shared_ptr<L24Classifier> >& classifiers,
+                      const vector<uint32_t>& provIds,
+                      vector<uint32_t> consIds, bool sliced) {
+    TableState state;
+    FlowEdit diffs;
+    FlowEntryList el;
+    for (uint32_t pvnid : provIds) {
+        for (uint32_t cvnid : consIds) {
+            addPair(classifiers, pvnid, cvnid, el);
+            if (sliced) {
+                state.apply(sliceId(pvnid, cvnid), el, diffs);
+                el.clear();
+            }
+        }
+    }
+    if (!sliced)
+        state.apply("contract", el, diffs);
+
+    uint32_t joined = 0x3000;
+    consIds.push_back(joined);
+    diffs.edits.clear();
+    size_t rendered = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    el.clear();
+    for (uint32_t pvnid : provIds) {
+        if (sliced) {
+            addPair(classifiers, pvnid, joined, el);
+            rendered += el.size();
+            state.apply(sliceId(pvnid, joined), el, diffs);
+            el.clear();
+        } else {
+            for (uint32_t cvnid : consIds)
+                addPair(classifiers, pvnid, cvnid, el);
+        }
+    }
+    if (!sliced) {
+        rendered = el.size();
+        state.apply("contract", el, diffs);
+    }
+    for (const FlowEdit::Entry& e : diffs.edits) {
+        ofpbuf* msg = FlowExecutor::EncodeFlowMod(e, OFP13_VERSION);
+        ofpbuf_delete(msg);
+    }
+    auto joinTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << "join=" << (sliced ? "sliced" : "whole")
+              << " rendered=" << rendered
+              << " flow_mods=" << diffs.edits.size()
+              << " join_ms=" << toMs(joinTime)
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Print this help message")
+        ("providers", po::value<size_t>()->default_value(50),
+         "Number of provider groups")
+        ("consumers", po::value<size_t>()->default_value(50),
+         "Number of consumer groups")
+        ("rules", po::value<size_t>()->default_value(40),
+         "Number of rules, each with a TCP port range classifier")
+        ("port-range", po::value<uint16_t>()->default_value(8),
+         "Number of destination ports matched by each classifier")
+        ;
+
+    size_t numProv, numCons, numRules;
+    uint16_t portRange;
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).
+                  options(desc).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << desc;
+            return 0;
+        }
+        numProv = vm["providers"].as<size_t>();
+        numCons = vm["consumers"].as<size_t>();
+        numRules = vm["rules"].as<size_t>();
+        portRange = vm["port-range"].as<uint16_t>();
+    } catch (po::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (numProv == 0 || numCons == 0 || numRules == 0 || portRange == 0 ||
+        numRules > 1000) {
+        std::cerr << "providers, consumers and port-range must be "
+                  << "positive, and rules between 1 and 1000" << std::endl;
+        return 1;
+    }
+
+    initLogging("error", false /*syslog*/, "", "contract-bench");
+
+    // The classifiers come from the MODB, so set up a framework to
+    // hold them
+    opflex::ofcore::OFFramework framework;
+    framework.setModel(modelgbp::getMetadata());
+    framework.start();
+    vector<shared_ptr<L24Classifier> > classifiers;
+    {
+        opflex::modb::Mutator mutator(framework, "init");
+        shared_ptr<modelgbp::dmtree::Root> root =
+            modelgbp::dmtree::Root::createRootElement(framework);
+        shared_ptr<modelgbp::policy::Space> space =
+            root->addPolicyUniverse()->addPolicySpace("bench");
+        for (size_t i = 0; i < numRules; ++i) {
+            std::stringstream name;
+            name << "classifier" << i;
+            uint16_t from = 1024 + i * 64;
+            classifiers.push_back(space->addGbpeL24Classifier(name.str()));
+            classifiers.back()
+                ->setEtherT(modelgbp::l2::EtherTypeEnumT::CONST_IPV4)
+                .setProt(6 /* TCP */)
+                .setDFromPort(from).setDToPort(from + portRange - 1);
+        }
+        mutator.commit();
+    }
+
+    vector<uint32_t> provIds, consIds;
+    for (size_t i = 0; i < numProv; ++i)
+        provIds.push_back(0x1000 + i);
+    for (size_t i = 0; i < numCons; ++i)
+        consIds.push_back(0x2000 + i);
+
+    std::cout << "providers=" << numProv
+              << " consumers=" << numCons
+              << " rules=" << numRules
+              << " port_range=" << portRange << std::endl;
+
+    uint16_t maxPrio = PolicyManager::MAX_POLICY_RULE_PRIORITY;
+
+    // A flow for every provider, consumer and rule
+    FlowEntryList pairwise;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t pvnid : provIds) {
+        for (uint32_t cvnid : consIds)
+            addPair(classifiers, pvnid, cvnid, pairwise);
+    }
+    report("pairwise", pairwise, std::chrono::steady_clock::now() - start);
+
+    joinBench(classifiers, provIds, consIds, false);
+    joinBench(classifiers, provIds, consIds, true);
+
+    // A conjunction for every rule, with a clause for each group and
+    // for the classifier
+    FlowEntryList conj;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numRules; ++i) {
+        uint32_t conjId = i + 1;
+        uint16_t prio = maxPrio - i;
+        for (uint32_t cvnid : consIds) {
+            FlowBuilder f;
+            flowutils::match_group(f, prio, cvnid, 0);
+            f.action().conjunction(conjId, 1, 3);
+            conj.push_back(f.build());
+        }
+        for (uint32_t pvnid : provIds) {
+            FlowBuilder f;
+            flowutils::match_group(f, prio, 0, pvnid);
+            f.action().conjunction(conjId, 2, 3);
+            conj.push_back(f.build());
+        }
+        flowutils::ConjList conjs;
+        flowutils::Conjunction c = {conjId, 3, 3};
+        conjs.push_back(c);
+        flowutils::add_classifier_conj_entries(*classifiers[i], prio,
+                                               conjs, conj);
+        conj.push_back(FlowBuilder()
+                       .priority(prio)
+                       .cookie(ovs_htonll(i + 1))
+                       .flags(OFPUTIL_FF_SEND_FLOW_REM)
+                       .conjId(conjId)
+                       .action().go(IntFlowManager::OUT_TABLE_ID)
+                       .parent().build());
+    }
+    report("conjunction", conj, std::chrono::steady_clock::now() - start);
+
+    framework.stop();
+    return 0;
+}
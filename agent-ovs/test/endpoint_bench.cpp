@@ -0,0 +1,204 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Endpoint rendering benchmark standalone: time and heap allocations
+ * per endpoint to build its bridge and route flows with flow
+ * builders, or by copying the flow templates of its group
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+#include <boost/program_options.hpp>
+#include <boost/asio/ip/address.hpp>
+
+#include "FlowBuilder.h"
+#include "FlowUtils.h"
+#include "FlowConstants.h"
+#include "IntFlowManager.h"
+#include "logging.h"
+#include "AllocCounter.h"
+
+#include "ovs-shim.h"
+#include "ovs-ofputil.h"
+
+using std::string;
+using std::vector;
+using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+using boost::asio::ip::address_v6;
+namespace po = boost::program_options;
+using namespace ovsagent;
+
+static const uint8_t ROUTER_MAC[6] = {0x00, 0x22, 0xbd, 0xf8, 0x19, 0xff};
+static const uint32_t EPG_VNID = 0xa0a;
+static const uint32_t BD_ID = 1;
+static const uint32_t RD_ID = 1;
+
+struct Endpoint {
+    uint32_t ofPort;
+    uint8_t mac[6];
+    vector<address> ips;
+};
+
+/* The bridge flow of the endpoint and a route flow for each of its
+   addresses, as IntFlowManager built them before templates */
+static void buildFlows(const Endpoint& ep, FlowEntryList& el) {
+    FlowBuilder().priority(10).ethDst(ep.mac).reg(4, BD_ID)
+        .action()
+        .reg(MFF_REG2, EPG_VNID)
+        .reg(MFF_REG7, ep.ofPort)
+        .go(IntFlowManager::POL_TABLE_ID)
+        .parent().build(el);
+    for (const address& ipAddr : ep.ips) {
+        FlowBuilder().priority(500)
+            .reg(6, RD_ID)
+            .ethDst(ROUTER_MAC)
+            .ipDst(ipAddr)
+            .action()
+            .reg(MFF_REG2, EPG_VNID)
+            .reg(MFF_REG7, ep.ofPort)
+            .ethSrc(ROUTER_MAC)
+            .ethDst(ep.mac)
+            .decTtl()
+            .metadata(flow::meta::ROUTED, flow::meta::ROUTED)
+            .go(IntFlowManager::POL_TABLE_ID)
+            .parent().build(el);
+    }
+}
+
+/* The same flows with placeholders for the endpoint fields, built
+   once for the group */
+static void buildTemplates(FlowEntryList& templates) {
+    static const uint8_t NO_MAC[6] = {0, 0, 0, 0, 0, 0};
+    Endpoint ep;
+    ep.ofPort = 0;
+    std::copy(NO_MAC, NO_MAC + 6, ep.mac);
+    ep.ips.push_back(address_v4::any());
+    ep.ips.push_back(address_v6::any());
+    buildFlows(ep, templates);
+}
+
+static void copyFlows(const Endpoint& ep, const FlowEntryList& templates,
+                      FlowEntryList& el) {
+    el.push_back(flowutils::copy_endpoint_flow(*templates[0], ep.ofPort,
+                                               ep.mac, NULL));
+    for (const address& ipAddr : ep.ips) {
+        const FlowEntry& tmpl = ipAddr.is_v4() ? *templates[1] : *templates[2];
+        el.push_back(flowutils::copy_endpoint_flow(tmpl, ep.ofPort,
+                                                   ep.mac, &ipAddr));
+    }
+}
+
+static void report(const string& mode, size_t numEps, size_t flows,
+                   size_t allocCount,
+                   std::chrono::steady_clock::duration d) {
+    std::cout << "mode=" << mode
+              << " endpoints=" << numEps
+              << " flows=" << flows
+              << " render_ns_per_ep="
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(d)
+                    .count() / numEps;
+    if (allocCountEnabled())
+        std::cout << " allocs_per_ep=" << (double)allocCount / numEps;
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Print this help message")
+        ("endpoints", po::value<size_t>()->default_value(100000),
+         "Number of endpoints to render")
+        ("ips-per-endpoint", po::value<size_t>()->default_value(2),
+         "Number of IP addresses of each endpoint, alternating between "
+         "IPv4 and IPv6")
+        ;
+
+    size_t numEps, numIps;
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).
+                  options(desc).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << desc;
+            return 0;
+        }
+        numEps = vm["endpoints"].as<size_t>();
+        numIps = vm["ips-per-endpoint"].as<size_t>();
+    } catch (po::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (numEps == 0) {
+        std::cerr << "endpoints must be positive" << std::endl;
+        return 1;
+    }
+
+    initLogging("error", false /*syslog*/, "", "endpoint-bench");
+
+    vector<Endpoint> eps(numEps);
+    for (size_t n = 0; n < numEps; ++n) {
+        Endpoint& ep = eps[n];
+        ep.ofPort = 1 + n;
+        uint8_t mac[6] = {0x02, 0x00, (uint8_t)(n >> 24), (uint8_t)(n >> 16),
+                          (uint8_t)(n >> 8), (uint8_t)n};
+        std::copy(mac, mac + 6, ep.mac);
+        for (size_t i = 0; i < numIps; ++i) {
+            if (i % 2 == 0) {
+                ep.ips.push_back(address_v4(0x0a000000 + n * numIps + i));
+            } else {
+                address_v6::bytes_type bytes = {{0xfd}};
+                for (size_t b = 0; b < 8; ++b)
+                    bytes[15 - b] = (uint8_t)((n * numIps + i) >> (8 * b));
+                ep.ips.push_back(address_v6(bytes));
+            }
+        }
+    }
+
+    // Flows built for every endpoint
+    FlowEntryList built;
+    built.reserve(numEps * (1 + numIps));
+    size_t startAllocs = getAllocCount();
+    auto start = std::chrono::steady_clock::now();
+    for (const Endpoint& ep : eps)
+        buildFlows(ep, built);
+    report("builder", numEps, built.size(),
+           getAllocCount() - startAllocs,
+           std::chrono::steady_clock::now() - start);
+
+    // Flows copied from the templates of the group, including the
+    // cost of building those once
+    FlowEntryList copied;
+    copied.reserve(numEps * (1 + numIps));
+    startAllocs = getAllocCount();
+    start = std::chrono::steady_clock::now();
+    FlowEntryList templates;
+    buildTemplates(templates);
+    for (const Endpoint& ep : eps)
+        copyFlows(ep, templates, copied);
+    report("template", numEps, copied.size(),
+           getAllocCount() - startAllocs,
+           std::chrono::steady_clock::now() - start);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < built.size(); ++i) {
+        if (!built[i]->matchEq(copied[i].get()) ||
+            !built[i]->actionEq(copied[i].get()))
+            mismatches += 1;
+    }
+    std::cout << "mismatches=" << mismatches << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
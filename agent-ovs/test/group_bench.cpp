@@ -0,0 +1,147 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Flood group benchmark standalone: size of the group modifications
+ * sent as endpoints join a flood group one at a time, modifying the
+ * whole group or inserting the bucket of each endpoint
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <string>
+#include <chrono>
+#include <iostream>
+#include <cstdlib>
+
+#include <boost/program_options.hpp>
+
+#include "IntFlowManager.h"
+#include "FlowExecutor.h"
+#include "ActionBuilder.h"
+#include "TableState.h"
+#include "logging.h"
+
+#include "ovs-shim.h"
+#include "ovs-ofputil.h"
+
+#include <openvswitch/list.h>
+
+using std::string;
+namespace po = boost::program_options;
+using namespace ovsagent;
+
+static const uint32_t GROUP_ID = 1;
+static const uint32_t TUN_PORT = 2048;
+
+static ofputil_bucket* createBucket(uint32_t bucketId) {
+    ofputil_bucket *bkt = (ofputil_bucket *)malloc(sizeof(ofputil_bucket));
+    bkt->weight = 0;
+    bkt->bucket_id = bucketId;
+    bkt->watch_port = OFPP_ANY;
+    bkt->watch_group = OFPG_ANY;
+    return bkt;
+}
+
+static size_t encodedSize(const GroupEdit::Entry& e, int version) {
+    ofpbuf* msg = FlowExecutor::EncodeGroupMod(e, version);
+    size_t size = msg->size;
+    ofpbuf_delete(msg);
+    return size;
+}
+
+static void report(const string& mode, size_t numEps, size_t bytes,
+                   size_t lastBytes,
+                   std::chrono::steady_clock::duration d) {
+    std::cout << "mode=" << mode
+              << " endpoints=" << numEps
+              << " group_mod_bytes_per_join=" << bytes / numEps
+              << " last_join_bytes=" << lastBytes
+              << " encode_ns_per_join="
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(d)
+                    .count() / numEps
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Print this help message")
+        ("endpoints", po::value<size_t>()->default_value(1000),
+         "Number of endpoints joining the flood group")
+        ;
+
+    size_t numEps;
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).
+                  options(desc).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << desc;
+            return 0;
+        }
+        numEps = vm["endpoints"].as<size_t>();
+    } catch (po::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (numEps == 0) {
+        std::cerr << "endpoints must be positive" << std::endl;
+        return 1;
+    }
+
+    initLogging("error", false /*syslog*/, "", "group-bench");
+
+    // Every join modifies the whole group, with the bucket of each
+    // endpoint so far followed by the tunnel bucket
+    GroupEdit::Entry full(new GroupEdit::GroupMod());
+    full->mod->command = OFPGC11_MODIFY;
+    full->mod->group_id = GROUP_ID;
+    {
+        ofputil_bucket *bkt = createBucket(TUN_PORT);
+        ActionBuilder ab;
+        IntFlowManager::actionTunnelMetadata(ab, IntFlowManager::ENCAP_VXLAN);
+        ab.output(TUN_PORT)
+            .build(bkt);
+        ovs_list_push_back(&full->mod->buckets, &bkt->list_node);
+    }
+    size_t bytes = 0;
+    size_t lastBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t port = 1; port <= numEps; ++port) {
+        ofputil_bucket *bkt = createBucket(port);
+        ActionBuilder ab;
+        ab.output(port)
+            .build(bkt);
+        ovs_list_insert(&ofputil_bucket_list_back(&full->mod->buckets)
+                        ->list_node, &bkt->list_node);
+        lastBytes = encodedSize(full, OFP13_VERSION);
+        bytes += lastBytes;
+    }
+    report("modify", numEps, bytes, lastBytes,
+           std::chrono::steady_clock::now() - start);
+
+    // Every join inserts the bucket of the endpoint after that of
+    // the one before
+    bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t port = 1; port <= numEps; ++port) {
+        GroupEdit::Entry e =
+            IntFlowManager::createInsertBucketMod(GROUP_ID, port,
+                                                  port == 1
+                                                  ? OFPG15_BUCKET_FIRST
+                                                  : port - 1);
+        lastBytes = encodedSize(e, OFP15_VERSION);
+        bytes += lastBytes;
+    }
+    report("insert_bucket", numEps, bytes, lastBytes,
+           std::chrono::steady_clock::now() - start);
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#ifndef OVSAGENT_TEST_ALLOCCOUNTER_H_
+#define OVSAGENT_TEST_ALLOCCOUNTER_H_
+
+#include <stddef.h>
+
+namespace ovsagent {
+
+/**
+ * Check whether the heap allocations of the program are counted,
+ * which is the case for programs linked with AllocCounter.cpp on
+ * glibc
+ *
+ * @return true if allocations are counted
+ */
+bool allocCountEnabled();
+
+/**
+ * Get the number of heap allocations made by the program so far,
+ * including those made by the OVS library and by operator new
+ *
+ * @return the number of allocations
+ */
+size_t getAllocCount();
+
+} // namespace ovsagent
+
+#endif /* OVSAGENT_TEST_ALLOCCOUNTER_H_ */
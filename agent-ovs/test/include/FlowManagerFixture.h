@@ -167,6 +167,11 @@ public:
     Bldr& isCtState(const std::string& s) {
         rep(",ct_state=" + s); return *this;
     }
+    Bldr& isConjId(uint32_t id) { rep(",conj_id=", str(id)); return *this; }
+    Bldr& isReg(uint8_t r, uint32_t v, uint32_t m) {
+        rep(",reg" + str(r) + "=", str(v, true) + "/" + str(m, true));
+        return *this;
+    }
     Bldr& isCtMark(const std::string& s) {
         rep(",ct_mark=" + s); return *this;
     }
@@ -189,6 +194,10 @@ public:
     Bldr& load(REG r, uint32_t v);
     Bldr& load(REG r, const std::string& v);
     Bldr& move(REG s, REG d);
+    Bldr& loadReg(uint8_t r, uint32_t v) {
+        rep("load:", str(v, true), "->NXM_NX_REG" + str(r) + "[]");
+        return *this;
+    }
     Bldr& ethSrc(const std::string& s) {
         rep("set_field:", s, "->eth_src"); return *this;
     }
@@ -240,6 +249,10 @@ public:
     }
     Bldr& polApplied() { rep("write_metadata:0x100/0x100"); return *this; }
     Bldr& resubmit(uint8_t t) { rep("resubmit(,", str(t), ")"); return *this; }
+    Bldr& conjunction(uint32_t id, uint8_t k, uint8_t n) {
+        rep("conjunction(" + str(id) + ",", str(k) + "/" + str(n), ")");
+        return *this;
+    }
 
 private:
     /**
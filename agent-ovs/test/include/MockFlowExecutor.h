@@ -29,9 +29,17 @@ public:
 
     virtual bool Execute(const FlowEdit& flowEdits);
     virtual bool Execute(const GroupEdit& groupEdits);
+    virtual bool ExecuteAll(const GroupEdit& groupEdits,
+                            const std::vector<FlowEdit>& flowEdits);
+    virtual bool ExecuteAsync(const FlowEdit& flowEdits,
+                              const CompletionCb& cb);
+    virtual bool ExecuteAsync(const GroupEdit& groupEdits,
+                              const CompletionCb& cb);
     virtual void Expect(FlowEdit::type mod, const std::string& fe);
     virtual void Expect(FlowEdit::type mod, const std::vector<std::string>& fe);
     virtual void ExpectGroup(FlowEdit::type mod, const std::string& ge);
+    virtual void ExpectGroup(const std::string& command,
+                             const std::string& ge);
     virtual void IgnoreFlowMods();
     virtual void IgnoreGroupMods();
     virtual bool IsEmpty();
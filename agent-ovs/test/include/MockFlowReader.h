@@ -35,9 +35,25 @@ public:
         cb(groups, true);
         return true;
     }
+    virtual bool getFlowCount(uint8_t tableId,
+                              const FlowReader::FlowCountCb& cb) {
+        uint64_t count = 0;
+        for (size_t i = 0; i < flows.size(); ++i) {
+            if (flows[i]->entry->table_id == tableId) {
+                count += 1;
+            }
+        }
+        cb(count, true);
+        return true;
+    }
+    virtual bool monitorFlows(const FlowReader::FlowUpdateCb& cb) {
+        monitorCb = cb;
+        return true;
+    }
 
     FlowEntryList flows;
     GroupEdit::EntryList groups;
+    FlowReader::FlowUpdateCb monitorCb;
 };
 
 } // namespace ovsagent
@@ -21,7 +21,8 @@ namespace ovsagent {
 class MockSwitchConnection : public SwitchConnection {
 public:
     MockSwitchConnection()
-        : SwitchConnection("mockBridge"), connected(false) {
+        : SwitchConnection("mockBridge"), connected(false),
+          protoVersion(OFP13_VERSION) {
     }
     virtual ~MockSwitchConnection() {
         clear();
@@ -40,16 +41,23 @@ public:
         return 0;
     }
 
-    virtual int GetProtocolVersion() { return OFP13_VERSION; }
+    virtual int GetProtocolVersion() { return protoVersion; }
 
     virtual int SendMessage(ofpbuf *msg) {
         sentMsgs.push_back(msg);
         return 0;
     }
 
+    virtual int SendMessages(std::vector<ofpbuf*>& msgs) {
+        sentMsgs.insert(sentMsgs.end(), msgs.begin(), msgs.end());
+        msgs.clear();
+        return 0;
+    }
+
     virtual bool IsConnected() { return connected; }
 
     bool connected;
+    int protoVersion;
     std::vector<ofpbuf*> sentMsgs;
 };
 
@@ -31,6 +31,19 @@ public:
 
     virtual void start(const std::string& swName) {
         connection.reset(new MockSwitchConnection());
+        if (incrementalSync)
+            monitorConnection.reset(new MockSwitchConnection());
+        if (auxConnections) {
+            packetInConnection.reset(new MockSwitchConnection());
+            statsConnection.reset(new MockSwitchConnection());
+        }
+    }
+
+    /**
+     * Get the flow monitor connection, if incremental sync is enabled
+     */
+    SwitchConnection* getMonitorConnection() {
+        return monitorConnection.get();
     }
 };
 
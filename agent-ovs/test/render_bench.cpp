@@ -0,0 +1,175 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Parallel rendering benchmark standalone: time for a task queue to
+ * render the flows of every endpoint into a switch manager, as after
+ * a restart, with a given number of worker threads
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <sstream>
+#include <memory>
+
+#include <boost/program_options.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+#include <opflex/ofcore/OFFramework.h>
+#include <modelgbp/metadata/metadata.hpp>
+
+#include "Agent.h"
+#include "SwitchManager.h"
+#include "TaskQueue.h"
+#include "FlowBuilder.h"
+#include "FlowExecutor.h"
+#include "FlowReader.h"
+#include "PortMapper.h"
+#include "logging.h"
+
+#include "ovs-shim.h"
+#include "ovs-ofputil.h"
+
+using std::string;
+using std::vector;
+namespace po = boost::program_options;
+using namespace ovsagent;
+
+/* The flows of one endpoint, spread over the tables and shaped like
+   those that match its addresses and registers */
+static void renderEndpoint(SwitchManager& switchManager, const string& uuid,
+                           uint32_t n, size_t numTables, size_t numFlows) {
+    for (size_t t = 0; t < numTables; ++t) {
+        FlowEntryList el;
+        for (size_t i = t; i < numFlows; i += numTables) {
+            boost::asio::ip::address_v4 addr(0x0a000000 + n * numFlows + i);
+            FlowBuilder fb;
+            fb.priority(100 + (i % 4))
+                .ethType(0x0800)
+                .reg(0, n % 4096)
+                .ipDst(addr)
+                .action()
+                .reg(MFF_REG2, n)
+                .output(1 + (n % 64));
+            el.push_back(fb.build());
+        }
+        switchManager.writeFlow(uuid, t, el);
+    }
+}
+
+static void runBench(size_t numEps, size_t numTables, size_t numFlows,
+                     size_t numThreads) {
+    opflex::ofcore::OFFramework framework;
+    framework.setModel(modelgbp::getMetadata());
+    Agent agent(framework);
+    FlowExecutor exec;
+    FlowReader reader;
+    PortMapper portMapper;
+    SwitchManager switchManager(agent, exec, reader, portMapper);
+    switchManager.setMaxFlowTables(numTables);
+    // Before the first sync only the table state is written, as
+    // after a restart
+    switchManager.start("br-bench");
+
+    // A single thread renders on an io_service of its own, as the
+    // agent does
+    boost::asio::io_service io;
+    std::unique_ptr<boost::asio::io_service::work>
+        work(new boost::asio::io_service::work(io));
+    std::thread ioThread([&io]() { io.run(); });
+    TaskQueue queue(io);
+    if (numThreads > 1)
+        queue.startWorkers(numThreads);
+
+    std::mutex doneMutex;
+    std::condition_variable doneCond;
+    size_t done = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < numEps; ++n) {
+        std::stringstream uuid;
+        uuid << "ep" << n;
+        string id = uuid.str();
+        queue.dispatch(id, [&, id, n]() {
+                renderEndpoint(switchManager, id, n, numTables, numFlows);
+                std::lock_guard<std::mutex> guard(doneMutex);
+                if (++done == numEps)
+                    doneCond.notify_all();
+            });
+    }
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCond.wait(lock, [&]() { return done == numEps; });
+    }
+    auto convergeTime = std::chrono::steady_clock::now() - start;
+
+    queue.stopWorkers();
+    work.reset();
+    ioThread.join();
+
+    std::cout << "threads=" << numThreads
+              << " endpoints=" << numEps
+              << " flows=" << numEps * numFlows
+              << " converge_ms="
+              << std::chrono::duration_cast<std::chrono::milliseconds>
+                    (convergeTime).count()
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Print this help message")
+        ("endpoints", po::value<size_t>()->default_value(10000),
+         "Number of endpoints to render")
+        ("tables", po::value<size_t>()->default_value(4),
+         "Number of flow tables the flows of an endpoint are spread over")
+        ("flows-per-endpoint", po::value<size_t>()->default_value(16),
+         "Number of flows of each endpoint")
+        ("threads", po::value<vector<size_t> >()->multitoken(),
+         "Numbers of rendering threads to measure (default 1 4 8)")
+        ;
+
+    size_t numEps, numTables, numFlows;
+    vector<size_t> threads({1, 4, 8});
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).
+                  options(desc).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << desc;
+            return 0;
+        }
+        numEps = vm["endpoints"].as<size_t>();
+        numTables = vm["tables"].as<size_t>();
+        numFlows = vm["flows-per-endpoint"].as<size_t>();
+        if (vm.count("threads"))
+            threads = vm["threads"].as<vector<size_t> >();
+    } catch (po::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (numEps == 0 || numTables == 0 || numFlows == 0 || numTables > 64) {
+        std::cerr << "endpoints and flows-per-endpoint must be positive, "
+                  << "and tables between 1 and 64" << std::endl;
+        return 1;
+    }
+
+    initLogging("error", false /*syslog*/, "", "render-bench");
+
+    for (size_t numThreads : threads)
+        runBench(numEps, numTables, numFlows, numThreads);
+    return 0;
+}
@@ -0,0 +1,239 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Security group rendering benchmark standalone: size of the security
+ * group tables of the access bridge for a mix of tenants whose
+ * endpoints use overlapping combinations of security groups, when the
+ * rules are rendered for each set of groups or once for each group
+ * with security group bits
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <string>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+
+#include <boost/program_options.hpp>
+
+#include <opflex/ofcore/OFFramework.h>
+#include <opflex/modb/Mutator.h>
+#include <modelgbp/metadata/metadata.hpp>
+#include <modelgbp/dmtree/Root.hpp>
+#include <modelgbp/l2/EtherTypeEnumT.hpp>
+
+#include "AccessFlowManager.h"
+#include "PolicyManager.h"
+#include "FlowUtils.h"
+#include "TableState.h"
+#include "logging.h"
+
+#include "ovs-shim.h"
+#include "ovs-ofputil.h"
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+namespace po = boost::program_options;
+using modelgbp::gbpe::L24Classifier;
+using namespace ovsagent;
+
+typedef vector<shared_ptr<L24Classifier> > rules_t;
+typedef std::set<size_t> group_set_t;
+
+/* The flows of the rules of a security group, matching the ID of a
+   set of groups in reg0, or the group's bit in registers 8 to 15 when
+   bit is not negative */
+static void addGroupRules(const rules_t& rules, uint32_t setId, int bit,
+                          FlowEntryList& el) {
+    uint16_t maxPrio = PolicyManager::MAX_POLICY_RULE_PRIORITY;
+    size_t first = el.size();
+    for (size_t i = 0; i < rules.size(); ++i) {
+        flowutils::add_classifier_entries(*rules[i], flowutils::CA_ALLOW,
+                                          boost::none, boost::none,
+                                          AccessFlowManager::OUT_TABLE_ID,
+                                          maxPrio - i,
+                                          OFPUTIL_FF_SEND_FLOW_REM,
+                                          i + 1, setId, 0, el);
+    }
+    if (bit < 0) return;
+    uint32_t mask = 1u << (bit % 32);
+    for (size_t i = first; i < el.size(); ++i)
+        match_set_reg_masked(&el[i]->entry->match, 8 + bit / 32,
+                             mask, mask);
+}
+
+static void report(const string& mode, size_t objects, size_t flows,
+                   std::chrono::steady_clock::duration d) {
+    std::cout << "mode=" << mode
+              << " objects=" << objects
+              << " flows=" << flows
+              << " build_ms="
+              << std::chrono::duration_cast<std::chrono::milliseconds>(d)
+                    .count()
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Print this help message")
+        ("tenants", po::value<size_t>()->default_value(20),
+         "Number of tenants")
+        ("groups", po::value<size_t>()->default_value(10),
+         "Number of security groups in each tenant")
+        ("rules", po::value<size_t>()->default_value(12),
+         "Number of rules in each security group")
+        ("endpoints", po::value<size_t>()->default_value(100),
+         "Number of endpoints in each tenant")
+        ("groups-per-endpoint", po::value<size_t>()->default_value(3),
+         "Largest number of security groups of an endpoint, each "
+         "endpoint having between 1 and this many of its tenant's "
+         "groups")
+        ("seed", po::value<unsigned>()->default_value(1),
+         "Seed for choosing rules and the groups of endpoints")
+        ;
+
+    size_t numTenants, numGroups, numRules, numEps, grpsPerEp;
+    unsigned seed;
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).
+                  options(desc).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << desc;
+            return 0;
+        }
+        numTenants = vm["tenants"].as<size_t>();
+        numGroups = vm["groups"].as<size_t>();
+        numRules = vm["rules"].as<size_t>();
+        numEps = vm["endpoints"].as<size_t>();
+        grpsPerEp = vm["groups-per-endpoint"].as<size_t>();
+        seed = vm["seed"].as<unsigned>();
+    } catch (po::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (numTenants == 0 || numGroups == 0 || numRules == 0 ||
+        numEps == 0 || grpsPerEp == 0 || grpsPerEp > numGroups ||
+        numRules > 1000) {
+        std::cerr << "tenants, groups, endpoints and groups-per-endpoint "
+                  << "must be positive, groups-per-endpoint at most groups, "
+                  << "and rules between 1 and 1000" << std::endl;
+        return 1;
+    }
+
+    initLogging("error", false /*syslog*/, "", "secgrp-bench");
+    std::mt19937 rng(seed);
+
+    // The classifiers come from the MODB, so set up a framework to
+    // hold them.  Most rules allow a single port, and some a range
+    // that takes several flows.
+    static const uint16_t widths[] = {1, 1, 1, 1, 2, 10, 100, 1000};
+    opflex::ofcore::OFFramework framework;
+    framework.setModel(modelgbp::getMetadata());
+    framework.start();
+    vector<rules_t> groups(numTenants * numGroups);
+    {
+        opflex::modb::Mutator mutator(framework, "init");
+        shared_ptr<modelgbp::dmtree::Root> root =
+            modelgbp::dmtree::Root::createRootElement(framework);
+        shared_ptr<modelgbp::policy::Space> space =
+            root->addPolicyUniverse()->addPolicySpace("bench");
+        for (size_t g = 0; g < groups.size(); ++g) {
+            for (size_t i = 0; i < numRules; ++i) {
+                std::stringstream name;
+                name << "classifier" << g << "_" << i;
+                uint16_t width = widths[rng() % (sizeof(widths) /
+                                                 sizeof(widths[0]))];
+                uint16_t from = 1 + rng() % (65535 - width);
+                groups[g].push_back(space->
+                                    addGbpeL24Classifier(name.str()));
+                groups[g].back()
+                    ->setEtherT(modelgbp::l2::EtherTypeEnumT::CONST_IPV4)
+                    .setProt(6 /* TCP */)
+                    .setDFromPort(from).setDToPort(from + width - 1);
+            }
+        }
+        mutator.commit();
+    }
+
+    // The distinct sets of groups used by the endpoints of each tenant
+    std::set<group_set_t> sets;
+    group_set_t used;
+    for (size_t t = 0; t < numTenants; ++t) {
+        for (size_t e = 0; e < numEps; ++e) {
+            group_set_t s;
+            size_t n = 1 + rng() % grpsPerEp;
+            while (s.size() < n)
+                s.insert(t * numGroups + rng() % numGroups);
+            used.insert(s.begin(), s.end());
+            sets.insert(s);
+        }
+    }
+
+    std::cout << "tenants=" << numTenants
+              << " groups=" << used.size()
+              << " sets=" << sets.size()
+              << " rules_per_group=" << numRules
+              << " endpoints=" << numTenants * numEps << std::endl;
+
+    // The rules of every group in a set under the set's ID
+    {
+        auto start = std::chrono::steady_clock::now();
+        TableState state;
+        FlowEdit diffs;
+        FlowEntryList el;
+        size_t flows = 0;
+        uint32_t setId = 1;
+        for (const group_set_t& s : sets) {
+            for (size_t g : s)
+                addGroupRules(groups[g], setId, -1, el);
+            flows += el.size();
+            std::stringstream objId;
+            objId << "set" << setId++;
+            state.apply(objId.str(), el, diffs);
+            el.clear();
+        }
+        report("set", sets.size(), flows,
+               std::chrono::steady_clock::now() - start);
+    }
+
+    // The rules of every group once, under the group's bit
+    if (used.size() > 256) {
+        std::cerr << "Security group bits can't render more than 256 "
+                  << "groups" << std::endl;
+    } else {
+        auto start = std::chrono::steady_clock::now();
+        TableState state;
+        FlowEdit diffs;
+        FlowEntryList el;
+        size_t flows = 0;
+        int bit = 0;
+        for (size_t g : used) {
+            addGroupRules(groups[g], 0, bit++, el);
+            flows += el.size();
+            std::stringstream objId;
+            objId << "secgrp" << g;
+            state.apply(objId.str(), el, diffs);
+            el.clear();
+        }
+        report("bits", used.size(), flows,
+               std::chrono::steady_clock::now() - start);
+    }
+
+    framework.stop();
+    return 0;
+}
@@ -0,0 +1,191 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Switch state reconciliation and flow mod encoding benchmark standalone
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/program_options.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+#include "SwitchStateHandler.h"
+#include "TableState.h"
+#include "FlowBuilder.h"
+#include "FlowExecutor.h"
+#include "logging.h"
+
+#include "ovs-shim.h"
+#include "ovs-ofputil.h"
+
+using std::string;
+using std::vector;
+namespace po = boost::program_options;
+using namespace ovsagent;
+
+/* A flow shaped like those of the policy table, with an output port
+   that the snapshot can change */
+static FlowEntryPtr makeFlow(size_t table, uint32_t n, uint32_t port) {
+    boost::asio::ip::address_v4 addr(0x0a000000 + n);
+    FlowBuilder fb;
+    fb.priority(100 + (n % 4))
+        .cookie(ovs_htonll(1))
+        .ethType(0x0800)
+        .reg(0, n % 4096)
+        .ipDst(addr)
+        .action()
+        .reg(MFF_REG2, n)
+        .output(port);
+    FlowEntryPtr fe = fb.build();
+    fe->entry->table_id = table;
+    return fe;
+}
+
+/* Encode a flow mod adding each flow, as when the tables are
+   reinstalled after a reconnect, and return the time taken */
+static std::chrono::steady_clock::duration
+encodeAll(const FlowEntryList& flows, bool cached) {
+    auto start = std::chrono::steady_clock::now();
+    for (const FlowEntryPtr& fe : flows) {
+        FlowEdit::Entry e(FlowEdit::ADD, fe);
+        ofpbuf* msg = cached
+            ? FlowExecutor::EncodeCachedFlowMod(e, OFP13_VERSION)
+            : FlowExecutor::EncodeFlowMod(e, OFP13_VERSION);
+        ofpbuf_delete(msg);
+    }
+    return std::chrono::steady_clock::now() - start;
+}
+
+static long toMs(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+}
+
+int main(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Print this help message")
+        ("tables", po::value<size_t>()->default_value(40),
+         "Number of flow tables")
+        ("flows", po::value<size_t>()->default_value(1000000),
+         "Total number of flows across all tables")
+        ("flows-per-object", po::value<size_t>()->default_value(16),
+         "Number of flows written by each object")
+        ("changed", po::value<size_t>()->default_value(100),
+         "Make one flow in this many differ between the table state "
+         "and the snapshot read from the switch")
+        ("threads", po::value<vector<size_t> >()->multitoken(),
+         "Thread counts to measure (default 1 and one per hardware "
+         "thread)")
+        ;
+
+    size_t numTables, numFlows, flowsPerObj, changed;
+    vector<size_t> threads({1, std::thread::hardware_concurrency()});
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).
+                  options(desc).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << desc;
+            return 0;
+        }
+        numTables = vm["tables"].as<size_t>();
+        numFlows = vm["flows"].as<size_t>();
+        flowsPerObj = vm["flows-per-object"].as<size_t>();
+        changed = vm["changed"].as<size_t>();
+        if (vm.count("threads"))
+            threads = vm["threads"].as<vector<size_t> >();
+    } catch (po::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (numTables == 0 || numTables > 253 || flowsPerObj == 0 ||
+        changed == 0) {
+        std::cerr << "tables must be between 1 and 253, and "
+                  << "flows-per-object and changed must be positive"
+                  << std::endl;
+        return 1;
+    }
+
+    initLogging("error", false /*syslog*/, "", "sync-bench");
+
+    // Build the table state, and a snapshot of the same flows as
+    // read back from the switch, with every changed-th flow pointing
+    // to a different port
+    vector<TableState> flowTables(numTables);
+    vector<FlowEntryList> recvFlows(numTables);
+    size_t flowsPerTable = (numFlows + numTables - 1) / numTables;
+    FlowEntryList el, allFlows;
+    FlowEdit diffs;
+    uint32_t n = 0;
+    for (size_t t = 0; t < numTables; ++t) {
+        for (size_t f = 0; f < flowsPerTable; f += flowsPerObj) {
+            std::stringstream objId;
+            objId << "/PolicyUniverse/PolicySpace/test/GbpEpGroup/epg"
+                  << (n % 64) << "/" << n << "/";
+            for (size_t i = f; i < std::min(f + flowsPerObj, flowsPerTable);
+                 ++i, ++n) {
+                el.push_back(makeFlow(t, n, 1 + (n % 64)));
+                recvFlows[t].push_back(n % changed == 0
+                                       ? makeFlow(t, n, 100)
+                                       : makeFlow(t, n, 1 + (n % 64)));
+            }
+            flowTables[t].apply(objId.str(), el, diffs);
+            allFlows.insert(allFlows.end(), el.begin(), el.end());
+            el.clear();
+        }
+    }
+
+    std::cout << "tables=" << numTables
+              << " flows=" << n << std::endl;
+    vector<const TableState*> tables;
+    for (const TableState& ts : flowTables)
+        tables.push_back(&ts);
+    for (size_t numThreads : threads) {
+        auto start = std::chrono::steady_clock::now();
+        vector<FlowEdit> tableDiffs =
+            SwitchStateHandler::diffTables(tables, recvFlows,
+                                           numThreads);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        size_t numDiffs = 0;
+        for (const FlowEdit& fe : tableDiffs)
+            numDiffs += fe.edits.size();
+        std::cout << "threads=" << numThreads
+                  << " diffs=" << numDiffs
+                  << " reconcile_ms=" << toMs(elapsed)
+                  << std::endl;
+    }
+
+    // The first cached pass pays for encoding and filling the cache;
+    // later passes only copy the cached messages
+    auto uncached = encodeAll(allFlows, false);
+    auto fill = encodeAll(allFlows, true);
+    auto cached = encodeAll(allFlows, true);
+    size_t cacheBytes = 0;
+    for (const FlowEntryPtr& fe : allFlows) {
+        ofpbuf* msg = fe->encoding.load();
+        if (msg)
+            cacheBytes += sizeof(*msg) + msg->allocated;
+    }
+    std::cout << "encode_ms=" << toMs(uncached)
+              << " cache_fill_ms=" << toMs(fill)
+              << " cached_encode_ms=" << toMs(cached)
+              << " cache_mb=" << cacheBytes / (1024 * 1024)
+              << std::endl;
+    return 0;
+}
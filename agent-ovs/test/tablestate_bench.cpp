@@ -0,0 +1,303 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * TableState memory, throughput, render allocation and object removal
+ * benchmark standalone
+ *
+ * Copyright (c) 2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <memory>
+
+#include <boost/program_options.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+#include "TableState.h"
+#include "FlowBuilder.h"
+#include "FlowExecutor.h"
+#include "SwitchManager.h"
+#include "FlowEntryArena.h"
+#include "logging.h"
+#include "AllocCounter.h"
+
+#include "ovs-shim.h"
+#include "ovs-ofputil.h"
+
+using std::string;
+using std::vector;
+namespace po = boost::program_options;
+using namespace ovsagent;
+
+/* Resident set size of this process in bytes */
+static size_t getRss() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* The flows for one object, shaped like the per-endpoint flows of
+   the policy table: distinct destination addresses, a register
+   match and a cookie */
+static void makeFlows(size_t obj, size_t flowsPerObj, uint64_t cookie,
+                      FlowEntryList& el) {
+    el.clear();
+    for (size_t i = 0; i < flowsPerObj; ++i) {
+        uint32_t n = obj * flowsPerObj + i;
+        boost::asio::ip::address_v4 addr(0x0a000000 + n);
+        FlowBuilder fb;
+        fb.priority(100 + (i % 4))
+            .cookie(ovs_htonll(cookie))
+            .ethType(0x0800)
+            .reg(0, obj % 4096)
+            .ipDst(addr)
+            .action()
+            .reg(MFF_REG2, n)
+            .output(1 + (n % 64));
+        el.push_back(fb.build());
+    }
+}
+
+static double rate(size_t flows, std::chrono::steady_clock::duration d) {
+    double secs = std::chrono::duration<double>(d).count();
+    return secs > 0 ? flows / secs : 0;
+}
+
+static void runBench(size_t numFlows, size_t flowsPerObj) {
+    using std::chrono::steady_clock;
+    size_t numObjs = (numFlows + flowsPerObj - 1) / flowsPerObj;
+    vector<string> objIds;
+    for (size_t i = 0; i < numObjs; ++i) {
+        std::stringstream ss;
+        ss << "/PolicyUniverse/PolicySpace/test/GbpEpGroup/epg"
+           << (i % 64) << "/GbpeEpgMapping/" << i << "/";
+        objIds.push_back(ss.str());
+    }
+
+    FlowEntryList el;
+    FlowEdit diffs;
+    size_t rssBefore = getRss();
+    TableState* state = new TableState();
+
+    // Add every flow
+    auto start = steady_clock::now();
+    for (size_t i = 0; i < numObjs; ++i) {
+        makeFlows(i, flowsPerObj, 1, el);
+        state->apply(objIds[i], el, diffs);
+    }
+    auto addTime = steady_clock::now() - start;
+    el.clear();
+    size_t rssAfter = getRss();
+
+    // Write the same flows again with a new cookie, which finds every
+    // match but generates no diffs
+    start = steady_clock::now();
+    for (size_t i = 0; i < numObjs; ++i) {
+        makeFlows(i, flowsPerObj, 2, el);
+        state->apply(objIds[i], el, diffs);
+    }
+    auto updateTime = steady_clock::now() - start;
+
+    // Remove every object
+    el.clear();
+    start = steady_clock::now();
+    for (size_t i = 0; i < numObjs; ++i) {
+        state->apply(objIds[i], el, diffs);
+    }
+    auto removeTime = steady_clock::now() - start;
+    delete state;
+
+    size_t rss = rssAfter > rssBefore ? rssAfter - rssBefore : 0;
+    std::cout << "flows=" << numFlows
+              << " objects=" << numObjs
+              << " rss_mb=" << rss / (1024 * 1024)
+              << " bytes_per_flow=" << rss / numFlows
+              << " add_per_s=" << (size_t)rate(numFlows, addTime)
+              << " update_per_s=" << (size_t)rate(numFlows, updateTime)
+              << " remove_per_s=" << (size_t)rate(numFlows, removeTime)
+              << std::endl;
+}
+
+/* Render every object again into a full table, as after a group
+   change: once with the same flows, which the table drops as
+   unchanged, and once with a new cookie for every flow, which makes
+   the table keep the new flows.  The flows are built on the heap,
+   or in an arena for each render. */
+static void runRenderBench(size_t numFlows, size_t flowsPerObj,
+                           bool useArena) {
+    using std::chrono::steady_clock;
+    size_t numObjs = (numFlows + flowsPerObj - 1) / flowsPerObj;
+    vector<string> objIds;
+    for (size_t i = 0; i < numObjs; ++i) {
+        std::stringstream ss;
+        ss << "obj" << i;
+        objIds.push_back(ss.str());
+    }
+
+    FlowEntryList el;
+    FlowEdit diffs;
+    TableState state;
+    for (size_t i = 0; i < numObjs; ++i) {
+        makeFlows(i, flowsPerObj, 1, el);
+        state.apply(objIds[i], el, diffs);
+    }
+
+    for (uint64_t cookie : {1, 2}) {
+        size_t edits = 0;
+        size_t startAllocs = getAllocCount();
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < numObjs; ++i) {
+            std::unique_ptr<FlowEntryArena> arena;
+            std::unique_ptr<FlowEntryArena::Scope> scope;
+            if (useArena) {
+                arena.reset(new FlowEntryArena());
+                scope.reset(new FlowEntryArena::Scope(*arena));
+            }
+            makeFlows(i, flowsPerObj, cookie, el);
+            state.apply(objIds[i], el, diffs);
+            edits += diffs.edits.size();
+            el.clear();
+        }
+        auto renderTime = steady_clock::now() - start;
+        size_t allocCount = getAllocCount() - startAllocs;
+
+        std::cout << "render=" << (cookie == 1 ? "unchanged" : "new_cookie")
+                  << " arena=" << useArena
+                  << " flows=" << numObjs * flowsPerObj
+                  << " flow_mods=" << edits
+                  << " render_per_s="
+                  << (size_t)rate(numObjs * flowsPerObj, renderTime);
+        if (allocCountEnabled())
+            std::cout << " allocs_per_flow="
+                      << (double)allocCount / (numObjs * flowsPerObj);
+        std::cout << std::endl;
+    }
+}
+
+/* Remove the flows of one large object, such as a contract with many
+   classifier flows, and encode the resulting flow mods: one strict
+   delete per flow, or one delete of the object's cookie range */
+static void runRemoveBench(size_t numFlows, bool objectCookies) {
+    using std::chrono::steady_clock;
+    const string objId("/PolicyUniverse/PolicySpace/test/GbpContract/c/");
+    const uint64_t objCookie = ovs_htonll((uint64_t)1 << 32);
+
+    FlowEntryList el;
+    FlowEdit diffs;
+    TableState state;
+    makeFlows(0, numFlows, 1, el);
+    if (objectCookies) {
+        for (const FlowEntryPtr& fe : el)
+            fe->entry->cookie |= objCookie;
+    }
+    state.apply(objId, el, diffs);
+
+    auto start = steady_clock::now();
+    el.clear();
+    state.apply(objId, el, diffs);
+    if (objectCookies)
+        SwitchManager::coalesceDeletes(0, objCookie, diffs);
+    size_t bytes = 0;
+    for (const FlowEdit::Entry& e : diffs.edits) {
+        ofpbuf* msg = FlowExecutor::EncodeFlowMod(e, OFP13_VERSION);
+        bytes += msg->size;
+        ofpbuf_delete(msg);
+    }
+    auto removeTime = steady_clock::now() - start;
+
+    std::cout << "object_flows=" << numFlows
+              << " object_cookies=" << objectCookies
+              << " flow_mods=" << diffs.edits.size()
+              << " bytes=" << bytes
+              << " remove_ms="
+              << std::chrono::duration_cast<std::chrono::milliseconds>
+                    (removeTime).count()
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Print this help message")
+        ("flows", po::value<vector<size_t> >()->multitoken(),
+         "Table sizes to measure (default 100000 500000 1000000)")
+        ("flows-per-object", po::value<size_t>()->default_value(16),
+         "Number of flows written by each object")
+        ("render-flows", po::value<size_t>()->default_value(100000),
+         "Number of flows rendered again with and without an arena, "
+         "or 0 to skip")
+        ("remove-object-flows", po::value<size_t>()->default_value(50000),
+         "Number of flows of the single object whose removal is "
+         "measured, or 0 to skip")
+        ;
+
+    vector<size_t> sizes({100000, 500000, 1000000});
+    size_t flowsPerObj, renderFlows, removeFlows;
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).
+                  options(desc).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << desc;
+            return 0;
+        }
+        if (vm.count("flows"))
+            sizes = vm["flows"].as<vector<size_t> >();
+        flowsPerObj = vm["flows-per-object"].as<size_t>();
+        renderFlows = vm["render-flows"].as<size_t>();
+        removeFlows = vm["remove-object-flows"].as<size_t>();
+    } catch (po::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (flowsPerObj == 0) {
+        std::cerr << "flows-per-object must be positive" << std::endl;
+        return 1;
+    }
+
+    initLogging("error", false /*syslog*/, "", "tablestate-bench");
+
+    // Each size is measured in a child process so that memory freed
+    // by a previous run doesn't hide the growth of the next one
+    for (size_t numFlows : sizes) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            runBench(numFlows, flowsPerObj);
+            std::cout.flush();
+            _exit(0);
+        } else if (pid > 0) {
+            int status;
+            waitpid(pid, &status, 0);
+        } else {
+            runBench(numFlows, flowsPerObj);
+        }
+    }
+
+    if (renderFlows > 0) {
+        runRenderBench(renderFlows, flowsPerObj, false);
+        runRenderBench(renderFlows, flowsPerObj, true);
+    }
+
+    if (removeFlows > 0) {
+        runRemoveBench(removeFlows, false);
+        runRemoveBench(removeFlows, true);
+    }
+    return 0;
+}
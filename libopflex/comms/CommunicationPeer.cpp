@@ -21,6 +21,7 @@
 #include <rapidjson/error/en.h>
 
 #include <cctype>
+#include <new>
 
 namespace yajr {
     namespace internal {
@@ -174,6 +175,9 @@ void CommunicationPeer::onDisconnect(bool now) {
         s_.deque_.clear();
         pendingBytes_ = 0;
 
+        /* compression has to be negotiated again on reconnect */
+        detachDeflate();
+
         connected_ = 0;
 
         if (getKeepAliveInterval()) {
@@ -331,6 +335,11 @@ void CommunicationPeer::readBuffer(
         return;
     }
 
+    if (deflate_ && deflate_->isDecompressing()) {
+        readCompressed(buffer, nread);
+        return;
+    }
+
     char lastByte[2];
 
     if (!canWriteJustPastTheEnd) {
@@ -342,6 +351,12 @@ void CommunicationPeer::readBuffer(
             readBufferZ(buffer, nread);
         }
 
+        if (deflate_ && deflate_->isDecompressing()) {
+            /* the frames above switched decompression on */
+            readCompressed(lastByte, 1);
+            return;
+        }
+
         nread = 1;
         buffer = lastByte;
 
@@ -355,6 +370,7 @@ void CommunicationPeer::readBuffer(
 void CommunicationPeer::readBufferZ(char const * buffer, size_t nread) const {
 
     size_t chunk_size;
+    bool decompressing = deflate_ && deflate_->isDecompressing();
 
     VLOG(6)
         << "nread="
@@ -369,6 +385,21 @@ void CommunicationPeer::readBufferZ(char const * buffer, size_t nread) const {
     ;
 
     while (--nread > 0) {
+        if (!decompressing && isCompressedFrame(buffer)) {
+            /* the peer has switched to compressed frames, so the rest of
+             * this buffer is compressed */
+            if (!deflate_->beginDecompressing()) {
+                LOG(ERROR)
+                    << this
+                    << " failed to set up decompression => closing"
+                ;
+                const_cast< CommunicationPeer * >(this)->onDisconnect();
+                return;
+            }
+            readCompressed(buffer, nread);
+            return;
+        }
+
         chunk_size = readChunk(buffer);
         nread -= chunk_size++;
 
@@ -405,9 +436,104 @@ void CommunicationPeer::readBufferZ(char const * buffer, size_t nread) const {
 
         msg->process();
 
+        if (!decompressing && deflate_ && deflate_->isDecompressing()) {
+            /* the frame just processed switched decompression on, so
+             * whatever follows it in this buffer is compressed */
+            if (nread > 1) {
+                readCompressed(buffer, nread - 1);
+            }
+            return;
+        }
+
     }
 }
 
+bool CommunicationPeer::isCompressedFrame(char const * buffer) const {
+
+    /* JSON-RPC frames are always objects, while a zlib stream starts with
+     * its header, so the first byte of a frame tells which one it is */
+    return deflate_ &&
+        deflate_->isAwaitingCompressed() &&
+        ssIn_.tellp() == 0 &&
+        buffer[0] != '{' &&
+        buffer[0] != '\0';
+
+}
+
+void CommunicationPeer::readCompressed(
+        char const * buffer,
+        size_t nread) const {
+
+    std::vector<char> plain;
+
+    if (!deflate_->decompress(buffer, nread, plain)) {
+        LOG(ERROR)
+            << this
+            << " failed to decompress input => closing"
+        ;
+        const_cast< CommunicationPeer * >(this)->onDisconnect();
+        return;
+    }
+
+    if (plain.empty()) {
+        return;
+    }
+
+    plain.push_back('\0');
+    readBufferZ(&plain[0], plain.size());
+
+}
+
+bool CommunicationPeer::compressFrame() const {
+
+    if (!deflate_->compress(s_.deque_, frameStart_)) {
+        LOG(ERROR)
+            << this
+            << " failed to compress output => closing"
+        ;
+        const_cast< CommunicationPeer * >(this)->onDisconnect();
+        return false;
+    }
+
+    return true;
+
+}
+
+transport::Deflate * CommunicationPeer::attachDeflate() {
+
+    if (!deflate_) {
+        deflate_ = new (std::nothrow) transport::Deflate();
+    }
+
+    return deflate_;
+
+}
+
+void CommunicationPeer::detachDeflate() const {
+
+    if (!deflate_) {
+        return;
+    }
+
+    transport::Deflate::Stats const & stats = deflate_->getStats();
+
+    LOG(INFO)
+        << this
+        << " deflate: sent "
+        << stats.rawOut
+        << " bytes as "
+        << stats.wireOut
+        << ", received "
+        << stats.rawIn
+        << " bytes as "
+        << stats.wireIn
+    ;
+
+    delete deflate_;
+    deflate_ = NULL;
+
+}
+
 void CommunicationPeer::dumpIov(std::stringstream & dbgLog, std::vector<iovec> const & iov) {
     dbgLog << "DUMP_IOV\n";
     for (size_t i=0; i < iov.size(); ++i) {
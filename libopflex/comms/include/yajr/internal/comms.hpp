@@ -15,6 +15,7 @@
 #include <yajr/yajr.hpp>
 #include <yajr/rpc/rpc.hpp>
 #include <yajr/transport/PlainText.hpp>
+#include <yajr/transport/Deflate.hpp>
 
 #include <opflex/logging/OFLogHandler.h>
 
@@ -449,11 +450,13 @@ class CommunicationPeer : public Peer, virtual public ::yajr::Peer {
                 connectionHandler_(connectionHandler),
                 data_(data),
                 writer_(s_),
+                frameStart_(0),
                 pendingBytes_(0),
                 nextId_(0),
                 keepAliveInterval_(0),
                 lastHeard_(0),
-                transport_(transport::PlainText::getPlainTextTransport())
+                transport_(transport::PlainText::getPlainTextTransport()),
+                deflate_(NULL)
             {
                 req_.data = this;
                 getHandle()->loop = uvLoopSelector_(getData());
@@ -502,9 +505,17 @@ class CommunicationPeer : public Peer, virtual public ::yajr::Peer {
         s_.Put('\0');
         assert(__checkInvariants());
 
+        if (deflate_ && deflate_->isCompressing()) {
+            return compressFrame();
+        }
+
         return true;
     }
 
+    bool compressFrame() const;
+    bool isCompressedFrame(char const * buffer) const;
+    void readCompressed(char const * buffer, size_t nread) const;
+
     int write() const;
     int writeIOV(std::vector<iovec> &) const;
 
@@ -532,6 +543,10 @@ class CommunicationPeer : public Peer, virtual public ::yajr::Peer {
 
     virtual void stopKeepAlive();
 
+    virtual size_t getQueuedBytes() const {
+        return s_.GetSize();
+    }
+
     static void on_timeout(uv_timer_t * timer);
 
     void sendEchoReq();
@@ -619,6 +634,7 @@ class CommunicationPeer : public Peer, virtual public ::yajr::Peer {
     ::yajr::rpc::SendHandler & getWriter() const {
         assert(__checkInvariants());
         writer_.Reset(s_);
+        frameStart_ = s_.deque_.size();
         assert(__checkInvariants());
         return writer_;
     }
@@ -649,9 +665,17 @@ class CommunicationPeer : public Peer, virtual public ::yajr::Peer {
 
         return &transport_;
     }
+
+    transport::Deflate * getDeflate() const {
+        return deflate_;
+    }
+
+    transport::Deflate * attachDeflate();
+    void detachDeflate() const;
   protected:
     /* don't leak memory! */
     virtual ~CommunicationPeer() {
+        detachDeflate();
 #ifdef COMMS_DEBUG_OBJECT_COUNT
         --counter;
 #endif
@@ -667,6 +691,7 @@ class CommunicationPeer : public Peer, virtual public ::yajr::Peer {
 
     mutable ::yajr::internal::StringQueue s_;
     mutable ::yajr::rpc::SendHandler writer_;
+    mutable size_t frameStart_;
     mutable size_t pendingBytes_;
     mutable uint64_t nextId_;
 
@@ -674,6 +699,7 @@ class CommunicationPeer : public Peer, virtual public ::yajr::Peer {
     mutable uint64_t lastHeard_;
 
     ::yajr::transport::Transport transport_;
+    mutable ::yajr::transport::Deflate * deflate_;
 
 };
 
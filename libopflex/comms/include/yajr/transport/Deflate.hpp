@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2014 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+#pragma once
+#ifndef _____COMMS__INCLUDE__YAJR__TRANSPORT__DEFLATE_HPP
+#define _____COMMS__INCLUDE__YAJR__TRANSPORT__DEFLATE_HPP
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+namespace yajr {
+
+    class Peer;
+
+namespace transport {
+
+/**
+ * @brief A compression layer based on zlib's deflate, stacked between the
+ * JSON-RPC framing and whichever transport the peer uses (PlainText or
+ * ZeroCopyOpenSSL).
+ *
+ * Each direction is a single deflate stream that lives as long as the
+ * connection and is flushed at every frame boundary, so every frame can be
+ * decoded as soon as it is received while still sharing the dictionary of
+ * URI prefixes and property names built up by the previous frames.
+ *
+ * The two directions are switched on separately, each by the sender only
+ * once it knows the receiver has agreed to it, typically from the handshake.
+ * The receiver either switches at a frame it knows to be the last plain one,
+ * or, with acceptCompressed(), at the first frame that starts with a zlib
+ * header rather than a JSON object.  Compression is switched off again when
+ * the peer disconnects.
+ */
+struct Deflate {
+  public:
+
+    /**
+     * @brief Byte counters for a compressed connection
+     */
+    struct Stats {
+        uint64_t rawOut;  /**< bytes of frames handed to the compressor */
+        uint64_t wireOut; /**< compressed bytes handed to the transport */
+        uint64_t rawIn;   /**< decompressed bytes handed to the parser */
+        uint64_t wireIn;  /**< compressed bytes received from the transport */
+    };
+
+    /**
+     * @brief Compresses every frame sent to the peer from now on
+     *
+     * @return true on success, false if the compressor could not be set up
+     */
+    static bool startCompressing(
+            yajr::Peer * p,
+            /**< [in] the peer to compress outbound frames for */
+            int level = -1
+            /**< [in] the zlib compression level, from 1 (fastest) to 9
+             *        (smallest), or -1 for the zlib default
+             */
+    );
+
+    /**
+     * @brief Decompresses all data received from the peer from now on
+     *
+     * @return true on success, false if the decompressor could not be set up
+     */
+    static bool startDecompressing(
+            yajr::Peer * p
+            /**< [in] the peer to decompress inbound data from */
+    );
+
+    /**
+     * @brief Decompresses all data received from the peer from its first
+     * compressed frame on
+     *
+     * Used by the side that accepts compression, since the peer keeps
+     * sending plain frames such as keepalives until it has seen the
+     * acceptance.  Frames are read as plain text for as long as they start
+     * with a JSON object.
+     *
+     * @return true on success, false if the peer is not a communication peer
+     */
+    static bool acceptCompressed(
+            yajr::Peer * p
+            /**< [in] the peer to decompress inbound data from */
+    );
+
+    /**
+     * @brief Retrieves the byte counters for a peer
+     *
+     * @return true if compression is enabled in either direction for the
+     * peer, false otherwise
+     */
+    static bool getStats(
+            yajr::Peer const * p,
+            /**< [in] the peer to query */
+            Stats & stats
+            /**< [out] the byte counters since compression was negotiated */
+    );
+
+    Deflate();
+    ~Deflate();
+
+    bool isCompressing() const { return compressing_; }
+    bool isDecompressing() const { return decompressing_; }
+    bool isAwaitingCompressed() const { return awaitingCompressed_; }
+    Stats const & getStats() const { return stats_; }
+
+    /**
+     * @brief Replaces the bytes of a deque past an offset with their
+     * compressed version, flushed so the peer can decode them on receipt
+     */
+    bool compress(std::deque<char> & d, size_t from);
+
+    /**
+     * @brief Sets up the decompressor and decompresses all the data
+     * received from now on
+     */
+    bool beginDecompressing();
+
+    /**
+     * @brief Appends the decompressed version of a buffer to a vector
+     */
+    bool decompress(char const * buf, size_t len, std::vector<char> & out);
+
+  private:
+    struct Streams;
+
+    Streams * z_;
+    bool compressing_;
+    bool decompressing_;
+    bool awaitingCompressed_;
+    Stats stats_;
+
+    Deflate(const Deflate &);
+    Deflate & operator=(const Deflate &);
+};
+
+} /* yajr::transport namespace */
+} /* yajr namespace */
+
+#endif /* _____COMMS__INCLUDE__YAJR__TRANSPORT__DEFLATE_HPP */
+
@@ -227,6 +227,19 @@ struct Peer {
      */
     virtual void stopKeepAlive() = 0;
 
+    /**
+     * @brief retrieves the number of bytes queued for this peer
+     *
+     * Retrieves the number of serialized bytes that have been queued for
+     * sending to this peer and whose write has not yet completed. This
+     * grows without bound if the remote end stops reading, so callers can
+     * use it to apply backpressure. Peers that do not track their
+     * queue report 0.
+     *
+     * @return the number of bytes queued for sending
+     */
+    virtual size_t getQueuedBytes() const { return 0; }
+
   protected:
     Peer() {}
     ~Peer() {}
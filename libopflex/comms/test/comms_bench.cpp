@@ -0,0 +1,963 @@
+/* -*- C++ -*-; c-basic-offset: 4; indent-tabs-mode: nil */
+/*
+ * Loopback benchmark for the yajr communication layer.
+ *
+ * Copyright (c) 2014 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+/* This must be included before anything else */
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+/*
+ * A ListeningPeer and an active TCP or UNIX domain socket peer are created on
+ * the same uv loop, optionally with the ZeroCopyOpenSSL transport attached to
+ * both ends, and three workloads are driven across them in turn:
+ *
+ *  echo     a custom request whose payload the server sends straight back,
+ *           sized like an endpoint declaration
+ *  reqresp  a policy_resolve request answered with a policy_update sized
+ *           response carrying --objects managed objects
+ *  bulk     a one-way stream of state_report requests the server never
+ *           answers, kept flowing as long as the client has less than
+ *           kBulkQueuedBytes waiting to be written
+ *
+ * Every request carries the uv_hrtime() at which it was serialized, which is
+ * echoed back in the response, so latencies are round trip times for echo and
+ * reqresp, and one-way times for bulk.  The first --warmup messages of each
+ * workload are not counted.
+ *
+ * One result line is printed on stdout per transport and workload, either as
+ * a JSON object or as CSV.  Byte rates count the JSON payloads only, and
+ * leave out the framing and any TLS records around them.
+ */
+
+#include <openssl/err.h>
+#include <openssl/conf.h>
+
+#include <yajr/rpc/methods.hpp>
+#include <yajr/rpc/rpc.hpp>
+#include <yajr/transport/ZeroCopyOpenSSL.hpp>
+#include <yajr/internal/comms.hpp>
+
+#include <opflex/logging/OFLogHandler.h>
+#include <opflex/logging/internal/logging.hpp>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using yajr::transport::ZeroCopyOpenSSL;
+
+namespace {
+
+    /* how much the bulk workload lets pile up in the client's write queue */
+    size_t const kBulkQueuedBytes = 1 << 20;
+
+    enum Workload { ECHO, REQRESP, BULK, NUM_WORKLOADS };
+
+    char const * const workloadNames[NUM_WORKLOADS] = {
+        "echo",
+        "reqresp",
+        "bulk"
+    };
+
+    struct Options {
+        size_t count;
+        size_t warmup;
+        size_t depth;
+        size_t objects;
+        uint16_t port;
+        std::string socketName;
+        std::string certDir;
+        bool runTcp;
+        bool runUnix;
+        bool runPlain;
+        bool runSsl;
+        bool runWorkload[NUM_WORKLOADS];
+        bool csv;
+        unsigned int timeout;
+    };
+
+    Options opts;
+
+    /**
+     * @brief Logs to stderr, so that stdout only carries results
+     */
+    class StdErrLogHandler : public opflex::logging::OFLogHandler {
+      public:
+        StdErrLogHandler(Level level) : OFLogHandler(level) {}
+
+        virtual void handleMessage(const std::string& file,
+                                   const int line,
+                                   const std::string& function,
+                                   const Level level,
+                                   const std::string& message) {
+            if (level < logLevel_) return;
+
+            std::cerr << file << ":" << line << ":" << function <<
+                "[" << level << "] " << message << std::endl;
+        }
+    };
+
+    /**
+     * @brief Generates the payload of a benchmark message
+     *
+     * The layout follows what the opflex engine puts on the wire for the
+     * corresponding method, so that serialization, parsing and TLS costs
+     * are representative of a real agent.
+     */
+    class PayloadGen {
+      public:
+        enum Kind {
+            ENDPOINT,     /**< endpoint_declare params */
+            RESOLVE,      /**< policy_resolve params */
+            POLICY,       /**< policy_resolve result */
+            OBSERVABLES   /**< state_report params */
+        };
+
+        PayloadGen(Kind kind, uint64_t seq, uint64_t sent, size_t objects)
+            :
+                kind_(kind), seq_(seq), sent_(sent), objects_(objects)
+            {}
+
+        bool operator()(yajr::rpc::SendHandler & h) {
+            return write(h);
+        }
+
+        template <typename W>
+        bool write(W & w) const {
+            switch (kind_) {
+                case ENDPOINT:
+                    return writeEndpoint(w);
+                case RESOLVE:
+                    return writeResolve(w);
+                case POLICY:
+                    return writePolicy(w);
+                case OBSERVABLES:
+                    return writeObservables(w);
+            }
+            return false;
+        }
+
+        /**
+         * @brief The size in bytes of the JSON the generator produces
+         */
+        size_t size() const {
+            rapidjson::StringBuffer sb;
+            rapidjson::Writer<rapidjson::StringBuffer> w(sb);
+            write(w);
+            return sb.GetSize();
+        }
+
+      private:
+        Kind kind_;
+        uint64_t seq_;
+        uint64_t sent_;
+        size_t objects_;
+
+        template <typename W>
+        void writeStamp(W & w) const {
+            w.String("seq");
+            w.Uint64(seq_);
+            w.String("sent");
+            w.Uint64(sent_);
+        }
+
+        template <typename W>
+        static void writeProp(W & w, char const * name, char const * data) {
+            w.StartObject();
+            w.String("name");
+            w.String(name);
+            w.String("data");
+            w.String(data);
+            w.EndObject();
+        }
+
+        template <typename W>
+        static void writeProp(W & w, char const * name, uint64_t data) {
+            w.StartObject();
+            w.String("name");
+            w.String(name);
+            w.String("data");
+            w.Uint64(data);
+            w.EndObject();
+        }
+
+        template <typename W>
+        void writeMo(W & w, size_t i) const {
+            std::string idx(boost::lexical_cast<std::string>(i));
+            std::string uri("/PolicyUniverse/PolicySpace/tenant0/"
+                            "GbpContract/contract" + idx + "/");
+            w.StartObject();
+            w.String("subject");
+            w.String("GbpContract");
+            w.String("uri");
+            w.String(uri.c_str());
+            w.String("properties");
+            w.StartArray();
+            writeProp(w, "name", ("contract" + idx).c_str());
+            writeProp(w, "scope", "tenant0");
+            w.EndArray();
+            w.String("parent_subject");
+            w.String("PolicySpace");
+            w.String("parent_uri");
+            w.String("/PolicyUniverse/PolicySpace/tenant0/");
+            w.String("parent_relation");
+            w.String("GbpContract");
+            w.String("children");
+            w.StartArray();
+            w.String((uri + "GbpSubject/subject0/").c_str());
+            w.String((uri + "GbpSubject/subject1/").c_str());
+            w.EndArray();
+            w.EndObject();
+        }
+
+        template <typename W>
+        bool writeEndpoint(W & w) const {
+            w.StartArray();
+            w.StartObject();
+            writeStamp(w);
+            w.String("endpoint");
+            w.StartArray();
+            w.StartObject();
+            w.String("subject");
+            w.String("EprL2Ep");
+            w.String("uri");
+            w.String("/EprL2Universe/EprL2Ep/"
+                     "%2fPolicyUniverse%2fPolicySpace%2ftenant0%2f"
+                     "GbpBridgeDomain%2fbd0%2f/00:22:bd:f8:19:ff/");
+            w.String("properties");
+            w.StartArray();
+            writeProp(w, "mac", "00:22:bd:f8:19:ff");
+            writeProp(w, "uuid", "83f18f0b-80f7-46e2-b06c-4d9487b0c754");
+            writeProp(w, "context",
+                      "/PolicyUniverse/PolicySpace/tenant0/"
+                      "GbpBridgeDomain/bd0/");
+            writeProp(w, "group",
+                      "/PolicyUniverse/PolicySpace/tenant0/"
+                      "GbpEpGroup/epg0/");
+            writeProp(w, "interfaceName", "veth0");
+            w.EndArray();
+            w.String("parent_subject");
+            w.String("EprL2Universe");
+            w.String("parent_uri");
+            w.String("/EprL2Universe/");
+            w.String("parent_relation");
+            w.String("EprL2Ep");
+            w.String("children");
+            w.StartArray();
+            w.EndArray();
+            w.EndObject();
+            w.EndArray();
+            w.String("prr");
+            w.Uint64(3600);
+            w.EndObject();
+            w.EndArray();
+            return true;
+        }
+
+        template <typename W>
+        bool writeResolve(W & w) const {
+            w.StartArray();
+            w.StartObject();
+            writeStamp(w);
+            w.String("subject");
+            w.String("GbpContract");
+            w.String("policy_uri");
+            w.String("/PolicyUniverse/PolicySpace/tenant0/"
+                     "GbpContract/contract0/");
+            w.String("prr");
+            w.Uint64(3600);
+            w.EndObject();
+            w.EndArray();
+            return true;
+        }
+
+        template <typename W>
+        bool writePolicy(W & w) const {
+            w.StartObject();
+            writeStamp(w);
+            w.String("policy");
+            w.StartArray();
+            for (size_t i = 0; i < objects_; ++i) {
+                writeMo(w, i);
+            }
+            w.EndArray();
+            w.EndObject();
+            return true;
+        }
+
+        template <typename W>
+        bool writeObservables(W & w) const {
+            static char const * const counters[] = {
+                "rxPackets", "txPackets", "rxBytes", "txBytes",
+                "rxDrop", "txDrop", "rxUcast", "txUcast",
+            };
+            w.StartArray();
+            w.StartObject();
+            writeStamp(w);
+            w.String("observable");
+            w.StartArray();
+            for (size_t i = 0; i < objects_; ++i) {
+                std::string idx(boost::lexical_cast<std::string>(i));
+                w.StartObject();
+                w.String("subject");
+                w.String("GbpeEpCounter");
+                w.String("uri");
+                w.String(("/GbpeEpCounterUniverse/GbpeEpCounter/"
+                          "83f18f0b-80f7-46e2-b06c-4d9487b0c7" + idx
+                          + "/").c_str());
+                w.String("properties");
+                w.StartArray();
+                for (size_t c = 0;
+                        c < sizeof(counters) / sizeof(counters[0]); ++c) {
+                    writeProp(w, counters[c], 1000003 * (seq_ + c + 1));
+                }
+                w.EndArray();
+                w.EndObject();
+            }
+            w.EndArray();
+            w.EndObject();
+            w.EndArray();
+            return true;
+        }
+    };
+
+    /**
+     * @brief State for the transport currently being benchmarked
+     */
+    struct Bench {
+        uv_loop_t loop;
+        uv_timer_t next;
+        uv_timer_t timeout;
+        uv_check_t check;
+
+        yajr::Listener * listener;
+        yajr::Peer * client;
+        boost::scoped_ptr<ZeroCopyOpenSSL::Ctx> serverCtx;
+        boost::scoped_ptr<ZeroCopyOpenSSL::Ctx> clientCtx;
+
+        bool unixSocket;
+        bool ssl;
+        bool failed;
+
+        int workload;     /* current workload, -1 before the first one */
+        size_t target;    /* warmup plus measured messages */
+        size_t sent;
+        size_t received;
+        uint64_t start;   /* when the first measured message was sent */
+        uint64_t end;
+        std::vector<uint64_t> latencies;
+    };
+
+    Bench * bench = NULL;
+
+    void sendNext() {
+        uint64_t now = uv_hrtime();
+        uint64_t seq = bench->sent++;
+
+        if (seq == opts.warmup) {
+            bench->start = now;
+        }
+
+        switch (bench->workload) {
+            case ECHO:
+                yajr::rpc::OutReq<&yajr::rpc::method::custom>(
+                        PayloadGen(PayloadGen::ENDPOINT, seq, now,
+                                   opts.objects),
+                        bench->client
+                    )
+                    .send();
+                break;
+            case REQRESP:
+                yajr::rpc::OutReq<&yajr::rpc::method::policy_resolve>(
+                        PayloadGen(PayloadGen::RESOLVE, seq, now,
+                                   opts.objects),
+                        bench->client
+                    )
+                    .send();
+                break;
+            case BULK:
+                yajr::rpc::OutReq<&yajr::rpc::method::state_report>(
+                        PayloadGen(PayloadGen::OBSERVABLES, seq, now,
+                                   opts.objects),
+                        bench->client
+                    )
+                    .send();
+                break;
+        }
+    }
+
+    void topUpBulk() {
+        while (bench->sent < bench->target &&
+               bench->client->getQueuedBytes() < kBulkQueuedBytes) {
+            sendNext();
+        }
+        if (bench->sent == bench->target) {
+            uv_check_stop(&bench->check);
+        }
+    }
+
+    void onCheck(uv_check_t *) {
+        topUpBulk();
+    }
+
+    void startNextWorkload(uv_timer_t *);
+    void onTimeout(uv_timer_t *);
+
+    /**
+     * Account for a benchmark message reaching its final destination: the
+     * response for echo and reqresp, the server for bulk
+     */
+    void onArrival(rapidjson::Value const & payload) {
+        if (!bench || bench->workload < 0) {
+            return;
+        }
+
+        /* requests carry an array of params, results a single object */
+        rapidjson::Value const & stamp =
+            payload.IsArray() ? payload[rapidjson::SizeType(0)] : payload;
+        uint64_t now = uv_hrtime();
+        uint64_t seq = stamp["seq"].GetUint64();
+
+        if (seq >= opts.warmup) {
+            bench->latencies.push_back(now - stamp["sent"].GetUint64());
+        }
+
+        if (++bench->received == bench->target) {
+            bench->end = now;
+            uv_timer_start(&bench->next, startNextWorkload, 0, 0);
+            return;
+        }
+
+        if (bench->workload != BULK && bench->sent < bench->target) {
+            sendNext();
+        }
+    }
+
+    uint64_t percentile(std::vector<uint64_t> const & sorted, double p) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[i];
+    }
+
+    void report() {
+        Workload w = static_cast<Workload>(bench->workload);
+        size_t reqBytes = 0;
+        size_t resBytes = 0;
+
+        switch (w) {
+            case ECHO:
+                reqBytes = resBytes =
+                    PayloadGen(PayloadGen::ENDPOINT, 0, 0, opts.objects)
+                        .size();
+                break;
+            case REQRESP:
+                reqBytes =
+                    PayloadGen(PayloadGen::RESOLVE, 0, 0, opts.objects)
+                        .size();
+                resBytes =
+                    PayloadGen(PayloadGen::POLICY, 0, 0, opts.objects)
+                        .size();
+                break;
+            case BULK:
+                reqBytes =
+                    PayloadGen(PayloadGen::OBSERVABLES, 0, 0, opts.objects)
+                        .size();
+                break;
+            default:
+                break;
+        }
+
+        std::vector<uint64_t> & l = bench->latencies;
+        std::sort(l.begin(), l.end());
+
+        size_t measured = bench->target - opts.warmup;
+        double secs = (bench->end - bench->start) / 1e9;
+        double msgsPerSec = secs > 0 ? measured / secs : 0;
+        double mbPerSec =
+            secs > 0 ? measured * (reqBytes + resBytes) / secs / 1e6 : 0;
+        char const * transport = bench->unixSocket ? "unix" : "tcp";
+        char const * latency = w == BULK ? "one-way" : "round-trip";
+
+        /* latencies are reported in microseconds */
+        double p50 = percentile(l, 0.50) / 1e3;
+        double p90 = percentile(l, 0.90) / 1e3;
+        double p99 = percentile(l, 0.99) / 1e3;
+        double p999 = percentile(l, 0.999) / 1e3;
+        double max = l.empty() ? 0 : l.back() / 1e3;
+
+        char line[512];
+        if (opts.csv) {
+            snprintf(line, sizeof(line),
+                     "%s,%d,%s,%zu,%zu,%zu,%zu,%s,"
+                     "%.1f,%.1f,%.1f,%.1f,%.1f,%.0f,%.2f",
+                     transport, bench->ssl ? 1 : 0, workloadNames[w],
+                     measured, opts.depth, reqBytes, resBytes, latency,
+                     p50, p90, p99, p999, max, msgsPerSec, mbPerSec);
+        } else {
+            snprintf(line, sizeof(line),
+                     "{\"transport\":\"%s\",\"ssl\":%s,\"workload\":\"%s\","
+                     "\"messages\":%zu,\"depth\":%zu,"
+                     "\"request_bytes\":%zu,\"response_bytes\":%zu,"
+                     "\"latency\":\"%s\",\"p50_us\":%.1f,\"p90_us\":%.1f,"
+                     "\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f,"
+                     "\"msgs_per_sec\":%.0f,\"mb_per_sec\":%.2f}",
+                     transport, bench->ssl ? "true" : "false",
+                     workloadNames[w], measured, opts.depth,
+                     reqBytes, resBytes, latency, p50, p90, p99, p999, max,
+                     msgsPerSec, mbPerSec);
+        }
+        std::cout << line << std::endl;
+    }
+
+    void shutdown() {
+        uv_check_stop(&bench->check);
+        uv_timer_stop(&bench->next);
+        uv_timer_stop(&bench->timeout);
+        uv_close((uv_handle_t *)&bench->check, NULL);
+        uv_close((uv_handle_t *)&bench->next, NULL);
+        uv_close((uv_handle_t *)&bench->timeout, NULL);
+
+        /* destroys the listener and both peers */
+        yajr::finiLoop(&bench->loop);
+    }
+
+    void startNextWorkload(uv_timer_t *) {
+        if (bench->workload >= 0) {
+            report();
+        }
+
+        do {
+            ++bench->workload;
+        } while (bench->workload < NUM_WORKLOADS &&
+                 !opts.runWorkload[bench->workload]);
+
+        if (bench->workload == NUM_WORKLOADS) {
+            shutdown();
+            return;
+        }
+
+        bench->target = opts.warmup + opts.count;
+        bench->sent = 0;
+        bench->received = 0;
+        bench->start = bench->end = 0;
+        bench->latencies.clear();
+        bench->latencies.reserve(opts.count);
+
+        uv_timer_start(&bench->timeout, onTimeout, opts.timeout * 1000, 0);
+
+        if (bench->workload == BULK) {
+            uv_check_start(&bench->check, onCheck);
+            topUpBulk();
+        } else {
+            for (size_t i = 0;
+                    i < opts.depth && bench->sent < bench->target; ++i) {
+                sendNext();
+            }
+        }
+    }
+
+    void onTimeout(uv_timer_t *) {
+        std::cerr << "timed out on "
+                  << (bench->unixSocket ? "unix" : "tcp")
+                  << (bench->ssl ? "+ssl " : " ")
+                  << (bench->workload < 0 ? "connect" :
+                      workloadNames[bench->workload])
+                  << " after " << bench->received << " of "
+                  << bench->target << " messages" << std::endl;
+        bench->failed = true;
+        shutdown();
+    }
+
+    void onClientStateChange(yajr::Peer *, void *,
+                             yajr::StateChange::To stateChange,
+                             int error) {
+        switch (stateChange) {
+            case yajr::StateChange::CONNECT:
+                if (bench->workload < 0) {
+                    uv_timer_start(&bench->next, startNextWorkload, 0, 0);
+                }
+                break;
+            case yajr::StateChange::FAILURE:
+            case yajr::StateChange::TRANSPORT_FAILURE:
+                LOG(WARNING)
+                    << "client connection failure: "
+                    << uv_strerror(error)
+                ;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void onServerStateChange(yajr::Peer * p, void *,
+                             yajr::StateChange::To stateChange,
+                             int error) {
+        switch (stateChange) {
+            case yajr::StateChange::CONNECT:
+                if (bench->ssl &&
+                        !ZeroCopyOpenSSL::attachTransport(
+                            p, bench->serverCtx.get())) {
+                    LOG(ERROR)
+                        << "could not attach SSL transport to server peer"
+                    ;
+                }
+                break;
+            case yajr::StateChange::FAILURE:
+            case yajr::StateChange::TRANSPORT_FAILURE:
+                LOG(WARNING)
+                    << "server connection failure: "
+                    << uv_strerror(error)
+                ;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void * onAccept(yajr::Listener *, void * data, int) {
+        return data;
+    }
+
+    uv_loop_t * loopSelector(void *) {
+        return &bench->loop;
+    }
+
+    /**
+     * Run all the selected workloads over one transport
+     *
+     * @return true if all the workloads completed
+     */
+    bool run(bool unixSocket, bool ssl) {
+        Bench b;
+        bench = &b;
+
+        b.listener = NULL;
+        b.client = NULL;
+        b.unixSocket = unixSocket;
+        b.ssl = ssl;
+        b.failed = false;
+        b.workload = -1;
+        b.target = b.sent = b.received = 0;
+
+        if (ssl) {
+            std::string caFile(opts.certDir + "/ca.pem");
+            std::string keyFile(opts.certDir + "/server.pem");
+            b.serverCtx.reset(ZeroCopyOpenSSL::Ctx::createCtx(
+                                  NULL, keyFile.c_str(), "password123"));
+            b.clientCtx.reset(ZeroCopyOpenSSL::Ctx::createCtx(
+                                  caFile.c_str(), NULL));
+            if (!b.serverCtx || !b.clientCtx) {
+                std::cerr << "could not load the certificates in "
+                          << opts.certDir << std::endl;
+                bench = NULL;
+                return false;
+            }
+        }
+
+        uv_loop_init(&b.loop);
+        yajr::initLoop(&b.loop);
+
+        uv_timer_init(&b.loop, &b.next);
+        uv_timer_init(&b.loop, &b.timeout);
+        uv_check_init(&b.loop, &b.check);
+        uv_timer_start(&b.timeout, onTimeout, opts.timeout * 1000, 0);
+
+        if (unixSocket) {
+            unlink(opts.socketName.c_str());
+            b.listener = yajr::Listener::create(opts.socketName,
+                                                onServerStateChange,
+                                                onAccept, NULL,
+                                                &b.loop, loopSelector);
+            b.client = yajr::Peer::create(opts.socketName,
+                                          onClientStateChange,
+                                          NULL, loopSelector);
+        } else {
+            b.listener = yajr::Listener::create("127.0.0.1", opts.port,
+                                                onServerStateChange,
+                                                onAccept, NULL,
+                                                &b.loop, loopSelector);
+            b.client = yajr::Peer::create("127.0.0.1",
+                          boost::lexical_cast<std::string>(opts.port),
+                          onClientStateChange, NULL, loopSelector);
+        }
+
+        if (!b.listener || !b.client) {
+            std::cerr << "could not create peers" << std::endl;
+            b.failed = true;
+            shutdown();
+        } else if (ssl &&
+                   !ZeroCopyOpenSSL::attachTransport(b.client,
+                                                     b.clientCtx.get())) {
+            std::cerr << "could not attach SSL transport to client peer"
+                      << std::endl;
+            b.failed = true;
+            shutdown();
+        }
+
+        uv_run(&b.loop, UV_RUN_DEFAULT);
+        uv_loop_close(&b.loop);
+
+        if (unixSocket) {
+            unlink(opts.socketName.c_str());
+        }
+
+        bench = NULL;
+        return !b.failed;
+    }
+
+    bool parseBoth(char const * arg, bool & a, bool & b,
+                   char const * aName, char const * bName) {
+        if (!strcmp(arg, aName)) {
+            a = true; b = false;
+        } else if (!strcmp(arg, bName)) {
+            a = false; b = true;
+        } else if (!strcmp(arg, "all")) {
+            a = b = true;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    void usage(char const * name) {
+        std::cerr <<
+            "Usage: " << name << " [options]\n"
+            "  --count N          measured messages per workload "
+                                  "(default 20000)\n"
+            "  --warmup N         unmeasured messages sent first "
+                                  "(default 1000)\n"
+            "  --depth N          requests in flight for echo and reqresp "
+                                  "(default 1)\n"
+            "  --objects N        managed objects in policy responses and "
+                                  "state reports (default 16)\n"
+            "  --transport T      tcp, unix or all (default all)\n"
+            "  --ssl S            off, on or all (default all)\n"
+            "  --workload W       echo, reqresp, bulk or all "
+                                  "(default all)\n"
+            "  --format F         json or csv (default json)\n"
+            "  --port P           TCP port to listen on (default 65400)\n"
+            "  --socket PATH      UNIX socket to listen on\n"
+            "  --certs DIR        directory with ca.pem and server.pem\n"
+            "  --timeout SECS     per-workload timeout (default 120)\n"
+            "  --log-level L      debug, info, warning or error "
+                                  "(default error)\n";
+    }
+
+}
+
+int main(int argc, char ** argv) {
+    using opflex::logging::OFLogHandler;
+
+    opts.count = 20000;
+    opts.warmup = 1000;
+    opts.depth = 1;
+    opts.objects = 16;
+    opts.port = 65400;
+    opts.socketName = "/tmp/comms_bench." +
+        boost::lexical_cast<std::string>(getpid()) + ".sock";
+#ifdef SRCDIR
+    opts.certDir = SRCDIR"/test";
+#else
+    opts.certDir = ".";
+#endif
+    opts.runTcp = opts.runUnix = true;
+    opts.runPlain = opts.runSsl = true;
+    for (size_t i = 0; i < NUM_WORKLOADS; ++i) {
+        opts.runWorkload[i] = true;
+    }
+    opts.csv = false;
+    opts.timeout = 120;
+    OFLogHandler::Level logLevel = OFLogHandler::ERROR;
+
+    static struct option long_options[] = {
+        {"count",     required_argument, 0, 'c'},
+        {"warmup",    required_argument, 0, 'w'},
+        {"depth",     required_argument, 0, 'd'},
+        {"objects",   required_argument, 0, 'o'},
+        {"transport", required_argument, 0, 't'},
+        {"ssl",       required_argument, 0, 's'},
+        {"workload",  required_argument, 0, 'W'},
+        {"format",    required_argument, 0, 'f'},
+        {"port",      required_argument, 0, 'p'},
+        {"socket",    required_argument, 0, 'u'},
+        {"certs",     required_argument, 0, 'C'},
+        {"timeout",   required_argument, 0, 'T'},
+        {"log-level", required_argument, 0, 'l'},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        bool ok = true;
+        switch (c) {
+            case 'c': opts.count = strtoul(optarg, NULL, 10); break;
+            case 'w': opts.warmup = strtoul(optarg, NULL, 10); break;
+            case 'd': opts.depth = strtoul(optarg, NULL, 10); break;
+            case 'o': opts.objects = strtoul(optarg, NULL, 10); break;
+            case 'p': opts.port = strtoul(optarg, NULL, 10); break;
+            case 'u': opts.socketName = optarg; break;
+            case 'C': opts.certDir = optarg; break;
+            case 'T': opts.timeout = strtoul(optarg, NULL, 10); break;
+            case 't':
+                ok = parseBoth(optarg, opts.runTcp, opts.runUnix,
+                               "tcp", "unix");
+                break;
+            case 's':
+                ok = parseBoth(optarg, opts.runPlain, opts.runSsl,
+                               "off", "on");
+                break;
+            case 'W':
+                if (!strcmp(optarg, "all")) {
+                    for (size_t i = 0; i < NUM_WORKLOADS; ++i) {
+                        opts.runWorkload[i] = true;
+                    }
+                    break;
+                }
+                ok = false;
+                for (size_t i = 0; i < NUM_WORKLOADS; ++i) {
+                    opts.runWorkload[i] = !strcmp(optarg, workloadNames[i]);
+                    ok = ok || opts.runWorkload[i];
+                }
+                break;
+            case 'f':
+                opts.csv = !strcmp(optarg, "csv");
+                ok = opts.csv || !strcmp(optarg, "json");
+                break;
+            case 'l':
+                if (!strcmp(optarg, "debug")) {
+                    logLevel = OFLogHandler::DEBUG;
+                } else if (!strcmp(optarg, "info")) {
+                    logLevel = OFLogHandler::INFO;
+                } else if (!strcmp(optarg, "warning")) {
+                    logLevel = OFLogHandler::WARNING;
+                } else if (!strcmp(optarg, "error")) {
+                    logLevel = OFLogHandler::ERROR;
+                } else {
+                    ok = false;
+                }
+                break;
+            case 'h':
+            default:
+                ok = false;
+                break;
+        }
+        if (!ok || opts.count == 0 || opts.depth == 0) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    StdErrLogHandler logHandler(logLevel);
+    OFLogHandler::registerHandler(logHandler);
+
+    ZeroCopyOpenSSL::initOpenSSL(false);
+
+    if (opts.csv) {
+        std::cout << "transport,ssl,workload,messages,depth,"
+                     "request_bytes,response_bytes,latency,"
+                     "p50_us,p90_us,p99_us,p999_us,max_us,"
+                     "msgs_per_sec,mb_per_sec" << std::endl;
+    }
+
+    int rc = 0;
+    for (int u = 0; u < 2; ++u) {
+        if (!(u ? opts.runUnix : opts.runTcp)) continue;
+        for (int s = 0; s < 2; ++s) {
+            if (!(s ? opts.runSsl : opts.runPlain)) continue;
+            if (!run(u, s)) {
+                rc = 1;
+            }
+        }
+    }
+
+    ERR_remove_state(0);
+    CONF_modules_unload(1);
+    ERR_free_strings();
+    EVP_cleanup();
+    ZeroCopyOpenSSL::finiOpenSSL();
+
+    return rc;
+}
+
+namespace yajr {
+    namespace rpc {
+
+/* echo: send the payload straight back, as the built-in echo method does */
+template<>
+void InbReq<&yajr::rpc::method::custom>::process() const {
+
+    VLOG(6);
+
+    OutboundResult (
+            this,
+            GeneratorFromValue(getPayload())
+        )
+        . send();
+
+}
+
+template<>
+void InbRes<&yajr::rpc::method::custom>::process() const {
+
+    onArrival(getPayload());
+
+}
+
+/* reqresp: answer with a policy sized response */
+template<>
+void InbReq<&yajr::rpc::method::policy_resolve>::process() const {
+
+    rapidjson::Value const & stamp = getPayload()[rapidjson::SizeType(0)];
+
+    OutboundResult (
+            this,
+            PayloadGen(PayloadGen::POLICY,
+                       stamp["seq"].GetUint64(),
+                       stamp["sent"].GetUint64(),
+                       opts.objects)
+        )
+        . send();
+
+}
+
+template<>
+void InbRes<&yajr::rpc::method::policy_resolve>::process() const {
+
+    onArrival(getPayload());
+
+}
+
+/* bulk: count and drop */
+template<>
+void InbReq<&yajr::rpc::method::state_report>::process() const {
+
+    onArrival(getPayload());
+
+}
+
+} /* yajr::rpc namespace */
+} /* yajr namespace */
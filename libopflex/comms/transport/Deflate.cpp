@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2014 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ */
+
+/* This must be included before anything else */
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+#include <yajr/transport/Deflate.hpp>
+#include <yajr/internal/comms.hpp>
+
+#include <opflex/logging/internal/logging.hpp>
+
+#include <zlib.h>
+
+#include <cstring>
+#include <new>
+
+namespace {
+
+    /* the chunk of stack used to receive each round of (de)compressed data */
+    size_t const kChunk = 16384;
+
+}
+
+namespace yajr {
+    namespace transport {
+
+using namespace yajr::comms::internal;
+
+struct Deflate::Streams {
+    z_stream out;
+    z_stream in;
+};
+
+Deflate::Deflate()
+    :
+        z_(new (std::nothrow) Streams()),
+        compressing_(false),
+        decompressing_(false),
+        awaitingCompressed_(false)
+    {
+        memset(&stats_, 0, sizeof(stats_));
+    }
+
+Deflate::~Deflate() {
+
+    if (!z_) {
+        return;
+    }
+
+    if (compressing_) {
+        deflateEnd(&z_->out);
+    }
+
+    if (decompressing_) {
+        inflateEnd(&z_->in);
+    }
+
+    delete z_;
+}
+
+bool Deflate::compress(std::deque<char> & d, size_t from) {
+
+    assert(compressing_);
+    assert(from <= d.size());
+
+    if (from == d.size()) {
+        return true;
+    }
+
+    std::vector<char> raw(d.begin() + from, d.end());
+    d.erase(d.begin() + from, d.end());
+
+    z_->out.next_in = reinterpret_cast< Bytef * >(&raw[0]);
+    z_->out.avail_in = raw.size();
+
+    char chunk[kChunk];
+    do {
+        z_->out.next_out = reinterpret_cast< Bytef * >(chunk);
+        z_->out.avail_out = kChunk;
+
+        int rc = deflate(&z_->out, Z_SYNC_FLUSH);
+        if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            LOG(ERROR)
+                << "deflate() failed: "
+                << rc
+            ;
+            return false;
+        }
+
+        d.insert(d.end(), chunk, chunk + (kChunk - z_->out.avail_out));
+    } while (!z_->out.avail_out);
+
+    stats_.rawOut += raw.size();
+    stats_.wireOut += d.size() - from;
+
+    return true;
+}
+
+bool Deflate::decompress(
+        char const * buf,
+        size_t len,
+        std::vector<char> & out) {
+
+    assert(decompressing_);
+
+    z_->in.next_in = reinterpret_cast< Bytef * >(const_cast< char * >(buf));
+    z_->in.avail_in = len;
+
+    size_t before = out.size();
+    char chunk[kChunk];
+    do {
+        z_->in.next_out = reinterpret_cast< Bytef * >(chunk);
+        z_->in.avail_out = kChunk;
+
+        /* the peer never ends its stream, so Z_STREAM_END is an error too */
+        int rc = inflate(&z_->in, Z_SYNC_FLUSH);
+        if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            LOG(ERROR)
+                << "inflate() failed: "
+                << rc
+                << " "
+                << (z_->in.msg ? z_->in.msg : "")
+            ;
+            return false;
+        }
+
+        out.insert(out.end(), chunk, chunk + (kChunk - z_->in.avail_out));
+    } while (!z_->in.avail_out);
+
+    assert(!z_->in.avail_in);
+
+    stats_.wireIn += len;
+    stats_.rawIn += out.size() - before;
+
+    return true;
+}
+
+bool Deflate::startCompressing(yajr::Peer * p, int level) {
+
+    CommunicationPeer * peer = dynamic_cast<CommunicationPeer *>(p);
+    if (!peer) {
+        return false;
+    }
+
+    Deflate * e = peer->attachDeflate();
+    if (!e || !e->z_) {
+        return false;
+    }
+
+    if (e->compressing_) {
+        return true;
+    }
+
+    memset(&e->z_->out, 0, sizeof(e->z_->out));
+    if (deflateInit(&e->z_->out, level) != Z_OK) {
+        LOG(ERROR)
+            << peer
+            << " deflateInit() failed"
+        ;
+        return false;
+    }
+
+    VLOG(1)
+        << peer
+        << " compressing outbound frames at level "
+        << level
+    ;
+
+    e->compressing_ = true;
+
+    return true;
+}
+
+bool Deflate::beginDecompressing() {
+
+    awaitingCompressed_ = false;
+
+    if (!z_) {
+        return false;
+    }
+
+    if (decompressing_) {
+        return true;
+    }
+
+    memset(&z_->in, 0, sizeof(z_->in));
+    if (inflateInit(&z_->in) != Z_OK) {
+        LOG(ERROR)
+            << "inflateInit() failed"
+        ;
+        return false;
+    }
+
+    decompressing_ = true;
+
+    return true;
+}
+
+bool Deflate::startDecompressing(yajr::Peer * p) {
+
+    CommunicationPeer * peer = dynamic_cast<CommunicationPeer *>(p);
+    if (!peer) {
+        return false;
+    }
+
+    Deflate * e = peer->attachDeflate();
+    if (!e || !e->beginDecompressing()) {
+        return false;
+    }
+
+    VLOG(1)
+        << peer
+        << " decompressing inbound data"
+    ;
+
+    return true;
+}
+
+bool Deflate::acceptCompressed(yajr::Peer * p) {
+
+    CommunicationPeer * peer = dynamic_cast<CommunicationPeer *>(p);
+    if (!peer) {
+        return false;
+    }
+
+    Deflate * e = peer->attachDeflate();
+    if (!e || !e->z_) {
+        return false;
+    }
+
+    if (!e->decompressing_) {
+        VLOG(1)
+            << peer
+            << " decompressing inbound data from the first compressed frame"
+        ;
+        e->awaitingCompressed_ = true;
+    }
+
+    return true;
+}
+
+bool Deflate::getStats(yajr::Peer const * p, Stats & stats) {
+
+    CommunicationPeer const * peer =
+        dynamic_cast<CommunicationPeer const *>(p);
+    if (!peer || !peer->getDeflate()) {
+        return false;
+    }
+
+    stats = peer->getDeflate()->getStats();
+
+    return true;
+}
+
+} /* yajr::transport namespace */
+} /* yajr namespace */
+
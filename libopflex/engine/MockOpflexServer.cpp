@@ -43,6 +43,9 @@ void MockOpflexServer::enableSSL(const std::string& caStorePath,
     pimpl->enableSSL(caStorePath, serverKeyPath,
                      serverKeyPass, verifyPeers);
 }
+void MockOpflexServer::enableCompression() {
+    pimpl->enableCompression();
+}
 void MockOpflexServer::start() {
     pimpl->start();
 }
@@ -73,7 +76,7 @@ using test::MockOpflexServer;
 MockOpflexServerImpl::MockOpflexServerImpl(int port_, uint8_t roles_,
                                            MockOpflexServer::peer_vec_t peers_,
                                            const modb::ModelMetadata& md)
-    : port(port_), roles(roles_), peers(peers_),
+    : port(port_), roles(roles_), compression(false), peers(peers_),
       listener(*this, port_, "name", "domain"),
       db(threadManager), serializer(&db) {
     db.init(md);
@@ -24,6 +24,10 @@
 #include "opflex/engine/internal/OpflexMessage.h"
 #include "opflex/engine/internal/MockServerHandler.h"
 #include "opflex/engine/internal/MockOpflexServerImpl.h"
+#include "opflex/engine/internal/OpflexServerConnection.h"
+
+#include <yajr/internal/comms.hpp>
+#include <yajr/transport/Deflate.hpp>
 
 namespace opflex {
 namespace engine {
@@ -58,10 +62,11 @@ public:
                     const std::string& domain_,
                     const optional<std::string>& your_location_,
                     const uint8_t roles_,
-                    test::MockOpflexServer::peer_vec_t peers_)
+                    test::MockOpflexServer::peer_vec_t peers_,
+                    bool compression_)
         : OpflexMessage("send_identity", RESPONSE, &id),
           name(name_), domain(domain_), your_location(your_location_),
-          roles(roles_), peers(peers_) {}
+          roles(roles_), peers(peers_), compression(compression_) {}
 
     virtual void serializePayload(yajr::rpc::SendHandler& writer) {
         (*this)(writer);
@@ -117,6 +122,10 @@ public:
             writer.EndObject();
         }
         writer.EndArray();
+        if (compression) {
+            writer.String("compression");
+            writer.String("deflate");
+        }
         writer.EndObject();
         return true;
     }
@@ -127,6 +136,7 @@ private:
     optional<std::string> your_location;
     uint8_t roles;
     test::MockOpflexServer::peer_vec_t peers;
+    bool compression;
 };
 
 class PolicyResolveRes : public OpflexMessage {
@@ -228,20 +238,48 @@ protected:
 void MockServerHandler::handleSendIdentityReq(const rapidjson::Value& id,
                                               const Value& payload) {
     LOG(DEBUG) << "Got send_identity req";
+
+    // The client only compresses once it has received our response,
+    // and may send plain frames such as keepalives until then, so
+    // decompress from its first compressed frame on, and compress
+    // everything after our response
+    bool compression = false;
+    if (server->isCompressionEnabled() && payload.IsArray() &&
+        payload.Size() > 0 && payload[0u].IsObject() &&
+        payload[0u].HasMember("compression")) {
+        const Value& offered = payload[0u]["compression"];
+        if (offered.IsArray()) {
+            Value::ConstValueIterator it;
+            for (it = offered.Begin(); it != offered.End(); ++it) {
+                if (it->IsString() &&
+                    std::string("deflate") == it->GetString())
+                    compression = true;
+            }
+        }
+    }
+    yajr::Peer* peer =
+        ((OpflexServerConnection*)getConnection())->getPeer();
+    if (compression)
+        compression = yajr::transport::Deflate::acceptCompressed(peer);
+
     std::stringstream sb;
     sb << "127.0.0.1:" << server->getPort();
     SendIdentityRes* res =
         new SendIdentityRes(id, sb.str(), "testdomain",
                             std::string("location_string"),
                             server->getRoles(),
-                            server->getPeers());
+                            server->getPeers(),
+                            compression);
     getConnection()->sendMessage(res, true);
+    if (compression)
+        yajr::transport::Deflate::startCompressing(peer);
     ready();
 }
 
 void MockServerHandler::handlePolicyResolveReq(const rapidjson::Value& id,
                                                const Value& payload) {
     LOG(DEBUG) << "Got policy_resolve req";
+    resolveReqs += 1;
 
     bool found = true;
     Value::ConstValueIterator it;
@@ -361,9 +399,23 @@ void MockServerHandler::handlePolicyUnresolveReq(const rapidjson::Value& id,
     getConnection()->sendMessage(res, true);
 }
 
+void MockServerHandler::checkStall() {
+    if (!stallMode) return;
+    stallMode = false;
+
+    LOG(INFO) << "Stalling connection";
+    yajr::Peer* peer =
+        ((OpflexServerConnection*)getConnection())->getPeer();
+    yajr::comms::internal::CommunicationPeer* cp =
+        dynamic_cast<yajr::comms::internal::CommunicationPeer*>(peer);
+    if (cp)
+        cp->choke();
+}
+
 void MockServerHandler::handleEPDeclareReq(const rapidjson::Value& id,
                                            const rapidjson::Value& payload) {
     LOG(DEBUG) << "Got endpoint_declare req";
+    checkStall();
     StoreClient::notif_t notifs;
     StoreClient& client = *server->getSystemClient();
     MOSerializer& serializer = server->getSerializer();
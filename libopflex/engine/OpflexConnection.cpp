@@ -40,10 +40,19 @@ using yajr::rpc::OutboundResult;
 using yajr::rpc::OutboundError;
 using yajr::transport::ZeroCopyOpenSSL;
 
+const size_t OpflexConnection::STARVATION_LIMIT;
+
 OpflexConnection::OpflexConnection(HandlerFactory& handlerFactory)
     : handler(handlerFactory.newHandler(this))
     ,requestId(1) ,connGeneration(0)
+    ,queuedBytes(0)
+    ,highMessages(0) ,lowMessages(0) ,highBytes(0) ,lowBytes(0)
 {
+    for (size_t i = 0; i < OpflexMessage::NUM_PRIORITIES; ++i) {
+        passedOver[i] = 0;
+        queuedMessages[i] = 0;
+        blocked[i] = false;
+    }
     uv_mutex_init(&queue_mutex);
     connect();
 }
@@ -68,10 +77,16 @@ void OpflexConnection::connect() {}
 void OpflexConnection::cleanup() {
     util::LockGuard guard(&queue_mutex);
     connGeneration += 1;
-    while (write_queue.size() > 0) {
-        delete write_queue.front().first;
-        write_queue.pop_front();
+    for (size_t i = 0; i < OpflexMessage::NUM_PRIORITIES; ++i) {
+        while (write_queue[i].size() > 0) {
+            delete write_queue[i].front().first;
+            write_queue[i].pop_front();
+        }
+        passedOver[i] = 0;
+        queuedMessages[i] = 0;
+        blocked[i] = false;
     }
+    queuedBytes = 0;
 }
 
 void OpflexConnection::disconnect() {
@@ -133,29 +148,162 @@ void OpflexConnection::doWrite(OpflexMessage* message) {
     }
 }
 
-void OpflexConnection::processWriteQueue() {
+void OpflexConnection::setWriteQueueLimits(size_t highMessages,
+                                           size_t lowMessages,
+                                           size_t highBytes,
+                                           size_t lowBytes) {
+    util::LockGuard guard(&queue_mutex);
+    this->highMessages = highMessages;
+    this->lowMessages = lowMessages;
+    this->highBytes = highBytes;
+    this->lowBytes = lowBytes;
+    updateBlocked();
+}
+
+bool OpflexConnection::isBlocked(OpflexMessage::MessagePriority priority) {
+    util::LockGuard guard(&queue_mutex);
+    return blocked[priority];
+}
+
+size_t OpflexConnection::getQueuedMessages() {
+    util::LockGuard guard(&queue_mutex);
+    size_t total = 0;
+    for (size_t i = 0; i < OpflexMessage::NUM_PRIORITIES; ++i)
+        total += queuedMessages[i];
+    return total;
+}
+
+size_t OpflexConnection::
+getQueuedMessages(OpflexMessage::MessagePriority priority) {
+    util::LockGuard guard(&queue_mutex);
+    return queuedMessages[priority];
+}
+
+size_t OpflexConnection::getQueuedBytes() {
     util::LockGuard guard(&queue_mutex);
-    while (write_queue.size() > 0) {
-        const write_queue_item_t& qi = write_queue.front();
+    return queuedBytes;
+}
+
+// must be called with queue_mutex held.  A priority class is
+// blocked by the messages queued in its own and all higher priority
+// classes
+void OpflexConnection::updateBlocked() {
+    bool overBytes = highBytes > 0 && queuedBytes >= highBytes;
+    bool underBytes = highBytes == 0 || queuedBytes <= lowBytes;
+    size_t messages = 0;
+    for (size_t i = 0; i < OpflexMessage::NUM_PRIORITIES; ++i) {
+        messages += queuedMessages[i];
+        if (!blocked[i]) {
+            if ((highMessages > 0 && messages >= highMessages) ||
+                overBytes) {
+                LOG(DEBUG) << "[" << getRemotePeer() << "] "
+                           << "Write queue above high watermark for "
+                           << "priority " << i << " ("
+                           << messages << " messages, "
+                           << queuedBytes << " bytes)";
+                blocked[i] = true;
+            }
+        } else if ((highMessages == 0 || messages <= lowMessages) &&
+                   underBytes) {
+            LOG(DEBUG) << "[" << getRemotePeer() << "] "
+                       << "Write queue drained below low watermark for "
+                       << "priority " << i;
+            blocked[i] = false;
+        }
+    }
+}
+
+// must be called with queue_mutex held.  Returns the lowest priority
+// queue that has been passed over too many times, otherwise the
+// highest priority non-empty queue, or NUM_PRIORITIES if all queues
+// are empty
+size_t OpflexConnection::nextQueue() {
+    size_t next = OpflexMessage::NUM_PRIORITIES;
+    for (size_t i = OpflexMessage::NUM_PRIORITIES; i-- > 0; ) {
+        if (!write_queue[i].empty() && passedOver[i] >= STARVATION_LIMIT) {
+            next = i;
+            break;
+        }
+    }
+    if (next == OpflexMessage::NUM_PRIORITIES) {
+        for (size_t i = 0; i < OpflexMessage::NUM_PRIORITIES; ++i) {
+            if (!write_queue[i].empty()) {
+                next = i;
+                break;
+            }
+        }
+        if (next == OpflexMessage::NUM_PRIORITIES)
+            return next;
+    }
+
+    passedOver[next] = 0;
+    for (size_t i = next + 1; i < OpflexMessage::NUM_PRIORITIES; ++i) {
+        if (!write_queue[i].empty())
+            passedOver[i] += 1;
+    }
+    return next;
+}
+
+bool OpflexConnection::processWriteQueue() {
+    util::LockGuard guard(&queue_mutex);
+    yajr::Peer* peer = getPeer();
+    bool pending = false;
+    while (true) {
+        if (peer != NULL && highBytes > 0) {
+            // Leave the rest in the queue until the peer catches up
+            queuedBytes = peer->getQueuedBytes();
+            if (queuedBytes >= highBytes) {
+                pending = true;
+                break;
+            }
+        }
+
+        size_t q = nextQueue();
+        if (q == OpflexMessage::NUM_PRIORITIES)
+            break;
+
+        const write_queue_item_t& qi = write_queue[q].front();
+        scoped_ptr<OpflexMessage> message(qi.first);
+        bool stale = qi.second < connGeneration;
+        write_queue[q].pop_front();
+        queuedMessages[q] -= 1;
+
         // Avoid writing messages from a previous reconnect attempt
-        if (qi.second < connGeneration) {
-            LOG(DEBUG) << "Ignoring " << qi.first->getMethod()
-                       << " of type " << qi.first->getType();
+        if (stale) {
+            LOG(DEBUG) << "Ignoring " << message->getMethod()
+                       << " of type " << message->getType();
             continue;
         }
-        scoped_ptr<OpflexMessage> message(qi.first);
-        write_queue.pop_front();
         doWrite(message.get());
     }
+    if (peer != NULL)
+        queuedBytes = peer->getQueuedBytes();
+    updateBlocked();
+    if (!pending) {
+        // A blocked connection is also retried with nothing queued,
+        // since nothing else will notice once the peer has drained
+        for (size_t i = 0; i < OpflexMessage::NUM_PRIORITIES; ++i) {
+            if (blocked[i])
+                pending = true;
+        }
+    }
+    return pending;
 }
 
 void OpflexConnection::sendMessage(OpflexMessage* message, bool sync) {
     if (sync) {
         scoped_ptr<OpflexMessage> messagep(message);
+        // doWrite must not interleave with a flush of the write queue
+        // from another thread, and assigns request IDs
+        util::LockGuard guard(&queue_mutex);
         doWrite(message);
     } else {
         util::LockGuard guard(&queue_mutex);
-        write_queue.push_back(std::make_pair(message, connGeneration));
+        OpflexMessage::MessagePriority priority = message->getPriority();
+        write_queue[priority].push_back(std::make_pair(message,
+                                                       connGeneration));
+        queuedMessages[priority] += 1;
+        updateBlocked();
     }
     messagesReady();
 }
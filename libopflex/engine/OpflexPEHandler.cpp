@@ -30,6 +30,7 @@
 #include "opflex/logging/internal/logging.hpp"
 #include "opflex/engine/internal/MOSerializer.h"
 #include "opflex/engine/internal/OpflexMessage.h"
+#include "yajr/transport/Deflate.hpp"
 
 namespace opflex {
 namespace engine {
@@ -53,9 +54,11 @@ public:
     SendIdentityReq(const string& name_,
                     const string& domain_,
                     const optional<string>& location_,
-                    const uint8_t roles_)
+                    const uint8_t roles_,
+                    bool compression_)
         : OpflexMessage("send_identity", REQUEST),
-          name(name_), domain(domain_), location(location_), roles(roles_) {}
+          name(name_), domain(domain_), location(location_), roles(roles_),
+          compression(compression_) {}
 
     virtual void serializePayload(yajr::rpc::SendHandler& writer) {
         (*this)(writer);
@@ -69,6 +72,8 @@ public:
         return new SendIdentityReq(*this);
     }
 
+    virtual MessagePriority getPriority() const { return PRIORITY_CONTROL; }
+
     template <typename T>
     bool operator()(Writer<T> & writer) {
         writer.StartArray();
@@ -94,6 +99,12 @@ public:
         if (roles & OFConstants::OBSERVER)
             writer.String("observer");
         writer.EndArray();
+        if (compression) {
+            writer.String("compression");
+            writer.StartArray();
+            writer.String("deflate");
+            writer.EndArray();
+        }
         writer.EndObject();
         writer.EndArray();
 
@@ -105,6 +116,7 @@ private:
     string domain;
     optional<string> location;
     uint8_t roles;
+    bool compression;
 };
 
 void OpflexPEHandler::connected() {
@@ -115,7 +127,8 @@ void OpflexPEHandler::connected() {
         new SendIdentityReq(pool.getName(),
                             pool.getDomain(),
                             pool.getLocation(),
-                            OFConstants::POLICY_ELEMENT);
+                            OFConstants::POLICY_ELEMENT,
+                            pool.getCompressionLevel().is_initialized());
     getConnection()->sendMessage(req, true);
 }
 
@@ -123,7 +136,9 @@ void OpflexPEHandler::disconnected() {
     setState(DISCONNECTED);
     OpflexPool& pool = getProcessor()->getPool();
     OpflexClientConnection* conn = (OpflexClientConnection*)getConnection();
-    pool.setRoles(conn, 0);
+    uint8_t lostRoles = pool.setRoles(conn, 0);
+    if (lostRoles)
+        getProcessor()->primaryLost(lostRoles);
 }
 
 void OpflexPEHandler::ready() {
@@ -144,6 +159,28 @@ void OpflexPEHandler::handleSendIdentityRes(uint64_t reqId,
 
     OpflexPool::peer_name_set_t peer_set;
 
+    // The server compresses everything it sends after this response.
+    // It reads what we send as plain text until our first compressed
+    // frame, so anything already sent is unaffected.
+    optional<int> compressionLevel = pool.getCompressionLevel();
+    if (compressionLevel && payload.HasMember("compression")) {
+        const Value& compression = payload["compression"];
+        if (compression.IsString() &&
+            string("deflate") == compression.GetString()) {
+            yajr::Peer* peer = conn->getPeer();
+            if (!yajr::transport::Deflate::
+                startCompressing(peer, compressionLevel.get()) ||
+                !yajr::transport::Deflate::startDecompressing(peer)) {
+                LOG(ERROR) << "[" << getConnection()->getRemotePeer() << "] "
+                           << "Could not enable compression";
+                conn->disconnect();
+                return;
+            }
+            LOG(INFO) << "[" << getConnection()->getRemotePeer() << "] "
+                      << "Using deflate compression";
+        }
+    }
+
     if (payload.HasMember("your_location")) {
         const Value& ylocation = payload["your_location"];
         if (ylocation.IsString())
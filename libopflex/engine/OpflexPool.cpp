@@ -32,10 +32,18 @@ using ofcore::OFConstants;
 using ofcore::PeerStatusListener;
 using yajr::transport::ZeroCopyOpenSSL;
 
+static const uint64_t WRITEQ_RETRY_DELAY = 50;
+
 OpflexPool::OpflexPool(HandlerFactory& factory_,
                        util::ThreadManager& threadManager_)
     : factory(factory_), threadManager(threadManager_),
-      active(false), curHealth(PeerStatusListener::DOWN) {
+      active(false), routingMode(OFConstants::ROUTE_ALL),
+      masterGeneration(0),
+      wqHighMessages(OFConstants::DEFAULT_WQ_HIGH_MESSAGES),
+      wqLowMessages(OFConstants::DEFAULT_WQ_LOW_MESSAGES),
+      wqHighBytes(OFConstants::DEFAULT_WQ_HIGH_BYTES),
+      wqLowBytes(OFConstants::DEFAULT_WQ_LOW_BYTES),
+      curHealth(PeerStatusListener::DOWN) {
     uv_mutex_init(&conn_mutex);
     uv_key_create(&conn_mutex_key);
 }
@@ -109,19 +117,36 @@ void OpflexPool::on_cleanup_async(uv_async_t* handle) {
             return;
     }
 
+    uv_timer_stop(&pool->writeq_timer);
+    uv_close((uv_handle_t*)&pool->writeq_timer, NULL);
     uv_close((uv_handle_t*)&pool->writeq_async, NULL);
     uv_close((uv_handle_t*)&pool->conn_async, NULL);
     uv_close((uv_handle_t*)handle, NULL);
     yajr::finiLoop(pool->client_loop);
 }
 
+void OpflexPool::processWriteQueues() {
+    util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+    bool pending = false;
+    BOOST_FOREACH(conn_map_t::value_type& v, connections) {
+        if (v.second.conn->processWriteQueue())
+            pending = true;
+    }
+    // Some peers are not keeping up; try again once they have had a
+    // chance to drain
+    if (pending && active && !uv_is_active((uv_handle_t*)&writeq_timer))
+        uv_timer_start(&writeq_timer, on_writeq_timer,
+                       WRITEQ_RETRY_DELAY, 0);
+}
+
 void OpflexPool::on_writeq_async(uv_async_t* handle) {
     OpflexPool* pool = (OpflexPool*)handle->data;
-    util::RecursiveLockGuard guard(&pool->conn_mutex,
-                                   &pool->conn_mutex_key);
-    BOOST_FOREACH(conn_map_t::value_type& v, pool->connections) {
-        v.second.conn->processWriteQueue();
-    }
+    pool->processWriteQueues();
+}
+
+void OpflexPool::on_writeq_timer(uv_timer_t* handle) {
+    OpflexPool* pool = (OpflexPool*)handle->data;
+    pool->processWriteQueues();
 }
 
 void OpflexPool::start() {
@@ -134,9 +159,11 @@ void OpflexPool::start() {
     conn_async.data = this;
     cleanup_async.data = this;
     writeq_async.data = this;
+    writeq_timer.data = this;
     uv_async_init(client_loop, &conn_async, on_conn_async);
     uv_async_init(client_loop, &cleanup_async, on_cleanup_async);
     uv_async_init(client_loop, &writeq_async, on_writeq_async);
+    uv_timer_init(client_loop, &writeq_timer);
 
     threadManager.startTask("connection_pool");
 }
@@ -244,6 +271,8 @@ void OpflexPool::doAddPeer(const std::string& hostname, int port) {
 
         OpflexClientConnection* conn =
             new OpflexClientConnection(factory, this, hostname, port);
+        conn->setWriteQueueLimits(wqHighMessages, wqLowMessages,
+                                  wqHighBytes, wqLowBytes);
         cd.conn = conn;
     }
 }
@@ -256,6 +285,8 @@ void OpflexPool::addPeer(OpflexClientConnection* conn) {
                    << conn->getHostname() << ":" << conn->getPort()
                    << " already exists";
     }
+    conn->setWriteQueueLimits(wqHighMessages, wqLowMessages,
+                              wqHighBytes, wqLowBytes);
     cd.conn = conn;
 }
 
@@ -269,16 +300,20 @@ void OpflexPool::doRemovePeer(const std::string& hostname, int port) {
     }
 }
 
-// must be called with conn_mutex held
-void OpflexPool::updateRole(ConnData& cd,
+// must be called with conn_mutex held.  Returns true if the
+// connection was the master for the role and has been removed from it
+bool OpflexPool::updateRole(ConnData& cd,
                             uint8_t newroles,
                             OFConstants::OpflexRole role) {
+    bool lostMaster = false;
     if (cd.roles & role) {
         if (!(newroles & role)) {
             role_map_t::iterator it = roles.find(role);
             if (it != roles.end()) {
-                if (it->second.curMaster == cd.conn)
+                if (it->second.curMaster == cd.conn) {
                     it->second.curMaster = NULL;
+                    lostMaster = true;
+                }
                 it->second.conns.erase(cd.conn);
                 if (it->second.conns.size() == 0)
                     roles.erase(it);
@@ -292,6 +327,7 @@ void OpflexPool::updateRole(ConnData& cd,
             cd.roles |= role;
         }
     }
+    return lostMaster;
 }
 
 int OpflexPool::getRoleCount(ofcore::OFConstants::OpflexRole role) {
@@ -303,20 +339,97 @@ int OpflexPool::getRoleCount(ofcore::OFConstants::OpflexRole role) {
 }
 
 
-void OpflexPool::setRoles(OpflexClientConnection* conn,
-                          uint8_t newroles) {
+void OpflexPool::setRoleRoutingMode(OFConstants::RoleRoutingMode mode) {
+    util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+    routingMode = mode;
+}
+
+OFConstants::RoleRoutingMode OpflexPool::getRoleRoutingMode() {
+    util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+    return routingMode;
+}
+
+void OpflexPool::enableCompression(int level) {
+    util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+    compressionLevel = level;
+}
+
+boost::optional<int> OpflexPool::getCompressionLevel() {
+    util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+    return compressionLevel;
+}
+
+uint8_t OpflexPool::setRoles(OpflexClientConnection* conn,
+                             uint8_t newroles) {
     util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
     ConnData& cd = connections.at(make_pair(conn->getHostname(),
                                             conn->getPort()));
-    doSetRoles(cd, newroles);
+    uint8_t lost = doSetRoles(cd, newroles);
+    if (routingMode != OFConstants::ROUTE_PRIMARY)
+        return 0;
+    return lost;
 }
 
 // must be called with conn_mutex held
-void OpflexPool::doSetRoles(ConnData& cd, uint8_t newroles) {
-    updateRole(cd, newroles, OFConstants::POLICY_ELEMENT);
-    updateRole(cd, newroles, OFConstants::POLICY_REPOSITORY);
-    updateRole(cd, newroles, OFConstants::ENDPOINT_REGISTRY);
-    updateRole(cd, newroles, OFConstants::OBSERVER);
+uint8_t OpflexPool::doSetRoles(ConnData& cd, uint8_t newroles) {
+    uint8_t lost = 0;
+    if (updateRole(cd, newroles, OFConstants::POLICY_ELEMENT))
+        lost |= OFConstants::POLICY_ELEMENT;
+    if (updateRole(cd, newroles, OFConstants::POLICY_REPOSITORY))
+        lost |= OFConstants::POLICY_REPOSITORY;
+    if (updateRole(cd, newroles, OFConstants::ENDPOINT_REGISTRY))
+        lost |= OFConstants::ENDPOINT_REGISTRY;
+    if (updateRole(cd, newroles, OFConstants::OBSERVER))
+        lost |= OFConstants::OBSERVER;
+    return lost;
+}
+
+void OpflexPool::setWriteQueueLimits(size_t highMessages,
+                                     size_t lowMessages,
+                                     size_t highBytes,
+                                     size_t lowBytes) {
+    util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+    wqHighMessages = highMessages;
+    wqLowMessages = lowMessages;
+    wqHighBytes = highBytes;
+    wqLowBytes = lowBytes;
+    BOOST_FOREACH(conn_map_t::value_type& v, connections) {
+        v.second.conn->setWriteQueueLimits(highMessages, lowMessages,
+                                           highBytes, lowBytes);
+    }
+}
+
+bool OpflexPool::isRoleBlocked(OFConstants::OpflexRole role,
+                               OpflexMessage::MessagePriority priority) {
+    util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+    if (routingMode == OFConstants::ROUTE_PRIMARY) {
+        OpflexClientConnection* master = getMasterForRole(role);
+        return master != NULL && master->isBlocked(priority);
+    }
+
+    role_map_t::iterator it = roles.find(role);
+    if (it == roles.end())
+        return false;
+    BOOST_FOREACH(OpflexClientConnection* conn, it->second.conns) {
+        if (conn->isReady() && conn->isBlocked(priority))
+            return true;
+    }
+    return false;
+}
+
+void OpflexPool::getRoleQueueDepth(OFConstants::OpflexRole role,
+                                   size_t& messages, size_t& bytes) {
+    util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+    messages = 0;
+    bytes = 0;
+    role_map_t::iterator it = roles.find(role);
+    if (it == roles.end())
+        return;
+    BOOST_FOREACH(OpflexClientConnection* conn, it->second.conns) {
+        if (!conn->isReady()) continue;
+        messages += conn->getQueuedMessages();
+        bytes += conn->getQueuedBytes();
+    }
 }
 
 OpflexClientConnection*
@@ -330,13 +443,24 @@ OpflexPool::getMasterForRole(OFConstants::OpflexRole role) {
         return it->second.curMaster;
     BOOST_FOREACH(OpflexClientConnection* conn, it->second.conns) {
         if (conn->isReady()) {
-            it->second.curMaster = conn;
+            if (it->second.curMaster != conn) {
+                it->second.curMaster = conn;
+                it->second.masterGen = ++masterGeneration;
+            }
             return conn;
         }
     }
     return NULL;
 }
 
+uint64_t OpflexPool::getMasterGeneration(OFConstants::OpflexRole role) {
+    util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+
+    if (getMasterForRole(role) == NULL)
+        return 0;
+    return roles[role].masterGen;
+}
+
 void OpflexPool::connectionClosed(OpflexClientConnection* conn) {
     util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
 
@@ -358,7 +482,8 @@ void OpflexPool::messagesReady() {
 
 size_t OpflexPool::sendToRole(OpflexMessage* message,
                            OFConstants::OpflexRole role,
-                           bool sync) {
+                           bool sync,
+                           OpflexClientConnection* target) {
 #ifdef HAVE_CXX11
     std::unique_ptr<OpflexMessage> messagep(message);
 #else
@@ -369,6 +494,27 @@ size_t OpflexPool::sendToRole(OpflexMessage* message,
     std::vector<OpflexClientConnection*> conns;
 
     util::RecursiveLockGuard guard(&conn_mutex, &conn_mutex_key);
+    if (target != NULL) {
+        // the target may have closed since it was named, so only
+        // dereference it if it still holds the role
+        role_map_t::iterator it = roles.find(role);
+        if (it == roles.end() ||
+            it->second.conns.find(target) == it->second.conns.end() ||
+            !target->isReady())
+            return 0;
+        messagep.release();
+        target->sendMessage(message, sync);
+        return 1;
+    }
+    if (routingMode == OFConstants::ROUTE_PRIMARY) {
+        OpflexClientConnection* master = getMasterForRole(role);
+        if (master == NULL)
+            return 0;
+        messagep.release();
+        master->sendMessage(message, sync);
+        return 1;
+    }
+
     role_map_t::iterator it = roles.find(role);
     if (it == roles.end())
         return 0;
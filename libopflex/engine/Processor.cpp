@@ -59,15 +59,17 @@ Processor::Processor(ObjectStore* store_, ThreadManager& threadManager_)
     : AbstractObjectListener(store_),
       serializer(store_, this),
       threadManager(threadManager_),
-      pool(*this, threadManager_), nextXid(FIRST_XID),
+      pool(*this, threadManager_), nextXid(FIRST_XID), heldBack(0),
       processingDelay(DEFAULT_PROC_DELAY),
       retryDelay(DEFAULT_RETRY_DELAY),
       proc_active(false) {
     uv_mutex_init(&item_mutex);
+    uv_mutex_init(&failover_mutex);
 }
 
 Processor::~Processor() {
     stop();
+    uv_mutex_destroy(&failover_mutex);
     uv_mutex_destroy(&item_mutex);
 }
 
@@ -177,6 +179,11 @@ bool Processor::isObjNew(const URI& uri) {
     return true;
 }
 
+size_t Processor::getHeldBackCount() {
+    util::LockGuard guard(&item_mutex);
+    return heldBack;
+}
+
 // check if the object has a zero refcount and it has no remote
 // ancestor that has a zero refcount.
 bool Processor::isOrphan(const item& item) {
@@ -225,11 +232,59 @@ bool Processor::isParentSyncObject(const item& item) {
     return true;
 }
 
+// get the role that handles requests for objects of the given type
+static uint8_t getRoleForType(ClassInfo::class_type_t type) {
+    switch (type) {
+    case ClassInfo::POLICY:
+        return OFConstants::POLICY_REPOSITORY;
+    case ClassInfo::REMOTE_ENDPOINT:
+    case ClassInfo::LOCAL_ENDPOINT:
+        return OFConstants::ENDPOINT_REGISTRY;
+    case ClassInfo::OBSERVABLE:
+        return OFConstants::OBSERVER;
+    default:
+        return 0;
+    }
+}
+
+// check whether new requests for objects of the given type must be
+// held back until the write queues for the role drain
+bool Processor::isBlocked(ClassInfo::class_type_t type) {
+    uint8_t role = getRoleForType(type);
+    if (role == 0) return false;
+    // state reports are queued behind everything else, so only they
+    // are held back by a telemetry backlog
+    OpflexMessage::MessagePriority priority =
+        type == ClassInfo::OBSERVABLE
+        ? OpflexMessage::PRIORITY_TELEMETRY
+        : OpflexMessage::PRIORITY_CONTROL;
+    if (!pool.isRoleBlocked((OFConstants::OpflexRole)role, priority))
+        return false;
+    heldBack += 1;
+    return true;
+}
+
+// reschedule an item whose requests were held back by a blocked role
+void Processor::deferItem(const item& i) {
+    // force a fresh resolve once the item is processed again
+    i.details->resolve_time = 0;
+    obj_state_by_uri& uri_index = obj_state.get<uri_tag>();
+    obj_state_by_uri::iterator uit = uri_index.find(i.uri);
+    if (uit != uri_index.end())
+        uri_index.modify(uit,
+                         change_expiration(now(proc_loop) + processingDelay));
+}
+
 void Processor::sendToRole(const item& i, uint64_t& newexp,
                            OpflexMessage* req,
-                           ofcore::OFConstants::OpflexRole role) {
+                           ofcore::OFConstants::OpflexRole role,
+                           OpflexClientConnection* target) {
     uint64_t xid = req->getReqXid();
-    size_t pending = pool.sendToRole(req, role);
+    size_t pending = pool.sendToRole(req, role, false, target);
+    // a replay to a single peer that does not hold the role leaves
+    // the requests already sent to the other peers alone
+    if (target != NULL && pending == 0)
+        return;
     i.details->pending_reqs = pending;
 
     obj_state_by_uri& uri_index = obj_state.get<uri_tag>();
@@ -241,7 +296,8 @@ void Processor::sendToRole(const item& i, uint64_t& newexp,
 }
 
 bool Processor::resolveObj(ClassInfo::class_type_t type, const item& i,
-                           uint64_t& newexp, bool checkTime) {
+                           uint64_t& newexp, bool checkTime,
+                           OpflexClientConnection* target) {
     uint64_t curTime = now(proc_loop);
     bool shouldRefresh =
         (i.details->resolve_time == 0) ||
@@ -253,6 +309,13 @@ bool Processor::resolveObj(ClassInfo::class_type_t type, const item& i,
     if (checkTime && !shouldRefresh && !shouldRetry)
         return false;
 
+    if ((type == ClassInfo::POLICY || type == ClassInfo::REMOTE_ENDPOINT) &&
+        isBlocked(type)) {
+        // try again once the write queue drains
+        newexp = curTime + processingDelay;
+        return false;
+    }
+
     switch (type) {
     case ClassInfo::POLICY:
         {
@@ -262,7 +325,8 @@ bool Processor::resolveObj(ClassInfo::class_type_t type, const item& i,
             refs.push_back(make_pair(i.details->class_id, i.uri));
             PolicyResolveReq* req =
                 new PolicyResolveReq(this, nextXid++, refs);
-            sendToRole(i, newexp, req, OFConstants::POLICY_REPOSITORY);
+            sendToRole(i, newexp, req, OFConstants::POLICY_REPOSITORY,
+                       target);
             return true;
         }
         break;
@@ -274,7 +338,8 @@ bool Processor::resolveObj(ClassInfo::class_type_t type, const item& i,
             refs.push_back(make_pair(i.details->class_id, i.uri));
             EndpointResolveReq* req =
                 new EndpointResolveReq(this, nextXid++, refs);
-            sendToRole(i, newexp, req, OFConstants::ENDPOINT_REGISTRY);
+            sendToRole(i, newexp, req, OFConstants::ENDPOINT_REGISTRY,
+                       target);
             return true;
         }
         break;
@@ -286,8 +351,15 @@ bool Processor::resolveObj(ClassInfo::class_type_t type, const item& i,
 }
 
 bool Processor::declareObj(ClassInfo::class_type_t type, const item& i,
-                           uint64_t& newexp) {
+                           uint64_t& newexp,
+                           OpflexClientConnection* target) {
     uint64_t curTime = now(proc_loop);
+    if ((type == ClassInfo::LOCAL_ENDPOINT || type == ClassInfo::OBSERVABLE) &&
+        isBlocked(type)) {
+        // try again once the write queue drains
+        newexp = curTime + processingDelay;
+        return true;
+    }
     switch (type) {
     case ClassInfo::LOCAL_ENDPOINT:
         if (isParentSyncObject(i)) {
@@ -297,7 +369,8 @@ bool Processor::declareObj(ClassInfo::class_type_t type, const item& i,
             refs.push_back(make_pair(i.details->class_id, i.uri));
             EndpointDeclareReq* req =
                 new EndpointDeclareReq(this, nextXid++, refs);
-            sendToRole(i, newexp, req, OFConstants::ENDPOINT_REGISTRY);
+            sendToRole(i, newexp, req, OFConstants::ENDPOINT_REGISTRY,
+                       target);
         }
         return true;
         break;
@@ -308,7 +381,8 @@ bool Processor::declareObj(ClassInfo::class_type_t type, const item& i,
             vector<reference_t> refs;
             refs.push_back(make_pair(i.details->class_id, i.uri));
             StateReportReq* req = new StateReportReq(this, nextXid++, refs);
-            sendToRole(i, newexp, req, OFConstants::OBSERVER);
+            sendToRole(i, newexp, req, OFConstants::OBSERVER,
+                       target);
         }
         return true;
         break;
@@ -533,6 +607,11 @@ void Processor::connect_async_cb(uv_async_t* handle) {
     processor->handleNewConnections();
 }
 
+void Processor::failover_async_cb(uv_async_t* handle) {
+    Processor* processor = (Processor*)handle->data;
+    processor->handleFailover();
+}
+
 static void register_listeners(void* processor, const modb::ClassInfo& ci) {
     Processor* p = (Processor*)processor;
     p->listen(ci.getId());
@@ -540,6 +619,7 @@ static void register_listeners(void* processor, const modb::ClassInfo& ci) {
 
 void Processor::timer_callback(uv_timer_t* handle) {
     Processor* processor = (Processor*)handle->data;
+    processor->handleFailover();
     processor->doProcess();
 }
 
@@ -549,6 +629,7 @@ void Processor::cleanup_async_cb(uv_async_t* handle) {
     uv_close((uv_handle_t*)&processor->proc_timer, NULL);
     uv_close((uv_handle_t*)&processor->proc_async, NULL);
     uv_close((uv_handle_t*)&processor->connect_async, NULL);
+    uv_close((uv_handle_t*)&processor->failover_async, NULL);
     uv_close((uv_handle_t*)handle, NULL);
 }
 
@@ -569,6 +650,8 @@ void Processor::start() {
     uv_async_init(proc_loop, &proc_async, proc_async_cb);
     connect_async.data = this;
     uv_async_init(proc_loop, &connect_async, connect_async_cb);
+    failover_async.data = this;
+    uv_async_init(proc_loop, &failover_async, failover_async_cb);
     proc_timer.data = this;
     uv_timer_start(&proc_timer, &timer_callback,
                    processingDelay, processingDelay);
@@ -661,6 +744,27 @@ void Processor::enableSSL(const std::string& caStorePath,
                    verifyPeers);
 }
 
+void Processor::setRoleRoutingMode(OFConstants::RoleRoutingMode mode) {
+    pool.setRoleRoutingMode(mode);
+}
+
+void Processor::enableCompression(int level) {
+    pool.enableCompression(level);
+}
+
+void Processor::setWriteQueueLimits(size_t highMessages, size_t lowMessages,
+                                    size_t highBytes, size_t lowBytes) {
+    pool.setWriteQueueLimits(highMessages, lowMessages,
+                             highBytes, lowBytes);
+}
+
+void Processor::getWriteQueueStats(OFConstants::OpflexRole role,
+                                   size_t& messages, size_t& bytes,
+                                   bool& blocked) {
+    pool.getRoleQueueDepth(role, messages, bytes);
+    blocked = pool.isRoleBlocked(role);
+}
+
 void Processor::addPeer(const std::string& hostname,
                         int port) {
     pool.addPeer(hostname, port);
@@ -675,24 +779,104 @@ OpflexHandler* Processor::newHandler(OpflexConnection* conn) {
     return new OpflexPEHandler(conn, this);
 }
 
-void Processor::handleNewConnections() {
+void Processor::replayRoles(uint8_t roles, OpflexClientConnection* target) {
     util::LockGuard guard(&item_mutex);
+    size_t replayed = 0;
     BOOST_FOREACH(const item& i, obj_state) {
-        uint64_t newexp = 0;
         const ClassInfo& ci = store->getClassInfo(i.details->class_id);
+        if (!(getRoleForType(ci.getType()) & roles)) continue;
+        if ((i.details->state == IN_SYNC || i.details->state == RESOLVED) &&
+            isBlocked(ci.getType())) {
+            deferItem(i);
+            continue;
+        }
+
+        uint64_t newexp = 0;
         if (i.details->state == IN_SYNC) {
-            declareObj(ci.getType(), i, newexp);
+            declareObj(ci.getType(), i, newexp, target);
+            replayed += 1;
+        } else if (i.details->state == RESOLVED) {
+            resolveObj(ci.getType(), i, newexp, false, target);
+            replayed += 1;
         }
-        if (i.details->state == RESOLVED) {
-            resolveObj(ci.getType(), i, newexp, false);
+    }
+    LOG(DEBUG) << "Replayed " << replayed << " requests";
+}
+
+uint8_t Processor::checkMasterChanges() {
+    if (pool.getRoleRoutingMode() != OFConstants::ROUTE_PRIMARY)
+        return 0;
+
+    static const OFConstants::OpflexRole ROLES[] =
+        {OFConstants::POLICY_REPOSITORY,
+         OFConstants::ENDPOINT_REGISTRY,
+         OFConstants::OBSERVER};
+    uint8_t changed = 0;
+    BOOST_FOREACH(OFConstants::OpflexRole role, ROLES) {
+        uint64_t gen = pool.getMasterGeneration(role);
+        if (gen == 0) continue;
+        uint64_t& replayedGen = replayedMasterGen[role];
+        if (replayedGen != gen) {
+            replayedGen = gen;
+            changed |= role;
         }
     }
+    return changed;
+}
+
+void Processor::handleNewConnections() {
+    std::vector<OpflexClientConnection*> conns;
+    {
+        util::LockGuard guard(&failover_mutex);
+        conns.swap(newConns);
+    }
+
+    if (pool.getRoleRoutingMode() == OFConstants::ROUTE_PRIMARY) {
+        // A new peer only needs the requests if it became the
+        // primary for a role
+        handleFailover();
+        return;
+    }
+
+    // Every other peer has already seen the requests, so only the
+    // new peers get them
+    BOOST_FOREACH(OpflexClientConnection* conn, conns) {
+        replayRoles(OFConstants::POLICY_REPOSITORY |
+                    OFConstants::ENDPOINT_REGISTRY |
+                    OFConstants::OBSERVER, conn);
+    }
+}
+
+void Processor::handleFailover() {
+    // The old primary held all the resolutions and declarations for
+    // the role, including any requests still in flight, so these must
+    // all be replayed to the new primary.  The primary can also
+    // change without the old one being lost, so the check is made
+    // against the primary the requests were last replayed to rather
+    // than against the roles reported lost.
+    uint8_t roles = checkMasterChanges();
+    if (roles == 0) return;
+
+    LOG(DEBUG) << "Primary changed for roles " << (int)roles;
+    replayRoles(roles, NULL);
 }
 
 void Processor::connectionReady(OpflexConnection* conn) {
+    {
+        util::LockGuard guard(&failover_mutex);
+        newConns.push_back(static_cast<OpflexClientConnection*>(conn));
+    }
     uv_async_send(&connect_async);
 }
 
+void Processor::primaryLost(uint8_t roles) {
+    // This is called from the connection pool thread, possibly with
+    // the pool lock held, so we can't take the item lock here
+    if (!proc_active) return;
+    LOG(DEBUG) << "Primary lost for roles " << (int)roles;
+    uv_async_send(&failover_async);
+}
+
 void Processor::responseReceived(uint64_t reqId) {
     util::LockGuard guard(&item_mutex);
     obj_state_by_xid& xid_index = obj_state.get<xid_tag>();
@@ -16,6 +16,7 @@
 #define OPFLEX_ENGINE_PROCESSOR_H
 
 #include <vector>
+#include <map>
 #include <utility>
 
 #include <boost/multi_index_container.hpp>
@@ -115,6 +116,50 @@ public:
                    const std::string& passphrase,
                    bool verifyPeers = true);
 
+    /**
+     * Set the mode used to route requests to the peers that share
+     * an OpFlex role.
+     *
+     * @param mode the routing mode to use
+     * @see opflex::ofcore::OFFramework::setRoleRoutingMode
+     */
+    void setRoleRoutingMode(ofcore::OFConstants::RoleRoutingMode mode);
+
+    /**
+     * Offer deflate compression to opflex peers
+     *
+     * @param level the zlib compression level
+     * @see opflex::ofcore::OFFramework::enableCompression
+     */
+    void enableCompression(int level = -1);
+
+    /**
+     * Set the write queue watermarks for connections to opflex
+     * peers.  While a connection is over its high watermark, no new
+     * resolves or declarations are generated for its roles.
+     *
+     * @param highMessages the high watermark in messages
+     * @param lowMessages the low watermark in messages
+     * @param highBytes the high watermark in bytes
+     * @param lowBytes the low watermark in bytes
+     * @see opflex::ofcore::OFFramework::setWriteQueueLimits
+     */
+    void setWriteQueueLimits(size_t highMessages, size_t lowMessages,
+                             size_t highBytes, size_t lowBytes);
+
+    /**
+     * Get the current state of the write queues for a role
+     *
+     * @param role the role to check
+     * @param messages set to the number of queued messages
+     * @param bytes set to the number of queued bytes
+     * @param blocked set to true if the role is blocked
+     * @see opflex::ofcore::OFFramework::getWriteQueueStats
+     */
+    void getWriteQueueStats(ofcore::OFConstants::OpflexRole role,
+                            size_t& messages, size_t& bytes,
+                            bool& blocked);
+
     /**
      * Add an OpFlex peer.
      *
@@ -178,6 +223,12 @@ public:
      */
     bool isObjNew(const modb::URI& uri);
 
+    /**
+     * Get the number of times a request was held back because the
+     * write queues for its role were over their high watermark
+     */
+    size_t getHeldBackCount();
+
     /**
      * Set the processing delay for unit tests
      */
@@ -199,7 +250,9 @@ public:
 
     /**
      * A new client connection is ready and the resolver state must be
-     * synchronized to the server.
+     * synchronized to the server.  The state is replayed only to the
+     * new connection, or in ROUTE_PRIMARY mode only if the new
+     * connection has become the primary for a role.
      * @param conn the new connection object
      */
     void connectionReady(internal::OpflexConnection* conn);
@@ -212,6 +265,18 @@ public:
      */
     void responseReceived(uint64_t reqId);
 
+    /**
+     * The primary connection for one or more roles has been lost.
+     * The resolutions and declarations for those roles, including
+     * any requests still in flight to the lost primary, will be
+     * replayed to the new primary for the role.  The same replay
+     * happens whenever the primary for a role changes, which is also
+     * checked periodically.
+     *
+     * @param roles a bitmask of the roles whose primary was lost
+     */
+    void primaryLost(uint8_t roles);
+
 private:
     /**
      * The system store client
@@ -426,6 +491,11 @@ private:
     object_state_t obj_state;
     uv_mutex_t item_mutex;
 
+    /**
+     * Requests held back by a blocked role.  Protected by item_mutex.
+     */
+    size_t heldBack;
+
     /**
      * Processing delay to allow batching updates
      */
@@ -444,12 +514,28 @@ private:
     uv_async_t cleanup_async;
     uv_async_t proc_async;
     uv_async_t connect_async;
+    uv_async_t failover_async;
     uv_timer_t proc_timer;
 
+    /**
+     * Connections that became ready and have not yet had the requests
+     * replayed to them.  Protected by failover_mutex.
+     */
+    std::vector<internal::OpflexClientConnection*> newConns;
+    uv_mutex_t failover_mutex;
+
+    /**
+     * The generation of the primary for each role to which the
+     * requests for the role were last replayed.  Only accessed from
+     * the processor thread.
+     */
+    std::map<uint8_t, uint64_t> replayedMasterGen;
+
     static void timer_callback(uv_timer_t* handle);
     static void cleanup_async_cb(uv_async_t *handle);
     static void proc_async_cb(uv_async_t *handle);
     static void connect_async_cb(uv_async_t *handle);
+    static void failover_async_cb(uv_async_t *handle);
 
     bool hasWork(/* out */ obj_state_by_exp::iterator& it);
     void addRef(obj_state_by_exp::iterator& it,
@@ -463,14 +549,23 @@ private:
     void doObjectUpdated(modb::class_id_t class_id,
                          const modb::URI& uri,
                          bool remote);
+    bool isBlocked(modb::ClassInfo::class_type_t type);
+    void deferItem(const item& it);
     void sendToRole(const item& it, uint64_t& newexp,
                     internal::OpflexMessage* req,
-                    ofcore::OFConstants::OpflexRole role);
+                    ofcore::OFConstants::OpflexRole role,
+                    internal::OpflexClientConnection* target = NULL);
     bool resolveObj(modb::ClassInfo::class_type_t type, const item& it,
-                    uint64_t& newexp, bool checkTime = true);
+                    uint64_t& newexp, bool checkTime = true,
+                    internal::OpflexClientConnection* target = NULL);
     bool declareObj(modb::ClassInfo::class_type_t type, const item& it,
-                    uint64_t& newexp);
+                    uint64_t& newexp,
+                    internal::OpflexClientConnection* target = NULL);
+    void replayRoles(uint8_t roles,
+                     internal::OpflexClientConnection* target);
+    uint8_t checkMasterChanges();
     void handleNewConnections();
+    void handleFailover();
     void clearTombstone(obj_state_by_uri& uri_index,
                         obj_state_by_uri::iterator& uit,
                         bool* remote = NULL);
@@ -61,6 +61,19 @@ public:
                    const std::string& serverKeyPass,
                    bool verifyPeers);
 
+    /**
+     * Accept deflate compression when clients offer it.  Call before
+     * start()
+     */
+    void enableCompression() { compression = true; }
+
+    /**
+     * Check whether the server accepts deflate compression
+     *
+     * @return true if compression is accepted
+     */
+    bool isCompressionEnabled() { return compression; }
+
     /**
      * Start the server
      */
@@ -138,6 +151,7 @@ public:
 private:
     int port;
     uint8_t roles;
+    bool compression;
 
     test::MockOpflexServer::peer_vec_t peers;
 
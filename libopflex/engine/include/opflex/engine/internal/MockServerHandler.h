@@ -39,7 +39,8 @@ public:
      * connection
      */
     MockServerHandler(OpflexConnection* conn, MockOpflexServerImpl* server_)
-        : OpflexHandler(conn), server(server_), flakyMode(false) {}
+        : OpflexHandler(conn), server(server_), flakyMode(false),
+          stallMode(false), resolveReqs(0) {}
 
     /**
      * Destroy the handler
@@ -56,6 +57,11 @@ public:
      */
     bool hasResolutions() { return resolutions.size() > 0; }
 
+    /**
+     * Get the number of policy resolve requests received
+     */
+    size_t getResolveReqs() { return resolveReqs; }
+
     /**
      * Enable or disable flaky mode.  When enabled, drop the first
      * attempt to resolve anything.
@@ -64,6 +70,13 @@ public:
      */
     void setFlaky(bool flakyMode) { this->flakyMode = flakyMode; }
 
+    /**
+     * Enable stall mode.  When enabled, the server stops reading from
+     * the connection after handling the next request, simulating a
+     * peer that has stopped responding.
+     */
+    void setStalled() { stallMode = true; }
+
     // *************
     // OpflexHandler
     // *************
@@ -95,6 +108,10 @@ protected:
     OF_UNORDERED_SET<modb::reference_t> resolutions;
     OF_UNORDERED_SET<modb::reference_t> declarations;
     bool flakyMode;
+    bool stallMode;
+    size_t resolveReqs;
+
+    void checkStall();
 };
 
 } /* namespace internal */
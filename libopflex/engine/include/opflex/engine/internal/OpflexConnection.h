@@ -23,6 +23,7 @@
 #include <uv.h>
 
 #include "yajr/yajr.hpp"
+#include "opflex/engine/internal/OpflexMessage.h"
 
 #pragma once
 #ifndef OPFLEX_ENGINE_OPFLEXCONNECTION_H
@@ -35,7 +36,6 @@ namespace internal {
 class OpflexPool;
 class OpflexHandler;
 class HandlerFactory;
-class OpflexMessage;
 
 /**
  * Maintain the connection state information for a connection to an
@@ -128,9 +128,77 @@ public:
 
     /**
      * Process the write queue for the connection from within the
-     * libuv loop thread
+     * libuv loop thread.  Messages are only handed to the peer while
+     * the bytes it has buffered are below the high watermark.
+     * Higher priority classes are written first, but a waiting lower
+     * priority class is served after it has been passed over
+     * STARVATION_LIMIT times.
+     *
+     * @return true if the write queue must be processed again later,
+     * because messages remain in it while the peer is not accepting
+     * more data or because the connection is still blocked
+     */
+    bool processWriteQueue();
+
+    /**
+     * Set the high and low watermarks for the write queue.  Once
+     * either the number of queued messages or the number of bytes
+     * buffered for the peer reaches its high watermark, the
+     * connection is blocked until both fall back to their low
+     * watermarks.  A high watermark of zero disables that limit.
+     *
+     * @param highMessages the high watermark in messages
+     * @param lowMessages the low watermark in messages
+     * @param highBytes the high watermark in bytes
+     * @param lowBytes the low watermark in bytes
      */
-    void processWriteQueue();
+    void setWriteQueueLimits(size_t highMessages, size_t lowMessages,
+                             size_t highBytes, size_t lowBytes);
+
+    /**
+     * Check whether the write queue is over its high watermark and
+     * has not yet drained to its low watermark.  Callers should avoid
+     * generating new messages for a blocked connection.  Only
+     * messages of the given or a higher priority count against the
+     * message watermarks, so a backlog of telemetry does not block
+     * control messages.
+     *
+     * @param priority the priority class of the messages to be sent
+     * @return true if the connection is blocked for the priority
+     */
+    bool isBlocked(OpflexMessage::MessagePriority priority =
+                   OpflexMessage::PRIORITY_TELEMETRY);
+
+    /**
+     * Get the number of messages waiting in the write queue
+     *
+     * @return the write queue depth in messages
+     */
+    size_t getQueuedMessages();
+
+    /**
+     * Get the number of messages of the given priority class waiting
+     * in the write queue
+     *
+     * @param priority the priority class
+     * @return the write queue depth in messages for the class
+     */
+    size_t getQueuedMessages(OpflexMessage::MessagePriority priority);
+
+    /**
+     * The number of messages that may be written ahead of a waiting
+     * lower priority message before that message is written
+     */
+    static const size_t STARVATION_LIMIT = 64;
+
+    /**
+     * Get the number of serialized bytes buffered for the peer that
+     * have not yet been written to the socket, as of the last time
+     * the write queue was processed
+     *
+     * @return the number of buffered bytes
+     */
+    size_t getQueuedBytes();
 
 protected:
     /**
@@ -155,16 +223,34 @@ protected:
      */
     virtual void cleanup();
 
+    /**
+     * Serialize the message and hand it to the peer.  Called with the
+     * write queue lock held.
+     *
+     * @param message the message to write
+     */
+    virtual void doWrite(OpflexMessage* message);
+
 private:
     uint64_t requestId;
 
     uint64_t connGeneration;
     typedef std::pair<OpflexMessage*, uint64_t> write_queue_item_t;
     typedef std::list<write_queue_item_t> write_queue_t;
-    write_queue_t write_queue;
+    write_queue_t write_queue[OpflexMessage::NUM_PRIORITIES];
+    size_t passedOver[OpflexMessage::NUM_PRIORITIES];
     uv_mutex_t queue_mutex;
 
-    void doWrite(OpflexMessage* message);
+    size_t queuedMessages[OpflexMessage::NUM_PRIORITIES];
+    size_t queuedBytes;
+    size_t highMessages;
+    size_t lowMessages;
+    size_t highBytes;
+    size_t lowBytes;
+    bool blocked[OpflexMessage::NUM_PRIORITIES];
+
+    size_t nextQueue();
+    void updateBlocked();
 
     virtual void notifyReady();
 
@@ -47,6 +47,23 @@ public:
         ERROR_RESPONSE
     };
 
+    /**
+     * The priority class of the message.  Messages in a higher
+     * priority class are written to the peer ahead of queued messages
+     * from lower priority classes.
+     */
+    enum MessagePriority {
+        /** Identity, endpoint and policy messages needed to forward
+            traffic */
+        PRIORITY_CONTROL,
+        /** Other requests and responses */
+        PRIORITY_NORMAL,
+        /** Telemetry such as state reports */
+        PRIORITY_TELEMETRY,
+        /** The number of priority classes */
+        NUM_PRIORITIES
+    };
+
     /**
      * Construct a new opflex message
      *
@@ -89,6 +106,13 @@ public:
      */
     virtual uint64_t getReqXid() { return 0; }
 
+    /**
+     * Get the priority class for this message
+     *
+     * @return the priority class used when queuing the message
+     */
+    virtual MessagePriority getPriority() const { return PRIORITY_NORMAL; }
+
     /**
      * Get the ID for this message.  Must only be called on a response
      * or error.
@@ -206,13 +206,48 @@ public:
      */
     void registerPeerStatusListener(ofcore::PeerStatusListener* listener);
 
+    /**
+     * Set the mode used to route messages to the connections in a
+     * role
+     *
+     * @param mode the new routing mode
+     */
+    void setRoleRoutingMode(ofcore::OFConstants::RoleRoutingMode mode);
+
+    /**
+     * Get the mode used to route messages to the connections in a
+     * role
+     *
+     * @return the current routing mode
+     */
+    ofcore::OFConstants::RoleRoutingMode getRoleRoutingMode();
+
+    /**
+     * Offer deflate compression to opflex peers during the handshake
+     *
+     * @param level the zlib compression level, from 1 to 9, or -1
+     * for the zlib default
+     */
+    void enableCompression(int level = -1);
+
+    /**
+     * Get the compression level to offer to opflex peers
+     *
+     * @return the compression level, or boost::none if compression
+     * is not enabled
+     */
+    boost::optional<int> getCompressionLevel();
+
     /**
      * Set the roles for the specified connection
      *
      * @param conn the connection to change the roles for
      * @param roles the new roles bitmask
+     * @return a bitmask of the roles for which the connection was
+     * the primary and that must now fail over to another connection.
+     * This is always zero unless the routing mode is ROUTE_PRIMARY.
      */
-    void setRoles(OpflexClientConnection* conn, uint8_t roles);
+    uint8_t setRoles(OpflexClientConnection* conn, uint8_t roles);
 
     /**
      * Get the primary connection for the given role.  This will be
@@ -224,19 +259,73 @@ public:
      */
     OpflexClientConnection* getMasterForRole(ofcore::OFConstants::OpflexRole role);
 
+    /**
+     * Get the generation of the primary connection for the given
+     * role.  The generation changes each time a different connection
+     * becomes the primary for the role, so that the requests for the
+     * role can be replayed to it.
+     *
+     * @param role the role to check
+     * @return the generation of the current primary, or zero if there
+     * is no ready connection with that role
+     */
+    uint64_t getMasterGeneration(ofcore::OFConstants::OpflexRole role);
+
     /**
      * Send a given message to all the connected and ready peers with
-     * the given role.  This message can be called from any thread.
+     * the given role, or only to the primary for the role if the
+     * routing mode is ROUTE_PRIMARY.  This message can be called from
+     * any thread.
      *
      * @param message the message to write.  The memory will be owned by the pool.
      * @param role the role to which the message should be sent
      * @param sync if true then this is being called from the libuv
      * thread
+     * @param target if not NULL, send the message only to this
+     * connection, provided it is still ready and holds the role
      * @return the number of ready connections to which we sent the message
      */
     size_t sendToRole(OpflexMessage* message,
                       ofcore::OFConstants::OpflexRole role,
-                      bool sync = false);
+                      bool sync = false,
+                      OpflexClientConnection* target = NULL);
+
+    /**
+     * Set the write queue watermarks applied to each connection in
+     * the pool
+     *
+     * @param highMessages the high watermark in messages
+     * @param lowMessages the low watermark in messages
+     * @param highBytes the high watermark in bytes
+     * @param lowBytes the low watermark in bytes
+     * @see OpflexConnection::setWriteQueueLimits
+     */
+    void setWriteQueueLimits(size_t highMessages, size_t lowMessages,
+                             size_t highBytes, size_t lowBytes);
+
+    /**
+     * Check whether new messages for the given role should be held
+     * back because the write queue of a connection that would receive
+     * them is over its high watermark.
+     *
+     * @param role the role to check
+     * @param priority the priority class of the messages
+     * @return true if the role is blocked
+     */
+    bool isRoleBlocked(ofcore::OFConstants::OpflexRole role,
+                       OpflexMessage::MessagePriority priority =
+                       OpflexMessage::PRIORITY_TELEMETRY);
+
+    /**
+     * Get the total write queue depth across the ready connections
+     * in a role
+     *
+     * @param role the role to check
+     * @param messages set to the number of queued messages
+     * @param bytes set to the number of queued bytes
+     */
+    void getRoleQueueDepth(ofcore::OFConstants::OpflexRole role,
+                           size_t& messages, size_t& bytes);
 
     /**
      * Get the number of connections in a particular role
@@ -312,8 +401,11 @@ private:
 
     class RoleData {
     public:
+        RoleData() : curMaster(NULL), masterGen(0) {}
+
         conn_set_t conns;
         OpflexClientConnection* curMaster;
+        uint64_t masterGen;
     };
 
     typedef std::map<uint8_t, RoleData> role_map_t;
@@ -322,19 +414,28 @@ private:
     conn_map_t connections;
     role_map_t roles;
     bool active;
+    ofcore::OFConstants::RoleRoutingMode routingMode;
+    uint64_t masterGeneration;
+    boost::optional<int> compressionLevel;
+
+    size_t wqHighMessages;
+    size_t wqLowMessages;
+    size_t wqHighBytes;
+    size_t wqLowBytes;
 
     uv_loop_t* client_loop;
     uv_async_t conn_async;
     uv_async_t cleanup_async;
     uv_async_t writeq_async;
+    uv_timer_t writeq_timer;
 
     std::list<ofcore::PeerStatusListener*> peerStatusListeners;
     ofcore::PeerStatusListener::Health curHealth;
 
     void doRemovePeer(const std::string& hostname, int port);
     void doAddPeer(const std::string& hostname, int port);
-    void doSetRoles(ConnData& cd, uint8_t newroles);
-    void updateRole(ConnData& cd, uint8_t newroles,
+    uint8_t doSetRoles(ConnData& cd, uint8_t newroles);
+    bool updateRole(ConnData& cd, uint8_t newroles,
                     ofcore::OFConstants::OpflexRole role);
     void connectionClosed(OpflexClientConnection* conn);
     void doConnectionClosed(OpflexClientConnection* conn);
@@ -344,6 +445,8 @@ private:
     static void on_conn_async(uv_async_t *handle);
     static void on_cleanup_async(uv_async_t *handle);
     static void on_writeq_async(uv_async_t *handle);
+    static void on_writeq_timer(uv_timer_t *handle);
+    void processWriteQueues();
 
     void updatePeerStatus(const std::string& hostname, int port,
                           ofcore::PeerStatusListener::PeerStatus status);
@@ -42,6 +42,7 @@ public:
           processor(processor_), xid(xid_) {}
     virtual ~ProcessorMessage() {};
     virtual uint64_t getReqXid() { return xid; }
+    virtual MessagePriority getPriority() const { return PRIORITY_CONTROL; }
 
 protected:
     /**
@@ -449,6 +450,8 @@ public:
         return new StateReportReq(*this);
     }
 
+    virtual MessagePriority getPriority() const { return PRIORITY_TELEMETRY; }
+
     /**
      * Operator that will serialize the message to the given writer.
      *
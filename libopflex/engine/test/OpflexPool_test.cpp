@@ -15,10 +15,13 @@
 #endif
 
 
+#include <vector>
+
 #include <boost/test/unit_test.hpp>
 
 #include "opflex/ofcore/OFConstants.h"
 #include "opflex/engine/internal/OpflexPool.h"
+#include "opflex/engine/internal/OpflexMessage.h"
 
 using namespace opflex::engine;
 using namespace opflex::engine::internal;
@@ -40,7 +43,7 @@ public:
         OpflexClientConnection(handlerFactory,
                                pool,
                                hostname,
-                               port), ready(true) {}
+                               port), ready(true), sent(0) {}
 
     virtual void connect() {}
     virtual void disconnect() {
@@ -51,10 +54,16 @@ public:
         static std::string dummy("DUMMY");
         return dummy;
     }
+    virtual void sendMessage(OpflexMessage* message, bool sync = false) {
+        delete message;
+        sent += 1;
+    }
 
     bool ready;
+    int sent;
 };
 
+
 class PoolFixture {
 public:
     PoolFixture() : pool(handlerFactory, threadManager) {
@@ -130,4 +139,142 @@ BOOST_FIXTURE_TEST_CASE( manage_roles , PoolFixture ) {
     BOOST_CHECK_EQUAL(0, pool.getRoleCount(OFConstants::ENDPOINT_REGISTRY));
 }
 
+static OpflexMessage* testMessage() {
+    return new GenericOpflexMessage("test", OpflexMessage::REQUEST);
+}
+
+BOOST_FIXTURE_TEST_CASE( route_primary , PoolFixture ) {
+    MockClientConn* c1 = new MockClientConn(handlerFactory, &pool,
+                                            "1.2.3.4", 1234);
+    MockClientConn* c2 = new MockClientConn(handlerFactory, &pool,
+                                            "1.2.3.4", 1235);
+    MockClientConn* c3 = new MockClientConn(handlerFactory, &pool,
+                                            "1.2.3.4", 1236);
+
+    pool.addPeer(c1);
+    pool.addPeer(c2);
+    pool.addPeer(c3);
+
+    pool.setRoles(c1, OFConstants::POLICY_REPOSITORY);
+    pool.setRoles(c2, OFConstants::POLICY_REPOSITORY);
+    pool.setRoles(c3, OFConstants::POLICY_REPOSITORY);
+
+    // by default every ready connection gets a copy
+    BOOST_CHECK_EQUAL(3, pool.sendToRole(testMessage(),
+                                         OFConstants::POLICY_REPOSITORY));
+    BOOST_CHECK_EQUAL(1, c1->sent);
+    BOOST_CHECK_EQUAL(1, c2->sent);
+    BOOST_CHECK_EQUAL(1, c3->sent);
+
+    pool.setRoleRoutingMode(OFConstants::ROUTE_PRIMARY);
+    MockClientConn* m1 = (MockClientConn*)
+        pool.getMasterForRole(OFConstants::POLICY_REPOSITORY);
+    BOOST_REQUIRE(m1 != NULL);
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK_EQUAL(1, pool.sendToRole(testMessage(),
+                                             OFConstants::POLICY_REPOSITORY));
+    }
+    BOOST_CHECK_EQUAL(11, m1->sent);
+    BOOST_CHECK_EQUAL(14, c1->sent + c2->sent + c3->sent);
+
+    // removing the primary from the role reports the lost role and
+    // the next message goes to a new primary
+    BOOST_CHECK_EQUAL(OFConstants::POLICY_REPOSITORY, pool.setRoles(m1, 0));
+    MockClientConn* m2 = (MockClientConn*)
+        pool.getMasterForRole(OFConstants::POLICY_REPOSITORY);
+    BOOST_REQUIRE(m2 != NULL);
+    BOOST_CHECK(m1 != m2);
+    BOOST_CHECK_EQUAL(1, pool.sendToRole(testMessage(),
+                                         OFConstants::POLICY_REPOSITORY));
+    BOOST_CHECK_EQUAL(2, m2->sent);
+    BOOST_CHECK_EQUAL(11, m1->sent);
+
+    // removing a non-primary connection does not trigger failover
+    MockClientConn* other = (c1 != m1 && c1 != m2) ? c1 :
+        ((c2 != m1 && c2 != m2) ? c2 : c3);
+    BOOST_CHECK_EQUAL(0, pool.setRoles(other, 0));
+
+    c1->disconnect();
+    c2->disconnect();
+    c3->disconnect();
+    BOOST_CHECK_EQUAL(0, pool.sendToRole(testMessage(),
+                                         OFConstants::POLICY_REPOSITORY));
+}
+
+class PriorityMessage : public GenericOpflexMessage {
+public:
+    PriorityMessage(const std::string& method, MessagePriority priority_)
+        : GenericOpflexMessage(method, REQUEST), priority(priority_) {}
+
+    virtual PriorityMessage* clone() {
+        return new PriorityMessage(*this);
+    }
+
+    virtual MessagePriority getPriority() const { return priority; }
+
+    MessagePriority priority;
+};
+
+class QueueConn : public OpflexConnection {
+public:
+    QueueConn(HandlerFactory& handlerFactory)
+        : OpflexConnection(handlerFactory) {}
+
+    virtual const std::string& getName() { return name; }
+    virtual const std::string& getDomain() { return name; }
+    virtual const std::string& getRemotePeer() { return name; }
+
+    std::vector<std::string> written;
+    std::string name;
+
+protected:
+    virtual void messagesReady() {}
+    virtual yajr::Peer* getPeer() { return NULL; }
+    virtual void doWrite(OpflexMessage* message) {
+        written.push_back(message->getMethod());
+    }
+};
+
+BOOST_AUTO_TEST_CASE( write_priority ) {
+    EmptyHandlerFactory handlerFactory;
+    QueueConn conn(handlerFactory);
+    conn.setWriteQueueLimits(1000, 500, 0, 0);
+
+    // a large telemetry backlog blocks more telemetry but not control
+    // messages
+    for (int i = 0; i < 100000; ++i)
+        conn.sendMessage(new PriorityMessage("state_report",
+                                             OpflexMessage::PRIORITY_TELEMETRY));
+    BOOST_CHECK(conn.isBlocked(OpflexMessage::PRIORITY_TELEMETRY));
+    BOOST_CHECK(!conn.isBlocked(OpflexMessage::PRIORITY_CONTROL));
+    BOOST_CHECK_EQUAL(100000,
+                      conn.getQueuedMessages(OpflexMessage::
+                                             PRIORITY_TELEMETRY));
+
+    // a declare queued behind the backlog is written first
+    conn.sendMessage(new PriorityMessage("endpoint_declare",
+                                         OpflexMessage::PRIORITY_CONTROL));
+    BOOST_CHECK_EQUAL(100001, conn.getQueuedMessages());
+    BOOST_CHECK(!conn.processWriteQueue());
+    BOOST_REQUIRE_EQUAL(100001, conn.written.size());
+    BOOST_CHECK_EQUAL("endpoint_declare", conn.written[0]);
+    BOOST_CHECK_EQUAL(0, conn.getQueuedMessages());
+    BOOST_CHECK(!conn.isBlocked(OpflexMessage::PRIORITY_TELEMETRY));
+
+    // telemetry is not starved by a stream of control messages
+    conn.written.clear();
+    for (int i = 0; i < 1000; ++i)
+        conn.sendMessage(new PriorityMessage("endpoint_declare",
+                                             OpflexMessage::PRIORITY_CONTROL));
+    for (int i = 0; i < 10; ++i)
+        conn.sendMessage(new PriorityMessage("state_report",
+                                             OpflexMessage::PRIORITY_TELEMETRY));
+    conn.processWriteQueue();
+    BOOST_REQUIRE_EQUAL(1010, conn.written.size());
+    size_t firstReport = 0;
+    while (conn.written[firstReport] != "state_report")
+        firstReport += 1;
+    BOOST_CHECK_EQUAL(OpflexConnection::STARVATION_LIMIT, firstReport);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
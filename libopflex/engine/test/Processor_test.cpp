@@ -20,14 +20,18 @@
 
 #include <boost/test/unit_test.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/foreach.hpp>
 #include <rapidjson/stringbuffer.h>
 
 #include "opflex/modb/internal/ObjectStore.h"
 #include "opflex/modb/MAC.h"
+#include "opflex/modb/URIBuilder.h"
 #include "opflex/engine/internal/MOSerializer.h"
 #include "opflex/engine/Processor.h"
 #include "opflex/logging/StdOutLogHandler.h"
 #include "opflex/engine/internal/MockOpflexServerImpl.h"
+#include "opflex/engine/internal/MockServerHandler.h"
+#include "yajr/transport/Deflate.hpp"
 
 #include "BaseFixture.h"
 #include "TestListener.h"
@@ -595,6 +599,312 @@ BOOST_FIXTURE_TEST_CASE( policy_resolve_flaky, PolicyFixture ) {
     WAIT_FOR(mockServer.getListener().applyConnPred(resolutions_pred, NULL), 1000);
 }
 
+// test policy resolve and update over a compressed connection
+BOOST_FIXTURE_TEST_CASE( policy_resolve_compressed, PolicyFixture ) {
+    mockServer.enableCompression();
+    processor.enableCompression();
+    startClient();
+    WAIT_FOR(connReady(processor.getPool(), LOCALHOST, 8009), 1000);
+    setup();
+
+    WAIT_FOR(itemPresent(client2, 4, c4u), 1000);
+    WAIT_FOR(itemPresent(client2, 6, c6u), 1000);
+    BOOST_CHECK_EQUAL("test", client2->get(4, c4u)->getString(9));
+    BOOST_CHECK_EQUAL("test2", client2->get(6, c6u)->getString(13));
+
+    vector<reference_t> replace;
+    vector<reference_t> merge;
+    vector<reference_t> del;
+    oi4->setString(9, "moretesting");
+    rclient->put(4, c4u, oi4);
+    merge.push_back(make_pair(4, c4u));
+    mockServer.policyUpdate(replace, merge, del);
+    WAIT_FOR("moretesting" == client2->get(4, c4u)->getString(9), 1000);
+
+    OpflexClientConnection* conn =
+        processor.getPool().getPeer(LOCALHOST, 8009);
+    BOOST_REQUIRE(conn != NULL);
+    yajr::transport::Deflate::Stats stats;
+    BOOST_REQUIRE(yajr::transport::Deflate::getStats(conn->getPeer(), stats));
+    BOOST_CHECK(stats.rawOut > 0);
+    BOOST_CHECK(stats.rawIn > 0);
+    BOOST_CHECK(stats.wireIn < stats.rawIn);
+}
+
+static size_t countResolving(const vector<MockOpflexServerImpl*>& servers) {
+    size_t count = 0;
+    BOOST_FOREACH(MockOpflexServerImpl* server, servers) {
+        if (server->getListener().applyConnPred(resolutions_pred, NULL))
+            count += 1;
+    }
+    return count;
+}
+
+static void initServerPolicy(MockOpflexServerImpl& server,
+                             const URI& c4u, const URI& c6u) {
+    StoreClient* rclient = server.getSystemClient();
+    OF_SHARED_PTR<ObjectInstance> root = OF_MAKE_SHARED<ObjectInstance>(1);
+    OF_SHARED_PTR<ObjectInstance> oi4 = OF_MAKE_SHARED<ObjectInstance>(4);
+    OF_SHARED_PTR<ObjectInstance> oi6 = OF_MAKE_SHARED<ObjectInstance>(6);
+    oi4->setString(9, "test");
+    oi6->setString(13, "test2");
+
+    rclient->put(1, URI::ROOT, root);
+    rclient->put(4, c4u, oi4);
+    rclient->put(6, c6u, oi6);
+    rclient->addChild(1, URI::ROOT, 8, 4, c4u);
+    rclient->addChild(4, c4u, 12, 6, c6u);
+}
+
+// test routing requests only to the primary for a role, and failing
+// over to a new primary when it is lost
+BOOST_FIXTURE_TEST_CASE( policy_resolve_primary, Fixture ) {
+    URI c4u("/class4/test/");
+    URI c5u("/class5/test/");
+    URI c6u("/class4/test/class6/test2/");
+
+    MockOpflexServer::peer_t p1 =
+        make_pair(SERVER_ROLES, "127.0.0.1:8009");
+    MockOpflexServer::peer_t p2 =
+        make_pair(SERVER_ROLES, "127.0.0.1:8010");
+    MockOpflexServer::peer_t p3 =
+        make_pair(SERVER_ROLES, "127.0.0.1:8011");
+
+    MockOpflexServerImpl peer1(8009, SERVER_ROLES, list_of(p1)(p2)(p3), md);
+    MockOpflexServerImpl peer2(8010, SERVER_ROLES, list_of(p1)(p2)(p3), md);
+    MockOpflexServerImpl peer3(8011, SERVER_ROLES, list_of(p1)(p2)(p3), md);
+    vector<MockOpflexServerImpl*> servers =
+        list_of(&peer1)(&peer2)(&peer3);
+
+    BOOST_FOREACH(MockOpflexServerImpl* server, servers) {
+        server->start();
+        WAIT_FOR(server->getListener().isListening(), 1000);
+        initServerPolicy(*server, c4u, c6u);
+    }
+
+    processor.setRoleRoutingMode(OFConstants::ROUTE_PRIMARY);
+    processor.addPeer(LOCALHOST, 8009);
+    WAIT_FOR(connReady(processor.getPool(), LOCALHOST, 8009), 1000);
+    WAIT_FOR(connReady(processor.getPool(), LOCALHOST, 8010), 1000);
+    WAIT_FOR(connReady(processor.getPool(), LOCALHOST, 8011), 1000);
+
+    // create a local reference to the remote policy object
+    StoreClient::notif_t notifs;
+    OF_SHARED_PTR<ObjectInstance> oi5 = OF_MAKE_SHARED<ObjectInstance>(5);
+    oi5->setString(10, "test");
+    oi5->addReference(11, 4, c4u);
+    client2->put(5, c5u, oi5);
+    client2->queueNotification(5, c5u, notifs);
+    client2->deliverNotifications(notifs);
+    notifs.clear();
+
+    WAIT_FOR(itemPresent(client2, 4, c4u), 1000);
+    WAIT_FOR(itemPresent(client2, 6, c6u), 1000);
+
+    // only one of the three peers should see the resolve
+    WAIT_FOR(countResolving(servers) == 1, 1000);
+    BOOST_CHECK_EQUAL(1, countResolving(servers));
+
+    OpflexClientConnection* primary =
+        processor.getPool().getMasterForRole(OFConstants::POLICY_REPOSITORY);
+    BOOST_REQUIRE(primary != NULL);
+    int primaryPort = primary->getPort();
+    vector<MockOpflexServerImpl*> remaining;
+    BOOST_FOREACH(MockOpflexServerImpl* server, servers) {
+        if (server->getPort() == primaryPort)
+            server->stop();
+        else
+            remaining.push_back(server);
+    }
+
+    // the resolution should be replayed to exactly one new primary
+    WAIT_FOR(countResolving(remaining) == 1, 1000);
+    BOOST_CHECK_EQUAL(1, countResolving(remaining));
+
+    BOOST_FOREACH(MockOpflexServerImpl* server, remaining) {
+        server->stop();
+    }
+}
+
+static bool resolve_reqs_pred(OpflexServerConnection* conn, void* user) {
+    MockServerHandler* handler = (MockServerHandler*)conn->getHandler();
+    *((size_t*)user) += handler->getResolveReqs();
+    return true;
+}
+
+static size_t countResolveReqs(MockOpflexServerImpl& server) {
+    size_t count = 0;
+    server.getListener().applyConnPred(resolve_reqs_pred, &count);
+    return count;
+}
+
+// test that a peer becoming ready does not replay the resolutions to
+// the primary when the primary has not changed
+BOOST_FIXTURE_TEST_CASE( policy_resolve_primary_new_peer, Fixture ) {
+    URI c4u("/class4/test/");
+    URI c5u("/class5/test/");
+    URI c6u("/class4/test/class6/test2/");
+
+    MockOpflexServer::peer_t p1 =
+        make_pair(SERVER_ROLES, "127.0.0.1:8009");
+    MockOpflexServer::peer_t p2 =
+        make_pair(SERVER_ROLES, "127.0.0.1:8010");
+
+    MockOpflexServerImpl peer1(8009, SERVER_ROLES, list_of(p1)(p2), md);
+    MockOpflexServerImpl peer2(8010, SERVER_ROLES, list_of(p1)(p2), md);
+
+    peer1.start();
+    WAIT_FOR(peer1.getListener().isListening(), 1000);
+    initServerPolicy(peer1, c4u, c6u);
+
+    processor.setRoleRoutingMode(OFConstants::ROUTE_PRIMARY);
+    processor.addPeer(LOCALHOST, 8009);
+    WAIT_FOR(connReady(processor.getPool(), LOCALHOST, 8009), 1000);
+
+    StoreClient::notif_t notifs;
+    OF_SHARED_PTR<ObjectInstance> oi5 = OF_MAKE_SHARED<ObjectInstance>(5);
+    oi5->setString(10, "test");
+    oi5->addReference(11, 4, c4u);
+    client2->put(5, c5u, oi5);
+    client2->queueNotification(5, c5u, notifs);
+    client2->deliverNotifications(notifs);
+    notifs.clear();
+
+    WAIT_FOR(itemPresent(client2, 4, c4u), 1000);
+    WAIT_FOR(itemPresent(client2, 6, c6u), 1000);
+    size_t resolveReqs = countResolveReqs(peer1);
+    BOOST_CHECK(resolveReqs > 0);
+
+    // the second peer becomes ready while the first stays primary
+    peer2.start();
+    WAIT_FOR(peer2.getListener().isListening(), 1000);
+    initServerPolicy(peer2, c4u, c6u);
+    WAIT_FOR(connReady(processor.getPool(), LOCALHOST, 8010), 5000);
+    BOOST_CHECK_EQUAL(8009, processor.getPool()
+                      .getMasterForRole(OFConstants::POLICY_REPOSITORY)
+                      ->getPort());
+    BOOST_CHECK_EQUAL(resolveReqs, countResolveReqs(peer1));
+
+    // the second peer only sees the resolutions once it takes over
+    // as primary
+    peer1.stop();
+    WAIT_FOR(countResolveReqs(peer2) > 0, 5000);
+    BOOST_CHECK(countResolveReqs(peer2) > 0);
+
+    peer2.stop();
+}
+
+// test that a peer becoming ready gets the resolutions replayed
+// without sending them again to the peers that already have them
+BOOST_FIXTURE_TEST_CASE( policy_resolve_all_new_peer, Fixture ) {
+    URI c4u("/class4/test/");
+    URI c5u("/class5/test/");
+    URI c6u("/class4/test/class6/test2/");
+
+    MockOpflexServer::peer_t p1 =
+        make_pair(SERVER_ROLES, "127.0.0.1:8009");
+    MockOpflexServer::peer_t p2 =
+        make_pair(SERVER_ROLES, "127.0.0.1:8010");
+
+    MockOpflexServerImpl peer1(8009, SERVER_ROLES, list_of(p1)(p2), md);
+    MockOpflexServerImpl peer2(8010, SERVER_ROLES, list_of(p1)(p2), md);
+
+    peer1.start();
+    WAIT_FOR(peer1.getListener().isListening(), 1000);
+    initServerPolicy(peer1, c4u, c6u);
+
+    processor.addPeer(LOCALHOST, 8009);
+    WAIT_FOR(connReady(processor.getPool(), LOCALHOST, 8009), 1000);
+
+    StoreClient::notif_t notifs;
+    OF_SHARED_PTR<ObjectInstance> oi5 = OF_MAKE_SHARED<ObjectInstance>(5);
+    oi5->setString(10, "test");
+    oi5->addReference(11, 4, c4u);
+    client2->put(5, c5u, oi5);
+    client2->queueNotification(5, c5u, notifs);
+    client2->deliverNotifications(notifs);
+    notifs.clear();
+
+    WAIT_FOR(itemPresent(client2, 4, c4u), 1000);
+    WAIT_FOR(itemPresent(client2, 6, c6u), 1000);
+    size_t resolveReqs = countResolveReqs(peer1);
+    BOOST_CHECK(resolveReqs > 0);
+
+    peer2.start();
+    WAIT_FOR(peer2.getListener().isListening(), 1000);
+    initServerPolicy(peer2, c4u, c6u);
+    WAIT_FOR(connReady(processor.getPool(), LOCALHOST, 8010), 5000);
+
+    // the replay is sent only to the new peer
+    WAIT_FOR(countResolveReqs(peer2) > 0, 5000);
+    BOOST_CHECK(countResolveReqs(peer2) > 0);
+    BOOST_CHECK_EQUAL(resolveReqs, countResolveReqs(peer1));
+
+    peer2.stop();
+    peer1.stop();
+}
+
+static bool make_stalled_pred(OpflexServerConnection* conn, void* user) {
+    MockServerHandler* handler = (MockServerHandler*)conn->getHandler();
+    handler->setStalled();
+    return true;
+}
+
+// test that the write queue stays bounded while the server is stalled
+BOOST_FIXTURE_TEST_CASE( write_queue_backpressure, ServerFixture ) {
+    static const size_t HIGH_MSGS = 64;
+    static const size_t HIGH_BYTES = 64*1024;
+    processor.setWriteQueueLimits(HIGH_MSGS, HIGH_MSGS/2,
+                                  HIGH_BYTES, HIGH_BYTES/2);
+    startClient();
+    WAIT_FOR(connReady(processor.getPool(), LOCALHOST, 8009), 1000);
+    mockServer.getListener().applyConnPred(make_stalled_pred, NULL);
+
+    StoreClient::notif_t notifs;
+    URI u1("/");
+    OF_SHARED_PTR<ObjectInstance> oi1 = OF_MAKE_SHARED<ObjectInstance>(1);
+    client1->put(1, u1, oi1);
+    client1->queueNotification(1, u1, notifs);
+    for (int64_t i = 0; i < 50000; ++i) {
+        URI u2 = URIBuilder().addElement("class2").addElement(i).build();
+        OF_SHARED_PTR<ObjectInstance> oi2 = OF_MAKE_SHARED<ObjectInstance>(2);
+        oi2->setInt64(4, i);
+        client1->put(2, u2, oi2);
+        client1->queueNotification(2, u2, notifs);
+    }
+    client1->deliverNotifications(notifs);
+    notifs.clear();
+
+    OpflexClientConnection* conn =
+        processor.getPool().getPeer(LOCALHOST, 8009);
+    BOOST_REQUIRE(conn != NULL);
+    WAIT_FOR(conn->isBlocked(), 5000);
+    BOOST_CHECK(processor.getPool()
+                .isRoleBlocked(OFConstants::ENDPOINT_REGISTRY));
+    {
+        size_t msgs, bytes;
+        bool blocked = false;
+        processor.getWriteQueueStats(OFConstants::ENDPOINT_REGISTRY,
+                                     msgs, bytes, blocked);
+        BOOST_CHECK(blocked);
+        BOOST_CHECK(msgs > 0);
+    }
+
+    // the queue depth stays flat each time the processor holds back
+    // the remaining declarations
+    for (int i = 0; i < 3; ++i) {
+        size_t heldBack = processor.getHeldBackCount();
+        WAIT_FOR(processor.getHeldBackCount() > heldBack, 5000);
+        BOOST_CHECK(processor.getHeldBackCount() > heldBack);
+
+        size_t msgs, bytes;
+        processor.getPool()
+            .getRoleQueueDepth(OFConstants::ENDPOINT_REGISTRY, msgs, bytes);
+        BOOST_CHECK(msgs <= HIGH_MSGS);
+        BOOST_CHECK(bytes <= HIGH_BYTES + 4096);
+    }
+}
+
 class StateFixture : public ServerFixture {
 public:
     StateFixture()
@@ -15,6 +15,8 @@
 #ifndef OPFLEX_CORE_CONSTANTS_H
 #define OPFLEX_CORE_CONSTANTS_H
 
+#include <cstddef>
+
 namespace opflex {
 namespace ofcore {
 
@@ -56,6 +58,48 @@ public:
          */
         OBSERVER = 8
     };
+
+    /**
+     * The set of possible modes for routing requests to the peers
+     * that share a given OpFlex role.
+     */
+    enum RoleRoutingMode {
+        /**
+         * Send each request to every ready peer in the role
+         */
+        ROUTE_ALL = 0,
+        /**
+         * Send each request only to the primary peer for the role,
+         * and fail over to another ready peer in the role when the
+         * primary is lost
+         */
+        ROUTE_PRIMARY = 1
+    };
+
+    /**
+     * The default high watermark in messages for the write queue of
+     * a connection to an opflex peer
+     */
+    static const size_t DEFAULT_WQ_HIGH_MESSAGES = 16384;
+
+    /**
+     * The default low watermark in messages for the write queue of a
+     * connection to an opflex peer
+     */
+    static const size_t DEFAULT_WQ_LOW_MESSAGES =
+        DEFAULT_WQ_HIGH_MESSAGES/2;
+
+    /**
+     * The default high watermark in bytes for the write queue of a
+     * connection to an opflex peer
+     */
+    static const size_t DEFAULT_WQ_HIGH_BYTES = 16*1024*1024;
+
+    /**
+     * The default low watermark in bytes for the write queue of a
+     * connection to an opflex peer
+     */
+    static const size_t DEFAULT_WQ_LOW_BYTES = DEFAULT_WQ_HIGH_BYTES/2;
 };
 
 /** @} ofcore */
@@ -581,6 +581,7 @@
 #include "opflex/modb/Mutator.h"
 #include "opflex/ofcore/PeerStatusListener.h"
 #include "opflex/ofcore/MainLoopAdaptor.h"
+#include "opflex/ofcore/OFConstants.h"
 
 /**
  * @defgroup cpp C++ Interface
@@ -796,6 +797,65 @@ public:
      */
     virtual void enableInspector(const std::string& socketName);
 
+    /**
+     * Set the mode used to route requests to the peers that share
+     * an OpFlex role.  By default each request is sent to every
+     * ready peer in the role.  Must be called before calling start()
+     * on the framework.
+     *
+     * @param mode the routing mode to use
+     */
+    virtual void setRoleRoutingMode(OFConstants::RoleRoutingMode mode);
+
+    /**
+     * Offer deflate compression of the JSON-RPC stream to opflex
+     * peers.  Compression is only used on connections where the peer
+     * accepts it during the handshake, and data is compressed before
+     * it is encrypted when SSL is enabled.  Must be called before
+     * calling start() on the framework.
+     *
+     * @param level the zlib compression level, from 1 (fastest) to
+     * 9 (smallest), or -1 for the zlib default
+     */
+    virtual void enableCompression(int level = -1);
+
+    /**
+     * Set the high and low watermarks for the write queue of each
+     * connection to an opflex peer.  When a connection reaches either
+     * high watermark, the framework stops generating new resolves and
+     * declarations for its roles until the queue drains back below
+     * both low watermarks.  A high watermark of zero disables that
+     * limit.
+     *
+     * @param highMessages the high watermark in queued messages
+     * @param lowMessages the low watermark in queued messages
+     * @param highBytes the high watermark in queued bytes
+     * @param lowBytes the low watermark in queued bytes
+     */
+    virtual void setWriteQueueLimits(size_t highMessages,
+                                     size_t lowMessages,
+                                     size_t highBytes,
+                                     size_t lowBytes);
+
+    /**
+     * Get the current state of the write queues of the connections
+     * to the opflex peers with a given role.  This can be called
+     * from any thread.
+     *
+     * @param role the role to check
+     * @param messages set to the number of messages queued to the
+     * ready peers with the role
+     * @param bytes set to the number of bytes queued to the ready
+     * peers with the role
+     * @param blocked set to true if new resolves and declarations for
+     * the role are being held back because a queue is over its high
+     * watermark
+     * @see setWriteQueueLimits
+     */
+    virtual void getWriteQueueStats(OFConstants::OpflexRole role,
+                                    size_t& messages, size_t& bytes,
+                                    bool& blocked);
+
     /**
      * Add an OpFlex peer.  If the framework is started, this will
      * immediately initiate a new connection asynchronously.
@@ -99,6 +99,12 @@ public:
                    const std::string& serverKeyPass,
                    bool verifyPeers = true);
 
+    /**
+     * Accept deflate compression when clients offer it.  Call before
+     * start()
+     */
+    void enableCompression();
+
     /**
      * Get the peers that this server was configured with
      *
@@ -158,6 +158,28 @@ void OFFramework::enableInspector(const std::string& socketName) {
     pimpl->inspector->setSocketName(socketName);
 }
 
+void OFFramework::setRoleRoutingMode(OFConstants::RoleRoutingMode mode) {
+    pimpl->processor.setRoleRoutingMode(mode);
+}
+
+void OFFramework::enableCompression(int level) {
+    pimpl->processor.enableCompression(level);
+}
+
+void OFFramework::setWriteQueueLimits(size_t highMessages,
+                                      size_t lowMessages,
+                                      size_t highBytes,
+                                      size_t lowBytes) {
+    pimpl->processor.setWriteQueueLimits(highMessages, lowMessages,
+                                         highBytes, lowBytes);
+}
+
+void OFFramework::getWriteQueueStats(OFConstants::OpflexRole role,
+                                     size_t& messages, size_t& bytes,
+                                     bool& blocked) {
+    pimpl->processor.getWriteQueueStats(role, messages, bytes, blocked);
+}
+
 void OFFramework::addPeer(const std::string& hostname,
                           int port) {
     pimpl->processor.addPeer(hostname, port);